@@ -58,14 +58,13 @@ ClusterResult ClusterProcess::process(const SequenceWorkItem& item)
     // Check if the bit in the vector has already been set for the lowest read index
     // If it has some other thread has already output this set so we do nothing
     int64_t lowestIndex = result.clusterNodes.front().interval.lower;
-    bool currentValue = m_parameters.pMarkedReads->test(lowestIndex);
     bool updateSuccess = false;
 
-    if(currentValue == false)
+    if(!m_parameters.pMarkedReads->test(lowestIndex))
     {
-        // Attempt to update the bit vector with an atomic CAS. If this returns false
+        // Attempt to set the bit atomically. If this returns false
         // the bit was set by some other thread
-        updateSuccess = m_parameters.pMarkedReads->updateCAS(lowestIndex, currentValue, true);
+        updateSuccess = m_parameters.pMarkedReads->testAndSet(lowestIndex);
     }
 
     if(updateSuccess)
@@ -76,20 +75,17 @@ ClusterResult ClusterProcess::process(const SequenceWorkItem& item)
         std::vector<ClusterNode>::const_iterator iter = result.clusterNodes.begin();
         for(; iter != result.clusterNodes.end(); ++iter)
         {
-            for(int64_t i = iter->interval.lower; i <= iter->interval.upper; ++i)
+            int64_t lower = iter->interval.lower;
+            int64_t upper = iter->interval.upper;
+            size_t expected = upper - lower + 1;
+            if(lowestIndex >= lower && lowestIndex <= upper)
+                expected -= 1; // already set
+
+            size_t claimed = m_parameters.pMarkedReads->claimRange(lower, upper + 1);
+            if(claimed != expected)
             {
-                if(i == lowestIndex) //already set
-                    continue;
-                currentValue = m_parameters.pMarkedReads->test(i);
-                if(currentValue)
-                {
-                    // This value should not be true, emit a warning
-                    std::cout << "Warning: Bit " << i << " was unexpectedly set by a different thread\n";
-                }
-                else
-                {
-                    m_parameters.pMarkedReads->updateCAS(i, currentValue, true);
-                }
+                // These bits should not be set, emit a warning
+                std::cout << "Warning: " << expected - claimed << " bits in [" << lower << "," << upper << "] were unexpectedly set by a different thread\n";
             }
         }
     }
@@ -94,7 +94,7 @@ ErrorCorrectResult ErrorCorrectProcess::overlapCorrection(const SequenceWorkItem
     {
         // Compute the set of overlap blocks for the read
         m_blockList.clear();
-        m_params.pOverlapper->overlapRead(currRead, m_params.minOverlap, &m_blockList);
+        m_params.pOverlapper->overlapRead(currRead, m_params.minOverlap, &m_blockList, &m_searchArena);
         int sumOverlaps = 0;
 
         // Sum the spans of the overlap blocks to calculate the total number of overlaps this read has
@@ -216,8 +216,8 @@ ErrorCorrectResult ErrorCorrectProcess::overlapCorrectionNew(const SequenceWorkI
 // Correct a read with a k-mer based corrector
 ErrorCorrectResult ErrorCorrectProcess::kmerCorrection(const SequenceWorkItem& workItem)
 {
-    assert(m_params.indices.pBWT != NULL);
-    assert(m_params.indices.pCache != NULL);
+    assert(m_params.indices.pShards != NULL || m_params.indices.pBWT != NULL);
+    assert(m_params.indices.pShards != NULL || m_params.indices.pCache != NULL);
 
     ErrorCorrectResult result;
 
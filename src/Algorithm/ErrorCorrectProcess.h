@@ -98,6 +98,7 @@ class ErrorCorrectProcess
         bool attemptKmerCorrection(size_t i, size_t k_idx, size_t minCount, std::string& readSequence);
 
         OverlapBlockList m_blockList;
+        OverlapSearchArena m_searchArena;
         ErrorCorrectParameters m_params;
 };
 
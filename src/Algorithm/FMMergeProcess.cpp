@@ -77,7 +77,7 @@ FMMergeResult FMMergeProcess::process(const SequenceWorkItem& item)
         record.id = pVertex->getID();
         record.seq = pVertex->getSeq().toString();
         OverlapBlockList blockList;
-        m_pOverlapper->overlapRead(record, m_minOverlap, &blockList);
+        m_pOverlapper->overlapRead(record, m_minOverlap, &blockList, &m_searchArena);
 
         removeContainmentBlocks(pVertex->getSeqLen(), &blockList);
 
@@ -97,7 +97,7 @@ FMMergeResult FMMergeProcess::process(const SequenceWorkItem& item)
             record.seq = currCandidate.pVertex->getSeq().toString();
 
             OverlapBlockList candidateBlockList;
-            m_pOverlapper->overlapRead(record, m_minOverlap, &candidateBlockList);
+            m_pOverlapper->overlapRead(record, m_minOverlap, &candidateBlockList, &m_searchArena);
             removeContainmentBlocks(currCandidate.pVertex->getSeqLen(), &candidateBlockList);
 
             bool validMergeNode = checkCandidate(currCandidate, &candidateBlockList);
@@ -154,14 +154,13 @@ FMMergeResult FMMergeProcess::process(const SequenceWorkItem& item)
         // Check if the bit in the vector has already been set for the lowest read index
         // If it has some other thread has already output this set so we do nothing
         int64_t lowestIndex = result.usedIntervals.front().lower;
-        bool currentValue = m_pMarkedReads->test(lowestIndex);
         bool updateSuccess = false;
 
-        if(currentValue == false)
+        if(!m_pMarkedReads->test(lowestIndex))
         {
-            // Attempt to update the bit vector with an atomic CAS. If this returns false
+            // Attempt to set the bit atomically. If this returns false
             // the bit was set by some other thread
-            updateSuccess = m_pMarkedReads->updateCAS(lowestIndex, currentValue, true);
+            updateSuccess = m_pMarkedReads->testAndSet(lowestIndex);
         }
 
         if(updateSuccess)
@@ -172,21 +171,15 @@ FMMergeResult FMMergeProcess::process(const SequenceWorkItem& item)
             std::vector<BWTInterval>::const_iterator iter = result.usedIntervals.begin();
             for(; iter != result.usedIntervals.end(); ++iter)
             {
-                for(int64_t i = iter->lower; i <= iter->upper; ++i)
+                size_t expected = iter->upper - iter->lower + 1;
+                if(lowestIndex >= iter->lower && lowestIndex <= iter->upper)
+                    expected -= 1; // already set
+
+                size_t claimed = m_pMarkedReads->claimRange(iter->lower, iter->upper + 1);
+                if(claimed != expected)
                 {
-                    if(i == lowestIndex) //already set
-                        continue;
-
-                    currentValue = m_pMarkedReads->test(i);
-                    if(currentValue)
-                    {
-                        // This value should not be true, emit a warning
-                        std::cout << "Warning: Bit " << i << " was set outside of critical section\n";
-                    }
-                    else
-                    {
-                        m_pMarkedReads->updateCAS(i, currentValue, true);
-                    }
+                    // These bits should not be set, emit a warning
+                    std::cout << "Warning: " << expected - claimed << " bits in [" << iter->lower << "," << iter->upper << "] were set outside of critical section\n";
                 }
             }
         }
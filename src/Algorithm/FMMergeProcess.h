@@ -68,6 +68,7 @@ class FMMergeProcess
         const OverlapAlgorithm* m_pOverlapper;
         const int m_minOverlap;
         BitVector* m_pMarkedReads;
+        OverlapSearchArena m_searchArena;
 };
 
 // Write the results from the overlap step to an ASQG file
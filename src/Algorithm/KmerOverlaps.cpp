@@ -50,38 +50,19 @@ MultipleAlignment KmerOverlaps::buildMultipleAlignment(const std::string& query,
     return multiple_alignment;
 }
 
-// Struct to hold a partial match in the FM-index
-// The position field is the location in the query sequence of this kmer.
-// The index field is an index into the BWT. 
-// The is_reverse flag indicates the strand of the partial match
-struct KmerMatch
-{
-    size_t position:16;
-    size_t index:47;
-    size_t is_reverse:1;
-
-    friend bool operator<(const KmerMatch& a, const KmerMatch& b)
-    {
-        if(a.index == b.index)
-            return a.is_reverse < b.is_reverse;
-        else
-            return a.index < b.index;
-    }
-
-    friend bool operator==(const KmerMatch& a, const KmerMatch& b)
-    {
-        return a.index == b.index && a.is_reverse == b.is_reverse;
-    }
-};
-
 // Return a hash key for a KmerMatch
 struct KmerMatchKey
 {
     size_t operator()(const KmerMatch& a) const { return a.index; }
 };
 
-typedef std::set<KmerMatch> KmerMatchSet;
-typedef HashMap<KmerMatch, bool, KmerMatchKey> KmerMatchMap;
+typedef HashSet<KmerMatch, KmerMatchKey> KmerMatchHash;
+
+// The number of backtracks that are interleaved by resolveKmerMatches
+static const size_t RESOLVE_BLOCK_SIZE = 64;
+
+// Intervals larger than this are considered repeats and are not used as seeds
+static const int64_t MAX_SEED_INTERVAL_SIZE = 200;
 
 //
 SequenceOverlapPairVector KmerOverlaps::retrieveMatches(const std::string& query, size_t k, 
@@ -100,146 +81,192 @@ SequenceOverlapPairVector KmerOverlaps::retrieveMatches(const std::string& query
 
     n_calls++;
 
-    int64_t max_interval_size = 200;
     SequenceOverlapPairVector overlap_vector;
     if(query.size() < k)
         return overlap_vector;
 
-    // Use the FM-index to look up intervals for each kmer of the read. Each index
-    // in the interval is stored individually in the KmerMatchMap. We then
-    // backtrack to map these kmer indices to read IDs. As reads can share
-    // multiple kmers, we use the map to avoid redundant lookups.
-    // There is likely a faster algorithm which performs direct decompression
-    // of the read sequences without having to expand the intervals to individual
-    // indices. The current algorithm suffices for now.
-    KmerMatchMap prematchMap;
-    size_t num_kmers = query.size() - k + 1;
-    for(size_t i = 0; i < num_kmers; ++i)
-    {
-        std::string kmer = query.substr(i, k);
-        BWTInterval interval = BWTAlgorithms::findInterval(indices, kmer);
-        if(interval.isValid() && interval.size() < max_interval_size) 
-        {
-            for(int64_t j = interval.lower; j <= interval.upper; ++j)
-            {
-                KmerMatch match = { i, static_cast<size_t>(j), false };
-                prematchMap.insert(std::make_pair(match, false));
-            }
-        }
+    KmerMatchVector kmer_matches;
+    findKmerMatches(query, k, 0, query.size() - k + 1, indices, kmer_matches);
+
+    KmerMatchVector matches;
+    resolveKmerMatches(kmer_matches, indices, matches);
 
-        kmer = reverseComplement(kmer);
-        interval = BWTAlgorithms::findInterval(indices, kmer);
-        if(interval.isValid() && interval.size() < max_interval_size) 
+    // Refine the matches by computing proper overlaps between the sequences
+    // Use the overlaps that meet the thresholds to build a multiple alignment
+    for(size_t i = 0; i < matches.size(); ++i)
+    {
+        SequenceOverlapPair op;
+        n_candidates += 1;
+        if(computeMatchOverlap(query, matches[i], k, min_overlap, min_identity, bandwidth, indices, op))
         {
-            for(int64_t j = interval.lower; j <= interval.upper; ++j)
-            {
-                KmerMatch match = { i, static_cast<size_t>(j), true };
-                prematchMap.insert(std::make_pair(match, false));
-            }
+            overlap_vector.push_back(op);
+            n_output += 1;
         }
     }
 
-    // Backtrack through the kmer indices to turn them into read indices.
-    // This mirrors the calcSA function in SampledSuffixArray except we mark each entry
-    // as visited once it is processed.
-    KmerMatchSet matches;
-    for(KmerMatchMap::iterator iter = prematchMap.begin(); iter != prematchMap.end(); ++iter)
-    {
-        // This index has been visited
-        if(iter->second)
-            continue;
+    t_time += timer.getElapsedCPUTime();
 
-        // Mark this as visited
-        iter->second = true;
+    if(Verbosity::Instance().getPrintLevel() > 6 && n_calls % 100 == 0)
+        printf("[kmer overlaps] n: %zu candidates: %zu valid: %zu (%.2lf) time: %.2lfs\n", 
+            n_calls, n_candidates, n_output, (double)n_output / n_candidates, t_time);
+    return overlap_vector;
+}
 
-        // Backtrack the index until we hit the starting symbol
-        KmerMatch out_match = iter->first;
-        while(1) 
-        {
-            char b = indices.pBWT->getChar(out_match.index);
-            out_match.index = indices.pBWT->getPC(b) + indices.pBWT->getOcc(b, out_match.index - 1);
+//
+void KmerOverlaps::findKmerMatches(const std::string& query, size_t k, 
+                                   size_t start, size_t end,
+                                   const BWTIndexSet& indices,
+                                   KmerMatchVector& out_matches)
+{
+    assert(end <= query.size() - k + 1);
 
-            // Check if the hash indicates we have visited this index. If so, stop the backtrack
-            KmerMatchMap::iterator find_iter = prematchMap.find(out_match);
-            if(find_iter != prematchMap.end())
-            {
-                // We have processed this index already
-                if(find_iter->second)
-                    break;
-                else
-                    find_iter->second = true;
-            }
+    // Use the FM-index to look up intervals for each kmer of the read. Each index
+    // in the interval is stored individually.
+    for(size_t i = start; i < end; ++i)
+    {
+        std::string kmer = query.substr(i, k);
+        for(int strand = 0; strand < 2; ++strand)
+        {
+            if(strand == 1)
+                kmer = reverseComplement(kmer);
 
-            if(b == '$')
+            BWTInterval interval = BWTAlgorithms::findInterval(indices, kmer);
+            if(interval.isValid() && interval.size() < MAX_SEED_INTERVAL_SIZE) 
             {
-                // We've found the lexicographic index for this read. Turn it into a proper ID
-                out_match.index = indices.pSSA->lookupLexoRank(out_match.index);
-                matches.insert(out_match);
-                break;
+                for(int64_t j = interval.lower; j <= interval.upper; ++j)
+                {
+                    KmerMatch match;
+                    match.position = i;
+                    match.index = j;
+                    match.is_reverse = strand == 1;
+                    out_matches.push_back(match);
+                }
             }
         }
     }
+}
 
-    // Refine the matches by computing proper overlaps between the sequences
-    // Use the overlaps that meet the thresholds to build a multiple alignment
-    for(KmerMatchSet::iterator iter = matches.begin(); iter != matches.end(); ++iter)
-    {
-        // If a read table is available in the index, use it to get the match sequence
-        // Otherwise get it from the BWT, which is slower
-        std::string match_sequence;
-        if(indices.pReadTable != NULL)
-            match_sequence = indices.pReadTable->getRead(iter->index).seq.toString();
-        else
-            match_sequence = BWTAlgorithms::extractString(indices.pBWT, iter->index);
-
-        if(iter->is_reverse)
-            match_sequence = reverseComplement(match_sequence);
-        
-        // Ignore identical matches
-        if(match_sequence == query)
-            continue;
+//
+void KmerOverlaps::resolveKmerMatches(const KmerMatchVector& kmer_matches,
+                                      const BWTIndexSet& indices,
+                                      KmerMatchVector& out_matches)
+{
+    assert(indices.pBWT != NULL);
+    assert(indices.pSSA != NULL);
+    const BWT* pBWT = indices.pBWT;
 
-        // Compute the overlap. If the kmer match occurs a single time in each sequence we use
-        // the banded extension overlap strategy. Otherwise we use the slow O(M*N) overlapper.
-        SequenceOverlap overlap;
-        std::string match_kmer = query.substr(iter->position, k);
-        size_t pos_0 = query.find(match_kmer);
-        size_t pos_1 = match_sequence.find(match_kmer);
-        assert(pos_0 != std::string::npos && pos_1 != std::string::npos);
-
-        // Check for secondary occurrences
-        if(query.find(match_kmer, pos_0 + 1) != std::string::npos || 
-           match_sequence.find(match_kmer, pos_1 + 1) != std::string::npos) {
-            // One of the reads has a second occurrence of the kmer. Use
-            // the slow overlapper.
-            overlap = Overlapper::computeOverlap(query, match_sequence);
-        } else {
-            overlap = Overlapper::extendMatch(query, match_sequence, pos_0, pos_1, bandwidth);
+    // Backtrack through the kmer indices to turn them into read indices.
+    // As reads can share multiple kmers, the backtrack from a kmer index
+    // stops once it reaches the index of another kmer. Only the backtrack from
+    // the first kmer of each read reaches the start of the read, which mirrors
+    // the calcSA function in SampledSuffixArray. The set holds the first
+    // query position that each index was found at.
+    KmerMatchHash kmer_set(kmer_matches.begin(), kmer_matches.end());
+    KmerMatchVector starts(kmer_set.begin(), kmer_set.end());
+
+    // The backtracks are independent so they are walked in lock-step in blocks,
+    // prefetching the markers of the next step while the other backtracks
+    // of the block are processed
+    KmerMatch current[RESOLVE_BLOCK_SIZE];
+    size_t active[RESOLVE_BLOCK_SIZE];
+    size_t first_out = out_matches.size();
+    for(size_t block_start = 0; block_start < starts.size(); block_start += RESOLVE_BLOCK_SIZE)
+    {
+        size_t num_active = std::min(RESOLVE_BLOCK_SIZE, starts.size() - block_start);
+        for(size_t i = 0; i < num_active; ++i)
+        {
+            current[i] = starts[block_start + i];
+            active[i] = i;
         }
 
-        n_candidates += 1;
-        bool bPassedOverlap = overlap.getOverlapLength() >= min_overlap;
-        bool bPassedIdentity = overlap.getPercentIdentity() / 100 >= min_identity;
-
-        if(bPassedOverlap && bPassedIdentity)
+        while(num_active > 0)
         {
-            SequenceOverlapPair op;
-            op.sequence[0] = query;
-            op.sequence[1] = match_sequence;
-            op.match_idx = iter->index;
-            op.overlap = overlap;
-            op.is_reversed = iter->is_reverse;
-            overlap_vector.push_back(op);
-            n_output += 1;
+            size_t i = 0;
+            while(i < num_active)
+            {
+                KmerMatch& match = current[active[i]];
+                char b;
+                match.index = pBWT->getLF(match.index, b);
+                if(b == '$')
+                {
+                    // We've found the lexicographic index for this read. Turn it into a proper ID
+                    match.index = indices.pSSA->lookupLexoRank(match.index);
+                    out_matches.push_back(match);
+                    active[i] = active[--num_active];
+                }
+                else if(kmer_set.find(match) != kmer_set.end())
+                {
+                    // Another backtrack covers the rest of this read
+                    active[i] = active[--num_active];
+                }
+                else
+                {
+                    pBWT->prefetchMarkers(match.index);
+                    ++i;
+                }
+            }
         }
     }
+    std::sort(out_matches.begin() + first_out, out_matches.end());
+}
 
-    t_time += timer.getElapsedCPUTime();
+//
+bool KmerOverlaps::computeMatchOverlap(const std::string& query, 
+                                       const KmerMatch& match,
+                                       size_t k,
+                                       int min_overlap,
+                                       double min_identity,
+                                       int bandwidth,
+                                       const BWTIndexSet& indices,
+                                       SequenceOverlapPair& out)
+{
+    // If a read table is available in the index, use it to get the match sequence
+    // Otherwise get it from the BWT, which is slower
+    std::string match_sequence;
+    if(indices.pReadTable != NULL)
+        match_sequence = indices.pReadTable->getRead(match.index).seq.toString();
+    else
+        match_sequence = BWTAlgorithms::extractString(indices.pBWT, match.index);
+
+    if(match.is_reverse)
+        match_sequence = reverseComplement(match_sequence);
+    
+    // Ignore identical matches
+    if(match_sequence == query)
+        return false;
+
+    // Compute the overlap. If the kmer match occurs a single time in each sequence we use
+    // the banded extension overlap strategy. Otherwise we use the slow O(M*N) overlapper.
+    SequenceOverlap overlap;
+    std::string match_kmer = query.substr(match.position, k);
+    size_t pos_0 = query.find(match_kmer);
+    size_t pos_1 = match_sequence.find(match_kmer);
+    assert(pos_0 != std::string::npos && pos_1 != std::string::npos);
+
+    // Check for secondary occurrences
+    if(query.find(match_kmer, pos_0 + 1) != std::string::npos || 
+       match_sequence.find(match_kmer, pos_1 + 1) != std::string::npos) {
+        // One of the reads has a second occurrence of the kmer. Use
+        // the slow overlapper, unless the bit-parallel filter shows
+        // that no overlap can pass the thresholds
+        if(!Overlapper::isOverlapPossible(query, match_sequence, min_overlap, min_identity))
+            return false;
+        overlap = Overlapper::computeOverlap(query, match_sequence);
+    } else {
+        overlap = Overlapper::extendMatch(query, match_sequence, pos_0, pos_1, bandwidth);
+    }
 
-    if(Verbosity::Instance().getPrintLevel() > 6 && n_calls % 100 == 0)
-        printf("[kmer overlaps] n: %zu candidates: %zu valid: %zu (%.2lf) time: %.2lfs\n", 
-            n_calls, n_candidates, n_output, (double)n_output / n_candidates, t_time);
-    return overlap_vector;
+    bool bPassedOverlap = overlap.getOverlapLength() >= min_overlap;
+    bool bPassedIdentity = overlap.getPercentIdentity() / 100 >= min_identity;
+    if(!bPassedOverlap || !bPassedIdentity)
+        return false;
+
+    out.sequence[0] = query;
+    out.sequence[1] = match_sequence;
+    out.match_idx = match.index;
+    out.overlap = overlap;
+    out.is_reversed = match.is_reverse;
+    return true;
 }
 
 struct SeedEdit
@@ -448,7 +475,12 @@ void _approximateSeededMatch(const std::string& in_query,
             if(in_query.find(query_seed, pos_0 + 1) != std::string::npos || 
                match_sequence.find(match_seed, pos_1 + 1) != std::string::npos) {
                 // One of the reads has a second occurrence of the kmer. Use
-                // the slow overlapper.
+                // the slow overlapper, unless the bit-parallel filter shows
+                // that no overlap can pass the thresholds
+                if(!Overlapper::isOverlapPossible(in_query, match_sequence, min_overlap, min_identity)) {
+                    n_candidates += 1;
+                    continue;
+                }
                 overlap = Overlapper::computeOverlap(in_query, match_sequence);
             } else {
                 overlap = Overlapper::extendMatch(in_query, match_sequence, pos_0, pos_1, bandwidth);
@@ -27,6 +27,32 @@ struct SequenceOverlapPair
 };
 typedef std::vector<SequenceOverlapPair> SequenceOverlapPairVector;
 
+// A kmer of a query sequence that was found in the FM-index.
+// The position field is the location in the query sequence of this kmer.
+// The index field is an index into the BWT, or the index of the matching
+// read once the match has been resolved. The is_reverse flag indicates the 
+// strand of the match.
+struct KmerMatch
+{
+    uint32_t position;
+    uint64_t index:63;
+    uint64_t is_reverse:1;
+
+    friend bool operator<(const KmerMatch& a, const KmerMatch& b)
+    {
+        if(a.index == b.index)
+            return a.is_reverse < b.is_reverse;
+        else
+            return a.index < b.index;
+    }
+
+    friend bool operator==(const KmerMatch& a, const KmerMatch& b)
+    {
+        return a.index == b.index && a.is_reverse == b.is_reverse;
+    }
+};
+typedef std::vector<KmerMatch> KmerMatchVector;
+
 namespace KmerOverlaps
 {
 
@@ -46,6 +72,35 @@ SequenceOverlapPairVector retrieveMatches(const std::string& query,
                                           int bandwidth,
                                           const BWTIndexSet& indices);
 
+// The steps of retrieveMatches. These are exposed so the work for
+// a long query can be split up between threads.
+
+// Append the FM-index matches of the kmers of query starting at positions [start, end)
+// to out_matches. Both strands are searched. Kmers that occur too many times are skipped.
+void findKmerMatches(const std::string& query, 
+                     size_t k,
+                     size_t start,
+                     size_t end,
+                     const BWTIndexSet& indices,
+                     KmerMatchVector& out_matches);
+
+// Convert the kmer matches found by findKmerMatches into the reads that contain them.
+// Each read is appended to out_matches once per strand, sorted by read index.
+void resolveKmerMatches(const KmerMatchVector& kmer_matches,
+                        const BWTIndexSet& indices,
+                        KmerMatchVector& out_matches);
+
+// Compute the overlap between the query and a read found by resolveKmerMatches.
+// Returns true and sets out if the overlap meets the thresholds.
+bool computeMatchOverlap(const std::string& query, 
+                         const KmerMatch& match,
+                         size_t k,
+                         int min_overlap,
+                         double min_identity,
+                         int bandwidth,
+                         const BWTIndexSet& indices,
+                         SequenceOverlapPair& out);
+
 SequenceOverlapPairVector approximateMatch(const std::string& query,
                                            int min_overlap, 
                                            double min_identity,
@@ -16,21 +16,23 @@ static const AlignFlags preSufAF(true, true, false);
 //#define DEBUGOVERLAP 1
 
 // Perform the overlap
-OverlapResult OverlapAlgorithm::overlapRead(const SeqRecord& read, int minOverlap, OverlapBlockList* pOutList) const
+OverlapResult OverlapAlgorithm::overlapRead(const SeqRecord& read, int minOverlap, OverlapBlockList* pOutList, 
+                                            OverlapSearchArena* pArena) const
 {
     OverlapResult r;
     if(static_cast<int>(read.seq.length()) < minOverlap)
         return r;
 
     if(!m_exactModeOverlap)
-        r = overlapReadInexact(read, minOverlap, pOutList);
+        r = overlapReadInexact(read, minOverlap, pOutList, pArena);
     else
         r = overlapReadExact(read, minOverlap, pOutList);
     return r;
 }
 
 //
-OverlapResult OverlapAlgorithm::overlapReadInexact(const SeqRecord& read, int minOverlap, OverlapBlockList* pOBOut) const
+OverlapResult OverlapAlgorithm::overlapReadInexact(const SeqRecord& read, int minOverlap, OverlapBlockList* pOBOut,
+                                                   OverlapSearchArena* pArena) const
 {
     OverlapResult result;
     OverlapBlockList obWorkingList;
@@ -46,11 +48,11 @@ OverlapResult OverlapAlgorithm::overlapReadInexact(const SeqRecord& read, int mi
     // case we dont run any of the subsequent commands and return no overlaps.
     bool valid = true;
     valid = findOverlapBlocksInexact(seq, m_pBWT, m_pRevBWT, sufPreAF, 
-                                     minOverlap, &obWorkingList, pOBOut, result);
+                                     minOverlap, &obWorkingList, pOBOut, result, pArena);
 
     if(valid)
         valid = findOverlapBlocksInexact(complement(seq), m_pRevBWT, m_pBWT, prePreAF, 
-                                         minOverlap, &obWorkingList, pOBOut, result);
+                                         minOverlap, &obWorkingList, pOBOut, result, pArena);
 
     if(valid)
     {
@@ -72,10 +74,10 @@ OverlapResult OverlapAlgorithm::overlapReadInexact(const SeqRecord& read, int mi
 
     // Match the prefix of seq to suffixes
     if(valid)
-        valid = findOverlapBlocksInexact(reverseComplement(seq), m_pBWT, m_pRevBWT, sufSufAF, minOverlap, &obWorkingList, pOBOut, result);
+        valid = findOverlapBlocksInexact(reverseComplement(seq), m_pBWT, m_pRevBWT, sufSufAF, minOverlap, &obWorkingList, pOBOut, result, pArena);
     
     if(valid)
-        valid = findOverlapBlocksInexact(reverse(seq), m_pRevBWT, m_pBWT, preSufAF, minOverlap, &obWorkingList, pOBOut, result);
+        valid = findOverlapBlocksInexact(reverse(seq), m_pRevBWT, m_pBWT, preSufAF, minOverlap, &obWorkingList, pOBOut, result, pArena);
 
     if(valid)
     {
@@ -299,12 +301,20 @@ void OverlapAlgorithm::findOverlapBlocksExact(const std::string& w, const BWT* p
 bool OverlapAlgorithm::findOverlapBlocksInexact(const std::string& w, const BWT* pBWT, 
                                                 const BWT* pRevBWT, const AlignFlags& af, int minOverlap,
                                                 OverlapBlockList* pOverlapList, OverlapBlockList* pContainList, 
-                                                OverlapResult& result) const
+                                                OverlapResult& result, OverlapSearchArena* pArena) const
 {
     int len = w.length();
     int overlap_region_left = len - minOverlap;
-    SearchSeedVector* pCurrVector = new SearchSeedVector;
-    SearchSeedVector* pNextVector = new SearchSeedVector;
+
+    // Use the seed vectors of the arena when one is given so their
+    // capacity is kept between searches
+    SearchSeedVector localVectors[2];
+    SearchSeedVector* pCurrVector = pArena != NULL ? &pArena->seedVectors[0] : &localVectors[0];
+    SearchSeedVector* pNextVector = pArena != NULL ? &pArena->seedVectors[1] : &localVectors[1];
+    SearchHistoryArena* pHistoryArena = pArena != NULL ? &pArena->historyArena : NULL;
+    pCurrVector->clear();
+    pNextVector->clear();
+
     OverlapBlockList workingList;
     SearchSeedVector::iterator iter;
 
@@ -321,7 +331,7 @@ bool OverlapAlgorithm::findOverlapBlocksInexact(const std::string& w, const BWT*
 
     assert(actual_seed_stride != 0);
 
-    createSearchSeeds(w, pBWT, pRevBWT, actual_seed_length, actual_seed_stride, pCurrVector);
+    createSearchSeeds(w, pBWT, pRevBWT, actual_seed_length, actual_seed_stride, pCurrVector, pHistoryArena);
     extendSeedsExactRight(w, pBWT, pRevBWT, ED_RIGHT, pCurrVector, pNextVector);
     pCurrVector->clear();
     pCurrVector->swap(*pNextVector);
@@ -420,8 +430,9 @@ bool OverlapAlgorithm::findOverlapBlocksInexact(const std::string& w, const BWT*
         pContainList->splice(pContainList->end(), containedWorkingList);
     }
 
-    delete pCurrVector;
-    delete pNextVector;
+    // Release the history links held by the remaining seeds
+    pCurrVector->clear();
+    pNextVector->clear();
     return !fail;
 }
 
@@ -493,10 +504,10 @@ void OverlapAlgorithm::calculateSeedParameters(const std::string& w, const int m
 // Create and intialize the search seeds
 int OverlapAlgorithm::createSearchSeeds(const std::string& w, const BWT* pBWT, 
                                         const BWT* pRevBWT, int seed_length, int seed_stride,
-                                        SearchSeedVector* pOutVector) const
+                                        SearchSeedVector* pOutVector, SearchHistoryArena* pHistoryArena) const
 {
     // Start a new chain of history links
-    SearchHistoryLink rootLink = SearchHistoryNode::createRoot();
+    SearchHistoryLink rootLink = SearchHistoryNode::createRoot(pHistoryArena);
 
     // The maximum possible number of differences occurs for a fully-aligned read
     int read_len = w.length();
@@ -609,15 +620,14 @@ void OverlapAlgorithm::extendSeedInexactRight(SearchSeed& seed, const std::strin
     }
     else
     {
-        // Calculating the AlphaCounts is the heavy part of the computation so we cache
-        // the value outside the loop, it is the same for all bases
-        AlphaCount64 lower = pRevBWT->getFullOcc(seed.ranges.interval[1].lower - 1);
-        AlphaCount64 upper = pRevBWT->getFullOcc(seed.ranges.interval[1].upper);
-        for(int i = 0; i < 4; ++i)
+        // Calculating the AlphaCounts is the heavy part of the computation so
+        // the extensions to all bases are found with a single rank query
+        BWTIntervalPair probes[DNA_ALPHABET::size];
+        BWTAlgorithms::updateBothRAllBases(seed.ranges, pRevBWT, probes);
+        for(int i = 0; i < DNA_ALPHABET::size; ++i)
         {
             char b = ALPHABET[i];    
-            BWTIntervalPair probe = seed.ranges;
-            BWTAlgorithms::updateBothR(probe, b, pRevBWT, lower, upper);
+            const BWTIntervalPair& probe = probes[i];
             if(probe.interval[RIGHT_INT_IDX].isValid())
             {
                 SearchSeed branched = seed;
@@ -652,15 +662,14 @@ void OverlapAlgorithm::extendSeedInexactLeft(SearchSeed& seed, const std::string
         }
         else
         {
-            // Calculating the AlphaCounts is the heavy part of the computation so we cache
-            // the value outside the loop, it is the same for all bases
-            AlphaCount64 lower = pBWT->getFullOcc(seed.ranges.interval[0].lower - 1);
-            AlphaCount64 upper = pBWT->getFullOcc(seed.ranges.interval[0].upper);
-            for(int i = 0; i < 4; ++i)
+            // Calculating the AlphaCounts is the heavy part of the computation so
+            // the extensions to all bases are found with a single rank query
+            BWTIntervalPair probes[DNA_ALPHABET::size];
+            BWTAlgorithms::updateBothLAllBases(seed.ranges, pBWT, probes);
+            for(int i = 0; i < DNA_ALPHABET::size; ++i)
             {
                 char b = ALPHABET[i];
-                BWTIntervalPair probe = seed.ranges;
-                BWTAlgorithms::updateBothL(probe, b, pBWT, lower, upper);
+                const BWTIntervalPair& probe = probes[i];
                 if(probe.interval[LEFT_INT_IDX].isValid())
                 {
                     SearchSeed branched = seed;
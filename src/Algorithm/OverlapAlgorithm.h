@@ -29,6 +29,17 @@ struct OverlapResult
     bool searchAborted;
 };
 
+// Scratch memory for the overlap search. Each thread should hold one
+// of these and pass it to overlapRead so the memory used by the search
+// is re-used from read to read, rather than allocated from the global
+// heap for each read. The nodes of the OverlapBlockLists and the
+// history vectors of the blocks come from the thread's ScratchMemory.
+struct OverlapSearchArena
+{
+    SearchHistoryArena historyArena;
+    SearchSeedVector seedVectors[2];
+};
+
 class OverlapAlgorithm
 {
     public:
@@ -46,8 +57,10 @@ class OverlapAlgorithm
                                          m_maxSeeds(maxSeeds) {}
 
         // Perform the overlap
-        // This function is threaded so everything must be const
-        OverlapResult overlapRead(const SeqRecord& read, int minOverlap, OverlapBlockList* pOutList) const;
+        // This function is threaded so everything must be const.
+        // The optional arena must not be shared between threads.
+        OverlapResult overlapRead(const SeqRecord& read, int minOverlap, OverlapBlockList* pOutList, 
+                                  OverlapSearchArena* pArena = NULL) const;
     
         // Perform an irreducible overlap
         OverlapResult overlapReadExact(const SeqRecord& read, int minOverlap, OverlapBlockList* pOBOut) const;
@@ -56,7 +69,8 @@ class OverlapAlgorithm
         OverlapResult alignReadDuplicate(const SeqRecord& read, OverlapBlockList* pOBOut) const;
 
         // Perform an inexact overlap
-        OverlapResult overlapReadInexact(const SeqRecord& read, int minOverlap, OverlapBlockList* pOBOut) const;
+        OverlapResult overlapReadInexact(const SeqRecord& read, int minOverlap, OverlapBlockList* pOBOut,
+                                         OverlapSearchArena* pArena = NULL) const;
 
         // Write the result of an overlap to an ASQG file
         void writeResultASQG(std::ostream& writer, const SeqRecord& read, const OverlapResult& result) const;
@@ -86,7 +100,8 @@ class OverlapAlgorithm
         // Same as above while allowing mismatches
         bool findOverlapBlocksInexact(const std::string& w, const BWT* pBWT, const BWT* pRevBWT, 
                                       const AlignFlags& af, const int minOverlap, OverlapBlockList* pOBList, 
-                                      OverlapBlockList* pOBFinal, OverlapResult& result) const;
+                                      OverlapBlockList* pOBFinal, OverlapResult& result,
+                                      OverlapSearchArena* pArena = NULL) const;
 
         //
         inline bool extendSeedExactRight(SearchSeed& seed, const std::string& w, const BWT* pBWT, const BWT* pRevBWT) const;
@@ -110,7 +125,7 @@ class OverlapAlgorithm
         //
         inline int createSearchSeeds(const std::string& w, const BWT* pBWT, 
                                      const BWT* pRevBWT, int seed_length, int seed_stride, 
-                                     SearchSeedVector* pOutVector) const;
+                                     SearchSeedVector* pOutVector, SearchHistoryArena* pHistoryArena = NULL) const;
 
         //
         inline void extendSeedsExactRightQueue(const std::string& w, const BWT* pBWT, const BWT* pRevBWT, 
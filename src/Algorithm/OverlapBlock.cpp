@@ -10,6 +10,8 @@
 // 
 #include "OverlapBlock.h"
 #include "BWTAlgorithms.h"
+#include "ReadInfoTable.h"
+#include "SuffixArray.h"
 
 //#define DEBUG_RESOLVE 1
 
@@ -500,6 +502,50 @@ MultiOverlap blockListToMultiOverlap(const SeqRecord& record, OverlapBlockList&
     return out;
 }
 
+// Convert the blocks to overlaps
+size_t blockListToOverlaps(size_t readIdx,
+                           const OverlapBlockList* pList,
+                           const ReadInfoTable* pQueryRIT,
+                           const ReadInfoTable* pTargetRIT,
+                           const SuffixArray* pFwdSAI,
+                           const SuffixArray* pRevSAI,
+                           bool bCheckIDs,
+                           OverlapVector& outVector)
+{
+    size_t numAlignments = 0;
+    const ReadInfo queryInfo = pQueryRIT->getReadInfo(readIdx);
+    for(OverlapBlockList::const_iterator iter = pList->begin(); iter != pList->end(); ++iter)
+    {
+        const OverlapBlock& record = *iter;
+        const SuffixArray* pCurrSAI = (record.flags.isTargetRev()) ? pRevSAI : pFwdSAI;
+
+        // Iterate through the range and write the overlaps
+        for(int64_t j = record.ranges.interval[0].lower; j <= record.ranges.interval[0].upper; ++j)
+        {
+            numAlignments += 1;
+
+            // The index of the second read is given as the position in the SuffixArray index
+            const ReadInfo targetInfo = pTargetRIT->getReadInfo(pCurrSAI->get(j).getID());
+
+            // Skip self alignments and non-canonical (where the query read has a lexo. higher name)
+            if(queryInfo.id != targetInfo.id)
+            {    
+                Overlap o = record.toOverlap(queryInfo.id, targetInfo.id, queryInfo.length, targetInfo.length);
+
+                // The alignment logic above has the potential to produce duplicate alignments
+                // To avoid this, we skip overlaps where the id of the first coord is lexo. lower than 
+                // the second or the match is a containment and the query is reversed (containments can be 
+                // output up to 4 times total).
+                if(bCheckIDs && (o.id[0] < o.id[1] || (o.match.isContainment() && record.flags.isQueryRev())))
+                    continue;
+
+                outVector.push_back(o);
+            }
+        }
+    }
+    return numAlignments;
+}
+
 // make an id string from a read index
 std::string makeIdxString(int64_t idx)
 {
@@ -18,6 +18,10 @@
 #include "SearchHistory.h"
 #include "GraphCommon.h"
 #include "MultiOverlap.h"
+#include "ScratchMemory.h"
+
+class ReadInfoTable;
+class SuffixArray;
 
 // Flags indicating how a given read was aligned to the FM-index
 // Used for internal bookkeeping
@@ -187,7 +191,7 @@ struct OverlapBlock
 };
 
 // Collections
-typedef std::list<OverlapBlock> OverlapBlockList;
+typedef std::list<OverlapBlock, ScratchAllocator<OverlapBlock> > OverlapBlockList;
 typedef OverlapBlockList::iterator OBLIter;
 
 // Global Functions
@@ -213,6 +217,19 @@ void removeContainmentBlocks(int readLen, OverlapBlockList* pList);
 // Convert an overlap block list into a multiple overlap
 MultiOverlap blockListToMultiOverlap(const SeqRecord& record, OverlapBlockList& blockList);
 
+// Convert the overlap blocks found for read readIdx into overlaps and append them to outVector.
+// The target reads are found by looking up the positions of the blocks in the suffix array index.
+// If bCheckIDs is true, the query and target reads are from the same set and only one
+// copy of each overlap is kept. Returns the number of alignments in the blocks.
+size_t blockListToOverlaps(size_t readIdx,
+                           const OverlapBlockList* pList,
+                           const ReadInfoTable* pQueryRIT,
+                           const ReadInfoTable* pTargetRIT,
+                           const SuffixArray* pFwdSAI,
+                           const SuffixArray* pRevSAI,
+                           bool bCheckIDs,
+                           OverlapVector& outVector);
+
 // 
 std::string makeIdxString(int64_t idx);
 
@@ -0,0 +1,70 @@
+///-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// OverlapGraphProcess - Compute the overlaps of reads
+// and add them to a string graph in memory
+//
+#include "OverlapGraphProcess.h"
+#include "SGAlgorithms.h"
+
+//
+OverlapGraphProcess::OverlapGraphProcess(const OverlapAlgorithm* pOverlapper, 
+                                         int minOverlap,
+                                         const ReadInfoTable* pRIT,
+                                         const SuffixArray* pFwdSAI,
+                                         const SuffixArray* pRevSAI) : m_pOverlapper(pOverlapper),
+                                                                       m_minOverlap(minOverlap),
+                                                                       m_pRIT(pRIT),
+                                                                       m_pFwdSAI(pFwdSAI),
+                                                                       m_pRevSAI(pRevSAI)
+{
+
+}
+
+//
+OverlapGraphResult OverlapGraphProcess::process(const SequenceWorkItem& workItem)
+{
+    OverlapGraphResult result;
+    OverlapResult overlapResult = m_pOverlapper->overlapRead(workItem.read, m_minOverlap, &m_blockList, &m_searchArena);
+    result.isSubstring = overlapResult.isSubstring;
+
+    // The reads are overlapped against themselves so only the canonical overlaps are kept
+    blockListToOverlaps(workItem.idx, &m_blockList, m_pRIT, m_pRIT, m_pFwdSAI, m_pRevSAI, true, result.overlaps);
+    m_blockList.clear();
+    return result;
+}
+
+//
+OverlapGraphPostProcess::OverlapGraphPostProcess(StringGraph* pGraph, size_t maxEdges) : m_pGraph(pGraph),
+                                                                                        m_maxEdges(maxEdges),
+                                                                                        m_numOverlaps(0),
+                                                                                        m_numSubstrings(0)
+{
+
+}
+
+//
+OverlapGraphPostProcess::~OverlapGraphPostProcess()
+{
+    printf("Added %zu overlaps to the graph, %zu reads are substrings of other reads\n", m_numOverlaps, m_numSubstrings);
+}
+
+//
+void OverlapGraphPostProcess::process(const SequenceWorkItem& item, const OverlapGraphResult& result)
+{
+    if(result.isSubstring)
+    {
+        // Vertex is a substring of some other vertex, mark it as contained
+        Vertex* pVertex = m_pGraph->getVertex(item.read.id);
+        assert(pVertex != NULL);
+        pVertex->setContained(true);
+        m_pGraph->setContainmentFlag(true);
+        m_numSubstrings += 1;
+    }
+
+    for(OverlapVector::const_iterator iter = result.overlaps.begin(); iter != result.overlaps.end(); ++iter)
+        SGAlgorithms::createEdgesFromOverlap(m_pGraph, *iter, true, m_maxEdges);
+    m_numOverlaps += result.overlaps.size();
+}
@@ -0,0 +1,69 @@
+///-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// OverlapGraphProcess - Compute the overlaps of reads
+// and add them to a string graph in memory, without writing
+// hits or ASQG files
+//
+#ifndef OVERLAPGRAPHPROCESS_H
+#define OVERLAPGRAPHPROCESS_H
+
+#include "Util.h"
+#include "OverlapAlgorithm.h"
+#include "SequenceProcessFramework.h"
+#include "ReadInfoTable.h"
+#include "SuffixArray.h"
+#include "Bigraph.h"
+#include "SGUtil.h"
+
+struct OverlapGraphResult
+{
+    OverlapGraphResult() : isSubstring(false) {}
+    bool isSubstring;
+    OverlapVector overlaps;
+};
+
+// Compute the overlaps for reads. This is the work of sga overlap
+// followed by the conversion of the hits to overlaps
+class OverlapGraphProcess
+{
+    public:
+        OverlapGraphProcess(const OverlapAlgorithm* pOverlapper, 
+                            int minOverlap,
+                            const ReadInfoTable* pRIT,
+                            const SuffixArray* pFwdSAI,
+                            const SuffixArray* pRevSAI);
+
+        OverlapGraphResult process(const SequenceWorkItem& item);
+    
+    private:
+        OverlapBlockList m_blockList;
+        OverlapSearchArena m_searchArena;
+        const OverlapAlgorithm* m_pOverlapper;
+        const int m_minOverlap;
+        const ReadInfoTable* m_pRIT;
+        const SuffixArray* m_pFwdSAI;
+        const SuffixArray* m_pRevSAI;
+};
+
+// Add the overlaps to the graph. The vertices for all the reads must be
+// in the graph already. The results are added in the order of the reads
+// so the graph is the same as the one loaded from the ASQG file of sga overlap.
+class OverlapGraphPostProcess
+{
+    public:
+        OverlapGraphPostProcess(StringGraph* pGraph, size_t maxEdges);
+        ~OverlapGraphPostProcess();
+
+        void process(const SequenceWorkItem& item, const OverlapGraphResult& result);
+
+    private:
+        StringGraph* m_pGraph;
+        size_t m_maxEdges;
+        size_t m_numOverlaps;
+        size_t m_numSubstrings;
+};
+
+#endif
@@ -240,7 +240,7 @@ DuplicateCheckResult QCProcess::performDuplicateCheck(const SequenceWorkItem& wo
     {
         // This read is not a duplicate
         // Attempt to atomically set the bit from false to true
-        if(m_params.pSharedBV->updateCAS(canonicalIdx, false, true))
+        if(m_params.pSharedBV->testAndSet(canonicalIdx))
         {
             // Call succeed, return that this read is not a duplicate
             return DCR_UNIQUE;
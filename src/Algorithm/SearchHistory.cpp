@@ -10,6 +10,7 @@
 #include "SearchHistory.h"
 #include <algorithm>
 #include <iterator>
+#include <new>
 
 //
 // Link
@@ -46,7 +47,7 @@ SearchHistoryLink& SearchHistoryLink::operator=(SearchHistoryLink const& link)
     {
         pOld->decrement();
         if(pOld->getCount() == 0)
-            delete pOld;
+            SearchHistoryNode::destroy(pOld);
     }
     return *this;
 }
@@ -58,7 +59,7 @@ SearchHistoryLink::~SearchHistoryLink()
     {
         pNode->decrement();
         if(pNode->getCount() == 0)
-            delete pNode;
+            SearchHistoryNode::destroy(pNode);
     }
 }
 
@@ -69,15 +70,99 @@ SearchHistoryLink::~SearchHistoryLink()
 // adding a child of the node automatically increments the refCount of this node
 // through the child's Link to this node. Once all the children of this node
 // have been removed it will automatically be deleted
+// The child is allocated from the same arena as its parent
 SearchHistoryLink SearchHistoryNode::createChild(int var_pos, char var_base)
 {
-    return SearchHistoryLink(new SearchHistoryNode(this, var_pos, var_base));
+    return SearchHistoryLink(create(this, var_pos, var_base, m_pArena));
 }
 
 // The root has NULL as a parent 
-SearchHistoryLink SearchHistoryNode::createRoot()
+SearchHistoryLink SearchHistoryNode::createRoot(SearchHistoryArena* pArena)
 {
-    return SearchHistoryLink(new SearchHistoryNode(NULL, -1, ROOT_CHAR));
+    return SearchHistoryLink(create(NULL, -1, ROOT_CHAR, pArena));
+}
+
+//
+SearchHistoryNode* SearchHistoryNode::create(SearchHistoryNode* pParent, int var_pos, 
+                                             char var_base, SearchHistoryArena* pArena)
+{
+    if(pArena == NULL)
+        return new SearchHistoryNode(pParent, var_pos, var_base, NULL);
+    else
+        return new(pArena->alloc()) SearchHistoryNode(pParent, var_pos, var_base, pArena);
+}
+
+// Destroying a node releases its link to the parent, which may
+// in turn destroy the parent
+void SearchHistoryNode::destroy(SearchHistoryNode* pNode)
+{
+    SearchHistoryArena* pArena = pNode->m_pArena;
+    if(pArena == NULL)
+    {
+        delete pNode;
+    }
+    else
+    {
+        pNode->~SearchHistoryNode();
+        pArena->dealloc(pNode);
+    }
+}
+
+//
+// Arena
+//
+SearchHistoryArena::SearchHistoryArena() : m_blockIdx(0), m_blockUsed(0), m_numLive(0)
+{
+
+}
+
+//
+SearchHistoryArena::~SearchHistoryArena()
+{
+    assert(m_numLive == 0);
+    for(size_t i = 0; i < m_blocks.size(); ++i)
+        free(m_blocks[i]);
+}
+
+// Return memory for a single node, taken from the end of the current block
+void* SearchHistoryArena::alloc()
+{
+    const size_t block_bytes = NODES_PER_BLOCK * sizeof(SearchHistoryNode);
+    if(m_blocks.empty() || m_blockUsed == block_bytes)
+    {
+        // Move to the next block, allocating it if necessary
+        if(!m_blocks.empty())
+            ++m_blockIdx;
+        m_blockUsed = 0;
+
+        if(m_blockIdx == m_blocks.size())
+        {
+            char* pBlock = (char*)malloc(block_bytes);
+            if(pBlock == NULL)
+            {
+                std::cerr << "SearchHistoryArena failed to allocate " << block_bytes << " bytes, exiting\n";
+                abort();
+            }
+            m_blocks.push_back(pBlock);
+        }
+    }
+
+    void* pNext = m_blocks[m_blockIdx] + m_blockUsed;
+    m_blockUsed += sizeof(SearchHistoryNode);
+    ++m_numLive;
+    return pNext;
+}
+
+// Individual nodes are not reclaimed. Once the last node
+// has been released, all of the blocks are re-used
+void SearchHistoryArena::dealloc(void* /*ptr*/)
+{
+    assert(m_numLive > 0);
+    if(--m_numLive == 0)
+    {
+        m_blockIdx = 0;
+        m_blockUsed = 0;
+    }
 }
 
 // Return the search history up to the root node
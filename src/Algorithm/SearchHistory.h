@@ -10,6 +10,7 @@
 #define SEARCHHISTORY_H
 
 #include "Util.h"
+#include "ScratchMemory.h"
 
 // Base, Position pair indicating a divergence during the search
 struct SearchHistoryItem
@@ -29,7 +30,7 @@ struct SearchHistoryItem
         return out;
     }
 };
-typedef std::vector<SearchHistoryItem> HistoryItemVector;
+typedef std::vector<SearchHistoryItem, ScratchAllocator<SearchHistoryItem> > HistoryItemVector;
 
 // A vector of history items that can be compared with other histories
 class SearchHistoryVector
@@ -64,6 +65,36 @@ class SearchHistoryVector
 
 class SearchHistoryNode;
 
+// A bump allocator for SearchHistoryNodes. The nodes are carved out of
+// large blocks of memory, which are rewound once every node has been
+// released. A thread that keeps one arena for all its reads re-uses the
+// same memory for each search instead of going through the global heap
+// for every node. Not thread-safe.
+class SearchHistoryArena
+{
+    public:
+        SearchHistoryArena();
+        ~SearchHistoryArena();
+
+        void* alloc();
+        void dealloc(void* ptr);
+
+        size_t getNumBlocks() const { return m_blocks.size(); }
+
+    private:
+
+        // Arenas cannot be copied
+        SearchHistoryArena(const SearchHistoryArena&);
+        SearchHistoryArena& operator=(const SearchHistoryArena&);
+
+        std::vector<char*> m_blocks;
+        size_t m_blockIdx;
+        size_t m_blockUsed;
+        size_t m_numLive;
+
+        static const size_t NODES_PER_BLOCK = 4096;
+};
+
 // A SearchHistoryLink is a reference-counted wrapper of a 
 // search node. This is the external interface to the SearchHistoryNodes
 // This allows the SearchHistoryNodes to be automatically cleaned up when 
@@ -97,7 +128,10 @@ class SearchHistoryNode
     public:
 
         SearchHistoryLink createChild(int var_pos, char var_base);
-        static SearchHistoryLink createRoot(); // Create the root node of the history tree
+
+        // Create the root node of the history tree. If pArena is not NULL
+        // all the nodes of the tree are allocated from it.
+        static SearchHistoryLink createRoot(SearchHistoryArena* pArena = NULL);
         SearchHistoryVector getHistoryVector();
 
     private:
@@ -107,12 +141,18 @@ class SearchHistoryNode
 
         // The nodes should only be constructed/destructed through the links
         SearchHistoryNode(SearchHistoryNode* pParent, 
-                          int var_pos, char var_base) : m_parentLink(pParent), 
+                          int var_pos, char var_base,
+                          SearchHistoryArena* pArena) : m_parentLink(pParent), 
                                                         m_variant(var_pos, var_base),
-                                                        m_refCount(0) {}
+                                                        m_refCount(0),
+                                                        m_pArena(pArena) {}
         
         ~SearchHistoryNode() { assert(m_refCount == 0); }
 
+        static SearchHistoryNode* create(SearchHistoryNode* pParent, int var_pos, 
+                                         char var_base, SearchHistoryArena* pArena);
+        static void destroy(SearchHistoryNode* pNode);
+
         inline void increment() { ++m_refCount; }
         inline void decrement() { --m_refCount; }
         inline int getCount() const { return m_refCount; }
@@ -120,6 +160,7 @@ class SearchHistoryNode
         SearchHistoryLink m_parentLink;
         SearchHistoryItem m_variant;
         int m_refCount;
+        SearchHistoryArena* m_pArena;
 
         static const char ROOT_CHAR = '0';
 };
@@ -11,9 +11,11 @@
 #define SEARCHSEED_H
 
 #include <queue>
+#include <deque>
 #include <list>
 #include "BWTInterval.h"
 #include "SearchHistory.h"
+#include "ScratchMemory.h"
 
 // types
 enum ExtendDirection
@@ -88,6 +90,6 @@ struct SearchSeed
 
 // Collections
 typedef std::vector<SearchSeed> SearchSeedVector;
-typedef std::queue<SearchSeed> SearchSeedQueue;
+typedef std::queue<SearchSeed, std::deque<SearchSeed, ScratchAllocator<SearchSeed> > > SearchSeedQueue;
 
 #endif
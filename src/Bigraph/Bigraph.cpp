@@ -20,7 +20,7 @@
 Bigraph::Bigraph() : m_hasContainment(false), m_hasTransitive(false), m_isExactMode(false), m_minOverlap(0), m_errorRate(0.0f)
 {
     // Set up the memory pools for the graph
-    m_pEdgeAllocator = new SimpleAllocator<Edge>();
+    m_pEdgeAllocator = new EdgeAllocator();
     m_pVertexAllocator = new SimpleAllocator<Vertex>();
 
     m_vertices.set_deleted_key("");
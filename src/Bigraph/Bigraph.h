@@ -169,7 +169,7 @@ class Bigraph
         void writeASQG(const std::string& filename) const;
 
         // Returns an allocator for the edges of the graph
-        SimpleAllocator<Edge>* getEdgeAllocator() { return m_pEdgeAllocator; }
+        EdgeAllocator* getEdgeAllocator() { return m_pEdgeAllocator; }
 
         // Returns an allocator for the vertices of the graph
         SimpleAllocator<Vertex>* getVertexAllocator() { return m_pVertexAllocator; }
@@ -199,7 +199,7 @@ class Bigraph
 
         // Memory management
         SimpleAllocator<Vertex>* m_pVertexAllocator;
-        SimpleAllocator<Edge>* m_pEdgeAllocator;
+        EdgeAllocator* m_pEdgeAllocator;
 };
 
 #endif
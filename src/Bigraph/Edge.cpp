@@ -9,6 +9,19 @@
 #include "Edge.h"
 #include "Vertex.h"
 
+//
+Edge* Edge::createTwins(EdgeAllocator* pAllocator,
+                        Vertex* pEnd0, EdgeDir dir0, const SeqCoord& coord0,
+                        Vertex* pEnd1, EdgeDir dir1, const SeqCoord& coord1,
+                        EdgeComp comp)
+{
+    assert(coord0.seqlen == (int)pEnd1->getSeqLen() && coord1.seqlen == (int)pEnd0->getSeqLen());
+    Edge* pPair = static_cast<Edge*>(pAllocator->allocPair());
+    ::new(&pPair[0]) Edge(pEnd0, dir0, comp, coord0, false);
+    ::new(&pPair[1]) Edge(pEnd1, dir1, comp, coord1, true);
+    return pPair;
+}
+
 // 
 EdgeDesc Edge::getTwinDesc() const
 {
@@ -38,13 +51,13 @@ void Edge::join(const Edge* pEdge)
     // Update the match coordinate
     Match m12 = pEdge->getMatch();
     Match m23 = getMatch();
-    m_matchCoord = m12.inverseTranslate(m23.coord[0]);
+    setMatchCoord(m12.inverseTranslate(m23.coord[0]));
 
     if(pEdge->getComp() == EC_REVERSE)
         flip();
 
     // Now, update the twin of this edge to extend to the twin of pEdge
-    m_pTwin->extend(pEdge->getTwin());
+    getTwin()->extend(pEdge->getTwin());
 }
 
 // Extend this edge by adding pEdge to the end
@@ -61,7 +74,7 @@ void Edge::extend(const Edge* pEdge)
 Match Edge::getMatch() const
 {
     const SeqCoord& sc = getMatchCoord();
-    const SeqCoord& tsc = m_pTwin->getMatchCoord();
+    const SeqCoord& tsc = getTwin()->getMatchCoord();
     return Match(sc, tsc, getComp() == EC_REVERSE, -1);
 }
 
@@ -74,40 +87,55 @@ Overlap Edge::getOverlap() const
 // Get the matching portion of V1 described by this edge
 std::string Edge::getMatchStr() const
 {
-    return m_matchCoord.getSubstring(getStart()->getStr());
+    return getMatchCoord().getSubstring(getStart()->getStr());
 }
 
 // Return the length of the sequence
 size_t Edge::getSeqLen() const
 {
-    SeqCoord unmatched = m_pTwin->getMatchCoord().complement();
-    return unmatched.length();
+    return m_pEnd->getSeqLen() - getTwin()->getMatchLength();
+}
+
+// Return the match on the start vertex
+SeqCoord Edge::getMatchCoord() const
+{
+    int seqlen = getStart()->getSeqLen();
+    int length = getMatchLength();
+    if(m_edgeData.isMatchAtEnd())
+        return SeqCoord(seqlen - length, seqlen - 1, seqlen);
+    else
+        return SeqCoord(0, length - 1, seqlen);
 }
 
-void Edge::offsetMatch(int offset)
+//
+void Edge::setMatchCoord(const SeqCoord& sc)
 {
-    m_matchCoord.interval.start += offset;
-    m_matchCoord.interval.end += offset;
+    assert(sc.isExtreme());
+    setMatch(sc.length(), !sc.isLeftExtreme());
+}
+
+//
+void Edge::setMatch(size_t length, bool atEnd)
+{
+    if(length > EdgeData::MAX_MATCH_LENGTH)
+    {
+        std::cerr << "Error: the match of length " << length << " is longer than the maximum of " 
+                  << EdgeData::MAX_MATCH_LENGTH << " that can be stored in an edge\n";
+        exit(EXIT_FAILURE);
+    }
+    m_edgeData.setMatch(length, atEnd);
 }
 
 void Edge::extendMatch(int ext_len)
 {
-    m_matchCoord.interval.end += ext_len;
+    setMatch(getMatchLength() + ext_len, m_edgeData.isMatchAtEnd());
 }
 
 // Bump the edges of the match outwards so it covers the entire 
 // sequence
 void Edge::extendMatchFullLength()
 {
-    if(m_matchCoord.isLeftExtreme())
-        m_matchCoord.interval.end = m_matchCoord.seqlen - 1;
-    else
-        m_matchCoord.interval.start = 0;
-}
-
-void Edge::updateSeqLen(int newLen)
-{
-    m_matchCoord.seqlen = newLen;
+    setMatch(getStart()->getSeqLen(), m_edgeData.isMatchAtEnd());
 }
 
 // Validate that the edge members are sane
@@ -11,69 +11,100 @@
 #define EDGE_H
 
 #include <ostream>
+#include <new>
 #include "Match.h"
 #include "Util.h"
 #include "GraphCommon.h"
 #include "EdgeDesc.h"
 #include "Vertex.h"
-#include "BitChar.h"
-#include "SimpleAllocator.h"
+#include "EdgeAllocator.h"
 
-// Packed structure holding the direction and comp of an edge
+// Packed structure holding the direction and comp of an edge,
+// which slot of its twin pair the edge occupies and the length of the
+// match on the start vertex together with the end of the vertex it is at.
 // The EdgeDir/EdgeComp enums (which only have values 0/1) are used 
 // as the interface for this class so the set flags are cast to/from
 // these types.
 struct EdgeData
 {
     public:
-        EdgeData() {}
+        EdgeData() : m_data(0) {}
+
+        // The longest match that can be stored
+        static const size_t MAX_MATCH_LENGTH = (1 << 28) - 1;
 
         // Setters 
-        void setDir(EdgeDir dir)
-        {
-            if(dir == ED_ANTISENSE)
-                m_data.set(DIR_BIT, true);
-            else
-                m_data.set(DIR_BIT, false);
-        }
+        void setDir(EdgeDir dir) { setBit(DIR_BIT, dir == ED_ANTISENSE); }
+        void setComp(EdgeComp comp) { setBit(COMP_BIT, comp == EC_REVERSE); }
+        void setSecondTwin(bool b) { setBit(TWIN_BIT, b); }
 
-        void setComp(EdgeComp comp)
+        // Set the match to cover the first length bases of the vertex
+        // or, if atEnd is true, the last length bases
+        void setMatch(size_t length, bool atEnd)
         {
-            if(comp == EC_REVERSE)
-                m_data.set(COMP_BIT, true);
-            else
-                m_data.set(COMP_BIT, false);
+            assert(length <= MAX_MATCH_LENGTH);
+            m_data = (m_data & FLAG_MASK) | ((uint32_t)length << LENGTH_SHIFT);
+            setBit(AT_END_BIT, atEnd);
         }
 
-        void flipDir() { m_data.flip(DIR_BIT); }
-        void flipComp() { m_data.flip(COMP_BIT); }
+        void flipDir() { m_data ^= DIR_BIT; }
+        void flipComp() { m_data ^= COMP_BIT; }
 
         // Getters
         inline EdgeDir getDir() const
         {
-            return m_data.test(DIR_BIT) ? ED_ANTISENSE : ED_SENSE;
+            return (m_data & DIR_BIT) ? ED_ANTISENSE : ED_SENSE;
         }
 
         inline EdgeComp getComp() const
         {
-            return m_data.test(COMP_BIT) ? EC_REVERSE : EC_SAME;
+            return (m_data & COMP_BIT) ? EC_REVERSE : EC_SAME;
         }
 
+        inline bool isSecondTwin() const { return m_data & TWIN_BIT; }
+        inline bool isMatchAtEnd() const { return m_data & AT_END_BIT; }
+        inline size_t getMatchLength() const { return m_data >> LENGTH_SHIFT; }
+
     private:
-        static const size_t DIR_BIT = 0;
-        static const size_t COMP_BIT = 1;
-        BitChar m_data;
+
+        void setBit(uint32_t bit, bool v)
+        {
+            if(v)
+                m_data |= bit;
+            else
+                m_data &= ~bit;
+        }
+
+        static const uint32_t DIR_BIT = 1;
+        static const uint32_t COMP_BIT = 2;
+        static const uint32_t TWIN_BIT = 4;
+        static const uint32_t AT_END_BIT = 8;
+        static const uint32_t FLAG_MASK = 15;
+        static const size_t LENGTH_SHIFT = 4;
+        uint32_t m_data;
 };
 
+// Edges are created in twinned pairs that are stored next to each other
+// in the graph's EdgeAllocator, so the twin of an edge is found from its
+// address rather than stored, and the color of an edge is kept in the
+// allocator's side table. Every edge of the graph matches a prefix or a
+// suffix of its start vertex, so the match is stored as its length and the
+// end of the vertex it is at, and the length of the vertex is read from the
+// vertex. The remaining members are packed to 4-byte alignment so an edge
+// takes 12 bytes.
+#pragma pack(push, 4)
 class Edge
 {
     public:
-        Edge(Vertex* end, EdgeDir dir, EdgeComp comp, SeqCoord m) : 
-                 m_pEnd(end), m_pTwin(NULL), m_matchCoord(m), m_color(GC_WHITE), isTrusted(false)
-        {
-            m_edgeData.setDir(dir);
-            m_edgeData.setComp(comp);
-        }
+
+        // Create the pair of twin edges for an overlap. The first edge points to pEnd0, with direction dir0
+        // and match coordinate coord0 on the other vertex, pEnd1. The second edge is its twin.
+        // The match coordinates must be at one end of the sequence or the other.
+        // Returns the first edge.
+        static Edge* createTwins(EdgeAllocator* pAllocator,
+                                 Vertex* pEnd0, EdgeDir dir0, const SeqCoord& coord0,
+                                 Vertex* pEnd1, EdgeDir dir1, const SeqCoord& coord1,
+                                 EdgeComp comp);
 
         ~Edge() { }
         
@@ -91,35 +122,40 @@ class Edge
         // Sequence Coordinate functions
         
         // update functions
+        // These are used when the start vertex is merged with the end vertex. As the
+        // match is stored relative to the end of the vertex it is at, matches
+        // stay correct when sequence is added to the vertex. 
         void extendMatchFullLength();
+
+        // Extend the match over ext_len bases added at the end of the vertex the match is at
         void extendMatch(int ext_len);
-        void offsetMatch(int offset);
-        void updateSeqLen(int newLen);
 
         // access functions
         size_t getSeqLen() const;
-        size_t getMatchLength() const { return m_matchCoord.length(); }
-        const SeqCoord& getMatchCoord() const { return m_matchCoord; }
+        size_t getMatchLength() const { return m_edgeData.getMatchLength(); }
+        SeqCoord getMatchCoord() const;
         std::string getMatchStr() const;
         Match getMatch() const;
         Overlap getOverlap() const;
         
         // setters
-        void setTwin(Edge* pEdge) { m_pTwin = pEdge; }
-        void setColor(GraphColor c) { m_color = c; }
+        void setColor(GraphColor c) { EdgeAllocator::setColor(this, c); }
 
         // getters
         VertexID getStartID() const { return getStart()->getID(); }
         VertexID getEndID() const { return m_pEnd->getID(); }
-        inline Vertex* getStart() const { assert(m_pTwin != NULL); return m_pTwin->getEnd(); }
+        inline Vertex* getStart() const { return getTwin()->getEnd(); }
         inline Vertex* getEnd() const { return m_pEnd; }
         inline EdgeDir getDir() const { return m_edgeData.getDir(); }
         inline EdgeComp getComp() const { return m_edgeData.getComp(); }        
-        inline Edge* getTwin() const { assert(m_pTwin != NULL); return m_pTwin; }
+        inline Edge* getTwin() const 
+        { 
+            return const_cast<Edge*>(m_edgeData.isSecondTwin() ? this - 1 : this + 1); 
+        }
         EdgeDesc getTwinDesc() const;
         std::string getLabel() const;
         bool isSelf() const { return getStart() == getEnd(); }
-        inline GraphColor getColor() const { return m_color; }
+        inline GraphColor getColor() const { return EdgeAllocator::getColor(this); }
         size_t getMemSize() const { return sizeof(*this); }
 
         // Returns the direction of an edge that continues in the same direction
@@ -136,11 +172,6 @@ class Edge
         void flip() { flipComp(); flipDir(); }
 
         // Memory management
-        void* operator new(size_t /*size*/, SimpleAllocator<Edge>* pAllocator)
-        {
-            return pAllocator->alloc();
-        }
-
         void operator delete(void* /*target*/, size_t /*size*/)
         {
             // Deletions are handled at the graph/pool level. The lifetime of an edge
@@ -156,6 +187,19 @@ class Edge
 
     protected:
         
+        // Edges must be created in pairs by createTwins
+        Edge(Vertex* end, EdgeDir dir, EdgeComp comp, const SeqCoord& m, bool isSecondTwin) : m_pEnd(end)
+        {
+            m_edgeData.setDir(dir);
+            m_edgeData.setComp(comp);
+            m_edgeData.setSecondTwin(isSecondTwin);
+            setMatchCoord(m);
+        }
+
+        // Set the match from a coordinate on the start vertex
+        void setMatchCoord(const SeqCoord& sc);
+        void setMatch(size_t length, bool atEnd);
+
         // Global new is not allowed, allocation must go through the memory pool
         // belonging to the graph.
         void* operator new(size_t size) { return malloc(size); } 
@@ -163,13 +207,8 @@ class Edge
         Edge() {}; // Default constructor is not allowed
 
         Vertex* m_pEnd;
-        Edge* m_pTwin;
-        SeqCoord m_matchCoord;
-        GraphColor m_color;
-        EdgeData m_edgeData; // dir/comp member
-
-    public:
-        bool isTrusted;
+        EdgeData m_edgeData; // dir/comp/twin/match member
 };
+#pragma pack(pop)
 
 #endif
@@ -0,0 +1,89 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// EdgeAllocator - Memory pool for the twinned edge
+// pairs of a graph and the side table of their colors.
+//
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <iostream>
+#include "EdgeAllocator.h"
+#include "Edge.h"
+
+// Each edge takes sizeof(Edge) bytes plus half a byte of color. The number of
+// edges per block is even so the two edges of a pair are always in the same block
+// and share one byte of the color table.
+static const size_t EDGES_PER_BLOCK = (((EDGE_BLOCK_BYTES - 64) * 2) / (2 * sizeof(Edge) + 1)) & ~(size_t)1;
+
+// The color table is padded so the edges start on a cache line
+static const size_t COLOR_BYTES = ((EDGES_PER_BLOCK / 2) + 63) & ~(size_t)63;
+
+// Return the byte of the color table holding the color of pEdge and
+// the position of the color within the byte
+static inline unsigned char* getColorByte(const Edge* pEdge, size_t& shift)
+{
+    uintptr_t addr = reinterpret_cast<uintptr_t>(pEdge);
+    uintptr_t block = addr & ~(uintptr_t)(EDGE_BLOCK_BYTES - 1);
+    size_t idx = (addr - block - COLOR_BYTES) / sizeof(Edge);
+    shift = (idx & 1) * 4;
+    return reinterpret_cast<unsigned char*>(block) + idx / 2;
+}
+
+//
+EdgeAllocator::EdgeAllocator() : m_numUsed(0)
+{
+
+}
+
+//
+EdgeAllocator::~EdgeAllocator()
+{
+    for(size_t i = 0; i < m_blocks.size(); ++i)
+        free(m_blocks[i]);
+    m_blocks.clear();
+}
+
+//
+void* EdgeAllocator::allocPair()
+{
+    if(m_blocks.empty() || m_numUsed + 2 > EDGES_PER_BLOCK)
+    {
+        void* pBlock = NULL;
+        if(posix_memalign(&pBlock, EDGE_BLOCK_BYTES, EDGE_BLOCK_BYTES) != 0)
+        {
+            std::cerr << "EdgeAllocator failed to allocate " << EDGE_BLOCK_BYTES <<
+                         " bytes for memory pool, exiting\n";
+            exit(EXIT_FAILURE);
+        }
+        m_blocks.push_back(static_cast<char*>(pBlock));
+        m_numUsed = 0;
+    }
+
+    char* pPair = m_blocks.back() + COLOR_BYTES + m_numUsed * sizeof(Edge);
+    m_numUsed += 2;
+
+    // Both edges of the pair start out GC_WHITE
+    size_t shift;
+    *getColorByte(reinterpret_cast<Edge*>(pPair), shift) = (GC_WHITE << 4) | GC_WHITE;
+    return pPair;
+}
+
+//
+GraphColor EdgeAllocator::getColor(const Edge* pEdge)
+{
+    size_t shift;
+    const unsigned char* pByte = getColorByte(pEdge, shift);
+    return (*pByte >> shift) & 0xF;
+}
+
+//
+void EdgeAllocator::setColor(const Edge* pEdge, GraphColor c)
+{
+    assert(c <= 0xF);
+    size_t shift;
+    unsigned char* pByte = getColorByte(pEdge, shift);
+    *pByte = (*pByte & ~(0xF << shift)) | (c << shift);
+}
@@ -0,0 +1,48 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// EdgeAllocator - Memory pool for the twinned edge
+// pairs of a graph and the side table of their colors.
+//
+// The edges are carved out of blocks of EDGE_BLOCK_BYTES that are
+// aligned to their size. The start of each block holds the colors
+// of the edges in the block, four bits per edge, so the color of an
+// edge is found by masking its address down to the start of its block
+// rather than stored in the edge. As with SimpleAllocator, deleted edges
+// are not tracked and the memory is released with the allocator.
+//
+// Not thread-safe.
+//
+#ifndef EDGEALLOCATOR_H
+#define EDGEALLOCATOR_H
+
+#include <stddef.h>
+#include <vector>
+#include "GraphCommon.h"
+
+#define EDGE_BLOCK_BYTES (1 << 20)
+
+class Edge;
+
+class EdgeAllocator
+{
+    public:
+        EdgeAllocator();
+        ~EdgeAllocator();
+
+        // Return memory for two edges that are adjacent in memory
+        void* allocPair();
+
+        // Read and write the color of an edge held by an EdgeAllocator
+        static GraphColor getColor(const Edge* pEdge);
+        static void setColor(const Edge* pEdge, GraphColor c);
+
+    private:
+
+        std::vector<char*> m_blocks;
+        size_t m_numUsed; // edges allocated from the last block
+};
+
+#endif
@@ -33,8 +33,6 @@ void Vertex::merge(Edge* pEdge)
     // Merge the sequence
     DNAEncodedString label = pEdge->getLabel();
     size_t label_len = label.length();
-    pEdge->updateSeqLen(m_seq.length() + label_len);
-    bool prepend = false;
 
     if(pEdge->getDir() == ED_SENSE)
     {
@@ -44,7 +42,6 @@ void Vertex::merge(Edge* pEdge)
     {
         label.append(m_seq);
         std::swap(m_seq, label);
-        prepend = true;
     }
 
     // Update the coverage value of the vertex
@@ -53,17 +50,9 @@ void Vertex::merge(Edge* pEdge)
     pEdge->extendMatch(label_len);
     pTwin->extendMatchFullLength();
 
-    // All the SeqCoords for the edges must have their seqlen field updated
-    // Also, if we prepended sequence to this edge, all the matches in the 
-    // SENSE direction must have their coordinates offset
-    size_t newLen = m_seq.length();
-    for(EdgePtrVecIter iter = m_edges.begin(); iter != m_edges.end(); ++iter)
-    {
-        Edge* pUpdateEdge = *iter;
-        pUpdateEdge->updateSeqLen(newLen);
-        if(prepend && pUpdateEdge->getDir() == ED_SENSE && pEdge != pUpdateEdge)
-            pUpdateEdge->offsetMatch(label_len);
-    }
+    // The matches of the other edges do not need to be updated. pEdge is the only
+    // edge in the direction of the merge so the other edges match the end of the
+    // sequence that did not grow, and matches are stored relative to that end.
 
 #ifdef VALIDATE
     VALIDATION_WARNING("Vertex::merge")
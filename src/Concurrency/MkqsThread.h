@@ -6,68 +6,243 @@
 //
 // Implementation of a multikey quicksort worker thread
 //
+// Each thread owns a deque of sort jobs. A thread takes its next
+// job from the back of its own deque and pushes the jobs created by
+// partitioning onto the back too, so it works depth-first on the data
+// it just touched. A thread with an empty deque steals from the front
+// of another thread's deque, where the oldest and largest jobs are.
+// A thread that finds no job anywhere sleeps until a job is pushed
+// or the sort is finished.
+//
+#ifndef MKQSTHREAD_H
+#define MKQSTHREAD_H
+
 #include <pthread.h>
-#include <semaphore.h>
+#include <deque>
+#include <vector>
 #include "mkqs.h"
 
-// 
+//
 template<typename T>
 struct MkqsJob
 {
+    MkqsJob() : pData(NULL), n(0), depth(0) {}
     MkqsJob(T* p, int num, int d) : pData(p), n(num), depth(d) {}
     T* pData;
     int n;
     int depth;
 };
 
+// A deque of jobs guarded by its own mutex. The lock is almost
+// always taken by the owning thread so it is rarely contended.
+template<typename T>
+class MkqsJobDeque
+{
+    typedef MkqsJob<T> Job;
+
+    public:
+        MkqsJobDeque()
+        {
+            int ret = pthread_mutex_init(&m_mutex, NULL);
+            if(ret != 0)
+            {
+                std::cerr << "Mutex initialization failed with error " << ret << ", aborting" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        ~MkqsJobDeque()
+        {
+            pthread_mutex_destroy(&m_mutex);
+        }
+
+        //
+        void push(const Job& job)
+        {
+            pthread_mutex_lock(&m_mutex);
+            m_jobs.push_back(job);
+            pthread_mutex_unlock(&m_mutex);
+        }
+
+        // Take the most recently added job, used by the owner
+        bool popBack(Job& job)
+        {
+            bool found = false;
+            pthread_mutex_lock(&m_mutex);
+            if(!m_jobs.empty())
+            {
+                job = m_jobs.back();
+                m_jobs.pop_back();
+                found = true;
+            }
+            pthread_mutex_unlock(&m_mutex);
+            return found;
+        }
+
+        // Take the oldest job, used by thieves
+        bool popFront(Job& job)
+        {
+            bool found = false;
+            pthread_mutex_lock(&m_mutex);
+            if(!m_jobs.empty())
+            {
+                job = m_jobs.front();
+                m_jobs.pop_front();
+                found = true;
+            }
+            pthread_mutex_unlock(&m_mutex);
+            return found;
+        }
+
+        //
+        bool empty()
+        {
+            pthread_mutex_lock(&m_mutex);
+            bool ret = m_jobs.empty();
+            pthread_mutex_unlock(&m_mutex);
+            return ret;
+        }
+
+    private:
+        std::deque<Job> m_jobs;
+        pthread_mutex_t m_mutex;
+};
+
+// State shared between the threads of one sort
+template<typename T>
+struct MkqsSharedState
+{
+    MkqsSharedState(int numThreads, int threshold) : deques(numThreads), pendingJobs(0), numIdle(0), thresholdSize(threshold)
+    {
+        int ret = pthread_mutex_init(&idleMutex, NULL);
+        if(ret == 0)
+            ret = pthread_cond_init(&workCond, NULL);
+        if(ret != 0)
+        {
+            std::cerr << "Mutex initialization failed with error " << ret << ", aborting" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    ~MkqsSharedState()
+    {
+        for(size_t i = 0; i < deques.size(); ++i)
+            delete deques[i];
+        pthread_cond_destroy(&workCond);
+        pthread_mutex_destroy(&idleMutex);
+    }
+
+    // Wake one idle thread, called after a job has been pushed
+    void notifyJob()
+    {
+        // An idle thread counts itself before checking the deques, so if
+        // it missed the job that was just pushed this reads its count
+        if(__sync_fetch_and_add(&numIdle, 0) == 0)
+            return;
+        pthread_mutex_lock(&idleMutex);
+        pthread_cond_signal(&workCond);
+        pthread_mutex_unlock(&idleMutex);
+    }
+
+    // Mark a job as finished, waking all idle threads if it was the last
+    void finishJob()
+    {
+        if(__sync_sub_and_fetch(&pendingJobs, 1) > 0)
+            return;
+        pthread_mutex_lock(&idleMutex);
+        pthread_cond_broadcast(&workCond);
+        pthread_mutex_unlock(&idleMutex);
+    }
+
+    // Sleep until some deque has a job or the sort is finished.
+    // Returns false if the sort is finished.
+    bool waitForJob()
+    {
+        pthread_mutex_lock(&idleMutex);
+        __sync_fetch_and_add(&numIdle, 1);
+        while(pendingJobs > 0 && !hasJob())
+            pthread_cond_wait(&workCond, &idleMutex);
+        __sync_fetch_and_sub(&numIdle, 1);
+        bool running = pendingJobs > 0;
+        pthread_mutex_unlock(&idleMutex);
+        return running;
+    }
+
+    //
+    bool hasJob()
+    {
+        for(size_t i = 0; i < deques.size(); ++i)
+        {
+            if(!deques[i]->empty())
+                return true;
+        }
+        return false;
+    }
+
+    std::vector<MkqsJobDeque<T>*> deques;
+
+    // The number of jobs that have been pushed but not finished.
+    // A job's sub-jobs are pushed before it is counted as finished
+    // so this only reaches zero when the sort is complete.
+    volatile int pendingJobs;
+
+    // Threads that found no job sleep on workCond. numIdle is the
+    // number of threads waiting or about to wait.
+    pthread_mutex_t idleMutex;
+    pthread_cond_t workCond;
+    volatile int numIdle;
+
+    // Jobs with at most this many elements are sorted serially
+    int thresholdSize;
+};
+
 //
 template<typename T, class PrimarySorter, class FinalSorter>
 class MkqsThread
 {
     typedef MkqsJob<T> Job;
-    typedef std::queue<Job> JobQueue;
 
     public:
-        MkqsThread(int id, JobQueue* pQueue, pthread_mutex_t* pQueueMutex, 
-                   sem_t* pQueueSem, sem_t* pDoneSem, int thresholdSize,
-                   const PrimarySorter* pPrimarySorter, 
-                   const FinalSorter* pFinalSorter) : m_id(id), 
-                                                      m_pQueue(pQueue), 
-                                                      m_pQueueMutex(pQueueMutex), 
-                                                      m_pQueueSem(pQueueSem),
-                                                      m_pDoneSem(pDoneSem),
-                                                      m_thresholdSize(thresholdSize),
-                                                      m_pPrimary(pPrimarySorter), 
+        MkqsThread(int id, MkqsSharedState<T>* pState,
+                   const PrimarySorter* pPrimarySorter,
+                   const FinalSorter* pFinalSorter) : m_id(id),
+                                                      m_pState(pState),
+                                                      m_pPrimary(pPrimarySorter),
                                                       m_pFinal(pFinalSorter),
-                                                      m_stopRequested(false),
-                                                      m_numProcessed(0) {}
+                                                      m_seed(id + 1),
+                                                      m_numProcessed(0),
+                                                      m_numStolen(0)
+        {
+            m_pState->deques[m_id] = new MkqsJobDeque<T>;
+        }
+
         ~MkqsThread();
 
         void start();
-        void stop();
         void join();
 
+        // Add a job to the deque of this thread
+        void addJob(const Job& job);
+
         static void* startThread(void* obj);
 
     private:
 
         void run();
-        void process(Job& job);
+        bool getJob(Job& job);
 
         // Data
         int m_id;
-        JobQueue* m_pQueue; // shared
-        pthread_mutex_t* m_pQueueMutex; // shared
-        sem_t* m_pQueueSem; // shared
-        sem_t* m_pDoneSem; // shared
-        
-        int m_thresholdSize;
+        MkqsSharedState<T>* m_pState; // shared
         const PrimarySorter* m_pPrimary;
         const FinalSorter* m_pFinal;
 
+        // Seed for choosing pivots, rand() serializes the threads on its lock
+        unsigned int m_seed;
+
         pthread_t m_thread;
-        volatile bool m_stopRequested;
         int m_numProcessed;
+        int m_numStolen;
 };
 
 //
@@ -88,13 +263,6 @@ void MkqsThread<T, PrimarySorter, FinalSorter>::start()
     }
 }
 
-// Stop thread
-template<typename T, class PrimarySorter, class FinalSorter>
-void MkqsThread<T, PrimarySorter, FinalSorter>::stop()
-{
-    m_stopRequested = true;
-}
-
 // Called from the external main function, joins the thread to the main on exit
 template<typename T, class PrimarySorter, class FinalSorter>
 void MkqsThread<T, PrimarySorter, FinalSorter>::join()
@@ -107,47 +275,63 @@ void MkqsThread<T, PrimarySorter, FinalSorter>::join()
     }
 }
 
+//
+template<typename T, class PrimarySorter, class FinalSorter>
+void MkqsThread<T, PrimarySorter, FinalSorter>::addJob(const Job& job)
+{
+    __sync_fetch_and_add(&m_pState->pendingJobs, 1);
+    m_pState->deques[m_id]->push(job);
+    m_pState->notifyJob();
+}
+
+// Take a job from this thread's deque or, if it is empty, steal one
+// from the other threads, starting with the next thread along
+template<typename T, class PrimarySorter, class FinalSorter>
+bool MkqsThread<T, PrimarySorter, FinalSorter>::getJob(Job& job)
+{
+    if(m_pState->deques[m_id]->popBack(job))
+        return true;
+
+    int numThreads = m_pState->deques.size();
+    for(int i = 1; i < numThreads; ++i)
+    {
+        if(m_pState->deques[(m_id + i) % numThreads]->popFront(job))
+        {
+            m_numStolen += 1;
+            return true;
+        }
+    }
+    return false;
+}
+
 // Run thread
 template<typename T, class PrimarySorter, class FinalSorter>
 void MkqsThread<T, PrimarySorter, FinalSorter>::run()
 {
     while(1)
     {
-        sem_post(m_pDoneSem);
-        sem_wait(m_pQueueSem);
-        
-        // Exit if the thread was stopped
-        if(m_stopRequested)
+        Job job;
+        if(!getJob(job))
         {
-            pthread_exit(NULL);
+            // All jobs are finished when none are pending. Otherwise another
+            // thread is partitioning and may push more work soon.
+            if(!m_pState->waitForJob())
+                return;
+            continue;
         }
 
-        // Take an item from the queue and process it
-        pthread_mutex_lock(m_pQueueMutex);
-        assert(!m_pQueue->empty());
-
-        // Decrement the done count. Since this is done
-        // while the queue is not empty and locked, the master
-        // thread can never see an empty queue before the
-        // done semaphore is decremented. This ensures all threads
-        // will work to completion
-        sem_wait(m_pDoneSem);
-
-        Job job = m_pQueue->front();
-        m_pQueue->pop();
-        pthread_mutex_unlock(m_pQueueMutex);
-
         // Process the item using either the parallel algorithm (which subdivides the job further)
         // or the serial algorithm (which doesn't subdivide)
-        if(job.n > m_thresholdSize)
+        if(job.n > m_pState->thresholdSize)
         {
-            parallel_mkqs_process(job, m_pQueue, m_pQueueMutex, m_pQueueSem, *m_pPrimary, *m_pFinal);
+            parallel_mkqs_process(job, this, &m_seed, *m_pPrimary, *m_pFinal);
         }
         else
         {
-            mkqs2(job.pData, job.n, job.depth, *m_pPrimary, *m_pFinal);
+            mkqs2(job.pData, job.n, job.depth, *m_pPrimary, *m_pFinal, &m_seed);
         }
         m_numProcessed += 1;
+        m_pState->finishJob();
     }
 }
 
@@ -158,3 +342,5 @@ void* MkqsThread<T, PrimarySorter, FinalSorter>::startThread(void* obj)
     reinterpret_cast<MkqsThread*>(obj)->run();
     return NULL;
 }
+
+#endif
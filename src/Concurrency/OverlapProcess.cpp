@@ -28,7 +28,7 @@ OverlapProcess::~OverlapProcess()
 //
 OverlapResult OverlapProcess::process(const SequenceWorkItem& workItem)
 {
-    OverlapResult result = m_pOverlapper->overlapRead(workItem.read, m_minOverlap, &m_blockList);
+    OverlapResult result = m_pOverlapper->overlapRead(workItem.read, m_minOverlap, &m_blockList, &m_searchArena);
     m_pOverlapper->writeOverlapBlocks(*m_pWriter, workItem.idx, result.isSubstring, &m_blockList);
     m_blockList.clear();
     return result;
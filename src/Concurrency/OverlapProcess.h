@@ -28,6 +28,7 @@ class OverlapProcess
     private:
         std::ostream* m_pWriter;
         OverlapBlockList m_blockList;
+        OverlapSearchArena m_searchArena;
         const OverlapAlgorithm* m_pOverlapper;
         const int m_minOverlap;
 };
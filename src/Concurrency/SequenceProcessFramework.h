@@ -12,6 +12,7 @@
 #include "Timer.h"
 #include "SequenceWorkItem.h"
 #include "config.h"
+#include <algorithm>
 
 #if HAVE_OPENMP
 #include <omp.h>
@@ -139,7 +140,7 @@ size_t processWorkParallelPthread(Generator& generator,
         }
 
         // Create and start the thread
-        threadVec[i] = new Thread(semVec[i], processPtrVector[i], BUFFER_SIZE);
+        threadVec[i] = new Thread(semVec[i], processPtrVector[i], BUFFER_SIZE, i);
         threadVec[i]->start();
 
         inputBuffers[i] = new InputItemVector;
@@ -278,6 +279,10 @@ size_t processWorkParallelOpenMP(Generator& generator,
 
     omp_set_num_threads(numThreads);
 
+    // Spread the threads over the NUMA nodes, if the index is interleaved
+    #pragma omp parallel
+    IndexMemory::pinThread(omp_get_thread_num());
+
     bool done = false;
     while(!done)
     {
@@ -338,6 +343,111 @@ size_t processWorkParallelOpenMP(Generator& generator,
 #endif
 }
 
+// Design:
+// This version reads batches of batchSize work items and processes the items
+// of a batch in the order of the key that pSortKey->getKey() returns for them,
+// rather than the order they were generated. The key is chosen so that items
+// touching the same data, for instance reads whose FM-index searches start in the
+// same region of the BWT, are processed one after another while that data is
+// still in the cache. The outputs are stored at the position of their input
+// so the post processor sees the items in the order they were generated.
+//
+// The batch is split between the processors with OpenMP. A single processor,
+// or a build without OpenMP, processes the batch serially.
+template<class Input, class Output, class Generator, class Processor, class PostProcessor, class SortKey>
+size_t processWorkSorted(Generator& generator, 
+                         std::vector<Processor*> processPtrVector, 
+                         PostProcessor* pPostProcessor, 
+                         const SortKey* pSortKey,
+                         size_t batchSize,
+                         size_t n = -1)
+{
+    Timer timer("SequenceProcess", true);
+
+    // Helpful typedefs
+    typedef std::vector<Input> InputVector;
+    typedef std::vector<Output> OutputVector;
+    typedef std::vector<std::pair<uint64_t, size_t> > KeyVector;
+
+    InputVector inputBuffer;
+    OutputVector outputBuffer;
+    KeyVector order;
+
+    size_t numWorkItemsRead = 0;
+    size_t numWorkItemsWrote = 0;
+    size_t numThreads = processPtrVector.size();
+    assert(numThreads > 0 && batchSize > 0);
+
+#if HAVE_OPENMP
+    omp_set_num_threads(numThreads);
+
+    // Spread the threads over the NUMA nodes, if the index is interleaved
+    #pragma omp parallel
+    IndexMemory::pinThread(omp_get_thread_num());
+#endif
+
+    bool done = false;
+    while(!done)
+    {
+        // Parse reads from the stream and add them into the incoming buffers
+        Input workItem;
+        bool valid = generator.generate(workItem);
+        if(valid)
+        {
+            inputBuffer.push_back(workItem);
+            numWorkItemsRead += 1;
+        }
+        
+        done = !valid || generator.getNumConsumed() == n;
+
+        if(inputBuffer.size() == batchSize || done)
+        {
+            // Order the batch by key. Ties keep their input order
+            order.resize(inputBuffer.size());
+            for(size_t i = 0; i < inputBuffer.size(); ++i)
+                order[i] = std::make_pair(pSortKey->getKey(inputBuffer[i]), i);
+            std::sort(order.begin(), order.end());
+
+            outputBuffer.resize(inputBuffer.size());
+
+            // Each thread takes consecutive runs of the sorted items
+#if HAVE_OPENMP
+            #pragma omp parallel for schedule(dynamic, 256) if(numThreads > 1)
+#endif
+            for(int i = 0; i < (int)order.size(); ++i)
+            {
+#if HAVE_OPENMP
+                size_t tid = omp_get_thread_num();
+#else
+                size_t tid = 0;
+#endif
+                size_t idx = order[i].second;
+                outputBuffer[idx] = processPtrVector[tid]->process(inputBuffer[idx]);
+            }
+
+            // Process the output with a single thread, in input order
+            for(size_t i = 0; i < inputBuffer.size(); ++i)
+            {
+                pPostProcessor->process(inputBuffer[i], outputBuffer[i]);
+                numWorkItemsWrote += 1;
+            }
+            inputBuffer.clear();
+            outputBuffer.clear();
+
+            double proc_time_secs = timer.getElapsedWallTime();
+            printf("[sga] Processed %zu sequences in %lfs (%lf sequences/s)\n", generator.getNumConsumed(), proc_time_secs, (double)generator.getNumConsumed() / proc_time_secs);
+        }
+    }
+
+    assert(n == (size_t)-1 || generator.getNumConsumed() == n);
+    assert(numWorkItemsRead == numWorkItemsWrote);
+
+    double proc_time_secs = timer.getElapsedWallTime();
+    printf("[sga::process] processed %zu sequences in %lfs (%lf sequences/s)\n", 
+            generator.getNumConsumed(), proc_time_secs, (double)generator.getNumConsumed() / proc_time_secs);
+    return generator.getNumConsumed();
+}
+
 // Wrapper function for operating over n elements of from a SeqReader
 template<class Input, class Output, class Processor, class PostProcessor>
 size_t processSequencesParallel(SeqReader& reader, 
@@ -387,6 +497,24 @@ size_t processSequencesParallelOpenMP(const std::string& readsFile, std::vector<
 }
 
 
+// Wrapper function for processing every sequence in readsFile in batches sorted by pSortKey
+template<class Input, class Output, class Processor, class PostProcessor, class SortKey>
+size_t processSequencesSorted(const std::string& readsFile, 
+                              std::vector<Processor*> processPtrVector, 
+                              PostProcessor* pPostProcessor,
+                              const SortKey* pSortKey,
+                              size_t batchSize)
+{
+    SeqReader reader(readsFile);
+    WorkItemGenerator<Input> generator(&reader);
+    return processWorkSorted<Input, 
+                             Output, 
+                             WorkItemGenerator<Input>, 
+                             Processor, 
+                             PostProcessor,
+                             SortKey>(generator, processPtrVector, pPostProcessor, pSortKey, batchSize);
+}
+
 };
 
 #endif
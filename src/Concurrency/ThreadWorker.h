@@ -16,6 +16,7 @@
 
 #include <semaphore.h>
 #include "Util.h"
+#include "IndexMemory.h"
 
 template<class Input, class Output, class Processor>
 class ThreadWorker
@@ -24,7 +25,7 @@ class ThreadWorker
     typedef std::vector<Output> OutputVector;
 
     public:
-        ThreadWorker(sem_t* pReadySem, Processor* pProcessor, const size_t max_items);
+        ThreadWorker(sem_t* pReadySem, Processor* pProcessor, const size_t max_items, size_t id = 0);
         ~ThreadWorker();
 
         // Exchange the contents of the shared input/output vectors with pInput/pOutput
@@ -48,6 +49,7 @@ class ThreadWorker
         
         // Handles
         pthread_t m_thread;
+        size_t m_id;
 
         // External semaphore to post to
         // when the thread is ready to receive data
@@ -71,7 +73,9 @@ class ThreadWorker
 template<class Input, class Output, class Processor>
 ThreadWorker<Input, Output, Processor>::ThreadWorker(sem_t* pReadySem, 
                                                      Processor* pProcessor,
-                                                     const size_t max_items) :
+                                                     const size_t max_items,
+                                                     size_t id) :
+                                                      m_id(id),
                                                       m_pReadySem(pReadySem),
                                                       m_pProcessor(pProcessor),
                                                       m_stopRequested(false), 
@@ -169,6 +173,9 @@ bool ThreadWorker<Input, Output, Processor>::isReady()
 template<class Input, class Output, class Processor>
 void ThreadWorker<Input, Output, Processor>::run()
 {
+    // Run on a NUMA node of its own, if the index is interleaved
+    IndexMemory::pinThread(m_id);
+
     // Indicate that the thread is ready to receive data
     pthread_mutex_lock(&m_mutex);
     m_isReady = true;
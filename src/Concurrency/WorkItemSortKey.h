@@ -0,0 +1,43 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// WorkItemSortKey - Keys used to order the work items of a batch
+// so that items touching the same data are processed together.
+// See SequenceProcessFramework::processWorkSorted
+//
+#ifndef WORKITEMSORTKEY_H
+#define WORKITEMSORTKEY_H
+
+#include <limits>
+#include "SequenceWorkItem.h"
+#include "BWTIntervalCache.h"
+
+// The overlap, merge and correction searches walk backwards through
+// the FM-index starting from the last bases of the read. This key is the
+// lower bound of the cached interval of the read's last k-mer, so reads
+// whose searches start in the same region of the BWT get nearby keys.
+// Reads shorter than the cached length sort last.
+class CachedIntervalSortKey
+{
+    public:
+        // The length of the cache built for sorting when a program does not already have one
+        static const size_t DEFAULT_CACHE_LENGTH = 8;
+
+        CachedIntervalSortKey(const BWTIntervalCache* pCache) : m_pCache(pCache) {}
+
+        uint64_t getKey(const SequenceWorkItem& item) const
+        {
+            std::string w = item.read.seq.toString();
+            size_t k = m_pCache->getCachedLength();
+            if(w.size() < k)
+                return std::numeric_limits<uint64_t>::max();
+            return m_pCache->lookup(w.c_str() + w.size() - k).lower;
+        }
+
+    private:
+        const BWTIntervalCache* m_pCache;
+};
+
+#endif
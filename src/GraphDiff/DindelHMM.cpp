@@ -44,6 +44,45 @@ char complement(char b) { return b;}
 #endif
 
 
+// Lookup tables shared by all threads running the HMM
+const DindelHMMTables g_dindelHMMTables;
+
+DindelHMMTables::DindelHMMTables()
+{
+    for(int q = 0; q <= MAX_QUAL; ++q)
+    {
+        // probabilities of correctly and incorrectly observing the read base
+        double pr = 1.0 - exp((-2.3026/10.0) * double(q));
+        m_baseCorrect[q] = .25 + .75 * pr;
+        m_baseIncorrect[q] = .75 + 1e-10 - .75 * pr;
+        m_logBaseCorrect[q] = log(m_baseCorrect[q]);
+    }
+
+    for(int hplen = 0; hplen < MAX_HP; ++hplen)
+        m_gapProb[hplen] = computeGapProb(hplen);
+}
+
+// Homopolymer-length dependent indel probability
+double DindelHMMTables::computeGapProb(int hplen)
+{
+    static const double hp[] = { 2.9e-5, 2.9e-5,2.9e-5, 2.9e-5, 4.3e-5, 1.1e-4, 2.4e-4, 5.7e-4, 1.0e-3, 1.4e-3 };
+    static const int MAXHP = 10;
+
+    double prob;
+    if (hplen<MAXHP) 
+    {
+        prob=hp[hplen]; 
+    }
+    else
+    {
+        prob=hp[9]+4.3e-4*double(hplen-10);
+        if (prob>0.95) prob=0.95;
+    }
+
+    // divide by two to get the insertion/deletion prob
+    return prob/2.0;
+}
+
 DindelHMM::DindelHMM(DindelRead & read, const DindelMultiHaplotype & haplotype) : m_pRead(&read), m_pHaplotype(& haplotype)
 {
         
@@ -11,6 +11,8 @@
 //
 #ifndef DINDELHMM_H
 #define	DINDELHMM_H
+#include <limits>
+#include <algorithm>
 #include "DindelRealignWindow.h"
 
 const int DEBUGDINDELHMM=0;
@@ -37,10 +39,52 @@ class DindelHMM
         const DindelMultiHaplotype * m_pHaplotype;
 };
 
-template<int BandWidth> ReadHaplotypeAlignment DindelHMMForward(const DindelRead * pRead, 
-                                                                const DindelMultiHaplotype * pHaplotype, 
-                                                                int hFirstBase, 
-                                                                bool rcRead)
+// Precomputed emission and gap probabilities used by the forward recursion.
+// The per-base exp() of the quality score and the homopolymer gap model
+// are evaluated once up front instead of inside the inner loop
+class DindelHMMTables
+{
+    public:
+
+        // Constructor
+        DindelHMMTables();
+
+        // Functions
+        inline double getBaseCorrect(int q) const { return m_baseCorrect[clampQual(q)]; }
+        inline double getBaseIncorrect(int q) const { return m_baseIncorrect[clampQual(q)]; }
+        inline double getLogBaseCorrect(int q) const { return m_logBaseCorrect[clampQual(q)]; }
+
+        // The gap probability is already divided by two to give the insertion/deletion probability
+        inline double getGapProb(int hplen) const { return hplen < MAX_HP ? m_gapProb[hplen] : computeGapProb(hplen); }
+
+        static double computeGapProb(int hplen);
+
+        static const int MAX_QUAL = 100;
+        static const int MAX_HP = 256;
+
+    private:
+        
+        inline static int clampQual(int q) { return q < 0 ? 0 : (q > MAX_QUAL ? MAX_QUAL : q); }
+
+        // Data
+        double m_baseCorrect[MAX_QUAL + 1];
+        double m_baseIncorrect[MAX_QUAL + 1];
+        double m_logBaseCorrect[MAX_QUAL + 1];
+        double m_gapProb[MAX_HP];
+};
+
+extern const DindelHMMTables g_dindelHMMTables;
+
+// Banded forward recursion, parameterized by the floating point type used for the 
+// state vectors. The band is small and fixed at compile time so the state vectors live
+// on the stack and the per-state loops below have constant trip counts, which lets
+// the compiler vectorize them. Returns false if the state vector underflowed,
+// in which case the caller should retry in double precision.
+template<int BandWidth, typename Real> bool DindelHMMForwardPass(const DindelRead * pRead, 
+                                                                 const DindelMultiHaplotype * pHaplotype, 
+                                                                 int hFirstBase, 
+                                                                 bool rcRead,
+                                                                 ReadHaplotypeAlignment& rha)
 {
 	// code for aligning assuming last base of read is aligned to the haplotype
 	// hFirstBase gives relative haplotype base of first base in read
@@ -48,22 +92,30 @@ template<int BandWidth> ReadHaplotypeAlignment DindelHMMForward(const DindelRead
 	if (DEBUGDINDELHMM) 
         std::cerr << " _hmm bandwidth: " << BandWidth << " hFirstBase: " << hFirstBase << std::endl;
 	
-	double hp[] = { 2.9e-5, 2.9e-5,2.9e-5, 2.9e-5, 4.3e-5, 1.1e-4, 2.4e-4, 5.7e-4, 1.0e-3, 1.4e-3 };
-	const int MAXHP = 10;
+	const DindelHMMTables& tables = g_dindelHMMTables;
+
+	const Real GAP_EXT = 0.5;
+	const Real GAP_STOP = 1.0 - GAP_EXT;
+	const Real ONE = 1.0;
+	const Real TWO = 2.0;
+	const Real GAP_PROB_DEFAULT = tables.getGapProb(0);
 
-	//const int BandWidth=32;
-	const Float GAP_EXT = 0.5;
-	const Float GAP_STOP = 1.0 - GAP_EXT;
+	// Deletion length distribution
+	static const Real DEL_PROB[] = { 0.632333, 0.232622, 0.085577, 0.031482, 0.011582, 0.004261, 0.001567, 0.000577 };
+	const int MAX_DEL = sizeof(DEL_PROB) / sizeof(DEL_PROB[0]);
+
+	// The smallest value a state is allowed to take after normalization
+	const Real MIN_STATE_PROB = 1e-10;
 
 	int rlen = pRead->length();
 	int hlen = pHaplotype->length();
 
 	const std::string & hapSeq = pHaplotype->getSequence();
 
-	Float *curr = new Float[BandWidth*2];
-	Float *next = new Float[BandWidth*2];
-	Float *obs = new Float[BandWidth];
-	Float *gap_prob = new Float[BandWidth];
+	Real curr[BandWidth*2];
+	Real next[BandWidth*2];
+	Real obs[BandWidth];
+	Real gap_prob[BandWidth];
 
 	// initialize curr to ones
 	for (int x=0;x<BandWidth*2;x++) 
@@ -73,18 +125,20 @@ template<int BandWidth> ReadHaplotypeAlignment DindelHMMForward(const DindelRead
 	}
 	if (DEBUGDINDELHMM) std::cerr << "RLEN: " << rlen << std::endl;
 
+	// The log-likelihood is accumulated in double precision. The normalizing
+	// constants are multiplied into scale and only moved into the log domain 
+	// when scale approaches the limits of a double
 	double norm=0.0;
+	double scale=1.0;
 	for (int l=0;l<rlen;l++)
 	{
-		//if (DEBUGDINDELHMM) std::cerr << "\n\n**************************************************************" << std::endl;
 		int readBaseIndex = (!rcRead)?l:(rlen-1-l);
 		char rb = (!rcRead)?pRead->getBase(readBaseIndex):complement(pRead->getBase(readBaseIndex));
 
 		// probabilities of correctly and incorrectly observing the read base
-
-		Float pr=1.0 - exp ( (-2.3026/10.0)*double(pRead->getQual(readBaseIndex) ));
-        	Float p_base_correct = (.25+.75*pr);
-        	Float p_base_incorrect =(.75+1e-10-.75*pr);
+		int q = pRead->getQual(readBaseIndex);
+		Real p_base_correct = tables.getBaseCorrect(q);
+		Real p_base_incorrect = tables.getBaseIncorrect(q);
 
 		// lower and upper haplotype position for this read base
 
@@ -99,11 +153,10 @@ template<int BandWidth> ReadHaplotypeAlignment DindelHMMForward(const DindelRead
 
 		if (sb>=BandWidth && l<rlen-1) 
 		{
-			// this is left of the pHaplotype->
+			// this is left of the haplotype
 			// We don't need to explicitly do a forward pass, as the base is assumed to match by default.
-			norm += log(p_base_correct);
+			norm += tables.getLogBaseCorrect(q);
 			continue;
-			//sb = BandWidth;
 		}
 
 		int uh = lh+BandWidth;
@@ -113,44 +166,30 @@ template<int BandWidth> ReadHaplotypeAlignment DindelHMMForward(const DindelRead
 			if (eb<-1) eb=-1;
 			uh=hlen-1;              // both are inclusive
 		}
-		if (DEBUGDINDELHMM && 1)
+		if (DEBUGDINDELHMM)
 		{
-			std::cerr << "l: " << l << " lh: " << lh << " uh: " << uh << " sb: " << sb << " eb: " << eb << " "; // << std::endl;
+			std::cerr << "l: " << l << " lh: " << lh << " uh: " << uh << " sb: " << sb << " eb: " << eb << " ";
 		}
 
 		if (sb>=BandWidth) sb=BandWidth;
-		// set observations and gap_prob
-		for (int x=0;x<sb;++x)
-		{
-			obs[x] = p_base_correct;
-			gap_prob[x] = hp[0]/2.0; // divide by two to get the insertion/deletion prob
 
-		}
-		for (int x=eb+1;x<BandWidth;++x)
+		// set observations and gap_prob
+		for (int x=0;x<BandWidth;++x)
 		{
 			obs[x] = p_base_correct;
-			gap_prob[x] = hp[0]/2.0;
+			gap_prob[x] = GAP_PROB_DEFAULT;
 		}
 
 		int h=lh;
 		for (int x=sb;x<=eb;++x,++h)
 		{
 			obs[x] = (hapSeq[h]==rb)?p_base_correct:p_base_incorrect;
-			int hplen = pHaplotype->getHomopolymerLength(h);
-			Float prob;
-			if (hplen<MAXHP) prob=hp[hplen]; else
-			{
-				prob=hp[9]+4.3e-4*double(hplen-10);
-				if (prob>0.95) prob=0.95;
-			}
-			gap_prob[x]=prob/2.0;
+			gap_prob[x] = tables.getGapProb(pHaplotype->getHomopolymerLength(h));
 		}
 
-		if (DEBUGDINDELHMM && 1)
+		if (DEBUGDINDELHMM)
 		{
-			//std::cerr << "l: " << l << std::endl;
 			for (int x=0;x<BandWidth;x++) std::cerr << "(" << obs[x] << " gp " << log(gap_prob[x]) << ")" << std::endl;
-			//std::cerr << "norm: " << norm << std::endl;
 		}
 
 		// UPDATES
@@ -158,9 +197,9 @@ template<int BandWidth> ReadHaplotypeAlignment DindelHMMForward(const DindelRead
 		{
 			// do forward pass
 
-		    	// P( INS(l) | INS(l+1) ) P (l+1)
+			// P( INS(l) | INS(l+1) ) P (l+1)
 
-		    	// INSERTION <= INSERTION
+			// INSERTION <= INSERTION
 			for (int x=1;x<BandWidth;++x) next[BandWidth+x-1] += GAP_EXT*curr[BandWidth+x]*p_base_correct;
 
 			// INSERTION <= NO_INSERTION
@@ -173,60 +212,66 @@ template<int BandWidth> ReadHaplotypeAlignment DindelHMMForward(const DindelRead
 			for (int x=0;x<BandWidth;++x) next[BandWidth+x] += GAP_STOP*curr[x];
 
 			// NO_INSERTION <= NO_INSERTION
-			for (int x=0;x<BandWidth;++x) next[x] += (1.0-2.0*gap_prob[x])*curr[x]; // this is the no-indel transition
-			for (int x=0;x<BandWidth-1;++x) next[x+1] += 0.632333*gap_prob[x]*curr[x]; // deletion of 1
-    			for (int x=0;x<BandWidth-2;++x) next[x+2] += 0.232622*gap_prob[x]*curr[x];
-    			for (int x=0;x<BandWidth-3;++x) next[x+3] += 0.085577*gap_prob[x]*curr[x];
-    			for (int x=0;x<BandWidth-4;++x) next[x+4] += 0.031482*gap_prob[x]*curr[x];
-			
-    			for (int x=0;x<BandWidth-5;++x) next[x+5] += 0.011582*gap_prob[x]*curr[x];
-    			for (int x=0;x<BandWidth-6;++x) next[x+6] += 0.004261*gap_prob[x]*curr[x];
-    			for (int x=0;x<BandWidth-7;++x) next[x+7] += 0.001567*gap_prob[x]*curr[x];
-    			for (int x=0;x<BandWidth-8;++x) next[x+8] += 0.000577*gap_prob[x]*curr[x];
-			
+			for (int x=0;x<BandWidth;++x) next[x] += (ONE-TWO*gap_prob[x])*curr[x]; // this is the no-indel transition
+
+			// deletions of length 1..MAX_DEL, gathered into each destination state
+			Real gap_curr[BandWidth];
+			for (int x=0;x<BandWidth;++x) gap_curr[x] = gap_prob[x]*curr[x];
+			for (int y=1;y<BandWidth;++y) 
+			{
+				Real del=0.0;
+				for (int d=0;d<MAX_DEL && d<y;++d)
+					del += DEL_PROB[d]*gap_curr[y-d-1];
+				next[y] += del;
+			}
 		}
 		else
 		{
 			if (DEBUGDINDELHMM) std::cerr << "normalizing" << std::endl;
 			// add prior and observations for last locus
-			for (int x=0;x<BandWidth;x++) next[x] = curr[x]*obs[x]*(1.0-2.0*gap_prob[x])/Float(BandWidth);
-			for (int x=0;x<BandWidth;x++) next[x+BandWidth] = curr[x+BandWidth]*p_base_correct*gap_prob[x]/Float(BandWidth);
+			for (int x=0;x<BandWidth;x++) next[x] = curr[x]*obs[x]*(ONE-TWO*gap_prob[x])/Real(BandWidth);
+			for (int x=0;x<BandWidth;x++) next[x+BandWidth] = curr[x+BandWidth]*p_base_correct*gap_prob[x]/Real(BandWidth);
 		}
 
 		// normalize
-		Float sum=0.0;
+		Real sum=0.0;
 		for (int x=0;x<BandWidth*2;x++) sum += next[x];
-		norm += log(sum);
 
+		// The states are clamped after every step so this should only trigger
+		// when Real does not have the range to represent the products above
+		if (!(sum > std::numeric_limits<Real>::min()) || sum > std::numeric_limits<Real>::max())
+			return false;
+
+		scale *= sum;
+		if(scale < 1e-250 || scale > 1e250)
+		{
+			norm += log(scale);
+			scale = 1.0;
+		}
 
 		for (int x=0;x<BandWidth*2;x++)
 		{
-			next[x]/=sum;
-			if (next[x]<1e-10) next[x]=1e-10; // introduces small rounding error....
-			curr[x]=0.0; // note curr will be swapped with next below
+			Real v = std::max(next[x]/sum, MIN_STATE_PROB); // introduces small rounding error....
+
+			// next becomes the current state for the following read base
+			curr[x]=v;
+			next[x]=0.0;
 		}
 
 		if (DEBUGDINDELHMM)
 		{
-			//std::cerr << "xyz l: " << l << std::endl;
-			if (1) for (int x=0;x<BandWidth;x++) std::cerr << "x: " << x << "\t" << next[x] << " " << next[x+BandWidth] << std::endl;
+			for (int x=0;x<BandWidth;x++) std::cerr << "x: " << x << "\t" << curr[x] << " " << curr[x+BandWidth] << std::endl;
 			std::cerr << "[ " << p_base_correct << " l: " << l << " " << " norm: " << norm << " sum: " << sum << "]" << std::endl;
 		}
 
-
 		// END UPDATES
-
-		// flip next and curr
-		Float *tmp = next;
-		next = curr;
-		curr = tmp;
 	} // end forward passes
 
 	// norm should give the log-likelihood
-
+	norm += log(scale);
 
 	// check if there is a state that has posterior >0.95
-	Float postProb = -1.0;
+	Real postProb = -1.0;
 	int state = -1;
 	for (int x=0;x<BandWidth;x++) 
 	{
@@ -238,20 +283,28 @@ template<int BandWidth> ReadHaplotypeAlignment DindelHMMForward(const DindelRead
 	}
 	int hapPosLastReadBase = (state!=-1)?(hFirstBase+rlen-1+state):-1;
 
-	// cleanup
-	delete[] curr;
-	delete[] next;
-	delete[] obs;
-	delete[] gap_prob;
-
-	//std::cerr << "NORM POS " << norm << " hlen: " << hlen << " check: " << (hapPosLastReadBase-rlen+1>=hlen) << " check2: " << (hFirstBase+BandWidth>=hlen) << std::endl;
 	assert(norm<0.0);
 
-	ReadHaplotypeAlignment rha;
-	//rha.logLik = addLogs(norm, -pRead->getMappingQual()*.23026-log(double(BandWidth))); // cap based on mapping quality
 	rha.logLik = norm;
 	rha.postProbLastReadBase = postProb;
 	rha.hapPosLastReadBase=hapPosLastReadBase;
+	return true;
+}
+
+// Align the read to the haplotype using the single precision recursion,
+// falling back to double precision if the state vector underflows
+template<int BandWidth> ReadHaplotypeAlignment DindelHMMForward(const DindelRead * pRead, 
+                                                                const DindelMultiHaplotype * pHaplotype, 
+                                                                int hFirstBase, 
+                                                                bool rcRead)
+{
+	ReadHaplotypeAlignment rha;
+	if(!DindelHMMForwardPass<BandWidth, float>(pRead, pHaplotype, hFirstBase, rcRead, rha))
+	{
+		bool success = DindelHMMForwardPass<BandWidth, double>(pRead, pHaplotype, hFirstBase, rcRead, rha);
+		assert(success);
+		(void)success;
+	}
 	return rha;
 }
 
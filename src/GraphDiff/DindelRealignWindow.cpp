@@ -38,6 +38,10 @@
 #include "Quality.h"
 #include <cmath>
 
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
+
 const int DINDEL_DEBUG=0;
 const int QUIET=1;
 const int ALWAYS_REALIGN=1;
@@ -1901,32 +1905,18 @@ void MaPosToCandidateSNP::addSNP(int readIndex, int refPos, char refBase, char a
 
 void DindelRealignWindow::HMMAlignReadAgainstHaplotypes(size_t readIndex, size_t firstHap, size_t lastHap, 
                                                         const std::vector<double> & lpCorrect, const std::vector<double> & lpError,
-                                                        HashMap<std::string, ReadHaplotypeAlignment>& hmm_alignment_cache)
+                                                        const ReadHaplotypeAlignment* pHMMAlignments,
+                                                        const std::vector<size_t>& hapToUnique)
 {
     const std::vector<DindelMultiHaplotype>& haplotypes = m_dindelWindow.getHaplotypes();
-    DindelRead& read = m_pDindelReads->at(readIndex);
+    const DindelRead& read = m_pDindelReads->at(readIndex);
 
     for (size_t h=firstHap;h<=lastHap;++h)
     {
         const DindelMultiHaplotype & haplotype = haplotypes[h];
 
-        // Look up the read in the alignment cache using the haplotype index, the read sequence and read quality string as a key
-        std::stringstream cache_key;
-        cache_key << h << ":" << read.getSequence() << ":" << read.getQualString();
-        ReadHaplotypeAlignment rha_hmm;
-
-        HashMap<std::string, ReadHaplotypeAlignment>::iterator iter = hmm_alignment_cache.find(cache_key.str());
-        if(iter != hmm_alignment_cache.end())
-        {
-            // Use the cached alignment
-            rha_hmm = iter->second;
-        }
-        else
-        {
-            DindelHMM hmm(read, haplotype);
-            rha_hmm = hmm.getAlignment();
-            hmm_alignment_cache[cache_key.str()] = rha_hmm;
-        }
+        // Start from the HMM alignment of this read's sequence against this haplotype's sequence
+        ReadHaplotypeAlignment rha_hmm = pHMMAlignments[hapToUnique[h - firstHap]];
 
         if (DINDEL_DEBUG)
         {
@@ -1967,30 +1957,99 @@ void DindelRealignWindow::computeReadHaplotypeAlignmentsUsingHMM(size_t firstHap
     if (DINDEL_DEBUG)
         std::cout << "DindelRealignWindow::computeReadHaplotypeAlignmentsUsingHMM firstHap " << firstHap << " " << lastHap << std::endl;
     // store information whether reads were realigned against all haplotypes or just the reference haplotype?
-    const std::vector<DindelMultiHaplotype> haplotypes = m_dindelWindow.getHaplotypes();
+    const std::vector<DindelMultiHaplotype>& haplotypes = m_dindelWindow.getHaplotypes();
+    std::vector<DindelRead>& reads = *m_pDindelReads;
 
     assert(haplotypes.size()>lastHap);
     for (size_t h=firstHap;h<=lastHap;h++)
     {
         if (haplotypes[h].isReference())
-            hapReadAlignments.push_back( std::vector<ReadHaplotypeAlignment>(m_pDindelReads->size(), ReadHaplotypeAlignment(realignParameters.minLogLikAlignToRef,-1)));
+            hapReadAlignments.push_back( std::vector<ReadHaplotypeAlignment>(reads.size(), ReadHaplotypeAlignment(realignParameters.minLogLikAlignToRef,-1)));
         else
-            hapReadAlignments.push_back( std::vector<ReadHaplotypeAlignment>(m_pDindelReads->size(), ReadHaplotypeAlignment(realignParameters.minLogLikAlignToAlt,-1)));
+            hapReadAlignments.push_back( std::vector<ReadHaplotypeAlignment>(reads.size(), ReadHaplotypeAlignment(realignParameters.minLogLikAlignToAlt,-1)));
     }
     
-    // We cache the results of the HMM alignment to save time when the read set contains many duplicate reads (like 1000 genomes).
-    HashMap<std::string, ReadHaplotypeAlignment> hmm_alignment_cache;
+    // The HMM alignment only depends on the read sequence, qualities and orientation 
+    // and the haplotype sequence. We collapse identical reads (common when the read set contains
+    // many duplicate reads, like 1000 genomes) and identical haplotypes so that each
+    // distinct pair is only aligned once.
+    std::vector<size_t> readToUnique(reads.size());
+    std::vector<size_t> uniqueReads;
+    HashMap<std::string, size_t> readKeyMap;
+    for (size_t r=0;r<reads.size();r++)
+    {
+        std::string key = std::string(reads[r].getRCRead() ? "-" : "+") + reads[r].getSequence() + ":" + reads[r].getQualString();
+        HashMap<std::string, size_t>::iterator iter = readKeyMap.find(key);
+        if(iter != readKeyMap.end())
+        {
+            readToUnique[r] = iter->second;
+        }
+        else
+        {
+            readToUnique[r] = uniqueReads.size();
+            readKeyMap.insert(std::make_pair(key, uniqueReads.size()));
+            uniqueReads.push_back(r);
+
+            // The seed hash of the read is built on first use. Build it now
+            // so the read is not modified once it is shared between threads
+            reads[r].getHashKeys();
+        }
+    }
 
-    for (size_t r=0;r<m_pDindelReads->size();r++)
+    std::vector<size_t> hapToUnique(lastHap - firstHap + 1);
+    std::vector<size_t> uniqueHaps;
+    HashMap<std::string, size_t> hapKeyMap;
+    for (size_t h=firstHap;h<=lastHap;h++)
     {
-        const DindelRead & read = (*m_pDindelReads)[r];
+        const std::string& key = haplotypes[h].getSequence();
+        HashMap<std::string, size_t>::iterator iter = hapKeyMap.find(key);
+        if(iter != hapKeyMap.end())
+        {
+            hapToUnique[h - firstHap] = iter->second;
+        }
+        else
+        {
+            hapToUnique[h - firstHap] = uniqueHaps.size();
+            hapKeyMap.insert(std::make_pair(key, uniqueHaps.size()));
+            uniqueHaps.push_back(h);
+        }
+    }
+
+    if (DINDEL_DEBUG)
+        std::cout << "DindelRealignWindow::computeReadHaplotypeAlignmentsUsingHMM unique reads: " << uniqueReads.size() << " unique haplotypes: " << uniqueHaps.size() << std::endl;
+
+    // Fill in the distinct read x haplotype HMM likelihood matrix. Each cell is independent
+    // so the result does not depend on the number of threads.
+    size_t numUniqueHaps = uniqueHaps.size();
+    std::vector<ReadHaplotypeAlignment> hmmAlignments(uniqueReads.size() * numUniqueHaps);
+
+#if HAVE_OPENMP
+    #pragma omp parallel for schedule(dynamic, DINDEL_HMM_READ_BLOCK_SIZE)
+#endif
+    for (size_t i=0;i<uniqueReads.size();i++)
+    {
+        DindelRead & read = reads[uniqueReads[i]];
+        for (size_t j=0;j<numUniqueHaps;j++)
+        {
+            DindelHMM hmm(read, haplotypes[uniqueHaps[j]]);
+            hmmAlignments[i * numUniqueHaps + j] = hmm.getAlignment();
+        }
+    }
+
+    // Expand the matrix back out to every read and run the ungapped alignments
+#if HAVE_OPENMP
+    #pragma omp parallel for schedule(dynamic, DINDEL_HMM_READ_BLOCK_SIZE)
+#endif
+    for (size_t r=0;r<reads.size();r++)
+    {
+        const DindelRead & read = reads[r];
         if  (DINDEL_DEBUG) std::cout << "\n*****\nDindelRealignWindow::computeReadHaplotypeAlignmentsUsingHMM reads[" << r << "]: " << read.getID() << std::endl;
     
         // only realign if it has not yet been found to map to the reference
         std::vector<double> lpCorrect, lpError;
         read.getLogProbCorrectError(lpCorrect, lpError);
 
-        HMMAlignReadAgainstHaplotypes(r, firstHap, lastHap, lpCorrect, lpError, hmm_alignment_cache);
+        HMMAlignReadAgainstHaplotypes(r, firstHap, lastHap, lpCorrect, lpError, &hmmAlignments[readToUnique[r] * numUniqueHaps], hapToUnique);
     }
 }
 
@@ -2139,6 +2198,7 @@ void DindelRealignWindow::doEM(const std::vector< std::vector<double> > & hrLik,
     std::vector<double> z(nh*nr,0.0); // expectations of read-haplotype indicator variables
     std::vector<double> pi(nh); // log of haplotype frequencies
     std::vector<double> nk(nh,0.0); // counts for each haplotype
+    std::vector<double> readLik(nr,0.0); // log-likelihood of each read under the current frequencies
 
     std::vector<double> hapFreqs=nk;
 
@@ -2162,8 +2222,12 @@ void DindelRealignWindow::doEM(const std::vector< std::vector<double> > & hrLik,
     {
 
         // compute expectation of indicator variables
-        for (size_t h=0;h<nh;h++) nk[h]=0.0;
-
+        // The reads are independent so the responsibilities are computed in parallel. 
+        // The counts are summed afterwards in read order so the estimates do not
+        // depend on the number of threads.
+#if HAVE_OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
         for (size_t r=0;r<nr;r++)
         {
             double lognorm=-HUGE_VAL;
@@ -2173,23 +2237,30 @@ void DindelRealignWindow::doEM(const std::vector< std::vector<double> > & hrLik,
                 z[h*nr+r]=pi[h]+(rl[h*nr+r]);
                 lognorm=addLogs(lognorm, z[h*nr+r]);
             }
-            // normalize and compute counts
+            // normalize
             for (size_t h=0;h<nh;h++)
             {
                 z[nr*h+r]-=lognorm;
                 z[nr*h+r]=exp(z[nr*h+r]);
-
-                nk[h]+=z[nr*h+r];
             }
         }
 
+        // compute counts
+        for (size_t h=0;h<nh;h++) 
+        {
+            nk[h]=0.0;
+            for (size_t r=0;r<nr;r++)
+                nk[h]+=z[nr*h+r];
+        }
 
        // compute frequencies
        double zh = 0.0;
        for (size_t h=0;h<nh;h++) zh += nk[h];
        for (size_t h=0;h<nh;h++) pi[h] = log(nk[h]/zh); 
 
-       eNew = 0.0;
+#if HAVE_OPENMP
+       #pragma omp parallel for schedule(static)
+#endif
        for (size_t r=0;r<nr;r++)
        {
            double t = -HUGE_VAL;
@@ -2198,8 +2269,12 @@ void DindelRealignWindow::doEM(const std::vector< std::vector<double> > & hrLik,
                // compute responsibilities
                t = addLogs(t, pi[h]+rl[h*nr+r]);
            }
-           eNew += t;
+           readLik[r] = t;
        }
+
+       eNew = 0.0;
+       for (size_t r=0;r<nr;r++)
+           eNew += readLik[r];
  
 
        if (DINDEL_DEBUG) std::cout << " EM iter: " << iter << " " << eNew << " eOld-eNew: " <<  eOld-eNew << std::endl;
@@ -29,6 +29,7 @@ enum DindelWindowCandHapAlgorithm {LINEAR} ;
 // Constants
 const size_t DINDEL_HASH_SIZE=8;
 const int DINDEL_HMM_BANDWIDTH=8;
+const int DINDEL_HMM_READ_BLOCK_SIZE=16; // number of reads per parallel task when filling the likelihood matrix
 
 // Event types
 const int DELETION_NOVEL_SEQUENCE = -1;
@@ -968,7 +969,8 @@ class DindelRealignWindow
                                            size_t lastHap, 
                                            const std::vector<double> & lpCorrect, 
                                            const std::vector<double> & lpError,
-                                           HashMap<std::string, ReadHaplotypeAlignment>& hmm_alignment_cache);
+                                           const ReadHaplotypeAlignment* pHMMAlignments,
+                                           const std::vector<size_t>& hapToUnique);
 
         // HAPLOTYPE FREQUENCY ESTIMATION BUSINESS
 
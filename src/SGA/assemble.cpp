@@ -15,6 +15,18 @@
 #include "SGVisitors.h"
 #include "Timer.h"
 #include "EncodedString.h"
+#include "ASQGIndex.h"
+#include "SGACommon.h"
+#include "BWT.h"
+#include "SuffixArray.h"
+#include "ReadInfoTable.h"
+#include "OverlapAlgorithm.h"
+#include "OverlapGraphProcess.h"
+#include "SequenceProcessFramework.h"
+
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
 
 //
 // Getopt
@@ -28,16 +40,29 @@ SUBPROGRAM " Version " PACKAGE_VERSION "\n"
 
 static const char *ASSEMBLE_USAGE_MESSAGE =
 "Usage: " PACKAGE_NAME " " SUBPROGRAM " [OPTION] ... ASQGFILE\n"
+"   or: " PACKAGE_NAME " " SUBPROGRAM " --overlap [OPTION] ... READSFILE\n"
 "Create contigs from the assembly graph ASQGFILE.\n"
+"With --overlap, compute the overlaps between the reads in READSFILE and build the graph\n"
+"in memory, without writing the hits and ASQG files of sga overlap.\n"
 "\n"
 "  -v, --verbose                        display verbose output\n"
 "      --help                           display this help and exit\n"
 "      -o, --out-prefix=NAME            use NAME as the prefix of the output files (output files will be NAME-contigs.fa, etc)\n"
 "      -m, --min-overlap=LEN            only use overlaps of at least LEN. This can be used to filter\n"
 "                                       the overlap set so that the overlap step only needs to be run once.\n"
+"                                       With --overlap, this is the minimum overlap computed (default: 45)\n"
 "          --transitive-reduction       remove transitive edges from the graph. Off by default.\n"
 "          --max-edges=N                limit each vertex to a maximum of N edges. For highly repetitive regions\n"
 "                                       this helps save memory by culling excessive edges around unresolvable repeats (default: 128)\n"
+"      -t, --threads=NUM                use NUM worker threads to compute the overlaps with --overlap, or to assemble\n"
+"                                       the partitions with --partitions (default: no threading)\n"
+"          --partitions=N               split the graph into N partitions that share no edges and assemble them independently.\n"
+"                                       The partitions are assembled in parallel using --threads. Only the partitions being assembled\n"
+"                                       are held in memory, so the memory required is about threads/N of the whole graph\n"
+"\nOverlap parameters, used with --overlap:\n"
+"          --overlap                    READSFILE is a set of reads indexed with sga index instead of an ASQG file\n"
+"      -e, --error-rate                 the maximum error rate allowed to consider two sequences aligned (default: exact matches only)\n"
+"      -p, --prefix=PREFIX              use PREFIX for the names of the index files (default: prefix of the input file)\n"
 "\nBubble/Variation removal parameters:\n"
 "      -b, --bubble=N                   perform N bubble removal steps (default: 3)\n"
 "      -d, --max-divergence=F           only remove variation if the divergence between sequences is less than F (default: 0.05)\n"
@@ -82,11 +107,21 @@ namespace opt
     static bool bValidate;
     static bool bExact = true;
     static bool bPerformTR = false;
+
+    // Overlap parameters
+    static bool bOverlapReads = false;
+    static int numThreads = 1;
+    static double errorRate = 0.0f;
+    static std::string prefix;
+
+    // Partition parameters
+    static size_t numPartitions = 1;
+    static std::string outPrefix;
 }
 
-static const char* shortopts = "p:o:m:d:g:b:a:r:x:l:sv";
+static const char* shortopts = "p:o:m:d:g:b:a:r:x:l:t:e:sv";
 
-enum { OPT_HELP = 1, OPT_VERSION, OPT_VALIDATE, OPT_EDGESTATS, OPT_EXACT, OPT_MAXINDEL, OPT_TR, OPT_MAXEDGES };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_VALIDATE, OPT_EDGESTATS, OPT_EXACT, OPT_MAXINDEL, OPT_TR, OPT_MAXEDGES, OPT_OVERLAP, OPT_PARTITIONS };
 
 static const struct option longopts[] = {
     { "verbose",               no_argument,       NULL, 'v' },
@@ -100,6 +135,11 @@ static const struct option longopts[] = {
     { "max-gap-divergence",    required_argument, NULL, 'g' },
     { "max-indel",             required_argument, NULL, OPT_MAXINDEL },
     { "max-edges",             required_argument, NULL, OPT_MAXEDGES },
+    { "overlap",               no_argument,       NULL, OPT_OVERLAP },
+    { "partitions",            required_argument, NULL, OPT_PARTITIONS },
+    { "threads",               required_argument, NULL, 't' },
+    { "error-rate",            required_argument, NULL, 'e' },
+    { "prefix",                required_argument, NULL, 'p' },
     { "smooth",                no_argument,       NULL, 's' },
     { "transitive-reduction",  no_argument,       NULL, OPT_TR },
     { "edge-stats",            no_argument,       NULL, OPT_EDGESTATS },
@@ -126,7 +166,35 @@ int assembleMain(int argc, char** argv)
 void assemble()
 {
     Timer t("sga assemble");
-    StringGraph* pGraph = SGUtil::loadASQG(opt::asqgFile, opt::minOverlap, true, opt::maxEdges);
+    if(opt::numPartitions > 1)
+    {
+        assemblePartitions();
+    }
+    else
+    {
+        StringGraph* pGraph;
+        if(opt::bOverlapReads)
+            pGraph = buildGraphFromReads();
+        else
+            pGraph = SGUtil::loadASQG(opt::asqgFile, opt::minOverlap, true, opt::maxEdges);
+
+        assembleGraph(pGraph, opt::outContigsFile, opt::outVariantsFile, opt::outGraphFile, "contig-");
+        delete pGraph;
+    }
+
+    // Index the graph for random access when it is written uncompressed.
+    // The index is built by reading the file back so the graph is freed first.
+    if(ASQGIndex::isIndexable(opt::outGraphFile))
+        ASQGIndex::build(opt::outGraphFile);
+}
+
+// Simplify the graph and write the contigs, variants and final graph
+void assembleGraph(StringGraph* pGraph, 
+                   const std::string& contigsFile, 
+                   const std::string& variantsFile, 
+                   const std::string& graphFile,
+                   const std::string& contigPrefix)
+{
     if(opt::bExact)
         pGraph->setExactMode(true);
     pGraph->printMemSize();
@@ -198,14 +266,14 @@ void assemble()
     if(opt::numBubbleRounds > 0)
     {
         std::cout << "\nPerforming variation smoothing\n";
-        SGSmoothingVisitor smoothingVisit(opt::outVariantsFile, opt::maxBubbleGapDivergence, opt::maxBubbleDivergence, opt::maxIndelLength);
+        SGSmoothingVisitor smoothingVisit(variantsFile, opt::maxBubbleGapDivergence, opt::maxBubbleDivergence, opt::maxIndelLength);
         int numSmooth = opt::numBubbleRounds;
         while(numSmooth-- > 0)
             pGraph->visit(smoothingVisit);
         pGraph->simplify();
     }
     
-    pGraph->renameVertices("contig-");
+    pGraph->renameVertices(contigPrefix);
 
     std::cout << "\n[Stats] Final graph:\n";
     pGraph->visit(statsVisit);
@@ -214,12 +282,168 @@ void assemble()
     //pGraph->renameVertices("contig-");
 
     // Write the results
-    SGFastaVisitor av(opt::outContigsFile);
+    SGFastaVisitor av(contigsFile);
     pGraph->visit(av);
 
-    pGraph->writeASQG(opt::outGraphFile);
+    pGraph->writeASQG(graphFile);
+}
+
+// Split the graph into partitions that share no edges and assemble
+// them independently. The partitions are assembled in parallel and 
+// their results are concatenated.
+void assemblePartitions()
+{
+    std::string partitionPrefix = opt::outPrefix + "-partition";
+    StringVector partitionFiles = SGUtil::partitionASQG(opt::asqgFile, opt::numPartitions, partitionPrefix);
+    size_t numPartitions = partitionFiles.size();
+
+    StringVector contigsFiles(numPartitions);
+    StringVector variantsFiles(numPartitions);
+    StringVector graphFiles(numPartitions);
+    for(size_t i = 0; i < numPartitions; ++i)
+    {
+        std::stringstream ss;
+        ss << partitionPrefix << "-" << i;
+        contigsFiles[i] = ss.str() + "-contigs.fa";
+        variantsFiles[i] = ss.str() + "-variants.fa";
+        graphFiles[i] = ss.str() + "-graph.asqg.gz";
+    }
+
+    // At most numThreads partitions are in memory at once
+#if HAVE_OPENMP
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(opt::numThreads)
+#endif
+    for(size_t i = 0; i < numPartitions; ++i)
+    {
+        std::stringstream ss;
+        ss << "contig-" << i << "-";
+
+        StringGraph* pGraph = SGUtil::loadASQG(partitionFiles[i], opt::minOverlap, true, opt::maxEdges);
+        assembleGraph(pGraph, contigsFiles[i], variantsFiles[i], graphFiles[i], ss.str());
+        delete pGraph;
+        unlink(partitionFiles[i].c_str());
+    }
+
+    // Concatenate the contigs and variants
+    concatenateFiles(contigsFiles, opt::outContigsFile);
+    if(opt::numBubbleRounds > 0)
+        concatenateFiles(variantsFiles, opt::outVariantsFile);
+
+    // Merge the graphs. All the vertex records must come before the edge records
+    ASQG::HeaderRecord headerRecord;
+    bool hasContainment = false;
+    bool hasTransitive = false;
+    for(size_t i = 0; i < numPartitions; ++i)
+    {
+        std::istream* pReader = createReader(graphFiles[i]);
+        std::string line;
+        getline(*pReader, line);
+        ASQG::HeaderRecord partitionHeader(line);
+        if(i == 0)
+            headerRecord = partitionHeader;
+        hasContainment = hasContainment || partitionHeader.getContainmentTag().get();
+        hasTransitive = hasTransitive || partitionHeader.getTransitiveTag().get();
+        delete pReader;
+    }
+    headerRecord.setContainmentTag(hasContainment);
+    headerRecord.setTransitiveTag(hasTransitive);
+
+    std::ostream* pWriter = createWriter(opt::outGraphFile);
+    headerRecord.write(*pWriter);
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        ASQG::RecordType copyType = (pass == 0) ? ASQG::RT_VERTEX : ASQG::RT_EDGE;
+        for(size_t i = 0; i < numPartitions; ++i)
+        {
+            std::istream* pReader = createReader(graphFiles[i]);
+            std::string line;
+            while(getline(*pReader, line))
+            {
+                if(ASQG::getRecordType(line) == copyType)
+                    *pWriter << line << "\n";
+            }
+            delete pReader;
+        }
+    }
+    delete pWriter;
+
+    for(size_t i = 0; i < numPartitions; ++i)
+        unlink(graphFiles[i].c_str());
+}
 
-    delete pGraph;
+// Write the contents of the input files to outFile and delete them
+void concatenateFiles(const StringVector& inFiles, const std::string& outFile)
+{
+    std::ofstream writer(outFile.c_str());
+    for(size_t i = 0; i < inFiles.size(); ++i)
+    {
+        std::ifstream reader(inFiles[i].c_str());
+        if(reader.peek() != std::ifstream::traits_type::eof())
+            writer << reader.rdbuf();
+        reader.close();
+        unlink(inFiles[i].c_str());
+    }
+}
+
+// Build the string graph by computing the overlaps between the reads.
+// This is the graph that would be loaded from the ASQG file written by
+// sga overlap with the same parameters.
+StringGraph* buildGraphFromReads()
+{
+    std::string indexPrefix = opt::prefix.empty() ? stripExtension(opt::asqgFile) : opt::prefix;
+    BWT* pBWT = new BWT(indexPrefix + BWT_EXT);
+    BWT* pRBWT = new BWT(indexPrefix + RBWT_EXT);
+    OverlapAlgorithm* pOverlapper = new OverlapAlgorithm(pBWT, pRBWT, opt::errorRate, 0, 0, true);
+    pOverlapper->setExactModeOverlap(opt::errorRate <= 0.0001);
+    pOverlapper->setExactModeIrreducible(opt::errorRate <= 0.0001);
+
+    // The suffix array indices and the read table are used to convert the overlap blocks to overlaps
+    SuffixArray* pFwdSAI = new SuffixArray(indexPrefix + SAI_EXT);
+    SuffixArray* pRevSAI = new SuffixArray(indexPrefix + RSAI_EXT);
+    ReadInfoTable* pRIT = new ReadInfoTable(opt::asqgFile, indexPrefix, pFwdSAI->getNumStrings());
+
+    // Add a vertex for every read before any of the edges are added
+    StringGraph* pGraph = SGUtil::loadFASTA(opt::asqgFile);
+    pGraph->setMinOverlap(opt::minOverlap);
+    pGraph->setErrorRate(opt::errorRate);
+    pGraph->setContainmentFlag(true);
+    pGraph->setTransitiveFlag(false);
+
+    // The overlaps are computed by the worker threads and added to the graph in the order of the reads
+    OverlapGraphPostProcess postProcessor(pGraph, opt::maxEdges);
+    if(opt::numThreads <= 1)
+    {
+        printf("[%s] computing overlaps in serial mode\n", SUBPROGRAM);
+        OverlapGraphProcess processor(pOverlapper, opt::minOverlap, pRIT, pFwdSAI, pRevSAI);
+        SequenceProcessFramework::processSequencesSerial<SequenceWorkItem,
+                                                         OverlapGraphResult, 
+                                                         OverlapGraphProcess, 
+                                                         OverlapGraphPostProcess>(opt::asqgFile, &processor, &postProcessor);
+    }
+    else
+    {
+        printf("[%s] computing overlaps with %d threads\n", SUBPROGRAM, opt::numThreads);
+        std::vector<OverlapGraphProcess*> processorVector;
+        for(int i = 0; i < opt::numThreads; ++i)
+            processorVector.push_back(new OverlapGraphProcess(pOverlapper, opt::minOverlap, pRIT, pFwdSAI, pRevSAI));
+
+        SequenceProcessFramework::processSequencesParallel<SequenceWorkItem,
+                                                           OverlapGraphResult, 
+                                                           OverlapGraphProcess, 
+                                                           OverlapGraphPostProcess>(opt::asqgFile, processorVector, &postProcessor);
+        for(int i = 0; i < opt::numThreads; ++i)
+            delete processorVector[i];
+    }
+
+    delete pRIT;
+    delete pFwdSAI;
+    delete pRevSAI;
+    delete pOverlapper;
+    delete pBWT;
+    delete pRBWT;
+
+    SGUtil::finishLoading(pGraph);
+    return pGraph;
 }
 
 // 
@@ -248,6 +472,11 @@ void parseAssembleOptions(int argc, char** argv)
             case 'x': arg >> opt::numTrimRounds; break;
             case 'r': arg >> opt::resolveSmallRepeatLen; break;
             case OPT_MAXEDGES: arg >> opt::maxEdges; break;
+            case OPT_OVERLAP: opt::bOverlapReads = true; break;
+            case OPT_PARTITIONS: arg >> opt::numPartitions; break;
+            case 't': arg >> opt::numThreads; break;
+            case 'e': arg >> opt::errorRate; break;
+            case 'p': arg >> opt::prefix; break;
             case OPT_TR: opt::bPerformTR = true; break;
             case OPT_MAXINDEL: arg >> opt::maxIndelLength; break;
             case OPT_EXACT: opt::bExact = true; break;
@@ -264,6 +493,7 @@ void parseAssembleOptions(int argc, char** argv)
     }
 
     // Build the output names
+    opt::outPrefix = prefix;
     opt::outContigsFile = prefix + "-contigs.fa";
     opt::outVariantsFile = prefix + "-variants.fa";
     opt::outGraphFile = prefix + "-graph.asqg.gz";
@@ -279,6 +509,24 @@ void parseAssembleOptions(int argc, char** argv)
         die = true;
     }
 
+    if(opt::numThreads <= 0)
+    {
+        std::cerr << SUBPROGRAM ": invalid number of threads: " << opt::numThreads << "\n";
+        die = true;
+    }
+
+    if(opt::numPartitions == 0)
+    {
+        std::cerr << SUBPROGRAM ": invalid number of partitions: " << opt::numPartitions << "\n";
+        die = true;
+    }
+
+    if(opt::numPartitions > 1 && opt::bOverlapReads)
+    {
+        std::cerr << SUBPROGRAM ": --partitions cannot be used with --overlap\n";
+        die = true;
+    }
+
     if (die) 
     {
         std::cout << "\n" << ASSEMBLE_USAGE_MESSAGE;
@@ -287,4 +535,12 @@ void parseAssembleOptions(int argc, char** argv)
 
     // Parse the input filename
     opt::asqgFile = argv[optind++];
+
+    if(opt::bOverlapReads)
+    {
+        if(opt::minOverlap == 0)
+            opt::minOverlap = DEFAULT_MIN_OVERLAP;
+        if(opt::errorRate <= 0)
+            opt::errorRate = 0.0f;
+    }
 }
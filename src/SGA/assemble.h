@@ -10,10 +10,19 @@
 #define ASSEMBLE_H
 #include <getopt.h>
 #include "config.h"
+#include "SGUtil.h"
 
 // functions
 int assembleMain(int argc, char** argv);
 void parseAssembleOptions(int argc, char** argv);
 void assemble();
+StringGraph* buildGraphFromReads();
+void assembleGraph(StringGraph* pGraph, 
+                   const std::string& contigsFile, 
+                   const std::string& variantsFile, 
+                   const std::string& graphFile,
+                   const std::string& contigPrefix);
+void assemblePartitions();
+void concatenateFiles(const StringVector& inFiles, const std::string& outFile);
 
 #endif
@@ -16,6 +16,13 @@
 #include "Timer.h"
 #include "BWTAlgorithms.h"
 
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
+
+// The number of strings extracted by a thread per unit of work
+#define BWT2FA_WORK_SIZE 4096
+
 //
 // Getopt
 //
@@ -33,6 +40,7 @@ static const char *BWT2FA_USAGE_MESSAGE =
 "\n"
 "  -v, --verbose                        display verbose output\n"
 "      --help                           display this help and exit\n"
+"      -t, --threads=NUM                use NUM threads to extract the sequences (default: 1)\n"
 "      -o,--outfile=FILE                write the sequences to FILE\n"
 "      -p,--prefix=STR                  prefix the names of the reads with STR\n"
 "\nReport bugs to " PACKAGE_BUGREPORT "\n\n";
@@ -43,17 +51,19 @@ namespace opt
     static std::string bwtFile;
     static std::string outFile;
     static std::string readPrefix;
+    static int numThreads = 1;
     static int sampleRate = 256;
 }
 
-static const char* shortopts = "p:o:v";
+static const char* shortopts = "p:o:t:v";
 
-enum { OPT_HELP = 1, OPT_VERSION, OPT_NO_REVERSE };
+enum { OPT_HELP = 1, OPT_VERSION };
 
 static const struct option longopts[] = {
     { "verbose",     no_argument,       NULL, 'v' },
     { "prefix",      required_argument, NULL, 'p' },
     { "outfile",     required_argument, NULL, 'o' },
+    { "threads",     required_argument, NULL, 't' },
     { "help",        no_argument,       NULL, OPT_HELP },
     { "version",     no_argument,       NULL, OPT_VERSION },
     { NULL, 0, NULL, 0 }
@@ -69,16 +79,44 @@ int bwt2faMain(int argc, char** argv)
 
     std::ostream* pWriter = createWriter(opt::outFile);
 
+#if HAVE_OPENMP
+    omp_set_num_threads(opt::numThreads);
+#endif
+
+    // The strings are extracted in batches. Each thread extracts the strings
+    // for a contiguous range of terminal symbols then the batch is written
+    // out in order, so the output is identical for any number of threads.
+    size_t n = pBWT->getNumStrings();
+    size_t batchSize = BWT2FA_WORK_SIZE * opt::numThreads;
+    int64_t numWorkUnits = opt::numThreads;
+    std::vector<std::vector<std::string> > batch(numWorkUnits);
+
     SeqItem outItem;
     outItem.id = "";
-    size_t n = pBWT->getNumStrings();
-    for(size_t i = 0; i < n; ++i)
+    for(size_t batchStart = 0; batchStart < n; batchStart += batchSize)
     {
-        std::stringstream nameSS;
-        nameSS << opt::readPrefix << "-" << i;
-        outItem.id = nameSS.str();
-        outItem.seq = BWTAlgorithms::extractString(pBWT, i);
-        outItem.write(*pWriter);
+#if HAVE_OPENMP
+        #pragma omp parallel for
+#endif
+        for(int64_t i = 0; i < numWorkUnits; ++i)
+        {
+            size_t first = std::min(batchStart + i * BWT2FA_WORK_SIZE, n);
+            size_t last = std::min(first + BWT2FA_WORK_SIZE, n);
+            BWTAlgorithms::extractStrings(pBWT, first, last, batch[i]);
+        }
+
+        size_t idx = batchStart;
+        for(int64_t i = 0; i < numWorkUnits; ++i)
+        {
+            for(size_t j = 0; j < batch[i].size(); ++j)
+            {
+                std::stringstream nameSS;
+                nameSS << opt::readPrefix << "-" << idx++;
+                outItem.id = nameSS.str();
+                outItem.seq = batch[i][j];
+                outItem.write(*pWriter);
+            }
+        }
     }
 
     delete pBWT;
@@ -101,6 +139,7 @@ void parseBWT2FAOptions(int argc, char** argv)
             case 'p': arg >> opt::readPrefix; break;
             case '?': die = true; break;
             case 'o': arg >> opt::outFile; break;
+            case 't': arg >> opt::numThreads; break;
             case 'v': opt::verbose++; break;
             case OPT_HELP:
                 std::cout << BWT2FA_USAGE_MESSAGE;
@@ -122,6 +161,12 @@ void parseBWT2FAOptions(int argc, char** argv)
         die = true;
     }
 
+    if(opt::numThreads <= 0)
+    {
+        std::cerr << SUBPROGRAM ": invalid number of threads: " << opt::numThreads << "\n";
+        die = true;
+    }
+
     if (die) 
     {
         std::cout << "\n" << BWT2FA_USAGE_MESSAGE;
@@ -219,7 +219,7 @@ void cluster()
 
     // Open the preclusters file and convert them to read names
     SuffixArray* pFwdSAI = new SuffixArray(opt::prefix + SAI_EXT);
-    ReadInfoTable* pRIT = new ReadInfoTable(opt::readsFile, pFwdSAI->getNumStrings());
+    ReadInfoTable* pRIT = new ReadInfoTable(opt::readsFile, opt::prefix, pFwdSAI->getNumStrings());
 
     size_t seedIdx = 0;
     std::istream* pPreReader = createReader(preclustersFile);
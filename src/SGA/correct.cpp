@@ -25,10 +25,13 @@
 #include "CorrectionThresholds.h"
 #include "KmerDistribution.h"
 #include "BWTIntervalCache.h"
+#include "ShardedBWT.h"
+#include "WorkItemSortKey.h"
+#include "IndexMemory.h"
 #include "LRAlignment.h"
 
 // Functions
-int learnKmerParameters(const BWT* pBWT);
+int learnKmerParameters(const BWTIndexSet& indices);
 
 //#define OVERLAPCORRECTION_VERBOSE 1
 
@@ -49,6 +52,10 @@ static const char *CORRECT_USAGE_MESSAGE =
 "      --help                           display this help and exit\n"
 "      -v, --verbose                    display verbose output\n"
 "      -p, --prefix=PREFIX              use PREFIX for the names of the index files (default: prefix of the input file)\n"
+"                                       With kmer correction PREFIX can be a comma-separated list of indices built\n"
+"                                       from disjoint subsets of the reads, which are queried together without merging them.\n"
+"                                       Every kmer lookup searches each index in turn, so correction with N indices can take\n"
+"                                       up to N times as long as with one merged index\n"
 "      -o, --outfile=FILE               write the corrected reads to FILE (default: READSFILE.ec.fa)\n"
 "      -t, --threads=NUM                use NUM threads for the computation (default: 1)\n"
 "          --discard                    detect and discard low-quality reads\n"
@@ -56,6 +63,12 @@ static const char *CORRECT_USAGE_MESSAGE =
 "                                       less memory at the cost of higher runtime. This value must be a power of 2 (default: 128)\n"
 "      -a, --algorithm=STR              specify the correction algorithm to use. STR must be one of kmer, hybrid, overlap. (default: kmer)\n"
 "          --metrics=FILE               collect error correction metrics (error rate by position in read, etc) and write them to FILE\n"
+"          --sort-batch=N               read the reads in batches of N and correct each batch in the order of where the\n"
+"                                       last bases of each read are in the FM-index, so consecutive reads reuse cached\n"
+"                                       index data. The output is unchanged (default: correct the reads in input order)\n"
+"          --huge-pages=MODE            back the FM-index with huge pages. MODE is thp (transparent huge pages), or 2m or 1g\n"
+"                                       (pages of that size reserved by the system, falling back to thp) (default: none)\n"
+"          --numa-interleave            spread the FM-index over all NUMA nodes and pin the worker threads to the nodes in turn\n"
 "\nKmer correction parameters:\n"
 "      -k, --kmer-size=N                The length of the kmer to use. (default: 31)\n"
 "      -x, --kmer-threshold=N           Attempt to correct kmers that are seen less than N times. (default: 3)\n"
@@ -112,13 +125,16 @@ namespace opt
     static int numKmerRounds = 10;
     static bool bLearnKmerParams = false;
     static int intervalCacheLength = 10;
+    static size_t sortBatchSize = 0;
+    static IndexMemory::HugePageMode hugePageMode = IndexMemory::HPM_NONE;
+    static bool bNumaInterleave = false;
 
     static ErrorCorrectAlgorithm algorithm = ECA_KMER;
 }
 
 static const char* shortopts = "p:m:M:O:d:e:t:l:s:o:r:b:a:c:k:x:X:i:v";
 
-enum { OPT_HELP = 1, OPT_VERSION, OPT_METRICS, OPT_DISCARD, OPT_LEARN };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_METRICS, OPT_DISCARD, OPT_LEARN, OPT_SORT_BATCH, OPT_HUGE_PAGES, OPT_NUMA_INTERLEAVE };
 
 static const struct option longopts[] = {
     { "verbose",       no_argument,       NULL, 'v' },
@@ -145,6 +161,9 @@ static const struct option longopts[] = {
     { "help",          no_argument,       NULL, OPT_HELP },
     { "version",       no_argument,       NULL, OPT_VERSION },
     { "metrics",       required_argument, NULL, OPT_METRICS },
+    { "sort-batch",    required_argument, NULL, OPT_SORT_BATCH },
+    { "huge-pages",    required_argument, NULL, OPT_HUGE_PAGES },
+    { "numa-interleave", no_argument,     NULL, OPT_NUMA_INTERLEAVE },
     { NULL, 0, NULL, 0 }
 };
 
@@ -157,26 +176,45 @@ int correctMain(int argc, char** argv)
 
     std::cout << "Correcting sequencing errors for " << opt::readsFile << "\n";
 
+    // The allocation policy must be set before the indices are loaded
+    IndexMemory::setHugePageMode(opt::hugePageMode);
+    IndexMemory::setInterleave(opt::bNumaInterleave);
+
     // Load indices
-    BWT* pBWT = new BWT(opt::prefix + BWT_EXT, opt::sampleRate);
+    BWT* pBWT = NULL;
     BWT* pRBWT = NULL;
     SampledSuffixArray* pSSA = NULL;
+    BWTIntervalCache* pIntervalCache = NULL;
+    ShardedBWT* pShards = NULL;
+
+    std::vector<std::string> prefixes = ShardedBWT::parseList(opt::prefix);
+    if(prefixes.size() > 1)
+    {
+        std::vector<std::string> bwtFiles;
+        for(size_t i = 0; i < prefixes.size(); ++i)
+            bwtFiles.push_back(prefixes[i] + BWT_EXT);
+        pShards = new ShardedBWT(bwtFiles, opt::sampleRate, opt::intervalCacheLength);
+    }
+    else
+    {
+        pBWT = new BWT(opt::prefix + BWT_EXT, opt::sampleRate);
+        pIntervalCache = new BWTIntervalCache(opt::intervalCacheLength, pBWT);
+    }
 
     if(opt::algorithm == ECA_OVERLAP || opt::algorithm == ECA_HYBRID)
         pSSA = new SampledSuffixArray(opt::prefix + SAI_EXT, SSA_FT_SAI);
 
-    BWTIntervalCache* pIntervalCache = new BWTIntervalCache(opt::intervalCacheLength, pBWT);
-
     BWTIndexSet indexSet;
     indexSet.pBWT = pBWT;
     indexSet.pRBWT = pRBWT;
     indexSet.pSSA = pSSA;
     indexSet.pCache = pIntervalCache;
+    indexSet.pShards = pShards;
 
     // Learn the parameters of the kmer corrector
     if(opt::bLearnKmerParams)
     {
-        int threshold = learnKmerParameters(pBWT);
+        int threshold = learnKmerParameters(indexSet);
         if(threshold != -1)
             CorrectionThresholds::Instance().setBaseMinSupport(threshold);
     }
@@ -185,7 +223,10 @@ int correctMain(int argc, char** argv)
     std::ostream* pWriter = createWriter(opt::outFile);
     std::ostream* pDiscardWriter = (!opt::discardFile.empty() ? createWriter(opt::discardFile) : NULL);
     Timer* pTimer = new Timer(PROGRAM_IDENT);
-    pBWT->printInfo();
+    if(pShards != NULL)
+        pShards->printInfo();
+    else
+        pBWT->printInfo();
 
     // Set the error correction parameters
     ErrorCorrectParameters ecParams;
@@ -213,7 +254,26 @@ int correctMain(int argc, char** argv)
     bool bCollectMetrics = !opt::metricsFile.empty();
     ErrorCorrectPostProcess postProcessor(pWriter, pDiscardWriter, bCollectMetrics);
 
-    if(opt::numThreads <= 1)
+    // Order the reads with the interval cache of the index, or of the first shard
+    CachedIntervalSortKey sortKey(pShards != NULL ? pShards->getCache(0) : pIntervalCache);
+
+    if(opt::sortBatchSize > 0)
+    {
+        std::vector<ErrorCorrectProcess*> processorVector;
+        for(int i = 0; i < opt::numThreads; ++i)
+            processorVector.push_back(new ErrorCorrectProcess(ecParams));
+
+        SequenceProcessFramework::processSequencesSorted<SequenceWorkItem,
+                                                         ErrorCorrectResult, 
+                                                         ErrorCorrectProcess, 
+                                                         ErrorCorrectPostProcess,
+                                                         CachedIntervalSortKey>(opt::readsFile, processorVector, &postProcessor,
+                                                                                &sortKey, opt::sortBatchSize);
+
+        for(int i = 0; i < opt::numThreads; ++i)
+            delete processorVector[i];
+    }
+    else if(opt::numThreads <= 1)
     {
         // Serial mode
         ErrorCorrectProcess processor(ecParams); 
@@ -252,6 +312,7 @@ int correctMain(int argc, char** argv)
 
     delete pBWT;
     delete pIntervalCache;
+    delete pShards;
     if(pRBWT != NULL)
         delete pRBWT;
 
@@ -271,7 +332,7 @@ int correctMain(int argc, char** argv)
 }
 
 // Learn parameters of the kmer corrector
-int learnKmerParameters(const BWT* pBWT)
+int learnKmerParameters(const BWTIndexSet& indices)
 {
     std::cout << "Learning kmer parameters\n";
     srand(time(0));
@@ -280,16 +341,68 @@ int learnKmerParameters(const BWT* pBWT)
     //
     KmerDistribution kmerDistribution;
     int k = opt::kmerLength;
-    for(size_t i = 0; i < n_samples; ++i)
+    if(indices.pShards != NULL)
     {
-        std::string s = BWTAlgorithms::sampleRandomString(pBWT);
-        int n = s.size();
-        int nk = n - k + 1;
-        for(int j = 0; j < nk; ++j)
+        // Sample reads from each shard in proportion to its size, then 
+        // count all the sampled kmers against the shards in one batch
+        const ShardedBWT* pShards = indices.pShards;
+        size_t totalStrings = pShards->getNumStrings();
+        std::vector<std::string> kmers;
+        for(size_t i = 0; i < pShards->getNumShards(); ++i)
         {
-            std::string kmer = s.substr(j, k);
-            int count = BWTAlgorithms::countSequenceOccurrences(kmer, pBWT);
-            kmerDistribution.add(count);
+            const BWT* pShardBWT = pShards->getBWT(i);
+            size_t shard_samples = (n_samples * pShardBWT->getNumStrings() + totalStrings - 1) / totalStrings;
+            for(size_t j = 0; j < shard_samples; ++j)
+            {
+                std::string s = BWTAlgorithms::sampleRandomString(pShardBWT);
+                int n = s.size();
+                int nk = n - k + 1;
+                for(int l = 0; l < nk; ++l)
+                    kmers.push_back(s.substr(l, k));
+            }
+        }
+
+        std::vector<size_t> counts;
+        pShards->countSequenceOccurrences(kmers, counts, opt::numThreads);
+        for(size_t i = 0; i < counts.size(); ++i)
+            kmerDistribution.add(counts[i]);
+    }
+    else
+    {
+        // Draw a seed for each sample up front so the samples
+        // can be taken by any thread
+        std::vector<unsigned int> seeds(n_samples);
+        for(size_t i = 0; i < n_samples; ++i)
+            seeds[i] = rand();
+
+#if HAVE_OPENMP
+        omp_set_num_threads(opt::numThreads);
+        #pragma omp parallel
+#endif
+        {
+            // Each thread counts into its own distribution, which are merged at the end
+            KmerDistribution threadDistribution;
+
+#if HAVE_OPENMP
+            #pragma omp for schedule(dynamic, 64)
+#endif
+            for(int i = 0; i < (int)n_samples; ++i)
+            {
+                std::string s = BWTAlgorithms::sampleRandomString(indices.pBWT, &seeds[i]);
+                int n = s.size();
+                int nk = n - k + 1;
+                for(int j = 0; j < nk; ++j)
+                {
+                    std::string kmer = s.substr(j, k);
+                    int count = BWTAlgorithms::countSequenceOccurrences(kmer, indices.pBWT);
+                    threadDistribution.add(count);
+                }
+            }
+
+#if HAVE_OPENMP
+            #pragma omp critical
+#endif
+            kmerDistribution.merge(threadDistribution);
         }
     }
 
@@ -355,6 +468,15 @@ void parseCorrectOptions(int argc, char** argv)
             case OPT_LEARN: opt::bLearnKmerParams = true; break;
             case OPT_DISCARD: bDiscardReads = true; break;
             case OPT_METRICS: arg >> opt::metricsFile; break;
+            case OPT_SORT_BATCH: arg >> opt::sortBatchSize; break;
+            case OPT_NUMA_INTERLEAVE: opt::bNumaInterleave = true; break;
+            case OPT_HUGE_PAGES:
+                if(!IndexMemory::parseHugePageMode(arg.str(), opt::hugePageMode))
+                {
+                    std::cerr << SUBPROGRAM ": invalid parameter to --huge-pages: " << arg.str() << ", must be none, thp, 2m or 1g\n";
+                    die = true;
+                }
+                break;
             case OPT_HELP:
                 std::cout << CORRECT_USAGE_MESSAGE;
                 exit(EXIT_SUCCESS);
@@ -439,6 +561,12 @@ void parseCorrectOptions(int argc, char** argv)
         }
     }
 
+    if(opt::prefix.find(',') != std::string::npos && opt::algorithm != ECA_KMER)
+    {
+        std::cerr << SUBPROGRAM ": multiple index prefixes are only supported by the kmer algorithm\n";
+        die = true;
+    }
+
     if (die) 
     {
         std::cout << "\n" << CORRECT_USAGE_MESSAGE;
@@ -29,10 +29,68 @@
 #include "api/BamReader.h"
 #include "api/BamWriter.h"
 
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
+
 // Structs
 
+// The number of pairs handed to the worker threads at a time
+static const size_t PAIR_BATCH_SIZE = 10000;
+
+// Flags recording the filters that a pair failed
+enum PairFilterFlag
+{
+    PFF_UNMAPPED = 1,
+    PFF_ERROR_RATE = 2,
+    PFF_QUALITY = 4,
+    PFF_DEPTH = 8,
+    PFF_FR_ORIENTATION = 16,
+    PFF_END_DISTANCE = 32,
+    PFF_DISTANCE = 64
+};
+
+struct AlignmentPair
+{
+    AlignmentPair() : flags(0), passed(false) {}
+
+    BamTools::BamAlignment record1;
+    BamTools::BamAlignment record2;
+
+    // Set by filterAlignmentPair
+    int flags;
+    bool passed;
+};
+typedef std::vector<AlignmentPair> AlignmentPairBatch;
+
+struct PairFilterCounts
+{
+    PairFilterCounts() : numPairsTotal(0), numPairsFilteredByDistance(0), numPairsFilteredByER(0),
+                         numPairsFilteredByQuality(0), numPairsFilteredByDepth(0), numPairsUnmapped(0),
+                         numPairsWrote(0), numPairsFilteredFRContamination(0), numPairsTooCloseToEnd(0) {}
+
+    int numPairsTotal;
+    int numPairsFilteredByDistance;
+    int numPairsFilteredByER;
+    int numPairsFilteredByQuality;
+    int numPairsFilteredByDepth;
+    int numPairsUnmapped;
+    int numPairsWrote;
+    int numPairsFilteredFRContamination;
+    int numPairsTooCloseToEnd;
+};
+
 // Functions
-bool filterByGraph(StringGraph* pGraph, 
+void filterAlignmentPair(const StringGraph* pGraph, 
+                         const BWT* pBWT, 
+                         const BWT* pRBWT,
+                         const BamTools::RefVector& referenceVector, 
+                         AlignmentPair& pair);
+
+void readAlignmentBatch(BamTools::BamReader* pReader, AlignmentPairBatch& batch);
+void writeAlignmentBatch(BamTools::BamWriter* pWriter, const AlignmentPairBatch& batch, PairFilterCounts& counts);
+
+bool filterByGraph(const StringGraph* pGraph, 
                    const BamTools::RefVector& referenceVector, 
                    BamTools::BamAlignment& record1, 
                    BamTools::BamAlignment& record2);
@@ -45,6 +103,15 @@ bool readAlignmentPair(BamTools::BamReader* pReader,
 
 int64_t getMaxKmerDepth(const std::string& w, const BWT* pBWT, const BWT* pRBWT);
 
+static inline int getThreadNum()
+{
+#if HAVE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
 //
 // Getopt
 //
@@ -61,6 +128,7 @@ static const char *FILTERBAM_USAGE_MESSAGE =
 "\n"
 "      --help                           display this help and exit\n"
 "      -v, --verbose                    display verbose output\n"
+"      -t, --threads=NUM                use NUM threads to filter the pairs (default: 1)\n"
 "      -a, --asqg=FILE                  load an asqg file and filter pairs that are shorter than --max-distance\n"
 "      -d, --max-distance=LEN           search the graph for a path completing the mate-pair fragment. If the path is less than LEN\n"
 "                                       then the pair will be discarded.\n"
@@ -69,6 +137,7 @@ static const char *FILTERBAM_USAGE_MESSAGE =
 "      -o, --out-bam=FILE               write the filtered reads to FILE\n"
 "      -p, --prefix=STR                 load the FM-index with prefix STR\n"
 "      -x, --max-kmer-depth=N           filter out pairs that contain a kmer that has been seen in the FM-index more than N times\n"
+"          --end-distance=LEN           filter out pairs aligning to different contigs within LEN bases of a contig end (default: 500)\n"
 "      -c, --mate-contamination         filter out pairs aligning with FR orientation, which may be contiminates in a mate pair library\n"
 "\nReport bugs to " PACKAGE_BUGREPORT "\n\n";
 
@@ -97,9 +166,9 @@ namespace opt
     static int sampleRate = 256;
 }
 
-static const char* shortopts = "d:t:o:q:e:a:p:x:t:c:v";
+static const char* shortopts = "d:t:o:q:e:a:p:x:c:v";
 
-enum { OPT_HELP = 1, OPT_VERSION };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_END_DISTANCE };
 
 static const struct option longopts[] = {
     { "verbose",            no_argument,       NULL, 'v' },
@@ -110,7 +179,7 @@ static const struct option longopts[] = {
     { "min-quality",        required_argument, NULL, 'q' },
     { "outfile",            required_argument, NULL, 'o' },
     { "fmIndexPrefix",      required_argument, NULL, 'p' },
-    { "end-distance",       required_argument, NULL, 't' },
+    { "end-distance",       required_argument, NULL, OPT_END_DISTANCE },
     { "mate-contamination", required_argument, NULL, 'c' },
     { "help",               no_argument,       NULL, OPT_HELP },
     { "version",            no_argument,       NULL, OPT_VERSION },
@@ -140,17 +209,6 @@ int filterBAMMain(int argc, char** argv)
 
     Timer* pTimer = new Timer(PROGRAM_IDENT);    
 
-    // 
-    int numPairsTotal = 0;
-    int numPairsFilteredByDistance = 0;
-    int numPairsFilteredByER = 0;
-    int numPairsFilteredByQuality = 0;
-    int numPairsFilteredByDepth = 0;
-    int numPairsUnmapped = 0;
-    int numPairsWrote = 0;
-    int numPairsFilteredFRContamination = 0;
-    int numPairsTooCloseToEnd = 0;
-
     // Open the bam files for reading/writing
     BamTools::BamReader* pBamReader = new BamTools::BamReader;
     pBamReader->Open(opt::bamFile);
@@ -159,152 +217,220 @@ int filterBAMMain(int argc, char** argv)
     pBamWriter->Open(opt::outFile, pBamReader->GetHeaderText(), pBamReader->GetReferenceData());
     const BamTools::RefVector& referenceVector = pBamReader->GetReferenceData();
 
-
-    BamTools::BamAlignment record1;
-    BamTools::BamAlignment record2;
-    bool done = false;
-
-    while(!done)
+    // The pairs are processed in batches through a three-stage pipeline.
+    // While the worker threads filter batch i, the first thread writes
+    // out batch i - 1 and reads batch i + 1, then joins the workers.
+    // The BamReader and BamWriter are only used by the first thread
+    // so the output is in the same order as the input.
+    AlignmentPairBatch batches[3];
+    PairFilterCounts counts;
+
+    size_t curr = 0;
+    readAlignmentBatch(pBamReader, batches[curr]);
+    while(!batches[curr].empty())
     {
-        if(numPairsTotal++ % 200000 == 0)
-            printf("[sga filterBAM] Processed %d pairs\n", numPairsTotal);
-
-        done = !readAlignmentPair(pBamReader, record1, record2);
-        if(done)
-            break;
+        AlignmentPairBatch& prevBatch = batches[(curr + 2) % 3];
+        AlignmentPairBatch& currBatch = batches[curr];
+        AlignmentPairBatch& nextBatch = batches[(curr + 1) % 3];
+        size_t nextPairIdx = 0;
 
-        if(!record1.IsMapped() || !record2.IsMapped())
+#if HAVE_OPENMP
+        #pragma omp parallel num_threads(opt::numThreads)
+#endif
         {
-            numPairsUnmapped += 1;
-            continue;
+            if(getThreadNum() == 0)
+            {
+                writeAlignmentBatch(pBamWriter, prevBatch, counts);
+                readAlignmentBatch(pBamReader, nextBatch);
+            }
+
+            size_t i;
+            while((i = __sync_fetch_and_add(&nextPairIdx, 1)) < currBatch.size())
+                filterAlignmentPair(pGraph, pBWT, pRBWT, referenceVector, currBatch[i]);
         }
+        curr = (curr + 1) % 3;
+    }
 
-        // Ensure the pairing is correct
-        if(record1.Name != record2.Name)
-            std::cout << "NAME FAIL: " << record1.Name << " " << record2.Name << "\n";
-        assert(record1.Name == record2.Name);
-        bool bPassedFilters = true;
+    // Write the last batch that was filtered
+    writeAlignmentBatch(pBamWriter, batches[(curr + 2) % 3], counts);
+
+    std::cout << "Total pairs: " << counts.numPairsTotal << "\n";
+    std::cout << "Total pairs output: " << counts.numPairsWrote << "\n";
+    std::cout << "Total filtered because one pair is unmapped: " << counts.numPairsUnmapped << "\n";
+    std::cout << "Total filtered by distance: " << counts.numPairsFilteredByDistance << "\n";
+    std::cout << "Total filtered by error rate: " << counts.numPairsFilteredByER << "\n";
+    std::cout << "Total filtered by quality: " << counts.numPairsFilteredByQuality << "\n";
+    std::cout << "Total filtered by depth: " << counts.numPairsFilteredByDepth << "\n";
+    std::cout << "Total filtered by FR orientation: " << counts.numPairsFilteredFRContamination << "\n";
+    std::cout << "Total filtered by alignment too close to contig end: " << counts.numPairsTooCloseToEnd << "\n";
+    
+    if(pGraph != NULL)
+        delete pGraph;
 
-        // Check if the error rate is below the max
-        double er1 = getErrorRate(record1);
-        double er2 = getErrorRate(record2);
+    if(pBWT != NULL)
+        delete pBWT;
 
-        if(er1 > opt::maxError || er2 > opt::maxError)
-        {
-            bPassedFilters = false;
-            numPairsFilteredByER += 1;
-        }
+    if(pRBWT != NULL)
+        delete pRBWT;
+
+    pBamWriter->Close();
+    pBamReader->Close();
+
+    delete pTimer;
+    delete pBamReader;
+    delete pBamWriter;
+    return 0;
+}
 
-        if(record1.MapQuality < opt::minQuality || record2.MapQuality < opt::minQuality)
+// Run the filters on a pair and record which of them failed
+void filterAlignmentPair(const StringGraph* pGraph, 
+                         const BWT* pBWT, 
+                         const BWT* pRBWT,
+                         const BamTools::RefVector& referenceVector, 
+                         AlignmentPair& pair)
+{
+    BamTools::BamAlignment& record1 = pair.record1;
+    BamTools::BamAlignment& record2 = pair.record2;
+    pair.flags = 0;
+    pair.passed = false;
+
+    if(!record1.IsMapped() || !record2.IsMapped())
+    {
+        pair.flags |= PFF_UNMAPPED;
+        return;
+    }
+
+    // Ensure the pairing is correct
+    if(record1.Name != record2.Name)
+        std::cout << "NAME FAIL: " << record1.Name << " " << record2.Name << "\n";
+    assert(record1.Name == record2.Name);
+    bool bPassedFilters = true;
+
+    // Check if the error rate is below the max
+    double er1 = getErrorRate(record1);
+    double er2 = getErrorRate(record2);
+
+    if(er1 > opt::maxError || er2 > opt::maxError)
+    {
+        bPassedFilters = false;
+        pair.flags |= PFF_ERROR_RATE;
+    }
+
+    if(record1.MapQuality < opt::minQuality || record2.MapQuality < opt::minQuality)
+    {
+        bPassedFilters = false;
+        pair.flags |= PFF_QUALITY;
+    }
+
+    // Perform depth check for pairs aligning to different contigs
+    if(bPassedFilters && (pBWT != NULL && pRBWT != NULL && opt::maxKmerDepth > 0) && (record1.RefID != record2.RefID))
+    {
+        int maxDepth1 = getMaxKmerDepth(record1.QueryBases, pBWT, pRBWT);
+        int maxDepth2 = getMaxKmerDepth(record1.QueryBases, pBWT, pRBWT);
+        if(maxDepth1 > opt::maxKmerDepth || maxDepth2 > opt::maxKmerDepth)
         {
             bPassedFilters = false;
-            numPairsFilteredByQuality += 1;
+            pair.flags |= PFF_DEPTH;
         }
+    }
 
-        // Perform depth check for pairs aligning to different contigs
-        if(bPassedFilters && (pBWT != NULL && pRBWT != NULL && opt::maxKmerDepth > 0) && (record1.RefID != record2.RefID))
+    // Filter forward-reverse contimating pairs in a mate pair library
+    if(opt::filterFRContamination)
+    {
+        if(record1.RefID == record2.RefID)
         {
-            int maxDepth1 = getMaxKmerDepth(record1.QueryBases, pBWT, pRBWT);
-            int maxDepth2 = getMaxKmerDepth(record1.QueryBases, pBWT, pRBWT);
-            if(maxDepth1 > opt::maxKmerDepth || maxDepth2 > opt::maxKmerDepth)
+            // Check the orientation of the pairs
+            // We discard the pair if they are like this:
+            //  ------1---->
+            //                <------2------
+            BamTools::BamAlignment* pUpstream;
+            BamTools::BamAlignment* pDownstream;
+            if(record1.Position < record2.Position)
             {
-                bPassedFilters = false;
-                numPairsFilteredByDepth += 1;
+                pUpstream = &record1;
+                pDownstream = &record2;
             }
-        }
-
-        // Filter forward-reverse contimating pairs in a mate pair library
-        if(opt::filterFRContamination)
-        {
-            if(record1.RefID == record2.RefID)
+            else
             {
-                // Check the orientation of the pairs
-                // We discard the pair if they are like this:
-                //  ------1---->
-                //                <------2------
-                BamTools::BamAlignment* pUpstream;
-                BamTools::BamAlignment* pDownstream;
-                if(record1.Position < record2.Position)
-                {
-                    pUpstream = &record1;
-                    pDownstream = &record2;
-                }
-                else
-                {
-                    pUpstream = &record2;
-                    pDownstream = &record1;
-                }
-                
-                // Upstream half of the pair (more 5') should be forward, downstream should be reverse
-                if(!pUpstream->IsReverseStrand() && pDownstream->IsReverseStrand())
-                {
-                    numPairsFilteredFRContamination += 1;
-                    bPassedFilters = false;
-                }
+                pUpstream = &record2;
+                pDownstream = &record1;
             }
-
-            if(bPassedFilters && record1.RefID != record2.RefID)
+            
+            // Upstream half of the pair (more 5') should be forward, downstream should be reverse
+            if(!pUpstream->IsReverseStrand() && pDownstream->IsReverseStrand())
             {
-                int distanceToLeftEnd1 = record1.Position;
-                int distanceToRightEnd1 = referenceVector[record1.RefID].RefLength - record1.GetEndPosition();
-                int distance1 = std::min(distanceToLeftEnd1, distanceToRightEnd1);
-                
-                int distanceToLeftEnd2 = record2.Position;
-                int distanceToRightEnd2 = referenceVector[record2.RefID].RefLength - record2.GetEndPosition();
-                int distance2 = std::min(distanceToLeftEnd2, distanceToRightEnd2);
-                if(distance1 < opt::minDistanceToEnd || distance2 < opt::minDistanceToEnd)
-                {
-                    bPassedFilters = false;
-                    numPairsTooCloseToEnd += 1;
-                }
+                pair.flags |= PFF_FR_ORIENTATION;
+                bPassedFilters = false;
             }
         }
 
-        // Perform short-insert pair check
-        if(pGraph != NULL)
-        {
-            bPassedFilters = bPassedFilters && filterByGraph(pGraph, referenceVector, record1, record2);
-            numPairsFilteredByDistance += 1;
-        }
-
-        if(bPassedFilters)
+        if(bPassedFilters && record1.RefID != record2.RefID)
         {
-            pBamWriter->SaveAlignment(record1);
-            pBamWriter->SaveAlignment(record2);
-            numPairsWrote += 1;
+            int distanceToLeftEnd1 = record1.Position;
+            int distanceToRightEnd1 = referenceVector[record1.RefID].RefLength - record1.GetEndPosition();
+            int distance1 = std::min(distanceToLeftEnd1, distanceToRightEnd1);
+            
+            int distanceToLeftEnd2 = record2.Position;
+            int distanceToRightEnd2 = referenceVector[record2.RefID].RefLength - record2.GetEndPosition();
+            int distance2 = std::min(distanceToLeftEnd2, distanceToRightEnd2);
+            if(distance1 < opt::minDistanceToEnd || distance2 < opt::minDistanceToEnd)
+            {
+                bPassedFilters = false;
+                pair.flags |= PFF_END_DISTANCE;
+            }
         }
     }
 
-    std::cout << "Total pairs: " << numPairsTotal << "\n";
-    std::cout << "Total pairs output: " << numPairsWrote << "\n";
-    std::cout << "Total filtered because one pair is unmapped: " << numPairsUnmapped << "\n";
-    std::cout << "Total filtered by distance: " << numPairsFilteredByDistance << "\n";
-    std::cout << "Total filtered by error rate: " << numPairsFilteredByER << "\n";
-    std::cout << "Total filtered by quality: " << numPairsFilteredByQuality << "\n";
-    std::cout << "Total filtered by depth: " << numPairsFilteredByDepth << "\n";
-    std::cout << "Total filtered by FR orientation: " << numPairsFilteredFRContamination << "\n";
-    std::cout << "Total filtered by alignment too close to contig end: " << numPairsTooCloseToEnd << "\n";
-    
+    // Perform short-insert pair check
     if(pGraph != NULL)
-        delete pGraph;
-
-    if(pBWT != NULL)
-        delete pBWT;
-
-    if(pRBWT != NULL)
-        delete pRBWT;
+    {
+        bPassedFilters = bPassedFilters && filterByGraph(pGraph, referenceVector, record1, record2);
+        pair.flags |= PFF_DISTANCE;
+    }
+    pair.passed = bPassedFilters;
+}
 
-    pBamWriter->Close();
-    pBamReader->Close();
+// Read the next batch of pairs from the BAM. The batch is empty
+// once the end of the file has been reached.
+void readAlignmentBatch(BamTools::BamReader* pReader, AlignmentPairBatch& batch)
+{
+    // The records of the batch are reused so their string storage does not need
+    // to be reallocated for each pair
+    batch.resize(PAIR_BATCH_SIZE);
+    size_t numRead = 0;
+    while(numRead < PAIR_BATCH_SIZE && readAlignmentPair(pReader, batch[numRead].record1, batch[numRead].record2))
+        numRead += 1;
+    batch.resize(numRead);
+}
 
-    delete pTimer;
-    delete pBamReader;
-    delete pBamWriter;
-    return 0;
+// Write out the pairs of a filtered batch that passed and update the counts
+void writeAlignmentBatch(BamTools::BamWriter* pWriter, const AlignmentPairBatch& batch, PairFilterCounts& counts)
+{
+    for(size_t i = 0; i < batch.size(); ++i)
+    {
+        if(counts.numPairsTotal++ % 200000 == 0)
+            printf("[sga filterBAM] Processed %d pairs\n", counts.numPairsTotal);
+
+        const AlignmentPair& pair = batch[i];
+        counts.numPairsUnmapped += (pair.flags & PFF_UNMAPPED) != 0;
+        counts.numPairsFilteredByER += (pair.flags & PFF_ERROR_RATE) != 0;
+        counts.numPairsFilteredByQuality += (pair.flags & PFF_QUALITY) != 0;
+        counts.numPairsFilteredByDepth += (pair.flags & PFF_DEPTH) != 0;
+        counts.numPairsFilteredFRContamination += (pair.flags & PFF_FR_ORIENTATION) != 0;
+        counts.numPairsTooCloseToEnd += (pair.flags & PFF_END_DISTANCE) != 0;
+        counts.numPairsFilteredByDistance += (pair.flags & PFF_DISTANCE) != 0;
+
+        if(pair.passed)
+        {
+            pWriter->SaveAlignment(pair.record1);
+            pWriter->SaveAlignment(pair.record2);
+            counts.numPairsWrote += 1;
+        }
+    }
 }
 
 // Returns true if the paired reads are a short-insert pair
-bool filterByGraph(StringGraph* pGraph, 
+bool filterByGraph(const StringGraph* pGraph, 
                    const BamTools::RefVector& referenceVector, 
                    BamTools::BamAlignment& record1, 
                    BamTools::BamAlignment& record2)
@@ -449,6 +575,7 @@ void parseFilterBAMOptions(int argc, char** argv)
             case 'p': arg >> opt::fmIndexPrefix; break;
             case 'x': arg >> opt::maxKmerDepth; break;
             case 'c': opt::filterFRContamination = true; break;
+            case OPT_END_DISTANCE: arg >> opt::minDistanceToEnd; break;
             case '?': die = true; break;
             case 'v': opt::verbose++; break;
             case OPT_HELP:
@@ -25,6 +25,7 @@
 #include "OverlapProcess.h"
 #include "ReadInfoTable.h"
 #include "FMMergeProcess.h"
+#include "WorkItemSortKey.h"
 
 //
 // Getopt
@@ -47,6 +48,11 @@ static const char *FMMERGE_USAGE_MESSAGE =
 "      -t, --threads=NUM                use NUM worker threads (default: no threading)\n"
 "      -m, --min-overlap=LEN            minimum overlap required between two reads to merge (default: 45)\n"
 "      -o, --outfile=FILE               write the merged sequences to FILE (default: basename.merged.fa)\n"
+"          --sort-batch=N               read the reads in batches of N and process each batch in the order of where the\n"
+"                                       search of each read starts in the FM-index, so consecutive searches reuse cached\n"
+"                                       index data. Which read of a merged set is processed first can change, so the\n"
+"                                       merged sequences may be written in a different order or orientation\n"
+"                                       (default: process the reads in input order)\n"
 "\nReport bugs to " PACKAGE_BUGREPORT "\n\n";
 
 static const char* PROGRAM_IDENT =
@@ -60,11 +66,12 @@ namespace opt
     static std::string outFile;
     static std::string prefix;
     static unsigned int minOverlap = DEFAULT_MIN_OVERLAP;
+    static size_t sortBatchSize = 0;
 }
 
 static const char* shortopts = "p:m:d:e:t:l:s:o:vix";
 
-enum { OPT_HELP = 1, OPT_VERSION };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_SORT_BATCH };
 
 static const struct option longopts[] = {
     { "prefix",      required_argument, NULL, 'p' },
@@ -72,6 +79,7 @@ static const struct option longopts[] = {
     { "threads",     required_argument, NULL, 't' },
     { "min-overlap", required_argument, NULL, 'm' },
     { "outfile",     required_argument, NULL, 'o' },
+    { "sort-batch",  required_argument, NULL, OPT_SORT_BATCH },
     { "help",        no_argument,       NULL, OPT_HELP },
     { "version",     no_argument,       NULL, OPT_VERSION },
     { NULL, 0, NULL, 0 }
@@ -100,7 +108,29 @@ int FMMergeMain(int argc, char** argv)
     std::ostream* pWriter = createWriter(opt::outFile);
     FMMergePostProcess postProcessor(pWriter, &markedReads);
 
-    if(opt::numThreads <= 1)
+    if(opt::sortBatchSize > 0)
+    {
+        printf("[%s] starting read merging in sorted batches of %zu with %d threads\n", PROGRAM_IDENT, opt::sortBatchSize, opt::numThreads);
+
+        // Order the reads by where their search starts in the FM-index
+        BWTIntervalCache sortCache(CachedIntervalSortKey::DEFAULT_CACHE_LENGTH, pBWT);
+        CachedIntervalSortKey sortKey(&sortCache);
+
+        std::vector<FMMergeProcess*> processorVector;
+        for(int i = 0; i < opt::numThreads; ++i)
+            processorVector.push_back(new FMMergeProcess(pOverlapper, opt::minOverlap, &markedReads));
+
+        SequenceProcessFramework::processSequencesSorted<SequenceWorkItem,
+                                                         FMMergeResult, 
+                                                         FMMergeProcess, 
+                                                         FMMergePostProcess,
+                                                         CachedIntervalSortKey>(opt::readsFile, processorVector, &postProcessor,
+                                                                                &sortKey, opt::sortBatchSize);
+
+        for(size_t i = 0; i < processorVector.size(); ++i)
+            delete processorVector[i];
+    }
+    else if(opt::numThreads <= 1)
     {
         printf("[%s] starting serial-mode read merging\n", PROGRAM_IDENT);
         FMMergeProcess processor(pOverlapper, opt::minOverlap, &markedReads);
@@ -170,6 +200,7 @@ void parseFMMergeOptions(int argc, char** argv)
             case 'p': arg >> opt::prefix; break;
             case 'o': arg >> opt::outFile; break;
             case 't': arg >> opt::numThreads; break;
+            case OPT_SORT_BATCH: arg >> opt::sortBatchSize; break;
             case '?': die = true; break;
             case 'v': opt::verbose++; break;
             case OPT_HELP:
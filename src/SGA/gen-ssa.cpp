@@ -83,7 +83,7 @@ int genSSAMain(int argc, char** argv)
     }
     else
     {
-        ReadInfoTable* pRIT = new ReadInfoTable(opt::readsFile, pBWT->getNumStrings(), RIO_NUMERICID);
+        ReadInfoTable* pRIT = new ReadInfoTable(opt::readsFile, opt::prefix, pBWT->getNumStrings(), RIO_NUMERICID);
         pSSA->build(pBWT, pRIT, opt::sampleRate);
         pSSA->writeSSA(opt::prefix + SSA_EXT);
         delete pRIT;
@@ -193,7 +193,7 @@ void parseGmapHits(const StringVector& hitsFilenames)
     SuffixArray* pRevSAI = new SuffixArray(opt::prefix + RSAI_EXT);
 
     // Load the read table and output the initial vertex set, consisting of all the reads
-    ReadInfoTable* pRIT = new ReadInfoTable(opt::targetsFile, pFwdSAI->getNumStrings());
+    ReadInfoTable* pRIT = new ReadInfoTable(opt::targetsFile, opt::prefix, pFwdSAI->getNumStrings());
 
     std::ostream* pWriter = createWriter(opt::outFile);
     int numRead = 0;
@@ -166,6 +166,12 @@ int graphDiffMain(int argc, char** argv)
     // Set the verbosity level for the entire package
     Verbosity::Instance().setPrintLevel(opt::verbose);
 
+    // The dindel realignment is parallelized within each window with OpenMP.
+    // Bound it by the requested number of threads
+#if HAVE_OPENMP
+    omp_set_num_threads(opt::numThreads);
+#endif
+
     if(opt::lowCoverage)
         std::cout << "Initializing population calling\n";
     else if(opt::referenceMode)
@@ -197,7 +203,7 @@ int graphDiffMain(int argc, char** argv)
     // is not set, this will just return default quality scores for all reads
     QualityTable* variantQuals = new QualityTable;
     if(opt::useQualityScores)
-        variantQuals->loadQualities(opt::variantFile);
+        variantQuals->loadQualities(opt::variantFile, variantPrefix, variantIndex.pBWT->getNumStrings());
     variantIndex.pQualityTable = variantQuals;
     std::cout << "done" << std::endl; 
 
@@ -224,11 +230,9 @@ int graphDiffMain(int argc, char** argv)
         baseIndex.pBWT = new BWT(basePrefix + BWT_EXT, opt::sampleRate);
         baseIndex.pSSA = new SampledSuffixArray(basePrefix + SAI_EXT, SSA_FT_SAI);
         baseIndex.pCache = new BWTIntervalCache(opt::cacheLength, baseIndex.pBWT);
-        baseIndex.pQualityTable = new QualityTable();
-
         QualityTable* baseQuals = new QualityTable;
         if(opt::useQualityScores)
-            baseQuals->loadQualities(opt::baseFile);
+            baseQuals->loadQualities(opt::baseFile, basePrefix, baseIndex.pBWT->getNumStrings());
         baseIndex.pQualityTable = baseQuals;
         std::cout << "done" << std::endl;
     }
@@ -8,7 +8,9 @@
 //
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <algorithm>
+#include <unistd.h>
 #include "SGACommon.h"
 #include "Util.h"
 #include "index.h"
@@ -21,6 +23,8 @@
 #include "BWTCABauerCoxRosone.h"
 #include "BWTCARopebwt.h"
 #include "SampledSuffixArray.h"
+#include "ReadInfoTable.h"
+#include "QualityTable.h"
 
 //
 // Getopt
@@ -48,6 +52,10 @@ static const char *INDEX_USAGE_MESSAGE =
 "  -t, --threads=NUM                    use NUM threads to construct the index (default: 1)\n"
 "  -c, --check                          validate that the suffix array/bwt is correct\n"
 "  -p, --prefix=PREFIX                  write index to file using PREFIX instead of prefix of READSFILE\n"
+"                                       The lengths and names of the reads are also written to PREFIX.rit\n"
+"                                       so later steps do not need to parse READSFILE again.\n"
+"      --qualities                      write the quality values of the reads to PREFIX.qst, which graph-diff can use\n"
+"                                       instead of parsing READSFILE\n"
 "      --no-reverse                     suppress construction of the reverse BWT. Use this option when building the index\n"
 "                                       for reads that will be error corrected using the k-mer corrector, which only needs the forward index\n"
 "      --no-forward                     suppress construction of the forward BWT. Use this option when building the forward and reverse index separately\n"
@@ -57,6 +65,10 @@ static const char *INDEX_USAGE_MESSAGE =
 "                                       When this value is set to 32, the memory requirement is essentially deterministic and requires ~5N bytes where\n"
 "                                       N is the size of the FM-index of READS2.\n"
 "                                       The default value is 8.\n"
+"      --gap-range=N                    build the gap array for at most N symbols of the internal index at a time. The ranks of the\n"
+"                                       reads being merged are written to temporary files (4 bytes per symbol) and the gap array\n"
+"                                       memory is bounded by the -g storage for N elements. N must be less than 2^32. The default (0)\n"
+"                                       builds the gap array for the entire index in memory.\n"
 "\nReport bugs to " PACKAGE_BUGREPORT "\n\n";
 
 namespace opt
@@ -71,13 +83,15 @@ namespace opt
     static bool bBuildReverse = true;
     static bool bBuildForward = true;
     static bool bBuildSAI = true;
+    static bool bWriteQualities = false;
     static bool validate;
     static int gapArrayStorage = 4;
+    static size_t gapRangeSize = 0;
 }
 
 static const char* shortopts = "p:a:m:t:d:g:cv";
 
-enum { OPT_HELP = 1, OPT_VERSION, OPT_NO_REVERSE, OPT_NO_FWD, OPT_NO_SAI };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_NO_REVERSE, OPT_NO_FWD, OPT_NO_SAI, OPT_GAP_RANGE, OPT_QUALITIES };
 
 static const struct option longopts[] = {
     { "verbose",     no_argument,       NULL, 'v' },
@@ -86,10 +100,12 @@ static const struct option longopts[] = {
     { "threads",     required_argument, NULL, 't' },
     { "disk",        required_argument, NULL, 'd' },
     { "gap-array",   required_argument, NULL, 'g' },
+    { "gap-range",   required_argument, NULL, OPT_GAP_RANGE },
     { "algorithm",   required_argument, NULL, 'a' },
     { "no-reverse",  no_argument,       NULL, OPT_NO_REVERSE },
     { "no-forward",  no_argument,       NULL, OPT_NO_FWD },
     { "no-sai",      no_argument,       NULL, OPT_NO_SAI },
+    { "qualities",   no_argument,       NULL, OPT_QUALITIES },
     { "help",        no_argument,       NULL, OPT_HELP },
     { "version",     no_argument,       NULL, OPT_VERSION },
     { NULL, 0, NULL, 0 }
@@ -112,6 +128,10 @@ int indexMain(int argc, char** argv)
     {
         indexOnDisk();
     }
+
+    // The SAIS algorithm writes the read info table from its read table
+    if(opt::bDiskAlgo || opt::algorithm != "sais" || !(opt::bBuildForward || opt::bBuildReverse))
+        writeReadMetadata(NULL);
     return 0;
 }
 
@@ -196,6 +216,7 @@ void indexInMemorySAIS()
     {
 		// Parse the initial read table
 		ReadTable* pRT = new ReadTable(opt::readsFile);
+		writeReadMetadata(pRT);
 
 		// Create and write the suffix array for the forward reads
 		if(opt::bBuildForward)
@@ -228,6 +249,7 @@ void indexOnDisk()
     parameters.numReadsPerBatch = opt::numReadsPerBatch;
     parameters.numThreads = opt::numThreads;
     parameters.storageLevel = opt::gapArrayStorage;
+    parameters.gapRangeSize = opt::gapRangeSize;
     parameters.bBuildReverse = false;
     parameters.bUseBCR = (opt::algorithm == "bcr");
 		
@@ -267,6 +289,56 @@ void buildIndexForTable(std::string prefix, const ReadTable* pRT, bool isReverse
     pSA = NULL;
 }
 
+// Write the lengths and names of the reads to PREFIX.rit and, if --qualities
+// is set, their quality values to PREFIX.qst. If pRT is not NULL the lengths
+// and names are taken from it. The reads file is parsed once, if needed,
+// and the quality values are written as they are read.
+void writeReadMetadata(const ReadTable* pRT)
+{
+    ReadInfoTable rit;
+    if(pRT != NULL)
+    {
+        for(size_t i = 0; i < pRT->getCount(); ++i)
+        {
+            const SeqItem& item = pRT->getRead(i);
+            rit.addRead(item.id, item.seq.length());
+        }
+    }
+
+    std::string qst_filename = opt::prefix + QUALITY_TABLE_EXT;
+    if(pRT == NULL || opt::bWriteQualities)
+    {
+        QualityTableWriter* pQualityWriter = opt::bWriteQualities ? new QualityTableWriter(qst_filename) : NULL;
+        bool hasQualities = false;
+
+        SeqReader reader(opt::readsFile);
+        SeqRecord sr;
+        while(reader.get(sr))
+        {
+            if(pRT == NULL)
+                rit.addRead(sr.id, sr.seq.length());
+
+            if(pQualityWriter != NULL)
+            {
+                pQualityWriter->addQualityString(sr.qual);
+                hasQualities = hasQualities || !sr.qual.empty();
+            }
+        }
+
+        if(pQualityWriter != NULL)
+        {
+            delete pQualityWriter;
+            if(!hasQualities)
+            {
+                std::cerr << "Warning: the reads do not have quality values, " << qst_filename << " was not written\n";
+                unlink(qst_filename.c_str());
+            }
+        }
+    }
+
+    rit.write(opt::prefix + RIT_EXT);
+}
+
 // 
 // Handle command line arguments
 //
@@ -284,11 +356,13 @@ void parseIndexOptions(int argc, char** argv)
             case 'd': opt::bDiskAlgo = true; arg >> opt::numReadsPerBatch; break;
             case 't': arg >> opt::numThreads; break;
             case 'g': arg >> opt::gapArrayStorage; break;
+            case OPT_GAP_RANGE: arg >> opt::gapRangeSize; break;
             case 'a': arg >> opt::algorithm; break;
             case 'v': opt::verbose++; break;
             case OPT_NO_REVERSE: opt::bBuildReverse = false; break;
             case OPT_NO_FWD: opt::bBuildForward = false; break;
             case OPT_NO_SAI: opt::bBuildSAI = false; break;
+            case OPT_QUALITIES: opt::bWriteQualities = true; break;
             case OPT_HELP:
                 std::cout << INDEX_USAGE_MESSAGE;
                 exit(EXIT_SUCCESS);
@@ -319,6 +393,12 @@ void parseIndexOptions(int argc, char** argv)
         die = true;
     }
 
+    if(opt::gapRangeSize > std::numeric_limits<uint32_t>::max())
+    {
+        std::cerr << SUBPROGRAM ": invalid argument, --gap-range must be less than 2^32 (found: " << opt::gapRangeSize << ")\n";
+        die = true;
+    }
+
     if(opt::numThreads <= 0)
     {
         std::cerr << SUBPROGRAM ": invalid number of threads: " << opt::numThreads << "\n";
@@ -18,6 +18,7 @@ void indexInMemoryBCR();
 void indexInMemoryRopebwt();
 void indexOnDisk();
 void buildIndexForTable(std::string outfile, const ReadTable* pRT, bool isReverse);
+void writeReadMetadata(const ReadTable* pRT);
 void parseIndexOptions(int argc, char** argv);
 
 #endif
@@ -8,6 +8,7 @@
 //
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <sys/stat.h>
 #include "SGACommon.h"
 #include "Util.h"
@@ -45,6 +46,10 @@ static const char *MERGE_USAGE_MESSAGE =
 "                                       When this value is set to 32, the memory requirement is essentially deterministic and requires ~5N bytes where\n"
 "                                       N is the size of the FM-index of READS2.\n"
 "                                       The default value is 4.\n"
+"      --gap-range=N                    build the gap array for at most N symbols of the internal index at a time. The ranks of the\n"
+"                                       reads being merged are written to temporary files (4 bytes per symbol) and the gap array\n"
+"                                       memory is bounded by the -g storage for N elements. N must be less than 2^32. The default (0)\n"
+"                                       builds the gap array for the entire index in memory.\n"
 "      --no-sequence                    Suppress merging of the sequence files. Use this option when merging the index(es) separate e.g. in parallel\n"
 "      --no-forward                     Suppress merging of the forward index. Use this option when merging the index(es) separate e.g. in parallel\n"
 "      --no-reverse                     Suppress merging of the reverse index. Use this option when merging the index(es) separate e.g. in parallel\n"
@@ -58,6 +63,7 @@ namespace opt
     static int numThreads = 1;
     static bool bRemove;
     static int gapArrayStorage = 4;
+    static size_t gapRangeSize = 0;
 	static bool bMergeSequence = true;
 	static bool bMergeForward = true;
 	static bool bMergeReverse = true;
@@ -65,7 +71,7 @@ namespace opt
 
 static const char* shortopts = "p:m:t:g:vr";
 
-enum { OPT_HELP = 1, OPT_VERSION, OPT_NO_SEQUENCE, OPT_NO_FWD, OPT_NO_REV };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_NO_SEQUENCE, OPT_NO_FWD, OPT_NO_REV, OPT_GAP_RANGE };
 
 static const struct option longopts[] = {
     { "verbose",     no_argument,       NULL, 'v' },
@@ -73,6 +79,7 @@ static const struct option longopts[] = {
     { "remove",      no_argument,       NULL, 'r' },
     { "threads",     required_argument, NULL, 't' },
     { "gap-array",   required_argument, NULL, 'g' },
+    { "gap-range",   required_argument, NULL, OPT_GAP_RANGE },
     { "no-sequence", no_argument,       NULL, OPT_NO_SEQUENCE },
     { "no-forward", no_argument,       NULL, OPT_NO_FWD },
     { "no-reverse", no_argument,       NULL, OPT_NO_REV },
@@ -104,7 +111,7 @@ int mergeMain(int argc, char** argv)
     // Merge the indices
 	if(opt::bMergeForward)
 	{
-		mergeIndependentIndices(inFiles[0], inFiles[1], opt::prefix, BWT_EXT, SAI_EXT, false, opt::numThreads, opt::gapArrayStorage);
+		mergeIndependentIndices(inFiles[0], inFiles[1], opt::prefix, BWT_EXT, SAI_EXT, false, opt::numThreads, opt::gapArrayStorage, opt::gapRangeSize);
 	}
     
     std::string prefix1 = stripGzippedExtension(inFiles[0]);
@@ -121,7 +128,7 @@ int mergeMain(int argc, char** argv)
 
     if((ret1 == 0 || ret2 == 0) && opt::bMergeReverse)
 	{
-		mergeIndependentIndices(inFiles[0], inFiles[1], opt::prefix, RBWT_EXT, RSAI_EXT, true, opt::numThreads, opt::gapArrayStorage);
+		mergeIndependentIndices(inFiles[0], inFiles[1], opt::prefix, RBWT_EXT, RSAI_EXT, true, opt::numThreads, opt::gapArrayStorage, opt::gapRangeSize);
 	}
 		
     // Merge the read files
@@ -180,6 +187,7 @@ void parseMergeOptions(int argc, char** argv)
             case '?': die = true; break;
             case 't': arg >> opt::numThreads; break;
             case 'g': arg >> opt::gapArrayStorage; break;
+            case OPT_GAP_RANGE: arg >> opt::gapRangeSize; break;
             case 'v': opt::verbose++; break;
 			case OPT_NO_SEQUENCE: opt::bMergeSequence = false; break;
 			case OPT_NO_FWD: opt::bMergeForward = false; break;
@@ -200,6 +208,12 @@ void parseMergeOptions(int argc, char** argv)
         die = true;
     }
 
+    if(opt::gapRangeSize > std::numeric_limits<uint32_t>::max())
+    {
+        std::cerr << SUBPROGRAM ": invalid argument, --gap-range must be less than 2^32 (found: " << opt::gapRangeSize << ")\n";
+        die = true;
+    }
+
     if(opt::numThreads <= 0)
     {
         std::cerr << SUBPROGRAM ": invalid number of threads: " << opt::numThreads << "\n";
@@ -25,7 +25,39 @@
 #include "ReadInfoTable.h"
 #include "KmerOverlaps.h"
 
+// Structs
+
+// The reads are processed in batches of at least this many bases
+static const size_t OVERLAP_LONG_BATCH_BASES = 1 << 20;
+
+// The number of kmers of a read that are looked up as one unit of work
+static const size_t OVERLAP_LONG_WINDOW_SIZE = 2048;
+
+// A range [start, end) of kmer positions of a read
+struct QueryWindow
+{
+    size_t read_idx;
+    size_t start;
+    size_t end;
+};
+typedef std::vector<QueryWindow> QueryWindowVector;
+
+// A read that shares a kmer with a query read
+struct MatchCandidate
+{
+    size_t read_idx;
+    KmerMatch match;
+    bool passed;
+    SequenceOverlapPair overlap;
+};
+
 // Functions
+void addQueryWindows(size_t read_idx, size_t read_length, size_t k, QueryWindowVector& windows);
+void writeLongOverlap(const SeqItem& curr_read, 
+                      const ReadTable& reads, 
+                      SequenceOverlapPair& sop, 
+                      std::ostream* pASQGWriter);
+
 size_t computeHitsSerial(const std::string& prefix, const std::string& readsFile, 
                          const OverlapAlgorithm* pOverlapper, int minOverlap, 
                          StringVector& filenameVec, std::ostream* pASQGWriter);
@@ -140,6 +172,66 @@ std::string ascii_overlap(const std::string& s0, const std::string& s1,
     return out;
 }
 
+// Add the windows of the kmer positions of a read to the vector. Windows
+// of consecutive kmers overlap by k - 1 bases of the read.
+void addQueryWindows(size_t read_idx, size_t read_length, size_t k, QueryWindowVector& windows)
+{
+    if(read_length < k)
+        return;
+
+    size_t num_kmers = read_length - k + 1;
+    for(size_t start = 0; start < num_kmers; start += OVERLAP_LONG_WINDOW_SIZE)
+    {
+        QueryWindow window;
+        window.read_idx = read_idx;
+        window.start = start;
+        window.end = std::min(start + OVERLAP_LONG_WINDOW_SIZE, num_kmers);
+        windows.push_back(window);
+    }
+}
+
+// Write an overlap between the query read and a matched read to the
+// ASQG file, along with a pictogram of the overlap to stdout
+void writeLongOverlap(const SeqItem& curr_read, 
+                      const ReadTable& reads, 
+                      SequenceOverlapPair& sop, 
+                      std::ostream* pASQGWriter)
+{
+    std::string match_id = reads.getRead(sop.match_idx).id;
+
+    // We only want to output each edge once so skip this overlap
+    // if the matched read has a lexicographically lower ID
+    if(curr_read.id > match_id)
+        return;
+
+    std::string ao = ascii_overlap(sop.sequence[0], sop.sequence[1], sop.overlap, 50);
+    printf("\t%s\t[%d %d] ID=%s OL=%d PI:%.2lf C=%s\n", ao.c_str(),
+                                                        sop.overlap.match[0].start,
+                                                        sop.overlap.match[0].end,
+                                                        match_id.c_str(),
+                                                        sop.overlap.getOverlapLength(),
+                                                        sop.overlap.getPercentIdentity(),
+                                                        sop.overlap.cigar.c_str());
+
+    // Convert to ASQG
+    SeqCoord sc1(sop.overlap.match[0].start, sop.overlap.match[0].end, sop.overlap.length[0]);
+    SeqCoord sc2(sop.overlap.match[1].start, sop.overlap.match[1].end, sop.overlap.length[1]);
+    
+    // KmerOverlaps returns the coordinates of the overlap after flipping the reads
+    // to ensure the strand matches. The ASQG file wants the coordinate of the original
+    // sequencing strand. Flip here if necessary
+    if(sop.is_reversed)
+        sc2.flip();
+
+    // Convert the SequenceOverlap the ASQG's overlap format
+    Overlap ovr(curr_read.id, sc1, match_id,  sc2, sop.is_reversed, -1);
+
+    ASQG::EdgeRecord er(ovr);
+    er.setCigarTag(sop.overlap.cigar);
+    er.setPercentIdentityTag(sop.overlap.getPercentIdentity());
+    er.write(*pASQGWriter);
+}
+
 //
 // Main
 //
@@ -196,67 +288,129 @@ int overlapLongMain(int argc, char** argv)
     index.pSSA = pSSA;
     index.pReadTable = &reads;
 
-    // Make a prefix for the temporary hits files
-    size_t n_reads = reads.getCount();
-
 #if HAVE_OPENMP
     omp_set_num_threads(opt::numThreads);
-    #pragma omp parallel for
 #endif
-    for(size_t read_idx = 0; read_idx < n_reads; ++read_idx)
+
+    // The reads are processed in batches. Each step of the batch is
+    // split into units of work that are distributed between the threads:
+    // the kmer lookups of long reads are split into windows, the backtracking
+    // is done per read and the overlaps are computed per candidate match.
+    // The buffers are kept between batches so their memory is reused.
+    size_t n_reads = reads.getCount();
+    QueryWindowVector windows;
+    std::vector<KmerMatchVector> window_matches;
+    std::vector<KmerMatchVector> read_matches;
+    std::vector<MatchCandidate> candidates;
+    StringVector batch_sequences;
+
+    size_t batch_start = 0;
+    while(batch_start < n_reads)
     {
-        const SeqItem& curr_read = reads.getRead(read_idx);
-
-        printf("read %s %zubp\n", curr_read.id.c_str(), curr_read.seq.length());
-        SequenceOverlapPairVector sopv = 
-            KmerOverlaps::retrieveMatches(curr_read.seq.toString(),
-                                          opt::seedLength,
-                                          opt::minOverlap,
-                                          1 - opt::errorRate,
-                                          100,
-                                          index);
-
-        printf("Found %zu matches\n", sopv.size());
-        for(size_t i = 0; i < sopv.size(); ++i)
+        // Select the reads of this batch and split them into windows
+        size_t batch_end = batch_start;
+        size_t batch_bases = 0;
+        windows.clear();
+        while(batch_end < n_reads && batch_bases < OVERLAP_LONG_BATCH_BASES)
         {
-            std::string match_id = reads.getRead(sopv[i].match_idx).id;
-
-            // We only want to output each edge once so skip this overlap
-            // if the matched read has a lexicographically lower ID
-            if(curr_read.id > match_id)
-                continue;
-
-            std::string ao = ascii_overlap(sopv[i].sequence[0], sopv[i].sequence[1], sopv[i].overlap, 50);
-            printf("\t%s\t[%d %d] ID=%s OL=%d PI:%.2lf C=%s\n", ao.c_str(),
-                                                                sopv[i].overlap.match[0].start,
-                                                                sopv[i].overlap.match[0].end,
-                                                                match_id.c_str(),
-                                                                sopv[i].overlap.getOverlapLength(),
-                                                                sopv[i].overlap.getPercentIdentity(),
-                                                                sopv[i].overlap.cigar.c_str());
-
-            // Convert to ASQG
-            SeqCoord sc1(sopv[i].overlap.match[0].start, sopv[i].overlap.match[0].end, sopv[i].overlap.length[0]);
-            SeqCoord sc2(sopv[i].overlap.match[1].start, sopv[i].overlap.match[1].end, sopv[i].overlap.length[1]);
-            
-            // KmerOverlaps returns the coordinates of the overlap after flipping the reads
-            // to ensure the strand matches. The ASQG file wants the coordinate of the original
-            // sequencing strand. Flip here if necessary
-            if(sopv[i].is_reversed)
-                sc2.flip();
-
-            // Convert the SequenceOverlap the ASQG's overlap format
-            Overlap ovr(curr_read.id, sc1, match_id,  sc2, sopv[i].is_reversed, -1);
-
-            ASQG::EdgeRecord er(ovr);
-            er.setCigarTag(sopv[i].overlap.cigar);
-            er.setPercentIdentityTag(sopv[i].overlap.getPercentIdentity());
-
-#pragma omp critical
+            size_t read_length = reads.getRead(batch_end).seq.length();
+            addQueryWindows(batch_end, read_length, opt::seedLength, windows);
+            batch_bases += read_length;
+            batch_end += 1;
+        }
+        size_t batch_size = batch_end - batch_start;
+
+        // Decode each read of the batch once, rather than once per window or candidate
+        batch_sequences.resize(batch_size);
+        for(size_t i = 0; i < batch_size; ++i)
+            batch_sequences[i] = reads.getRead(batch_start + i).seq.toString();
+
+        // Find the kmer matches in each window
+        window_matches.resize(windows.size());
+#if HAVE_OPENMP
+        #pragma omp parallel for schedule(dynamic)
+#endif
+        for(int i = 0; i < (int)windows.size(); ++i)
+        {
+            const QueryWindow& window = windows[i];
+            window_matches[i].clear();
+            KmerOverlaps::findKmerMatches(batch_sequences[window.read_idx - batch_start], 
+                                          opt::seedLength, window.start, window.end, 
+                                          index, window_matches[i]);
+        }
+
+        // Gather the kmer matches of each read, in order, and convert them
+        // into the reads that they hit
+        std::vector<size_t> first_window(batch_size + 1, windows.size());
+        for(size_t i = windows.size(); i-- > 0;)
+            first_window[windows[i].read_idx - batch_start] = i;
+        for(size_t i = batch_size; i-- > 0;)
+            first_window[i] = std::min(first_window[i], first_window[i + 1]);
+
+        read_matches.resize(batch_size);
+#if HAVE_OPENMP
+        #pragma omp parallel for schedule(dynamic)
+#endif
+        for(int i = 0; i < (int)batch_size; ++i)
+        {
+            KmerMatchVector kmer_matches;
+            for(size_t j = first_window[i]; j < first_window[i + 1]; ++j)
+                kmer_matches.insert(kmer_matches.end(), window_matches[j].begin(), window_matches[j].end());
+
+            read_matches[i].clear();
+            KmerOverlaps::resolveKmerMatches(kmer_matches, index, read_matches[i]);
+        }
+
+        // Compute the overlaps for every candidate of the batch
+        candidates.clear();
+        for(size_t i = 0; i < batch_size; ++i)
+        {
+            for(size_t j = 0; j < read_matches[i].size(); ++j)
+            {
+                MatchCandidate candidate;
+                candidate.read_idx = batch_start + i;
+                candidate.match = read_matches[i][j];
+                candidate.passed = false;
+                candidates.push_back(candidate);
+            }
+        }
+
+#if HAVE_OPENMP
+        #pragma omp parallel for schedule(dynamic)
+#endif
+        for(int i = 0; i < (int)candidates.size(); ++i)
+        {
+            MatchCandidate& candidate = candidates[i];
+            candidate.passed = KmerOverlaps::computeMatchOverlap(batch_sequences[candidate.read_idx - batch_start],
+                                                                 candidate.match,
+                                                                 opt::seedLength,
+                                                                 opt::minOverlap,
+                                                                 1 - opt::errorRate,
+                                                                 100,
+                                                                 index,
+                                                                 candidate.overlap);
+        }
+
+        // Write the overlaps in the order of the reads
+        size_t candidate_idx = 0;
+        for(size_t read_idx = batch_start; read_idx < batch_end; ++read_idx)
+        {
+            size_t candidate_end = candidate_idx;
+            size_t num_matches = 0;
+            while(candidate_end < candidates.size() && candidates[candidate_end].read_idx == read_idx)
+                num_matches += candidates[candidate_end++].passed;
+
+            const SeqItem& curr_read = reads.getRead(read_idx);
+            printf("read %s %zubp\n", curr_read.id.c_str(), curr_read.seq.length());
+            printf("Found %zu matches\n", num_matches);
+            for(; candidate_idx < candidate_end; ++candidate_idx)
             {
-                er.write(*pASQGWriter);
+                if(candidates[candidate_idx].passed)
+                    writeLongOverlap(curr_read, reads, candidates[candidate_idx].overlap, pASQGWriter);
             }
         }
+
+        batch_start = batch_end;
     }
 
     // Cleanup
@@ -19,10 +19,14 @@
 #include "Timer.h"
 #include "BWTAlgorithms.h"
 #include "ASQG.h"
+#include "ASQGIndex.h"
 #include "gzstream.h"
 #include "SequenceProcessFramework.h"
 #include "OverlapProcess.h"
+#include "WorkItemSortKey.h"
+#include "IndexMemory.h"
 #include "ReadInfoTable.h"
+#include "AllocationCounter.h"
 
 //
 enum OutputType
@@ -34,11 +38,13 @@ enum OutputType
 // Functions
 size_t computeHitsSerial(const std::string& prefix, const std::string& readsFile, 
                          const OverlapAlgorithm* pOverlapper, int minOverlap, 
-                         StringVector& filenameVec, std::ostream* pASQGWriter);
+                         StringVector& filenameVec, std::ostream* pASQGWriter,
+                         const CachedIntervalSortKey* pSortKey);
 
 size_t computeHitsParallel(int numThreads, const std::string& prefix, const std::string& readsFile, 
                            const OverlapAlgorithm* pOverlapper, int minOverlap, 
-                           StringVector& filenameVec, std::ostream* pASQGWriter);
+                           StringVector& filenameVec, std::ostream* pASQGWriter,
+                           const CachedIntervalSortKey* pSortKey);
 
 //
 void convertHitsToASQG(const std::string& indexPrefix, const StringVector& hitsFilenames, std::ostream* pASQGWriter);
@@ -76,6 +82,13 @@ static const char *OVERLAP_USAGE_MESSAGE =
 "                                       is specified (see above). This parameter defaults to the same value as --seed-length\n"
 "      -d, --sample-rate=N              sample the symbol counts every N symbols in the FM-index. Higher values use significantly\n"
 "                                       less memory at the cost of higher runtime. This value must be a power of 2 (default: 128)\n"
+"          --sort-batch=N               read the queries in batches of N and process each batch in the order of where the\n"
+"                                       search of each read starts in the FM-index, so consecutive searches reuse cached\n"
+"                                       index data. The overlaps found are the same but the edges may be written in a\n"
+"                                       different order (default: process the reads in input order)\n"
+"          --huge-pages=MODE            back the FM-index with huge pages. MODE is thp (transparent huge pages), or 2m or 1g\n"
+"                                       (pages of that size reserved by the system, falling back to thp) (default: none)\n"
+"          --numa-interleave            spread the FM-index over all NUMA nodes and pin the worker threads to the nodes in turn\n"
 "\nReport bugs to " PACKAGE_BUGREPORT "\n\n";
 
 static const char* PROGRAM_IDENT =
@@ -98,11 +111,14 @@ namespace opt
     static int sampleRate = BWT::DEFAULT_SAMPLE_RATE_SMALL;
     static bool bIrreducibleOnly = true;
     static bool bExactIrreducible = false;
+    static size_t sortBatchSize = 0;
+    static IndexMemory::HugePageMode hugePageMode = IndexMemory::HPM_NONE;
+    static bool bNumaInterleave = false;
 }
 
 static const char* shortopts = "m:d:e:t:l:s:o:f:p:vix";
 
-enum { OPT_HELP = 1, OPT_VERSION, OPT_EXACT };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_EXACT, OPT_SORT_BATCH, OPT_HUGE_PAGES, OPT_NUMA_INTERLEAVE };
 
 static const struct option longopts[] = {
     { "verbose",     no_argument,       NULL, 'v' },
@@ -117,6 +133,9 @@ static const struct option longopts[] = {
     { "seed-stride", required_argument, NULL, 's' },
     { "exhaustive",  no_argument,       NULL, 'x' },
     { "exact",       no_argument,       NULL, OPT_EXACT },
+    { "sort-batch",  required_argument, NULL, OPT_SORT_BATCH },
+    { "huge-pages",  required_argument, NULL, OPT_HUGE_PAGES },
+    { "numa-interleave", no_argument,   NULL, OPT_NUMA_INTERLEAVE },
     { "help",        no_argument,       NULL, OPT_HELP },
     { "version",     no_argument,       NULL, OPT_VERSION },
     { NULL, 0, NULL, 0 }
@@ -159,6 +178,9 @@ int overlapMain(int argc, char** argv)
       else
         indexPrefix = stripExtension(opt::readsFile);
     }
+    // The allocation policy must be set before the indices are loaded
+    IndexMemory::setHugePageMode(opt::hugePageMode);
+    IndexMemory::setInterleave(opt::bNumaInterleave);
     BWT* pBWT = new BWT(indexPrefix + BWT_EXT, opt::sampleRate);
     BWT* pRBWT = new BWT(indexPrefix + RBWT_EXT, opt::sampleRate);
     OverlapAlgorithm* pOverlapper = new OverlapAlgorithm(pBWT, pRBWT, 
@@ -168,6 +190,15 @@ int overlapMain(int argc, char** argv)
     pOverlapper->setExactModeOverlap(opt::errorRate <= 0.0001);
     pOverlapper->setExactModeIrreducible(opt::errorRate <= 0.0001);
 
+    // Cache the intervals of short strings to order the reads by where their search starts
+    BWTIntervalCache* pSortCache = NULL;
+    CachedIntervalSortKey* pSortKey = NULL;
+    if(opt::sortBatchSize > 0)
+    {
+        pSortCache = new BWTIntervalCache(CachedIntervalSortKey::DEFAULT_CACHE_LENGTH, pBWT);
+        pSortKey = new CachedIntervalSortKey(pSortCache);
+    }
+
     Timer* pTimer = new Timer(PROGRAM_IDENT);
     pBWT->printInfo();
 
@@ -180,18 +211,29 @@ int overlapMain(int argc, char** argv)
         outPrefix.append(stripFilename(opt::targetFile));
     }
 
+    size_t numAllocations = AllocationCounter::getCount();
+    size_t numReads;
     if(opt::numThreads <= 1)
     {
         printf("[%s] starting serial-mode overlap computation\n", PROGRAM_IDENT);
-        computeHitsSerial(outPrefix, opt::readsFile, pOverlapper, opt::minOverlap, hitsFilenames, pASQGWriter);
+        numReads = computeHitsSerial(outPrefix, opt::readsFile, pOverlapper, opt::minOverlap, hitsFilenames, pASQGWriter, pSortKey);
     }
     else
     {
         printf("[%s] starting parallel-mode overlap computation with %d threads\n", PROGRAM_IDENT, opt::numThreads);
-        computeHitsParallel(opt::numThreads, outPrefix, opt::readsFile, pOverlapper, opt::minOverlap, hitsFilenames, pASQGWriter);
+        numReads = computeHitsParallel(opt::numThreads, outPrefix, opt::readsFile, pOverlapper, opt::minOverlap, hitsFilenames, pASQGWriter, pSortKey);
+    }
+
+    if(AllocationCounter::isEnabled())
+    {
+        numAllocations = AllocationCounter::getCount() - numAllocations;
+        printf("[%s] %zu allocations for %zu reads (%.1lf per read)\n", PROGRAM_IDENT, 
+               numAllocations, numReads, numReads > 0 ? (double)numAllocations / numReads : 0.0);
     }
 
     // Get the number of strings in the BWT, this is used to pre-allocated the read table
+    delete pSortKey;
+    delete pSortCache;
     delete pOverlapper;
     delete pBWT; 
     delete pRBWT;
@@ -201,6 +243,11 @@ int overlapMain(int argc, char** argv)
 
     // Cleanup
     delete pASQGWriter;
+
+    // Index the graph for random access when it is written uncompressed
+    if(ASQGIndex::isIndexable(opt::outFile))
+        ASQGIndex::build(opt::outFile);
+
     delete pTimer;
     if(opt::numThreads > 1)
         pthread_exit(NULL);
@@ -212,7 +259,8 @@ int overlapMain(int argc, char** argv)
 // Return the number of reads processed
 size_t computeHitsSerial(const std::string& prefix, const std::string& readsFile, 
                          const OverlapAlgorithm* pOverlapper, int minOverlap, 
-                         StringVector& filenameVec, std::ostream* pASQGWriter)
+                         StringVector& filenameVec, std::ostream* pASQGWriter,
+                         const CachedIntervalSortKey* pSortKey)
 {
     std::string filename = prefix + HITS_EXT + GZIP_EXT;
     filenameVec.push_back(filename);
@@ -220,11 +268,24 @@ size_t computeHitsSerial(const std::string& prefix, const std::string& readsFile
     OverlapProcess processor(filename, pOverlapper, minOverlap);
     OverlapPostProcess postProcessor(pASQGWriter, pOverlapper);
 
-    size_t numProcessed = 
-           SequenceProcessFramework::processSequencesSerial<SequenceWorkItem,
-                                                            OverlapResult, 
-                                                            OverlapProcess, 
-                                                            OverlapPostProcess>(readsFile, &processor, &postProcessor);
+    size_t numProcessed;
+    if(pSortKey != NULL)
+    {
+        std::vector<OverlapProcess*> processorVector(1, &processor);
+        numProcessed = SequenceProcessFramework::processSequencesSorted<SequenceWorkItem,
+                                                                        OverlapResult, 
+                                                                        OverlapProcess, 
+                                                                        OverlapPostProcess,
+                                                                        CachedIntervalSortKey>(readsFile, processorVector, &postProcessor,
+                                                                                               pSortKey, opt::sortBatchSize);
+    }
+    else
+    {
+        numProcessed = SequenceProcessFramework::processSequencesSerial<SequenceWorkItem,
+                                                                        OverlapResult, 
+                                                                        OverlapProcess, 
+                                                                        OverlapPostProcess>(readsFile, &processor, &postProcessor);
+    }
     return numProcessed;
 }
 
@@ -235,7 +296,8 @@ size_t computeHitsSerial(const std::string& prefix, const std::string& readsFile
 // The number of reads processsed is returned
 size_t computeHitsParallel(int numThreads, const std::string& prefix, const std::string& readsFile, 
                            const OverlapAlgorithm* pOverlapper, int minOverlap, 
-                           StringVector& filenameVec, std::ostream* pASQGWriter)
+                           StringVector& filenameVec, std::ostream* pASQGWriter,
+                           const CachedIntervalSortKey* pSortKey)
 {
     std::string filename = prefix + HITS_EXT + GZIP_EXT;
 
@@ -253,11 +315,23 @@ size_t computeHitsParallel(int numThreads, const std::string& prefix, const std:
     // The post processing is performed serially so only one post processor is created
     OverlapPostProcess postProcessor(pASQGWriter, pOverlapper);
     
-    size_t numProcessed = 
-           SequenceProcessFramework::processSequencesParallel<SequenceWorkItem,
-                                                              OverlapResult, 
-                                                              OverlapProcess, 
-                                                              OverlapPostProcess>(readsFile, processorVector, &postProcessor);
+    size_t numProcessed;
+    if(pSortKey != NULL)
+    {
+        numProcessed = SequenceProcessFramework::processSequencesSorted<SequenceWorkItem,
+                                                                        OverlapResult, 
+                                                                        OverlapProcess, 
+                                                                        OverlapPostProcess,
+                                                                        CachedIntervalSortKey>(readsFile, processorVector, &postProcessor,
+                                                                                               pSortKey, opt::sortBatchSize);
+    }
+    else
+    {
+        numProcessed = SequenceProcessFramework::processSequencesParallel<SequenceWorkItem,
+                                                                          OverlapResult, 
+                                                                          OverlapProcess, 
+                                                                          OverlapPostProcess>(readsFile, processorVector, &postProcessor);
+    }
     for(int i = 0; i < numThreads; ++i)
         delete processorVector[i];
     return numProcessed;
@@ -271,13 +345,16 @@ void convertHitsToASQG(const std::string& indexPrefix, const StringVector& hitsF
     SuffixArray* pFwdSAI = new SuffixArray(indexPrefix + SAI_EXT);
     SuffixArray* pRevSAI = new SuffixArray(indexPrefix + RSAI_EXT);
 
-    // Load the ReadInfoTable for the queries to look up the ID and lengths of the hits
-    ReadInfoTable* pQueryRIT = new ReadInfoTable(opt::readsFile);
+    // Load the ReadInfoTable for the queries to look up the ID and lengths of the hits.
+    // The tables are mapped from the .rit files written by the indexer when possible
+    bool bHasTarget = !opt::targetFile.empty() && opt::targetFile != opt::readsFile;
+    std::string queryPrefix = bHasTarget ? stripExtension(opt::readsFile) : indexPrefix;
+    ReadInfoTable* pQueryRIT = new ReadInfoTable(opt::readsFile, queryPrefix, bHasTarget ? 0 : pFwdSAI->getNumStrings());
 
     // If the target file is not the query file, load its ReadInfoTable
     ReadInfoTable* pTargetRIT;
-    if(!opt::targetFile.empty() && opt::targetFile != opt::readsFile)
-        pTargetRIT = new ReadInfoTable(opt::targetFile);
+    if(bHasTarget)
+        pTargetRIT = new ReadInfoTable(opt::targetFile, indexPrefix, pFwdSAI->getNumStrings());
     else
         pTargetRIT = pQueryRIT;
 
@@ -339,6 +416,15 @@ void parseOverlapOptions(int argc, char** argv)
             case 'd': arg >> opt::sampleRate; break;
             case 'f': arg >> opt::targetFile; break;
             case OPT_EXACT: opt::bExactIrreducible = true; break;
+            case OPT_SORT_BATCH: arg >> opt::sortBatchSize; break;
+            case OPT_NUMA_INTERLEAVE: opt::bNumaInterleave = true; break;
+            case OPT_HUGE_PAGES:
+                if(!IndexMemory::parseHugePageMode(arg.str(), opt::hugePageMode))
+                {
+                    std::cerr << SUBPROGRAM ": invalid parameter to --huge-pages: " << arg.str() << ", must be none, thp, 2m or 1g\n";
+                    die = true;
+                }
+                break;
             case 'x': opt::bIrreducibleOnly = false; break;
             case '?': die = true; break;
             case 'v': opt::verbose++; break;
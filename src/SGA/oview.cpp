@@ -16,9 +16,11 @@
 #include "BWT.h"
 #include "SGUtil.h"
 #include "MultiOverlap.h"
+#include "ASQGIndex.h"
 
 void detectMisalignments(const ReadTable* pRT, const OverlapMap* pOM);
 void detect(const SeqItem& read, const ReadTable* pRT, const OverlapMap* pOM);
+void parseIndexedASQG(const std::string& filename, const std::string& rootID, ReadTable* pRT, OverlapMap* pOM);
 
 
 //
@@ -37,7 +39,8 @@ static const char *OVIEW_USAGE_MESSAGE =
 "\n"
 "  -v, --verbose                        display verbose output\n"
 "      --help                           display this help and exit\n"
-"      -i, --id=ID                      only show overlaps for read with ID\n"
+"      -i, --id=ID                      only show overlaps for read with ID. If ASQGFILE has an index\n"
+"                                       (ASQGFILE.aqi) only the records for ID and its neighbors are read\n"
 "      -m, --max-overhang=D             only show D overhanging bases of the alignments (default: 6)\n"
 "      -d, --default-padding=D          pad the overlap lines with D characters (default: 20)\n"
 "\nReport bugs to " PACKAGE_BUGREPORT "\n\n";
@@ -78,7 +81,10 @@ int oviewMain(int argc, char** argv)
     ReadTable* pRT = new ReadTable();
     OverlapMap* pOM = new OverlapMap;
 
-    parseASQG(opt::asqgFile, pRT, pOM);
+    if(!opt::readFilter.empty() && ASQGIndex::hasIndex(opt::asqgFile))
+        parseIndexedASQG(opt::asqgFile, opt::readFilter, pRT, pOM);
+    else
+        parseASQG(opt::asqgFile, pRT, pOM);
     pRT->indexReadsByID();
 
     // draw mode
@@ -189,6 +195,44 @@ void parseASQG(std::string filename, ReadTable* pRT, OverlapMap* pOM)
 }
 
 
+// Read the overlaps of rootID and the sequences of its neighbors
+// from the graph using its index
+void parseIndexedASQG(const std::string& filename, const std::string& rootID, ReadTable* pRT, OverlapMap* pOM)
+{
+    ASQGIndex index(filename);
+
+    ASQG::VertexRecord vertexRecord;
+    std::vector<ASQG::EdgeRecord> edgeRecords;
+    if(!index.readVertex(rootID, vertexRecord, &edgeRecords))
+        return;
+
+    SeqItem root = { vertexRecord.getID(), vertexRecord.getSeq() };
+    pRT->addRead(root);
+
+    for(size_t i = 0; i < edgeRecords.size(); ++i)
+    {
+        const Overlap& ovr = edgeRecords[i].getOverlap();
+        const std::string& otherID = ovr.id[0] == rootID ? ovr.id[1] : ovr.id[0];
+
+        // Skip the overlaps with vertices that are missing from the index, or stale
+        // in it, as their sequences cannot be drawn
+        if(otherID != rootID)
+        {
+            ASQG::VertexRecord otherRecord;
+            if(!index.readVertex(otherID, otherRecord, NULL) || otherRecord.getID() != otherID)
+            {
+                std::cerr << "Warning: vertex " << otherID << " was not found in the index of " << filename << ", skipping its overlap\n";
+                continue;
+            }
+            SeqItem si = { otherRecord.getID(), otherRecord.getSeq() };
+            pRT->addRead(si);
+        }
+
+        (*pOM)[ovr.id[0]].push_back(ovr);
+        (*pOM)[ovr.id[1]].push_back(ovr);
+    }
+}
+
 // 
 // Handle command line arguments
 //
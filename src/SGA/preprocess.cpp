@@ -8,6 +8,9 @@
 //
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <string.h>
+#include <zlib.h>
 #include "Util.h"
 #include "preprocess.h"
 #include "Timer.h"
@@ -16,6 +19,10 @@
 #include "Alphabet.h"
 #include "Quality.h"
 
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
+
 static unsigned int DEFAULT_MIN_LENGTH = 40;
 static int LOW_QUALITY_PHRED_SCORE = 3;
 
@@ -37,6 +44,10 @@ static const char *PREPROCESS_USAGE_MESSAGE =
 "      --help                           display this help and exit\n"
 "      -v, --verbose                    display verbose output\n"
 "          --seed                       set random seed\n"
+"      -t, --threads=NUM                use NUM threads to process the reads (default: 1)\n"
+"                                       The output order is the same for any number of threads.\n"
+"                                       If the output file ends in .gz it is compressed in parallel\n"
+"                                       as a series of concatenated gzip members.\n"
 "\nInput/Output options:\n"
 "      -o, --out=FILE                   write the reads to FILE (default: stdout)\n"
 "      -p, --pe-mode=INT                0 - do not treat reads as paired (default)\n"
@@ -83,6 +94,7 @@ namespace opt
 {
     static unsigned int verbose;
     static unsigned int seed = 0;
+    static int numThreads = 1;
     static std::string outFile;
     static unsigned int qualityTrim = 0;
     static unsigned int hardClip = 0;
@@ -108,7 +120,7 @@ namespace opt
     static std::string adapterR; // adapter sequence reverse
 }
 
-static const char* shortopts = "o:q:m:h:p:r:c:s:f:vi";
+static const char* shortopts = "o:q:m:h:p:r:c:s:f:t:vi";
 
 enum { OPT_HELP = 1, OPT_SEED, OPT_VERSION, OPT_PERMUTE,
        OPT_QSCALE, OPT_MINGC, OPT_MAXGC,
@@ -122,6 +134,7 @@ static const struct option longopts[] = {
     { "quality-trim",           required_argument, NULL, 'q' },
     { "quality-filter",         required_argument, NULL, 'f' },
     { "pe-mode",                required_argument, NULL, 'p' },
+    { "threads",                required_argument, NULL, 't' },
     { "hard-clip",              required_argument, NULL, 'h' },
     { "min-length",             required_argument, NULL, 'm' },
     { "sample",                 required_argument, NULL, 's' },
@@ -143,13 +156,56 @@ static const struct option longopts[] = {
     { NULL, 0, NULL, 0 }
 };
 
-static int64_t s_numReadsRead = 0;
+// Number of reads (or pairs, in pe-mode) processed in parallel at a time
+#define PREPROCESS_BATCH_SIZE 20000
+
+// Gzipped output is split into blocks of at least this many bytes
+// that are compressed independently
+#define PREPROCESS_MIN_GZIP_BLOCK (256 * 1024)
+#define PREPROCESS_MAX_GZIP_BLOCK (64 * 1024 * 1024)
+
+// Counters updated by processRead. Each thread keeps its own
+// copy which is added to the global total when a batch is done.
+struct PreprocessStats
+{
+    PreprocessStats() : numReadsRead(0), numBasesRead(0), numReadsPrimer(0), numFailedDust(0) {}
+
+    void add(const PreprocessStats& other)
+    {
+        numReadsRead += other.numReadsRead;
+        numBasesRead += other.numBasesRead;
+        numReadsPrimer += other.numReadsPrimer;
+        numFailedDust += other.numFailedDust;
+    }
+
+    int64_t numReadsRead;
+    int64_t numBasesRead;
+    int64_t numReadsPrimer;
+    int64_t numFailedDust;
+};
+
+// Write a block of formatted records to a file or stdout. Gzipped
+// files are written as a series of concatenated gzip members, which
+// lets the members of a block be compressed in parallel.
+class PreprocessWriter
+{
+    public:
+        PreprocessWriter(const std::string& filename);
+        ~PreprocessWriter();
+
+        void write(const std::string& buffer);
+
+    private:
+        std::ostream* m_pWriter;
+        bool m_compress;
+        bool m_writtenMember;
+};
+
+static PreprocessStats s_stats;
+static int64_t s_numRecordsParsed = 0;
 static int64_t s_numReadsKept = 0;
-static int64_t s_numBasesRead = 0;
 static int64_t s_numBasesKept = 0;
-static int64_t s_numReadsPrimer = 0;
 static int64_t s_numInvalidPE = 0;
-static int64_t s_numFailedDust = 0;
 
 //
 // Main
@@ -182,6 +238,7 @@ int preprocessMain(int argc, char** argv)
     std::cerr << "MaxGC: " << opt::maxGC << "\n";
     std::cerr << "Outfile: " << (opt::outFile.empty() ? "stdout" : opt::outFile) << "\n";
     std::cerr << "Orphan file: " << (opt::orphanFile.empty() ? "none" : opt::orphanFile) << "\n";
+    std::cerr << "Threads: " << opt::numThreads << "\n";
     if(opt::bDiscardAmbiguous)
         std::cerr << "Discarding sequences with ambiguous bases\n";
     if(opt::bDiscardQuality)
@@ -201,21 +258,22 @@ int preprocessMain(int argc, char** argv)
     // Seed the RNG
     srand(opt::seed);
 
-    std::ostream* pWriter;
-    if(opt::outFile.empty())
-    {
-        pWriter = &std::cout;
-    }
-    else
-    {
-        std::ostream* pFile = createWriter(opt::outFile);
-        pWriter = pFile;
-    }
+#if HAVE_OPENMP
+    omp_set_num_threads(opt::numThreads);
+#endif
+
+    PreprocessWriter* pWriter = new PreprocessWriter(opt::outFile);
 
     // Create a filehandle to write orphaned reads to, if necessary
-    std::ostream* pOrphanWriter = NULL;
+    PreprocessWriter* pOrphanWriter = NULL;
     if(!opt::orphanFile.empty())
-        pOrphanWriter = createWriter(opt::orphanFile);
+        pOrphanWriter = new PreprocessWriter(opt::orphanFile);
+
+    // The records of the current batch. In pe-mode the two
+    // halves of a pair are stored next to each other.
+    std::vector<SeqRecord> records;
+    std::vector<uint8_t> passed;
+    records.reserve(PREPROCESS_BATCH_SIZE * (opt::peMode == 0 ? 1 : 2));
 
     if(opt::peMode == 0)
     {
@@ -227,18 +285,37 @@ int preprocessMain(int argc, char** argv)
             SeqReader reader(filename, SRF_NO_VALIDATION);
             SeqRecord record;
 
-            while(reader.get(record))
+            bool done = false;
+            while(!done)
             {
-                bool passed = processRead(record);
-                if(passed && samplePass())
+                records.clear();
+                while(records.size() < PREPROCESS_BATCH_SIZE)
+                {
+                    if(!reader.get(record))
+                    {
+                        done = true;
+                        break;
+                    }
+                    records.push_back(record);
+                }
+
+                processBatch(records, passed);
+
+                std::ostringstream outBuffer;
+                for(size_t i = 0; i < records.size(); ++i)
                 {
-                    if(!opt::suffix.empty())
-                        record.id.append(opt::suffix);
+                    SeqRecord& outRecord = records[i];
+                    if(passed[i] && samplePass())
+                    {
+                        if(!opt::suffix.empty())
+                            outRecord.id.append(opt::suffix);
 
-                    record.write(*pWriter);
-                    ++s_numReadsKept;
-                    s_numBasesKept += record.seq.length();
+                        outRecord.write(outBuffer);
+                        ++s_numReadsKept;
+                        s_numBasesKept += outRecord.seq.length();
+                    }
                 }
+                pWriter->write(outBuffer.str());
             }
         }
     }
@@ -287,55 +364,82 @@ int preprocessMain(int argc, char** argv)
 
             SeqRecord record1;
             SeqRecord record2;
-            while(pReader1->get(record1) && pReader2->get(record2))
+            bool done = false;
+            while(!done)
             {
-                // If the names of the records are the same, append a /1 and /2 to them
-                if(record1.id == record2.id)
+                records.clear();
+                while(records.size() < 2 * PREPROCESS_BATCH_SIZE)
                 {
-                    if(!opt::suffix.empty())
+                    if(!pReader1->get(record1) || !pReader2->get(record2))
                     {
-                        record1.id.append(opt::suffix);
-                        record2.id.append(opt::suffix);
+                        done = true;
+                        break;
                     }
 
-                    record1.id.append("/1");
-                    record2.id.append("/2");
-                }
+                    // If the names of the records are the same, append a /1 and /2 to them
+                    if(record1.id == record2.id)
+                    {
+                        if(!opt::suffix.empty())
+                        {
+                            record1.id.append(opt::suffix);
+                            record2.id.append(opt::suffix);
+                        }
+
+                        record1.id.append("/1");
+                        record2.id.append("/2");
+                    }
 
-                // Ensure the read names are sensible
-                std::string expectedID2 = getPairID(record1.id);
-                std::string expectedID1 = getPairID(record2.id);
+                    // Ensure the read names are sensible
+                    std::string expectedID2 = getPairID(record1.id);
+                    std::string expectedID1 = getPairID(record2.id);
 
-                if(expectedID1 != record1.id || expectedID2 != record2.id)
-                {
-                    std::cerr << "Warning: Pair IDs do not match (expected format /1,/2 or /A,/B)\n";
-                    std::cerr << "Read1 ID: " << record1.id << "\n";
-                    std::cerr << "Read2 ID: " << record2.id << "\n";
-                    s_numInvalidPE += 2;
-                }
+                    if(expectedID1 != record1.id || expectedID2 != record2.id)
+                    {
+                        std::cerr << "Warning: Pair IDs do not match (expected format /1,/2 or /A,/B)\n";
+                        std::cerr << "Read1 ID: " << record1.id << "\n";
+                        std::cerr << "Read2 ID: " << record2.id << "\n";
+                        s_numInvalidPE += 2;
+                    }
 
-                bool passed1 = processRead(record1);
-                bool passed2 = processRead(record2);
+                    records.push_back(record1);
+                    records.push_back(record2);
+                }
 
-                if(!samplePass())
-                    continue;
+                processBatch(records, passed);
 
-                if(passed1 && passed2)
+                std::ostringstream outBuffer;
+                std::ostringstream orphanBuffer;
+                for(size_t i = 0; i < records.size(); i += 2)
                 {
-                    record1.write(*pWriter);
-                    record2.write(*pWriter);
-                    s_numReadsKept += 2;
-                    s_numBasesKept += record1.seq.length();
-                    s_numBasesKept += record2.seq.length();
-                }
-                else if(passed1 && pOrphanWriter != NULL)
-                {
-                    record1.write(*pOrphanWriter);
-                }
-                else if(passed2 && pOrphanWriter != NULL)
-                {
-                    record2.write(*pOrphanWriter);
+                    if(!samplePass())
+                        continue;
+
+                    bool passed1 = passed[i];
+                    bool passed2 = passed[i + 1];
+                    const SeqRecord& outRecord1 = records[i];
+                    const SeqRecord& outRecord2 = records[i + 1];
+
+                    if(passed1 && passed2)
+                    {
+                        outRecord1.write(outBuffer);
+                        outRecord2.write(outBuffer);
+                        s_numReadsKept += 2;
+                        s_numBasesKept += outRecord1.seq.length();
+                        s_numBasesKept += outRecord2.seq.length();
+                    }
+                    else if(passed1 && pOrphanWriter != NULL)
+                    {
+                        outRecord1.write(orphanBuffer);
+                    }
+                    else if(passed2 && pOrphanWriter != NULL)
+                    {
+                        outRecord2.write(orphanBuffer);
+                    }
                 }
+
+                pWriter->write(outBuffer.str());
+                if(pOrphanWriter != NULL)
+                    pOrphanWriter->write(orphanBuffer.str());
             }
 
             if(pReader2 != pReader1)
@@ -350,27 +454,59 @@ int preprocessMain(int argc, char** argv)
 
     }
 
-    if(pWriter != &std::cout)
-        delete pWriter;
+    delete pWriter;
     if(pOrphanWriter != NULL)
         delete pOrphanWriter;
 
     std::cerr << "\nPreprocess stats:\n";
-    std::cerr << "Reads parsed:\t" << s_numReadsRead << "\n";
-    std::cerr << "Reads kept:\t" << s_numReadsKept << " (" << (double)s_numReadsKept / (double)s_numReadsRead << ")\n";
-    std::cerr << "Reads failed primer screen:\t" << s_numReadsPrimer << " (" << (double)s_numReadsPrimer / (double)s_numReadsRead << ")\n";
-    std::cerr << "Bases parsed:\t" << s_numBasesRead << "\n";
-    std::cerr << "Bases kept:\t" << s_numBasesKept << " (" << (double)s_numBasesKept / (double)s_numBasesRead << ")\n";
+    std::cerr << "Reads parsed:\t" << s_stats.numReadsRead << "\n";
+    std::cerr << "Reads kept:\t" << s_numReadsKept << " (" << (double)s_numReadsKept / (double)s_stats.numReadsRead << ")\n";
+    std::cerr << "Reads failed primer screen:\t" << s_stats.numReadsPrimer << " (" << (double)s_stats.numReadsPrimer / (double)s_stats.numReadsRead << ")\n";
+    std::cerr << "Bases parsed:\t" << s_stats.numBasesRead << "\n";
+    std::cerr << "Bases kept:\t" << s_numBasesKept << " (" << (double)s_numBasesKept / (double)s_stats.numBasesRead << ")\n";
     std::cerr << "Number of incorrectly paired reads that were discarded: " << s_numInvalidPE << "\n";
     if(opt::bDustFilter)
-        std::cerr << "Number of reads failed dust filter: " << s_numFailedDust << "\n";
+        std::cerr << "Number of reads failed dust filter: " << s_stats.numFailedDust << "\n";
     delete pTimer;
     return 0;
 }
 
+// Run processRead on every record of the batch in parallel. passed[i]
+// is set to true if records[i] should be kept. The random state used to
+// resolve ambiguity codes is derived from the seed and the position of the
+// record in the input so the results do not depend on the number of threads.
+void processBatch(std::vector<SeqRecord>& records, std::vector<uint8_t>& passed)
+{
+    passed.resize(records.size());
+    int numRecords = records.size();
+    int64_t firstRecordIdx = s_numRecordsParsed;
+    s_numRecordsParsed += numRecords;
+
+#if HAVE_OPENMP
+    #pragma omp parallel
+#endif
+    {
+        PreprocessStats threadStats;
+
+#if HAVE_OPENMP
+        #pragma omp for schedule(dynamic, 256)
+#endif
+        for(int i = 0; i < numRecords; ++i)
+        {
+            unsigned int randState = opt::seed ^ (unsigned int)((firstRecordIdx + i) * 2654435761ULL);
+            passed[i] = processRead(records[i], randState, threadStats);
+        }
+
+#if HAVE_OPENMP
+        #pragma omp critical
+#endif
+        s_stats.add(threadStats);
+    }
+}
+
 // Process a single read by quality trimming, filtering
 // returns true if the read should be kept
-bool processRead(SeqRecord& record)
+bool processRead(SeqRecord& record, unsigned int& randState, PreprocessStats& stats)
 {
     // let's remove the adapter if the user has requested so
     // before doing any filtering
@@ -410,8 +546,8 @@ bool processRead(SeqRecord& record)
     std::string seqStr = record.seq.toString();
     std::string qualStr = record.qual;
 
-    ++s_numReadsRead;
-    s_numBasesRead += seqStr.size();
+    ++stats.numReadsRead;
+    stats.numBasesRead += seqStr.size();
 
     // If ambiguity codes are present in the sequence
     // and the user wants to keep them, we randomly
@@ -432,7 +568,7 @@ bool processRead(SeqRecord& record)
             std::string possibles = IUPAC::getPossibleSymbols(seqStr[i]);
 
             // select one of the bases at random
-            int j = rand() % possibles.size();
+            int j = rand_r(&randState) % possibles.size();
             seqStr[i] = possibles[j];
         }
     }
@@ -493,7 +629,7 @@ bool processRead(SeqRecord& record)
 
         if(!bAcceptDust)
         {
-            s_numFailedDust += 1;
+            stats.numFailedDust += 1;
             if(opt::verbose >= 1)
             {
                 printf("Failed dust: %s %s %lf\n", record.id.c_str(),
@@ -518,7 +654,7 @@ bool processRead(SeqRecord& record)
         bool containsPrimer = PrimerScreen::containsPrimer(seqStr);
         if(containsPrimer)
         {
-            ++s_numReadsPrimer;
+            ++stats.numReadsPrimer;
             return false;
         }
     }
@@ -546,6 +682,106 @@ bool samplePass()
     return r < opt::sampleFreq;
 }
 
+//
+PreprocessWriter::PreprocessWriter(const std::string& filename) : m_compress(false), m_writtenMember(false)
+{
+    if(filename.empty())
+    {
+        m_pWriter = &std::cout;
+    }
+    else if(isGzip(filename))
+    {
+        std::ofstream* pFile = new std::ofstream(filename.c_str(), std::ios::out | std::ios::binary);
+        assertFileOpen(*pFile, filename);
+        m_pWriter = pFile;
+        m_compress = true;
+    }
+    else
+    {
+        m_pWriter = createWriter(filename);
+    }
+}
+
+//
+PreprocessWriter::~PreprocessWriter()
+{
+    // Always write at least one member so the output is a valid gzip file
+    if(m_compress && !m_writtenMember)
+    {
+        std::string member;
+        compressGzipMember(NULL, 0, member);
+        m_pWriter->write(member.data(), member.size());
+    }
+
+    if(m_pWriter != &std::cout)
+        delete m_pWriter;
+}
+
+//
+void PreprocessWriter::write(const std::string& buffer)
+{
+    if(!m_compress)
+    {
+        m_pWriter->write(buffer.data(), buffer.size());
+        return;
+    }
+
+    if(buffer.empty())
+        return;
+
+    // Split the buffer into one block per thread, as long as the blocks
+    // are large enough to not hurt the compression ratio
+    size_t blockSize = (buffer.size() + opt::numThreads - 1) / opt::numThreads;
+    blockSize = std::max(blockSize, (size_t)PREPROCESS_MIN_GZIP_BLOCK);
+    blockSize = std::min(blockSize, (size_t)PREPROCESS_MAX_GZIP_BLOCK);
+    int numBlocks = (buffer.size() + blockSize - 1) / blockSize;
+
+    std::vector<std::string> members(numBlocks);
+#if HAVE_OPENMP
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for(int i = 0; i < numBlocks; ++i)
+    {
+        size_t start = i * blockSize;
+        size_t length = std::min(blockSize, buffer.size() - start);
+        compressGzipMember(buffer.data() + start, length, members[i]);
+    }
+
+    for(int i = 0; i < numBlocks; ++i)
+        m_pWriter->write(members[i].data(), members[i].size());
+    m_writtenMember = true;
+}
+
+// Compress data into a complete gzip member, stored in out
+void compressGzipMember(const char* data, size_t length, std::string& out)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+
+    // A window size of 15 + 16 tells zlib to write a gzip header and trailer
+    if(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        std::cerr << "Error: could not initialize gzip compression\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // deflateBound does not include the gzip header and trailer in older versions of zlib
+    out.resize(deflateBound(&zs, length) + 32);
+    zs.next_in = (Bytef*)data;
+    zs.avail_in = length;
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = out.size();
+
+    if(deflate(&zs, Z_FINISH) != Z_STREAM_END)
+    {
+        std::cerr << "Error: gzip compression failed\n";
+        exit(EXIT_FAILURE);
+    }
+
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+}
+
 // Perform a soft-clipping of the sequence by removing low quality bases from the
 // 3' end using Heng Li's algorithm from bwa
 void softClip(int qualTrim, std::string& seq, std::string& qual)
@@ -625,6 +861,7 @@ void parsePreprocessOptions(int argc, char** argv)
             case 'm': arg >> opt::minLength; break;
             case 'h': arg >> opt::hardClip; break;
             case 'p': arg >> opt::peMode; break;
+            case 't': arg >> opt::numThreads; break;
             case 'r': arg >> opt::adapterF; break;
             case 'c': arg >> opt::adapterR; break;
             case 's': arg >> opt::sampleFreq; break;
@@ -656,6 +893,12 @@ void parsePreprocessOptions(int argc, char** argv)
         die = true;
     }
 
+    if(opt::numThreads <= 0)
+    {
+        std::cerr << SUBPROGRAM ": invalid number of threads: " << opt::numThreads << "\n";
+        die = true;
+    }
+
     if (die)
     {
         std::cout << "\n" << PREPROCESS_USAGE_MESSAGE;
@@ -15,10 +15,13 @@
 // functions
 int preprocessMain(int argc, char** argv);
 void parsePreprocessOptions(int argc, char** argv);
-bool processRead(SeqRecord& record);
+struct PreprocessStats;
+void processBatch(std::vector<SeqRecord>& records, std::vector<uint8_t>& passed);
+bool processRead(SeqRecord& record, unsigned int& randState, PreprocessStats& stats);
 bool samplePass();
 void softClip(int qualTrim, std::string& seq, std::string& qual);
 int countLowQuality(const std::string& seq, const std::string& qual);
 double calcGC(const std::string& seq);
+void compressGzipMember(const char* data, size_t length, std::string& out);
 
 #endif
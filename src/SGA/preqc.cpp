@@ -41,6 +41,29 @@ enum BranchClassification
     BC_REPEAT
 };
 
+// The random number streams used by the sampling loops. Each
+// loop draws its samples from its own stream so that the
+// modules do not affect each other's samples.
+enum SampleStream
+{
+    SS_QUALITY_STATS,
+    SS_KMER_COUNTS,
+    SS_GENOME_SIZE,
+    SS_KMER_COVERAGE,
+    SS_FIRST_ERROR,
+    SS_ERRORS_PER_BASE,
+    SS_GRAPH_COMPLEXITY,
+    SS_DOUBLE_BRANCH,
+    SS_RANDOM_WALK,
+    SS_GC,
+    SS_DUPLICATION,
+    SS_FRAGMENT_SIZE,
+    SS_BRANCH_CLASSIFICATION,
+    SS_REFERENCE_BRANCH_CLASSIFICATION,
+    SS_DE_BRUIJN_SIMULATION,
+    SS_UNIPATH_LENGTH
+};
+
 // Structs
 
 // struct to store some estimated properties of the genome
@@ -98,6 +121,24 @@ struct ModelPosteriors
     BranchClassification classification;
 };
 
+// struct to sum the branch classification results of one thread
+struct BranchClassificationSums
+{
+    BranchClassificationSums() : num_error_branches(0), 
+                                 num_variant_branches(0), 
+                                 num_repeat_branches(0),
+                                 num_kmers(0),
+                                 mean_count(0),
+                                 n_tests(0) {}
+
+    double num_error_branches;
+    double num_variant_branches;
+    double num_repeat_branches;
+    double num_kmers;
+    double mean_count;
+    size_t n_tests;
+};
+
 // struct to store a description of the neighbors of a vertex in the graph
 struct KmerNeighbors
 {
@@ -159,6 +200,8 @@ static const char *PREQC_USAGE_MESSAGE =
 "      -v, --verbose                    display verbose output\n"
 "      -t, --threads=NUM                use NUM threads (default: 1)\n"
 "          --simple                     only compute the metrics that do not need the FM-index\n"
+"          --seed=N                     use N to seed the random sampling. The output is reproducible\n"
+"                                       for a given seed and number of threads (default: 0)\n"
 "          --max-contig-length=N        stop contig extension at N bp (default: 50000)\n"
 "          --reference=FILE             use the reference FILE to calculate GC plot\n"
 "          --diploid-reference-mode     generate metrics assuming that the input data\n"
@@ -183,11 +226,12 @@ namespace opt
     static int diploidReferenceMode = 0;
     static bool forceEM = false;
     static bool simple = false;
+    static unsigned int seed = 0;
 }
 
 static const char* shortopts = "p:d:t:o:k:n:b:v";
 
-enum { OPT_HELP = 1, OPT_VERSION, OPT_REFERENCE, OPT_MAX_CONTIG, OPT_DIPLOID, OPT_FORCE_EM, OPT_SIMPLE };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_REFERENCE, OPT_MAX_CONTIG, OPT_DIPLOID, OPT_FORCE_EM, OPT_SIMPLE, OPT_SEED };
 
 static const struct option longopts[] = {
     { "verbose",                no_argument,       NULL, 'v' },
@@ -200,6 +244,7 @@ static const struct option longopts[] = {
     { "max-contig-length",      required_argument, NULL, OPT_MAX_CONTIG },
     { "reference",              required_argument, NULL, OPT_REFERENCE },
     { "simple",                 no_argument,       NULL, OPT_SIMPLE },
+    { "seed",                   required_argument, NULL, OPT_SEED },
     { "force-EM",               no_argument,       NULL, OPT_FORCE_EM },
     { "diploid-reference-mode", no_argument,       NULL, OPT_DIPLOID },
     { "help",                   no_argument,       NULL, OPT_HELP },
@@ -207,6 +252,34 @@ static const struct option longopts[] = {
     { NULL, 0, NULL, 0 }
 };
 
+// Return the initial rand_r state for sample i of a sampling loop.
+// Each sample has its own state, derived from the seed, the stream
+// and the sample index, so the sample drawn does not depend on which
+// thread processes it. param distinguishes loops that are run once
+// per value of k.
+unsigned int get_sample_seed(SampleStream stream, size_t param, size_t i)
+{
+    // splitmix64 finalizer
+    uint64_t x = opt::seed;
+    x = x * 0x9E3779B97F4A7C15ULL + stream;
+    x = x * 0x9E3779B97F4A7C15ULL + param;
+    x = x * 0x9E3779B97F4A7C15ULL + i;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x = x ^ (x >> 31);
+    return static_cast<unsigned int>(x);
+}
+
+// Return the number of the calling thread within the current parallel region
+inline int get_thread_num()
+{
+#if HAVE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
 // Returns the valid SUFFIX neighbors of the kmer
 // in the de Bruijn graph. The neighbors are encoded
 // as the single base they add. A coverage threshold
@@ -351,24 +424,60 @@ int calculate_delta(const std::string& kmer,
     return delta;
 }
 
-KmerDistribution sample_kmer_counts(size_t k, size_t n, const BWTIndexSet& index_set)
+// Sample n reads using all threads and add the count of each of their
+// k-mers to distribution. Returns the total length of the sampled reads.
+size_t sample_kmer_distribution(SampleStream stream,
+                                size_t k, 
+                                size_t n, 
+                                const BWTIndexSet& index_set, 
+                                KmerDistribution& distribution)
 {
-    // Learn k-mer occurrence distribution for this value of k
-    KmerDistribution distribution;
-    for(size_t i = 0; i < n; ++i)
+    size_t sum_read_length = 0;
+
+#if HAVE_OPENMP
+    omp_set_num_threads(opt::numThreads);
+    #pragma omp parallel
+#endif
     {
-        std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
-        if(s.size() < k)
-            continue;
-        size_t nk = s.size() - k + 1;    
-        for(size_t j = 0; j < nk; ++j)
+        KmerDistribution thread_distribution;
+        size_t thread_read_length = 0;
+
+#if HAVE_OPENMP
+        #pragma omp for schedule(dynamic, 64)
+#endif
+        for(int i = 0; i < (int)n; ++i)
+        {
+            unsigned int seed = get_sample_seed(stream, k, i);
+            std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT, &seed);
+            thread_read_length += s.size();
+            if(s.size() < k)
+                continue;
+
+            size_t nk = s.size() - k + 1;    
+            for(size_t j = 0; j < nk; ++j)
+            {
+                std::string kmer = s.substr(j, k);
+                thread_distribution.add(BWTAlgorithms::countSequenceOccurrences(kmer, index_set.pBWT));
+            }
+        }
+
+        // The distribution does not depend on the order the counts are added in
+#if HAVE_OPENMP
+        #pragma omp critical
+#endif
         {
-            std::string kmer = s.substr(j, k);
-            int count = BWTAlgorithms::countSequenceOccurrences(kmer, index_set.pBWT);
-            distribution.add(count);
+            distribution.merge(thread_distribution);
+            sum_read_length += thread_read_length;
         }
     }
+    return sum_read_length;
+}
 
+KmerDistribution sample_kmer_counts(size_t k, size_t n, const BWTIndexSet& index_set)
+{
+    // Learn k-mer occurrence distribution for this value of k
+    KmerDistribution distribution;
+    sample_kmer_distribution(SS_KMER_COUNTS, k, n, index_set, distribution);
     return distribution;
 }
 
@@ -648,18 +757,7 @@ void generate_kmer_coverage(JSONWriter* pWriter, const BWTIndexSet& index_set)
     pWriter->Int(k);
     
     KmerDistribution kmerDistribution;
-    for(size_t i = 0; i < n_samples; ++i)
-    {
-        std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
-        int n = s.size();
-        int nk = n - k + 1;
-        for(int j = 0; j < nk; ++j)
-        {
-            std::string kmer = s.substr(j, k);
-            int count = BWTAlgorithms::countSequenceOccurrences(kmer, index_set.pBWT);
-            kmerDistribution.add(count);
-        }
-    }
+    sample_kmer_distribution(SS_KMER_COVERAGE, k, n_samples, index_set, kmerDistribution);
 
     pWriter->String("distribution");
     pWriter->StartArray();
@@ -689,36 +787,67 @@ void generate_position_of_first_error(JSONWriter* pWriter, const BWTIndexSet& in
 
     std::vector<size_t> position_count;
     std::vector<size_t> error_count;
-    for(size_t i = 0; i < n_samples; ++i)
+
+#if HAVE_OPENMP
+    omp_set_num_threads(opt::numThreads);
+    #pragma omp parallel
+#endif
     {
-        std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
-        if(s.length() < k)
-            continue;
+        std::vector<size_t> thread_position_count;
+        std::vector<size_t> thread_error_count;
 
-        size_t nk = s.size() - k + 1;
-        size_t first_kmer_count = 
-            BWTAlgorithms::countSequenceOccurrences(s.substr(0, k), index_set.pBWT);
+#if HAVE_OPENMP
+        #pragma omp for schedule(dynamic, 64)
+#endif
+        for(int i = 0; i < (int)n_samples; ++i)
+        {
+            unsigned int seed = get_sample_seed(SS_FIRST_ERROR, k, i);
+            std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT, &seed);
+            if(s.length() < k)
+                continue;
 
-        // Skip reads with a weak starting kmer
-        if(first_kmer_count < starting_count)
-            continue;
+            size_t nk = s.size() - k + 1;
+            size_t first_kmer_count = 
+                BWTAlgorithms::countSequenceOccurrences(s.substr(0, k), index_set.pBWT);
 
-        for(size_t j = 1; j < nk; ++j)
-        {
-            size_t kmer_count =
-                BWTAlgorithms::countSequenceOccurrences(s.substr(j, k), index_set.pBWT);
+            // Skip reads with a weak starting kmer
+            if(first_kmer_count < starting_count)
+                continue;
+
+            for(size_t j = 1; j < nk; ++j)
+            {
+                size_t kmer_count =
+                    BWTAlgorithms::countSequenceOccurrences(s.substr(j, k), index_set.pBWT);
+
+                if(j >= thread_position_count.size())
+                {
+                    thread_position_count.resize(j+1);
+                    thread_error_count.resize(j+1);
+                }
+
+                thread_position_count[j] += 1;
+                if(kmer_count < min_count)
+                {
+                    thread_error_count[j] += 1;
+                    break;
+                }
+            }
+        }
 
-            if(j >= position_count.size())
+#if HAVE_OPENMP
+        #pragma omp critical
+#endif
+        {
+            if(thread_position_count.size() > position_count.size())
             {
-                position_count.resize(j+1);
-                error_count.resize(j+1);
+                position_count.resize(thread_position_count.size());
+                error_count.resize(thread_position_count.size());
             }
 
-            position_count[j] += 1;
-            if(kmer_count < min_count)
+            for(size_t j = 0; j < thread_position_count.size(); ++j)
             {
-                error_count[j] += 1;
-                break;
+                position_count[j] += thread_position_count[j];
+                error_count[j] += thread_error_count[j];
             }
         }
     }
@@ -765,7 +894,8 @@ void generate_errors_per_base(JSONWriter* pWriter, const BWTIndexSet& index_set)
 #endif
     for(int i = 0; i < n_samples; ++i)
     {
-        std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
+        unsigned int seed = get_sample_seed(SS_ERRORS_PER_BASE, k, i);
+        std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT, &seed);
         if(s.length() < k)
             continue;
 
@@ -867,7 +997,8 @@ void generate_local_graph_complexity(JSONWriter* pWriter, const BWTIndexSet& ind
 #endif
         for(int i = 0; i < n_samples; ++i)
         {
-            std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
+            unsigned int seed = get_sample_seed(SS_GRAPH_COMPLEXITY, k, i);
+            std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT, &seed);
             if(s.size() < k)
                 continue;
             
@@ -929,7 +1060,8 @@ void generate_double_branch(JSONWriter* pWriter, const BWTIndexSet& index_set)
 #endif
         for(int i = 0; i < n_samples; ++i)
         {
-            std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
+            unsigned int seed = get_sample_seed(SS_DOUBLE_BRANCH, k, i);
+            std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT, &seed);
             if(s.size() < k)
                 continue;
 
@@ -994,61 +1126,100 @@ void generate_random_walk_length(JSONWriter* pWriter, const BWTIndexSet& index_s
         pWriter->String("walk_lengths");
         pWriter->StartArray();
 
-#if HAVE_OPENMP
-        omp_set_num_threads(opt::numThreads);
-        #pragma omp parallel for
-#endif
-        for(int i = 0; i < n_samples; ++i)
+        // The walks are found in batches, like the de Bruijn graph simulation.
+        // A walk does not read the filter after its first kmer so the walks of a
+        // batch are run in parallel, recording the bases they extend by. The
+        // starting kmers are then tested against the filter and the walks added to it
+        // in sample order, which gives the same lengths as running the walks one by one.
+        int batch_size = 8 * opt::numThreads;
+        for(int batch_start = 0; batch_start < n_samples; batch_start += batch_size)
         {
-            size_t walk_length = 0;
-            std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
-            if(s.size() < k)
-                continue;
+            int batch_end = std::min(batch_start + batch_size, n_samples);
 
-            std::string kmer = s.substr(0, k);
-            std::string rc_kmer = reverseComplement(kmer);
-
-            // Only start a walk from this kmer if is not in the bloom filter and has coverage on both strands
-            bool in_filter = bloom_filter->test( (kmer < rc_kmer ? kmer.c_str() : rc_kmer.c_str()), k);
-            size_t fc = BWTAlgorithms::countSequenceOccurrencesSingleStrand(kmer, index_set);
-            size_t rc = BWTAlgorithms::countSequenceOccurrencesSingleStrand(rc_kmer, index_set);
-            if(in_filter || fc == 0 || rc == 0)
-                continue;
+            // The starting kmer of each walk and the bases it was extended by.
+            // Skipped samples have an empty starting kmer.
+            std::vector<std::string> start_kmers(batch_end - batch_start);
+            std::vector<std::string> walks(batch_end - batch_start);
 
-            while(walk_length < max_length) 
+#if HAVE_OPENMP
+            omp_set_num_threads(opt::numThreads);
+            #pragma omp parallel for schedule(dynamic)
+#endif
+            for(int i = batch_start; i < batch_end; ++i)
             {
-                bloom_filter->add( (kmer < rc_kmer ? kmer.c_str() : rc_kmer.c_str()), k);
+                unsigned int seed = get_sample_seed(SS_RANDOM_WALK, k, i);
+                std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT, &seed);
+                if(s.size() < k)
+                    continue;
 
-                // Get the possible extensions of this kmer
-                int f_counts[5] = { 0, 0, 0, 0, 0 };
-                int r_counts[5] = { 0, 0, 0, 0, 0 };
+                std::string kmer = s.substr(0, k);
+                std::string rc_kmer = reverseComplement(kmer);
 
-                fill_neighbor_count_by_strand(kmer, index_set, f_counts, r_counts);
+                // Only start a walk from this kmer if is not in the bloom filter and has coverage on both strands
+                bool in_filter = bloom_filter->test( (kmer < rc_kmer ? kmer.c_str() : rc_kmer.c_str()), k);
+                size_t fc = BWTAlgorithms::countSequenceOccurrencesSingleStrand(kmer, index_set);
+                size_t rc = BWTAlgorithms::countSequenceOccurrencesSingleStrand(rc_kmer, index_set);
+                if(in_filter || fc == 0 || rc == 0)
+                    continue;
 
-                // Only allow extensions to vertices that have coverage on both strands
-                std::string extensions;
-                for(size_t bi = 0; bi < 4; ++bi)
+                start_kmers[i - batch_start] = kmer;
+                std::string& walk = walks[i - batch_start];
+                while(walk.size() < max_length) 
                 {
-                    if(f_counts[bi] >= 1 && r_counts[bi] >= 1)
-                        extensions.append(1, "ACGT"[bi]);
+                    // Get the possible extensions of this kmer
+                    int f_counts[5] = { 0, 0, 0, 0, 0 };
+                    int r_counts[5] = { 0, 0, 0, 0, 0 };
+
+                    fill_neighbor_count_by_strand(kmer, index_set, f_counts, r_counts);
+
+                    // Only allow extensions to vertices that have coverage on both strands
+                    std::string extensions;
+                    for(size_t bi = 0; bi < 4; ++bi)
+                    {
+                        if(f_counts[bi] >= 1 && r_counts[bi] >= 1)
+                            extensions.append(1, "ACGT"[bi]);
+                    }
+
+                    if(!extensions.empty())
+                    {
+                        char b = extensions[BWTAlgorithms::randomIndex(extensions.size(), &seed)];
+                        kmer.erase(0, 1);
+                        kmer.append(1, b);
+                        walk.append(1, b);
+                    }
+                    else
+                    {
+                        break;
+                    }
                 }
+            }
 
-                if(!extensions.empty())
+            for(size_t wi = 0; wi < walks.size(); ++wi)
+            {
+                std::string kmer = start_kmers[wi];
+                if(kmer.empty())
+                    continue;
+
+                // Skip the walk if an earlier walk of the batch passed through its first kmer
+                std::string rc_kmer = reverseComplement(kmer);
+                if(bloom_filter->test( (kmer < rc_kmer ? kmer.c_str() : rc_kmer.c_str()), k))
+                    continue;
+
+                // Add every kmer of the walk except the last, which is where the walk stopped
+                const std::string& walk = walks[wi];
+                for(size_t j = 0; j < walk.size(); ++j)
                 {
+                    bloom_filter->add( (kmer < rc_kmer ? kmer.c_str() : rc_kmer.c_str()), k);
                     kmer.erase(0, 1);
-                    kmer.append(1, extensions[rand() % extensions.size()]);
+                    kmer.append(1, walk[j]);
                     rc_kmer = reverseComplement(kmer);
-                    walk_length += 1;
-                }
-                else
-                {
-                    break;
                 }
+
+                // A walk that stopped early added the kmer it could not extend
+                if(walk.size() < max_length)
+                    bloom_filter->add( (kmer < rc_kmer ? kmer.c_str() : rc_kmer.c_str()), k);
+                pWriter->Int(walk.size());
             }
-#if HAVE_OPENMP
-        #pragma omp critical
-#endif
-            pWriter->Int(walk_length);
         }
 
         pWriter->EndArray();
@@ -1077,10 +1248,20 @@ void generate_gc_distribution(JSONWriter* pJSONWriter, const BWTIndexSet& index_
     read_gc_sum.resize((size_t)(1.0f / gc_bin_size) + 1);
     ref_gc_sum.resize((size_t)(1.0f / gc_bin_size) + 1);
 
-    // Calculate the gc content of sampled reads
+    // Calculate the gc content of sampled reads. The results are stored by
+    // sample index so they can be collected in a fixed order below. 
+    // Samples that are skipped have a coverage of zero.
+    std::vector<size_t> sample_coverage(n_samples, 0);
+    std::vector<double> sample_gc(n_samples, 0.0f);
+
+#if HAVE_OPENMP
+    omp_set_num_threads(opt::numThreads);
+    #pragma omp parallel for schedule(dynamic, 64)
+#endif
     for(int i = 0; i < n_samples; ++i)
     {
-        std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
+        unsigned int seed = get_sample_seed(SS_GC, k, i);
+        std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT, &seed);
         if(s.size() < k)
             continue;
 
@@ -1100,13 +1281,22 @@ void generate_gc_distribution(JSONWriter* pJSONWriter, const BWTIndexSet& index_
                 at += 1;
         }
         
-        double gc_f = gc / (gc + at);
+        sample_gc[i] = gc / (gc + at);
+        sample_coverage[i] = cov;
+    }
+
+    for(int i = 0; i < n_samples; ++i)
+    {
+        if(sample_coverage[i] == 0)
+            continue;
+
+        double gc_f = sample_gc[i];
         size_t bin_idx = (size_t)(gc_f / gc_bin_size);
         read_gc_sum[bin_idx] += gc_f;
         read_gc_n += 1;
 
         gc_vector.push_back(gc_f);
-        coverage_vector.push_back(cov);
+        coverage_vector.push_back(sample_coverage[i]);
     }
 
     // If a reference file is provided, calculate the reference GC for comparison
@@ -1193,7 +1383,8 @@ void generate_duplication_rate(JSONWriter* pJSONWriter, const BWTIndexSet& index
     for(int i = 0; i < n_samples; ++i)
     {
         // Choose a read pair
-        int64_t source_pair_idx = rand() % total_pairs;
+        unsigned int seed = get_sample_seed(SS_DUPLICATION, k, i);
+        int64_t source_pair_idx = BWTAlgorithms::randomIndex(total_pairs, &seed);
         std::string r1 = BWTAlgorithms::extractString(index_set.pBWT, source_pair_idx * 2);
         std::string r2 = BWTAlgorithms::extractString(index_set.pBWT, source_pair_idx * 2 + 1);
 
@@ -1257,17 +1448,19 @@ void generate_pe_fragment_sizes(JSONWriter* pJSONWriter, const BWTIndexSet& inde
     size_t k = 51;
     size_t MAX_INSERT = 1500;
 
-    std::vector<size_t> fragment_sizes;
+    // The size found for each sample, or zero if no path was found
+    std::vector<size_t> sample_sizes(n_samples, 0);
 
     size_t total_pairs = index_set.pBWT->getNumStrings() / 2;
 #if HAVE_OPENMP
     omp_set_num_threads(opt::numThreads);
-    #pragma omp parallel for
+    #pragma omp parallel for schedule(dynamic, 64)
 #endif
     for(int i = 0; i < n_samples; ++i)
     {
         // Choose a read pair
-        int64_t source_pair_idx = rand() % total_pairs;
+        unsigned int seed = get_sample_seed(SS_FRAGMENT_SIZE, k, i);
+        int64_t source_pair_idx = BWTAlgorithms::randomIndex(total_pairs, &seed);
         std::string start_kmer = BWTAlgorithms::extractString(index_set.pBWT, source_pair_idx * 2).substr(0, k);
         std::string end_kmer = BWTAlgorithms::extractString(index_set.pBWT, source_pair_idx * 2 + 1).substr(0, k);
         // We assume that the pairs are orientated F/R therefore we reverse-complement k_end
@@ -1292,12 +1485,14 @@ void generate_pe_fragment_sizes(JSONWriter* pJSONWriter, const BWTIndexSet& inde
         }
 
         if(found)
-        {
-#if HAVE_OPENMP
-            #pragma omp critical
-#endif
-            fragment_sizes.push_back(steps + k);
-        }
+            sample_sizes[i] = steps + k;
+    }
+
+    std::vector<size_t> fragment_sizes;
+    for(int i = 0; i < n_samples; ++i)
+    {
+        if(sample_sizes[i] > 0)
+            fragment_sizes.push_back(sample_sizes[i]);
     }
 
     pJSONWriter->String("FragmentSize");
@@ -1323,9 +1518,10 @@ void generate_quality_stats(JSONWriter* pJSONWriter, const std::string& filename
     std::vector<size_t> sum_quality;
     std::vector<size_t> num_q30;
 
+    unsigned int seed = get_sample_seed(SS_QUALITY_STATS, 0, 0);
     while(reader.get(record) && n_reads++ < max_reads)
     {
-        if((double)rand() / RAND_MAX < sample_rate && record.qual.length() == record.seq.length())
+        if((double)rand_r(&seed) / RAND_MAX < sample_rate && record.qual.length() == record.seq.length())
         {
             size_t l = record.seq.length();
             if(l > bases_checked.size())
@@ -1366,22 +1562,12 @@ void generate_quality_stats(JSONWriter* pJSONWriter, const std::string& filename
 GenomeEstimates estimate_genome_size_from_k_counts(size_t k, const BWTIndexSet& index_set)
 {
     //
-    size_t sum_read_length = 0;
-    
     KmerDistribution kmerDistribution;
-    for(size_t i = 0; i < opt::kmerDistributionSamples; ++i)
-    {
-        std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
-        int n = s.size();
-        int nk = n - k + 1;
-        for(int j = 0; j < nk; ++j)
-        {
-            std::string kmer = s.substr(j, k);
-            int count = BWTAlgorithms::countSequenceOccurrences(kmer, index_set.pBWT);
-            kmerDistribution.add(count);
-        }
-        sum_read_length += s.size();
-    }
+    size_t sum_read_length = sample_kmer_distribution(SS_GENOME_SIZE, 
+                                                      k, 
+                                                      opt::kmerDistributionSamples, 
+                                                      index_set, 
+                                                      kmerDistribution);
 
     // calculate the k-mer count model parameters from the distribution
     // this gives us the estimated proportion of kmers that contain errors
@@ -1580,21 +1766,20 @@ void generate_branch_classification(JSONWriter* pWriter,
         for(size_t c = 4; c < max_count; ++c)
             p_unique_by_count[c] = probability_diploid_copy(params, c);
 
-        // Our output counts
-        double num_error_branches = 0;
-        double num_variant_branches = 0;
-        double num_repeat_branches = 0;
-        double num_kmers = 0;
-        double mean_count = 0;
-        size_t n_tests = 0;
+        // Each thread sums the results of its own samples. The samples are
+        // statically assigned to the threads, so adding the per-thread sums in
+        // thread order gives the same floating point result on every run.
+        std::vector<BranchClassificationSums> thread_sums(opt::numThreads);
 
 #if HAVE_OPENMP
         omp_set_num_threads(opt::numThreads);
-        #pragma omp parallel for
+        #pragma omp parallel for schedule(static)
 #endif
         for(int i = 0; i < classification_samples; ++i)
         {
-            std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
+            BranchClassificationSums& sums = thread_sums[get_thread_num()];
+            unsigned int seed = get_sample_seed(SS_BRANCH_CLASSIFICATION, k, i);
+            std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT, &seed);
             if(s.size() < k)
                 continue;
             
@@ -1631,23 +1816,31 @@ void generate_branch_classification(JSONWriter* pWriter,
                     ret = classify_2_branch(params, estimates, c_1, c_2, delta);
                 }
 
-#if HAVE_OPENMP
-                #pragma omp critical
-#endif
-                {
-                    num_error_branches += (p_single_copy * ret.posterior_error);
-                    num_variant_branches += (p_single_copy * ret.posterior_variant);
-                    num_repeat_branches += (p_single_copy * ret.posterior_repeat);
-                    num_kmers += p_single_copy;
-                    mean_count += count;
-                    n_tests += 1;
-                }
+                sums.num_error_branches += (p_single_copy * ret.posterior_error);
+                sums.num_variant_branches += (p_single_copy * ret.posterior_variant);
+                sums.num_repeat_branches += (p_single_copy * ret.posterior_repeat);
+                sums.num_kmers += p_single_copy;
+                sums.mean_count += count;
+                sums.n_tests += 1;
 
                 if(ret.classification == BC_VARIANT || ret.classification == BC_REPEAT)
                     break;
             }
         }
 
+        // Our output counts
+        double num_error_branches = 0;
+        double num_variant_branches = 0;
+        double num_repeat_branches = 0;
+        double num_kmers = 0;
+        for(size_t t = 0; t < thread_sums.size(); ++t)
+        {
+            num_error_branches += thread_sums[t].num_error_branches;
+            num_variant_branches += thread_sums[t].num_variant_branches;
+            num_repeat_branches += thread_sums[t].num_repeat_branches;
+            num_kmers += thread_sums[t].num_kmers;
+        }
+
         pWriter->StartObject();
         pWriter->String("k");
         pWriter->Int(k);
@@ -1700,7 +1893,8 @@ void generate_reference_branch_classification(JSONWriter* pWriter, const BWTInde
 #endif
         for(int i = 0; i < classification_samples; ++i)
         {
-            std::string s = BWTAlgorithms::sampleRandomSubstring(index_set.pBWT, 100);
+            unsigned int seed = get_sample_seed(SS_REFERENCE_BRANCH_CLASSIFICATION, k, i);
+            std::string s = BWTAlgorithms::sampleRandomSubstring(index_set.pBWT, 100, &seed);
             if(s.size() < k)
                 continue;
             
@@ -1828,117 +2022,131 @@ void generate_de_bruijn_simulation(JSONWriter* pWriter,
         pWriter->Int(static_cast<int>(params.mode));
         pWriter->String("walk_lengths");
         pWriter->StartArray();
+
+        // The walks are found in batches. The walks of a batch are run in parallel,
+        // testing their starting kmers against the filter as it was at the start of
+        // the batch. They are then added to the filter and written in sample order, 
+        // so the output does not depend on the order the threads finish in.
+        int batch_size = 8 * opt::numThreads;
+        for(int batch_start = 0; batch_start < n_samples; batch_start += batch_size)
+        {
+            int batch_end = std::min(batch_start + batch_size, n_samples);
+
+            // Skipped samples have an empty walk
+            std::vector<std::set<std::string> > walks(batch_end - batch_start);
+
 #if HAVE_OPENMP
-        omp_set_num_threads(opt::numThreads);
-        #pragma omp parallel for
+            omp_set_num_threads(opt::numThreads);
+            #pragma omp parallel for schedule(dynamic)
 #endif
-        for(int i = 0; i < n_samples; ++i)
-        {
-            //
-            // Find a new starting point for the walk
-            //
+            for(int i = batch_start; i < batch_end; ++i)
+            {
+                std::set<std::string>& kmer_set = walks[i - batch_start];
 
-            // Get a random read from the BWT
-            std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
+                // Get a random read from the BWT
+                unsigned int seed = get_sample_seed(SS_DE_BRUIJN_SIMULATION, k, i);
+                std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT, &seed);
 
-            // Use the first-kmer of the read to seed the seach
-            if(s.size() < k)
-                continue;
+                // Use the first-kmer of the read to seed the seach
+                if(s.size() < k)
+                    continue;
             
-            std::string start_kmer = s.substr(0, k);
+                std::string start_kmer = s.substr(0, k);
 
-            size_t count = BWTAlgorithms::countSequenceOccurrences(start_kmer, index_set);
+                size_t count = BWTAlgorithms::countSequenceOccurrences(start_kmer, index_set);
             
-            // Only start walks from paths that are likely to be unique diploid sequence
-            if(count >= 3 * params.mode)
-                continue;
-
-            double p_single_copy = p_unique_by_count[count];
-            if(p_single_copy < 0.50)
-                continue;
+                // Only start walks from paths that are likely to be unique diploid sequence
+                if(count >= 3 * params.mode)
+                    continue;
 
-            // skip if this kmer has been used in a previous walk
-            std::string rc_start_kmer = reverseComplement(start_kmer);
-            bool in_filter = bf->test( (start_kmer < rc_start_kmer ? start_kmer.c_str() : rc_start_kmer.c_str()), k);
-            if(in_filter)
-                continue;
+                double p_single_copy = p_unique_by_count[count];
+                if(p_single_copy < 0.50)
+                    continue;
 
-            //
-            // All checks pass, start a new walk
-            //
-            std::set<std::string> kmer_set;
+                // skip if this kmer has been used in a previous walk
+                std::string rc_start_kmer = reverseComplement(start_kmer);
+                bool in_filter = bf->test( (start_kmer < rc_start_kmer ? start_kmer.c_str() : rc_start_kmer.c_str()), k);
+                if(in_filter)
+                    continue;
 
-            for(size_t dir = 0; dir <= 1; ++dir)
-            {
-                std::string curr_kmer = dir == 0 ? start_kmer : reverseComplement(start_kmer);
-                kmer_set.insert(curr_kmer);
+                //
+                // All checks pass, start a new walk
+                //
 
-                bool done = false;
-                while(!done && kmer_set.size() < opt::maxContigLength)
+                for(size_t dir = 0; dir <= 1; ++dir)
                 {
-                    KmerNeighbors neighbors = calculate_neighbor_data(curr_kmer, index_set);
+                    std::string curr_kmer = dir == 0 ? start_kmer : reverseComplement(start_kmer);
+                    kmer_set.insert(curr_kmer);
 
-                    char extension_base = '\0';
-                    if(neighbors.extensions_both_strands.size() < 2)
+                    bool done = false;
+                    while(!done && kmer_set.size() < opt::maxContigLength)
                     {
-                        // No ambiguity, just pick the highest coverage extension as the next node
-                        // In this case we do not require the picked node to have coverage on both strands
-                        std::string sorted = KmerNeighbors::getExtensionsFromCount(neighbors.total_count);
-                        char best_extension = sorted[0];
-                        if(neighbors.total_count.get(best_extension) > 0)
-                            extension_base = best_extension;
-                    } 
-                    else
-                    {
-                        std::string sorted = KmerNeighbors::getExtensionsFromCount(neighbors.count_both_strands);
-                        char b_1 = sorted[0];
-                        char b_2 = sorted[1];
-
-                        size_t c_1 = neighbors.count_both_strands.get(b_1);
-                        size_t c_2 = neighbors.count_both_strands.get(b_2);
-
-                        // Calculate delta and classify the branch
-                        int delta = calculate_delta(curr_kmer, neighbors, index_set);
-                        assert(delta >= 0);
-                        ModelPosteriors ret = classify_2_branch(params, estimates, c_1, c_2, delta);
+                        KmerNeighbors neighbors = calculate_neighbor_data(curr_kmer, index_set);
 
-                        if(ret.classification == BC_ERROR || ret.classification == BC_VARIANT)
+                        char extension_base = '\0';
+                        if(neighbors.extensions_both_strands.size() < 2)
                         {
-                            // if this is an error branch, we take the non-error (higher coverage) option
-                            // if this is a variant path we also take the higher coverage option to simulate
-                            // a successfully popped bubble
-                            extension_base = sorted[0];
+                            // No ambiguity, just pick the highest coverage extension as the next node
+                            // In this case we do not require the picked node to have coverage on both strands
+                            std::string sorted = KmerNeighbors::getExtensionsFromCount(neighbors.total_count);
+                            char best_extension = sorted[0];
+                            if(neighbors.total_count.get(best_extension) > 0)
+                                extension_base = best_extension;
+                        } 
+                        else
+                        {
+                            std::string sorted = KmerNeighbors::getExtensionsFromCount(neighbors.count_both_strands);
+                            char b_1 = sorted[0];
+                            char b_2 = sorted[1];
+
+                            size_t c_1 = neighbors.count_both_strands.get(b_1);
+                            size_t c_2 = neighbors.count_both_strands.get(b_2);
+
+                            // Calculate delta and classify the branch
+                            int delta = calculate_delta(curr_kmer, neighbors, index_set);
+                            assert(delta >= 0);
+                            ModelPosteriors ret = classify_2_branch(params, estimates, c_1, c_2, delta);
+
+                            if(ret.classification == BC_ERROR || ret.classification == BC_VARIANT)
+                            {
+                                // if this is an error branch, we take the non-error (higher coverage) option
+                                // if this is a variant path we also take the higher coverage option to simulate
+                                // a successfully popped bubble
+                                extension_base = sorted[0];
+                            }
                         }
-                    }
 
-                    if(extension_base != '\0')
-                    {
-                        curr_kmer.erase(0, 1);
-                        curr_kmer.append(1, extension_base);
+                        if(extension_base != '\0')
+                        {
+                            curr_kmer.erase(0, 1);
+                            curr_kmer.append(1, extension_base);
                         
-                        // the insert call returns true in the second
-                        // element of the pair if it succeeds
-                        if(!kmer_set.insert(curr_kmer).second)
+                            // the insert call returns true in the second
+                            // element of the pair if it succeeds
+                            if(!kmer_set.insert(curr_kmer).second)
+                                done = true;
+                        }
+                        else
+                        {
                             done = true;
-                    }
-                    else
-                    {
-                        done = true;
+                        }
                     }
                 }
             }
 
-#if HAVE_OPENMP
-            #pragma omp critical
-#endif
+            for(size_t wi = 0; wi < walks.size(); ++wi)
             {
-                // For small genomes there is a very real possibility that multiple threads
-                // found the same path simultaneously. We do this update section within
-                // a lock to detect this case using the bloom filter. If more than p percentage 
-                // kmers in the walk are already in the filter, we reject the path
+                const std::set<std::string>& kmer_set = walks[wi];
+                if(kmer_set.empty())
+                    continue;
+
+                // For small genomes there is a very real possibility that multiple walks
+                // in a batch found the same path. We detect this case using the bloom filter. 
+                // If more than p percentage kmers in the walk are already in the filter, 
+                // we reject the path
                 size_t total_kmers = kmer_set.size();
                 size_t kmers_in_filter = 0;
-                for(std::set<std::string>::iterator iter = kmer_set.begin();
+                for(std::set<std::string>::const_iterator iter = kmer_set.begin();
                         iter != kmer_set.end(); ++iter)
                 {
                     std::string rc_curr = reverseComplement(*iter);
@@ -1978,18 +2186,38 @@ int preQCMain(int argc, char** argv)
     // Top-level document
     writer.StartObject();
     
-    // In simple mode we only compute metrics that do not need the FM-index
-    generate_quality_stats(&writer, opt::readsFile);
+    // The quality scores are read from the reads file, which does not need the FM-index, 
+    // so the FM-index is loaded at the same time. Only the quality stats use the writer here.
+    BWTIndexSet index_set;
+#if HAVE_OPENMP
+    #pragma omp parallel sections num_threads(2) if(opt::numThreads > 1 && !opt::simple)
+#endif
+    {
+#if HAVE_OPENMP
+        #pragma omp section
+#endif
+        {
+            // In simple mode we only compute metrics that do not need the FM-index
+            generate_quality_stats(&writer, opt::readsFile);
+        }
 
-    // Load the FM-index and compute the rest of the metrics if requested
+#if HAVE_OPENMP
+        #pragma omp section
+#endif
+        {
+            if(!opt::simple)
+            {
+                fprintf(stderr, "Loading FM-index of %s\n", opt::readsFile.c_str());
+                index_set.pBWT = new BWT(opt::prefix + BWT_EXT);
+                index_set.pSSA = new SampledSuffixArray(opt::prefix + SAI_EXT, SSA_FT_SAI);
+                index_set.pCache = new BWTIntervalCache(10, index_set.pBWT);
+            }
+        }
+    }
+
+    // Compute the rest of the metrics if requested
     if(!opt::simple)
     {
-        BWTIndexSet index_set;
-        fprintf(stderr, "Loading FM-index of %s\n", opt::readsFile.c_str());
-        index_set.pBWT = new BWT(opt::prefix + BWT_EXT);
-        index_set.pSSA = new SampledSuffixArray(opt::prefix + SAI_EXT, SSA_FT_SAI);
-        index_set.pCache = new BWTIntervalCache(10, index_set.pBWT);
-
         if(!opt::diploidReferenceMode)
         {
             GenomeEstimates estimates = generate_genome_size(&writer, index_set);
@@ -2034,14 +2262,19 @@ void unipath_length_distribution(JSONWriter* pWriter,
     pWriter->String("walk_lengths");
     pWriter->StartArray();
 
+    // The walk length of each sample is stored so they can be 
+    // written in sample order. Skipped samples are marked with -1.
+    std::vector<int> walk_lengths(n_samples, -1);
+
 #if HAVE_OPENMP
     omp_set_num_threads(opt::numThreads);
-    #pragma omp parallel for
+    #pragma omp parallel for schedule(dynamic)
 #endif
     for(int i = 0; i < (int)n_samples; ++i)
     {
         // Get a random read from the BWT
-        std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT);
+        unsigned int seed = get_sample_seed(SS_UNIPATH_LENGTH, k, i);
+        std::string s = BWTAlgorithms::sampleRandomString(index_set.pBWT, &seed);
 
         // Use the first-kmer of the read to seed the seach
         if(s.size() < k)
@@ -2072,10 +2305,13 @@ void unipath_length_distribution(JSONWriter* pWriter,
                 done = true;
             }
         }
-#if HAVE_OPENMP
-        #pragma omp critical
-#endif
-        pWriter->Int(walk_length);
+        walk_lengths[i] = walk_length;
+    }
+
+    for(size_t i = 0; i < n_samples; ++i)
+    {
+        if(walk_lengths[i] >= 0)
+            pWriter->Int(walk_lengths[i]);
     }
     pWriter->EndArray();
     pWriter->EndObject();
@@ -2097,6 +2333,7 @@ void parsePreQCOptions(int argc, char** argv)
             case '?': die = true; break;
             case 'v': opt::verbose++; break;
             case OPT_SIMPLE: opt::simple = true; break;
+            case OPT_SEED: arg >> opt::seed; break;
             case OPT_MAX_CONTIG: arg >> opt::maxContigLength; break;
             case OPT_DIPLOID: opt::diploidReferenceMode = true; break;
             case OPT_REFERENCE: arg >> opt::referenceFile; break;
@@ -198,7 +198,7 @@ std::string parseDupHits(const StringVector& hitsFilenames, const std::string& o
     // are duplicated, the read with the lexographically lower read name was chosen
     // to be kept. To save memory here, we break ties using the index in the ReadInfoTable
     // instead. This allows us to avoid loading the read names.
-    ReadInfoTable* pRIT = new ReadInfoTable(opt::readsFile, pFwdSAI->getNumStrings(), RIO_NUMERICID);
+    ReadInfoTable* pRIT = new ReadInfoTable(opt::readsFile, opt::prefix, pFwdSAI->getNumStrings(), RIO_NUMERICID);
 
     std::string outFile = out_prefix + ".fa";
     std::string dupFile = out_prefix + ".dups.fa";
@@ -17,6 +17,13 @@
 #include "OverlapTools.h"
 #include "ScaffoldSequenceCollection.h"
 
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
+
+// The number of scaffold records that are resolved in parallel at a time
+#define SCAFFOLD2FASTA_BATCH_SIZE 1000
+
 //
 void writeUnplaced(std::ostream* pWriter, StringGraph* pGraph, int minLength);
 
@@ -64,6 +71,9 @@ static const char *SCAFFOLD2FASTA_USAGE_MESSAGE =
 "                                       aggressive. The default is unique\n"
 "      -d, --distanceFactor=T           Accept a walk as correctly resolving a gap if the walk length is within T standard \n"
 "                                       deviations from the estimated distance (default: 3.0f)\n" 
+"          --max-search-nodes=N         stop the walk search for a link after it has expanded N nodes. The link is\n"
+"                                       then resolved with a gap (default: 10000)\n"
+"      -t, --threads=NUM                use NUM threads to resolve the scaffolds (default: 1)\n"
 "\nReport bugs to " PACKAGE_BUGREPORT "\n\n";
 
 namespace opt
@@ -83,11 +93,13 @@ namespace opt
     static bool bWriteNames = false;
     static int minScaffoldLength = 200;
     static float distanceFactor = 3.0f;
+    static size_t maxSearchNodes = 10000;
+    static int numThreads = 1;
 }
 
-static const char* shortopts = "vm:o:f:a:g:d:";
+static const char* shortopts = "vm:o:f:a:g:d:t:";
 
-enum { OPT_HELP = 1, OPT_VERSION, OPT_NOSINGLETON, OPT_USEOVERLAP, OPT_MINGAPLENGTH, OPT_WRITEUNPLACED, OPT_WRITENAMES };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_NOSINGLETON, OPT_USEOVERLAP, OPT_MINGAPLENGTH, OPT_WRITEUNPLACED, OPT_WRITENAMES, OPT_MAXSEARCHNODES };
 
 static const struct option longopts[] = {
     { "verbose",        no_argument,       NULL, 'v' },
@@ -97,6 +109,8 @@ static const struct option longopts[] = {
     { "asqg-file",      required_argument, NULL, 'a' },
     { "graph-resolve",  required_argument, NULL, 'g' },
     { "distanceFactor", required_argument, NULL, 'd' },
+    { "threads",        required_argument, NULL, 't' },
+    { "max-search-nodes", required_argument, NULL, OPT_MAXSEARCHNODES },
     { "min-gap-length", required_argument, NULL, OPT_MINGAPLENGTH },
     { "write-unplaced", no_argument,       NULL, OPT_WRITEUNPLACED },
     { "write-names",    no_argument,       NULL, OPT_WRITENAMES },
@@ -138,6 +152,9 @@ int scaffold2fastaMain(int argc, char** argv)
     // Statistics tracking object
     ResolveStats stats;
 
+    // Results of graph walks, shared between threads
+    GraphResolveCache resolveCache;
+
     // Set up the parameters for the gap resolution function
     resolveParams.minOverlap = opt::minOverlap;
     resolveParams.maxOverlap = opt::maxOverlap;
@@ -145,19 +162,77 @@ int scaffold2fastaMain(int argc, char** argv)
     resolveParams.resolveMask = opt::resolveMask;
     resolveParams.minGapLength = opt::minGapLength;
     resolveParams.distanceFactor = opt::distanceFactor;
+    resolveParams.maxSearchNodes = opt::maxSearchNodes;
     resolveParams.pStats = &stats;
+    resolveParams.pGraphResolveCache = &resolveCache;
+
+#if HAVE_OPENMP
+    omp_set_num_threads(opt::numThreads);
+#endif
+
+    // The scaffolds are read in batches and their strings are generated in parallel.
+    // The graph and sequence collection are only read while the batch is processed.
+    // The placed sequences are marked in the collection after the batch is done, in input order.
+    std::vector<ScaffoldRecord> records;
+    std::vector<std::string> sequences;
+    std::vector<StringVector> componentIDs;
+    std::vector<StringVector> placedIDs;
 
     std::string line;
     size_t idx = 0;
-    while(getline(*pReader, line))
+    bool done = false;
+    while(!done)
     {
-        ScaffoldRecord record;
-        record.parse(line);
-        if(record.getNumComponents() > 1 || !opt::bNoSingletons)
+        records.clear();
+        while(records.size() < SCAFFOLD2FASTA_BATCH_SIZE)
         {
-            StringVector ids;
-            std::string sequence = record.generateString(resolveParams, ids);
-            
+            if(!getline(*pReader, line))
+            {
+                done = true;
+                break;
+            }
+
+            ScaffoldRecord record;
+            record.parse(line);
+            if(record.getNumComponents() > 1 || !opt::bNoSingletons)
+                records.push_back(record);
+        }
+
+        int numRecords = records.size();
+        sequences.assign(numRecords, std::string());
+        componentIDs.assign(numRecords, StringVector());
+        placedIDs.assign(numRecords, StringVector());
+
+#if HAVE_OPENMP
+        #pragma omp parallel
+#endif
+        {
+            ResolveStats threadStats;
+            ResolveParams threadParams = resolveParams;
+            threadParams.pStats = &threadStats;
+
+#if HAVE_OPENMP
+            #pragma omp for schedule(dynamic, 1)
+#endif
+            for(int i = 0; i < numRecords; ++i)
+            {
+                threadParams.pPlacedIDs = &placedIDs[i];
+                sequences[i] = records[i].generateString(threadParams, componentIDs[i]);
+            }
+
+#if HAVE_OPENMP
+            #pragma omp critical
+#endif
+            stats.add(threadStats);
+        }
+
+        for(int i = 0; i < numRecords; ++i)
+        {
+            for(size_t j = 0; j < placedIDs[i].size(); ++j)
+                resolveParams.pSequenceCollection->setPlaced(placedIDs[i][j]);
+
+            const StringVector& ids = componentIDs[i];
+
             // Write out the sequence of contigs to a stringstream
             std::stringstream contig_ss;
             contig_ss << "Contigs=";
@@ -170,7 +245,7 @@ int scaffold2fastaMain(int argc, char** argv)
             if(opt::bWriteNames)
                 id_ss << "\t" << contig_ss.str();
             
-            writeFastaRecord(pWriter, id_ss.str(), sequence);
+            writeFastaRecord(pWriter, id_ss.str(), sequences[i]);
             ++idx;
         }
     }
@@ -184,6 +259,10 @@ int scaffold2fastaMain(int argc, char** argv)
 
     delete pReader;
     delete pWriter;
+
+    stats.print();
+    if(opt::verbose > 0)
+        printf("Num graph walks reused from the cache: %zu\n", resolveCache.getNumHits());
     return 0;
 }
 
@@ -206,6 +285,8 @@ void parseScaffold2fastaOptions(int argc, char** argv)
             case 'o': arg >> opt::outFile; break;
             case 'g': arg >> modeStr; break;
             case 'd': arg >> opt::distanceFactor; break;
+            case 't': arg >> opt::numThreads; break;
+            case OPT_MAXSEARCHNODES: arg >> opt::maxSearchNodes; break;
             case OPT_WRITEUNPLACED: opt::bWriteUnplaced = true; break;
             case OPT_WRITENAMES: opt::bWriteNames = true; break;
             case OPT_MINGAPLENGTH: arg >> opt::minGapLength; break;
@@ -231,6 +312,12 @@ void parseScaffold2fastaOptions(int argc, char** argv)
         die = true;
     }
 
+    if(opt::numThreads <= 0)
+    {
+        std::cerr << SUBPROGRAM ": invalid number of threads: " << opt::numThreads << "\n";
+        die = true;
+    }
+
     if (die) 
     {
         std::cout << "\n" << SCAFFOLD2FASTA_USAGE_MESSAGE;
@@ -27,9 +27,16 @@
 #include "MultiAlignment.h"
 #include "api/BamReader.h"
 
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
+
 // Types
 typedef HashMap<std::string, std::string> StringStringHash;
 
+// The number of variants that are filtered in parallel at a time
+static const size_t VARIANT_BATCH_SIZE = 1000;
+
 //
 // Getopt
 //
@@ -123,6 +130,15 @@ static const struct option longopts[] = {
     { NULL, 0, NULL, 0 }
 };
 
+static inline int getThreadNum()
+{
+#if HAVE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
 // Calculate the median value of the vector
 template<typename T>
 double median(const std::vector<T> v)
@@ -301,14 +317,10 @@ CoverageStats getVariantCoverage(BamTools::BamReader* pReader, const VCFRecord&
     else
         stats.median_mapping_quality = 60;
 
-    // Shuffle and take the first N alignments only
-    std::random_shuffle(alignments.begin(), alignments.end());
-
-#if HAVE_OPENMP
-    #pragma omp parallel for
-#endif    
+    // The variants are filtered in parallel so the reads
+    // of a single variant are processed serially
     for(size_t i = 0; i < alignments.size(); ++i) {
-        BamTools::BamAlignment alignment = alignments[i];
+        const BamTools::BamAlignment& alignment = alignments[i];
 
         VariantReadSegments segments = splitReadAtVariant(alignment, record);
 
@@ -359,18 +371,15 @@ CoverageStats getVariantCoverage(BamTools::BamReader* pReader, const VCFRecord&
             }
         }
 
-        #pragma omp critical
+        stats.n_total_reads += 1;
+        if(is_evidence_read)
         {
-            stats.n_total_reads += 1;
-            if(is_evidence_read)
+            stats.n_evidence_reads += 1;
+            if(is_snv && segments.variantQual.size() == 1)
             {
-                stats.n_evidence_reads += 1;
-                if(is_snv && segments.variantQual.size() == 1)
-                {
-                    char qb = segments.variantQual[0];
-                    int q = Quality::char2phred(qb);
-                    stats.snv_evidence_quals.push_back(q);
-                }
+                char qb = segments.variantQual[0];
+                int q = Quality::char2phred(qb);
+                stats.snv_evidence_quals.push_back(q);
             }
         }
     }
@@ -588,6 +597,175 @@ void getVariantContext(const VCFRecord& record, const ReadTable* refTable,
     suffix = reference_haplotype.substr(eventEnd, k);
 }
 
+// Open a BAM file and its index
+BamTools::BamReader* openIndexedBam(const std::string& filename)
+{
+    BamTools::BamReader* pReader = new BamTools::BamReader;
+    pReader->Open(filename);
+    pReader->LocateIndex();
+    assert(pReader->HasIndex());
+    return pReader;
+}
+
+// Apply the filters to a variant and return its output line. The
+// BamReaders must be owned by the calling thread.
+std::string filterVariant(VCFRecord& record,
+                          BamTools::BamReader* pTumorBamReader,
+                          BamTools::BamReader* pNormalBamReader,
+                          const ReadTable* refTable)
+{
+    if(opt::verbose > 0)
+    {
+        std::stringstream ss;
+        ss << "Variant: " << record << "\n";
+        fprintf(stderr, "===============================================\n%s", ss.str().c_str());
+    }
+
+    StringStringHash tagHash;
+    makeTagHash(record, tagHash);
+
+    StringVector fail_reasons;
+
+    int hplen = 0;
+    if(!getTagValue(tagHash, "HPLen", hplen))
+        hplen = calculateHomopolymerLength(record, refTable);
+
+    if(hplen > opt::maxHPLen)
+        fail_reasons.push_back("Homopolymer");
+
+    double dust = 0.0f;
+    if(!getTagValue(tagHash, "Dust", dust))
+        dust = HapgenUtil::calculateDustScoreAtPosition(record.refName, 
+                                                        record.refPosition, 
+                                                        refTable);
+
+    if(dust > opt::maxDust)
+        fail_reasons.push_back("LowComplexity");
+    
+    double af;
+    if(getTagValue(tagHash, "AF", af) && af < opt::minAF)
+        fail_reasons.push_back("LowAlleleFrequency");
+
+    int varDP;
+    if(getTagValue(tagHash, "VarDP", varDP) && varDP < opt::minVarDP)
+        fail_reasons.push_back("LowVarDP");
+    
+    double avgHapLen;
+    if(getTagValue(tagHash, "AvgHapLen", avgHapLen) && avgHapLen < opt::minHaplotypeLength)
+        fail_reasons.push_back("ShortHaplotype");
+
+    double strandBias;
+    if(getTagValue(tagHash, "SB", strandBias) && strandBias >= opt::maxStrandBias)
+        fail_reasons.push_back("StrandBias");
+    
+    // Count the number of copies of the inserted/deleted sequence in the reference
+    RepeatCounts repeatCounts = getRepeatCounts(record, refTable);
+
+    // Realignment-based stats
+    CoverageStats tumor_stats = getVariantCoverage(pTumorBamReader, record, refTable);
+    CoverageStats normal_stats = getVariantCoverage(pNormalBamReader, record, refTable);
+
+    if(opt::verbose > 0)
+    {
+        fprintf(stderr, "Tumor: [%zu %zu]\n",  tumor_stats.n_total_reads, tumor_stats.n_evidence_reads);
+        fprintf(stderr, "Normal: [%zu %zu]\n", normal_stats.n_total_reads, normal_stats.n_evidence_reads);
+    }
+
+    if(!tumor_stats.too_many_alignments && !normal_stats.too_many_alignments)
+    {
+        // Check that there is not evidence for the variant in the normal sample
+        if(normal_stats.n_evidence_reads > opt::maxNormalReads)
+            fail_reasons.push_back("NormalEvidence");
+        
+        // If the normal is poorly covered in this region, we may call a germline variant as a variant
+        if(normal_stats.n_total_reads < opt::minNormalDepth)
+            fail_reasons.push_back("LowNormalDepth");
+
+        if(!tumor_stats.snv_evidence_quals.empty())
+        {
+            // Check that the base scores of SNVs are reasonably high
+            double median_quality = median(tumor_stats.snv_evidence_quals);
+            if(median_quality < opt::minMedianQuality)
+                fail_reasons.push_back("LowQuality");
+
+            // For very deep regions, errors can be mistaken for SNVs
+            // Check if the variant frequency is very low. This check is not performed
+            // for indels and MNPs as they might not be aligned to this region.
+            double vf_estimate = tumor_stats.n_evidence_reads / (double)tumor_stats.n_total_reads;
+            if(vf_estimate < opt::errorBound)
+                fail_reasons.push_back("PossibleError");
+        }
+        
+        // Check that the mapping quality of reads in the region is reasonable
+        if(tumor_stats.median_mapping_quality < opt::minMedianQuality)
+            fail_reasons.push_back("LowMappingQuality");
+    }
+    else 
+    {
+        // If the depth in the region is excessively high, the statistical models may break down
+        fail_reasons.push_back("DepthLimitReached");
+    }
+
+    if(!fail_reasons.empty() && !opt::annotateOnly)
+    {
+        if(record.passStr != "PASS" && record.passStr != ".")
+            fail_reasons.insert(fail_reasons.begin(), record.passStr);
+
+        std::stringstream strss;
+        std::copy(fail_reasons.begin(), fail_reasons.end(), std::ostream_iterator<std::string>(strss, ";"));
+        record.passStr = strss.str();
+        record.passStr.erase(record.passStr.size() - 1); // erase trailing ;
+    }
+    
+    // Add INFO tags indicating allele coverage
+    if(opt::annotateOnly)
+    {
+        double tumor_vf = tumor_stats.calculateVAF();
+        double normal_vf = normal_stats.calculateVAF();
+
+        std::string prefix;
+        std::string suffix;
+        getVariantContext(record, refTable, prefix, suffix);
+
+        record.addComment("TumorVAF", tumor_vf);
+        record.addComment("NormalVAF", normal_vf);
+        record.addComment("TumorVarDepth", (int)tumor_stats.n_evidence_reads);
+        record.addComment("TumorTotalDepth", (int)tumor_stats.n_total_reads);
+        record.addComment("NormalVarDepth", (int)normal_stats.n_evidence_reads);
+        record.addComment("NormalTotalDepth", (int)normal_stats.n_total_reads);
+        record.addComment("5pContext", prefix);
+        record.addComment("3pContext", suffix);
+        record.addComment("RepeatUnit", repeatCounts.unit);
+        record.addComment("RepeatRefCount", (int)repeatCounts.numRefUnits);
+    }
+
+    std::stringstream out;
+    out << record;
+    return out.str();
+}
+
+// Filter a batch of variants in parallel, then write them out in input order
+void filterVariantBatch(std::vector<VCFRecord>& batch,
+                        std::vector<BamTools::BamReader*>& tumorBamReaders,
+                        std::vector<BamTools::BamReader*>& normalBamReaders,
+                        const ReadTable* refTable)
+{
+    std::vector<std::string> output(batch.size());
+
+#if HAVE_OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for(int i = 0; i < (int)batch.size(); ++i)
+    {
+        int tid = getThreadNum();
+        output[i] = filterVariant(batch[i], tumorBamReaders[tid], normalBamReaders[tid], refTable);
+    }
+
+    for(size_t i = 0; i < output.size(); ++i)
+        std::cout << output[i] << "\n";
+    batch.clear();
+}
+
 //
 // Main
 //
@@ -604,16 +782,15 @@ int somaticVariantFiltersMain(int argc, char** argv)
     ReadTable refTable(opt::referenceFile, SRF_NO_VALIDATION);
     refTable.indexReadsByID();
 
-    // Load BAMs
-    BamTools::BamReader* pTumorBamReader = new BamTools::BamReader;
-    pTumorBamReader->Open(opt::tumorBamFile);
-    pTumorBamReader->LocateIndex();
-    assert(pTumorBamReader->HasIndex());
-
-    BamTools::BamReader* pNormalBamReader = new BamTools::BamReader;
-    pNormalBamReader->Open(opt::normalBamFile);
-    pNormalBamReader->LocateIndex();
-    assert(pNormalBamReader->HasIndex());
+    // Load BAMs. Each thread has its own readers as a BamReader
+    // holds the state of the region that it is scanning.
+    std::vector<BamTools::BamReader*> tumorBamReaders(opt::numThreads);
+    std::vector<BamTools::BamReader*> normalBamReaders(opt::numThreads);
+    for(int i = 0; i < opt::numThreads; ++i)
+    {
+        tumorBamReaders[i] = openIndexedBam(opt::tumorBamFile);
+        normalBamReaders[i] = openIndexedBam(opt::normalBamFile);
+    }
 
     // Track duplicated variants
     HashSet<std::string> duplicateHash;
@@ -621,6 +798,9 @@ int somaticVariantFiltersMain(int argc, char** argv)
     std::istream* pInput = createReader(opt::vcfFile.c_str());
     std::string line;
 
+    // The records are parsed and checked for duplicates in input order,
+    // then filtered in batches
+    std::vector<VCFRecord> batch;
     while(getline(*pInput, line))
     {
         if(line.empty())
@@ -628,6 +808,7 @@ int somaticVariantFiltersMain(int argc, char** argv)
 
         if(line[0] == '#')
         {
+            filterVariantBatch(batch, tumorBamReaders, normalBamReaders, &refTable);
             std::cout << line << "\n";
             continue;
         }
@@ -647,138 +828,19 @@ int somaticVariantFiltersMain(int argc, char** argv)
         else
             duplicateHash.insert(key);
 
-        if(opt::verbose > 0)
-        {
-            std::stringstream ss;
-            ss << "Variant: " << record << "\n";
-            fprintf(stderr, "===============================================\n%s", ss.str().c_str());
-        }
-
-        StringStringHash tagHash;
-        makeTagHash(record, tagHash);
-
-        StringVector fail_reasons;
-
-        int hplen = 0;
-        if(!getTagValue(tagHash, "HPLen", hplen))
-            hplen = calculateHomopolymerLength(record, &refTable);
-
-        if(hplen > opt::maxHPLen)
-            fail_reasons.push_back("Homopolymer");
-
-        double dust = 0.0f;
-        if(!getTagValue(tagHash, "Dust", dust))
-            dust = HapgenUtil::calculateDustScoreAtPosition(record.refName, 
-                                                            record.refPosition, 
-                                                            &refTable);
-
-        if(dust > opt::maxDust)
-            fail_reasons.push_back("LowComplexity");
-        
-        double af;
-        if(getTagValue(tagHash, "AF", af) && af < opt::minAF)
-            fail_reasons.push_back("LowAlleleFrequency");
-
-        int varDP;
-        if(getTagValue(tagHash, "VarDP", varDP) && varDP < opt::minVarDP)
-            fail_reasons.push_back("LowVarDP");
-        
-        double avgHapLen;
-        if(getTagValue(tagHash, "AvgHapLen", avgHapLen) && avgHapLen < opt::minHaplotypeLength)
-            fail_reasons.push_back("ShortHaplotype");
-
-        double strandBias;
-        if(getTagValue(tagHash, "SB", strandBias) && strandBias >= opt::maxStrandBias)
-            fail_reasons.push_back("StrandBias");
-        
-        // Count the number of copies of the inserted/deleted sequence in the reference
-        RepeatCounts repeatCounts = getRepeatCounts(record, &refTable);
-
-        // Realignment-based stats
-        CoverageStats tumor_stats = getVariantCoverage(pTumorBamReader, record, &refTable);
-        CoverageStats normal_stats = getVariantCoverage(pNormalBamReader, record, &refTable);
-
-        if(opt::verbose > 0)
-        {
-            fprintf(stderr, "Tumor: [%zu %zu]\n",  tumor_stats.n_total_reads, tumor_stats.n_evidence_reads);
-            fprintf(stderr, "Normal: [%zu %zu]\n", normal_stats.n_total_reads, normal_stats.n_evidence_reads);
-        }
-
-        if(!tumor_stats.too_many_alignments && !normal_stats.too_many_alignments)
-        {
-            // Check that there is not evidence for the variant in the normal sample
-            if(normal_stats.n_evidence_reads > opt::maxNormalReads)
-                fail_reasons.push_back("NormalEvidence");
-            
-            // If the normal is poorly covered in this region, we may call a germline variant as a variant
-            if(normal_stats.n_total_reads < opt::minNormalDepth)
-                fail_reasons.push_back("LowNormalDepth");
-
-            if(!tumor_stats.snv_evidence_quals.empty())
-            {
-                // Check that the base scores of SNVs are reasonably high
-                double median_quality = median(tumor_stats.snv_evidence_quals);
-                if(median_quality < opt::minMedianQuality)
-                    fail_reasons.push_back("LowQuality");
-
-                // For very deep regions, errors can be mistaken for SNVs
-                // Check if the variant frequency is very low. This check is not performed
-                // for indels and MNPs as they might not be aligned to this region.
-                double vf_estimate = tumor_stats.n_evidence_reads / (double)tumor_stats.n_total_reads;
-                if(vf_estimate < opt::errorBound)
-                    fail_reasons.push_back("PossibleError");
-            }
-            
-            // Check that the mapping quality of reads in the region is reasonable
-            if(tumor_stats.median_mapping_quality < opt::minMedianQuality)
-                fail_reasons.push_back("LowMappingQuality");
-        }
-        else 
-        {
-            // If the depth in the region is excessively high, the statistical models may break down
-            fail_reasons.push_back("DepthLimitReached");
-        }
-
-        if(!fail_reasons.empty() && !opt::annotateOnly)
-        {
-            if(record.passStr != "PASS" && record.passStr != ".")
-                fail_reasons.insert(fail_reasons.begin(), record.passStr);
-
-            std::stringstream strss;
-            std::copy(fail_reasons.begin(), fail_reasons.end(), std::ostream_iterator<std::string>(strss, ";"));
-            record.passStr = strss.str();
-            record.passStr.erase(record.passStr.size() - 1); // erase trailing ;
-        }
-        
-        // Add INFO tags indicating allele coverage
-        if(opt::annotateOnly)
-        {
-            double tumor_vf = tumor_stats.calculateVAF();
-            double normal_vf = normal_stats.calculateVAF();
-
-            std::string prefix;
-            std::string suffix;
-            getVariantContext(record, &refTable, prefix, suffix);
-
-            record.addComment("TumorVAF", tumor_vf);
-            record.addComment("NormalVAF", normal_vf);
-            record.addComment("TumorVarDepth", (int)tumor_stats.n_evidence_reads);
-            record.addComment("TumorTotalDepth", (int)tumor_stats.n_total_reads);
-            record.addComment("NormalVarDepth", (int)normal_stats.n_evidence_reads);
-            record.addComment("NormalTotalDepth", (int)normal_stats.n_total_reads);
-            record.addComment("5pContext", prefix);
-            record.addComment("3pContext", suffix);
-            record.addComment("RepeatUnit", repeatCounts.unit);
-            record.addComment("RepeatRefCount", (int)repeatCounts.numRefUnits);
-        }
-
-        std::cout << record << "\n";
+        batch.push_back(record);
+        if(batch.size() == VARIANT_BATCH_SIZE)
+            filterVariantBatch(batch, tumorBamReaders, normalBamReaders, &refTable);
     }
+    filterVariantBatch(batch, tumorBamReaders, normalBamReaders, &refTable);
     
     // Cleanup
     delete pInput;
-    delete pTumorBamReader;
-    delete pNormalBamReader;
+    for(int i = 0; i < opt::numThreads; ++i)
+    {
+        delete tumorBamReaders[i];
+        delete normalBamReaders[i];
+    }
     delete pTimer;
 
     return 0;
@@ -23,8 +23,12 @@
 #include "SequenceProcessFramework.h"
 #include "StatsProcess.h"
 #include "BWTDiskConstruction.h"
+#include "IndexMemory.h"
+#include "BitVector.h"
 
 // Functions
+void runRankBenchmark(const BWT* pBWT, size_t numQueries);
+void runBitVectorBenchmark(size_t numUpdates);
 
 //
 // Getopt
@@ -54,6 +58,12 @@ static const char *STATS_USAGE_MESSAGE =
 "      --run-lengths                    Print the run length distribution of the BWT\n"
 "      --kmer-distribution              Print the distribution of kmer counts\n"
 "      --no-overlap                     Suppress the overlap-based error statistics (faster if you only want the k-mer distribution)\n"
+"      --rank-benchmark=N               Time N rank queries at random positions of the FM-index, using -t threads, and exit\n"
+"      --bitvector-benchmark=N          Time N contended updates of a BitVector, using -t threads, and exit. No index is loaded\n"
+"                                       and READSFILE is not needed\n"
+"      --huge-pages=MODE                back the FM-index with huge pages. MODE is thp (transparent huge pages), or 2m or 1g\n"
+"                                       (pages of that size reserved by the system, falling back to thp) (default: none)\n"
+"      --numa-interleave                spread the FM-index over all NUMA nodes and pin the threads to the nodes in turn\n"
 "\nReport bugs to " PACKAGE_BUGREPORT "\n\n";
 
 static const char* PROGRAM_IDENT =
@@ -73,11 +83,15 @@ namespace opt
     static bool bPrintRunLengths = false;
     static bool bPrintKmerDist = false;
     static bool bNoOverlap = false;
+    static size_t numBenchmarkQueries = 0;
+    static size_t numBitVectorUpdates = 0;
+    static IndexMemory::HugePageMode hugePageMode = IndexMemory::HPM_NONE;
+    static bool bNumaInterleave = false;
 }
 
 static const char* shortopts = "p:d:t:o:k:n:b:v";
 
-enum { OPT_HELP = 1, OPT_VERSION, OPT_RUNLENGTHS, OPT_KMERDIST, OPT_NOOVERLAP};
+enum { OPT_HELP = 1, OPT_VERSION, OPT_RUNLENGTHS, OPT_KMERDIST, OPT_NOOVERLAP, OPT_RANKBENCHMARK, OPT_BITVECTORBENCHMARK, OPT_HUGEPAGES, OPT_NUMAINTERLEAVE };
 
 static const struct option longopts[] = {
     { "verbose",            no_argument,       NULL, 'v' },
@@ -90,6 +104,10 @@ static const struct option longopts[] = {
     { "kmer-distribution",  no_argument,       NULL, OPT_KMERDIST },
     { "no-overlap",         no_argument,       NULL, OPT_NOOVERLAP },
     { "run-lengths",        no_argument,       NULL, OPT_RUNLENGTHS },
+    { "rank-benchmark",     required_argument, NULL, OPT_RANKBENCHMARK },
+    { "bitvector-benchmark", required_argument, NULL, OPT_BITVECTORBENCHMARK },
+    { "huge-pages",         required_argument, NULL, OPT_HUGEPAGES },
+    { "numa-interleave",    no_argument,       NULL, OPT_NUMAINTERLEAVE },
     { "help",               no_argument,       NULL, OPT_HELP },
     { "version",            no_argument,       NULL, OPT_VERSION },
     { NULL, 0, NULL, 0 }
@@ -103,6 +121,16 @@ int statsMain(int argc, char** argv)
     parseStatsOptions(argc, argv);
     Timer* pTimer = new Timer(PROGRAM_IDENT);
 
+    if(opt::numBitVectorUpdates > 0)
+    {
+        runBitVectorBenchmark(opt::numBitVectorUpdates);
+        delete pTimer;
+        return 0;
+    }
+
+    IndexMemory::setHugePageMode(opt::hugePageMode);
+    IndexMemory::setInterleave(opt::bNumaInterleave);
+
     BWT* pBWT = new BWT(opt::prefix + BWT_EXT, opt::sampleRate);
     BWT* pRBWT = NULL;
 
@@ -116,6 +144,17 @@ int statsMain(int argc, char** argv)
         pBWT->printRunLengths();
     }
 
+    if(opt::numBenchmarkQueries > 0)
+    {
+        if(!opt::bPrintRunLengths)
+            pBWT->printInfo();
+        runRankBenchmark(pBWT, opt::numBenchmarkQueries);
+        delete pBWT;
+        delete pRBWT;
+        delete pTimer;
+        return 0;
+    }
+
     SeqReader reader(opt::readsFile);
     
     StatsPostProcess postProcessor(opt::bPrintKmerDist);
@@ -161,6 +200,151 @@ int statsMain(int argc, char** argv)
     return 0;
 }
 
+// Time rank queries at random positions of the BWT. The single queries
+// are what the backward search does for one base, the paired queries are
+// what it does to extend an interval
+void runRankBenchmark(const BWT* pBWT, size_t numQueries)
+{
+    // Draw the positions before starting the clock so only the queries are timed
+    size_t bwLen = pBWT->getBWLen();
+    std::vector<size_t> positions(numQueries);
+    unsigned int seed = 1;
+    for(size_t i = 0; i < numQueries; ++i)
+        positions[i] = (((size_t)rand_r(&seed) << 31) | rand_r(&seed)) % bwLen;
+
+    // The counts are summed so the queries cannot be optimized away
+    size_t checksum = 0;
+
+#if HAVE_OPENMP
+    omp_set_num_threads(opt::numThreads);
+    #pragma omp parallel
+    IndexMemory::pinThread(omp_get_thread_num());
+#endif
+
+    Timer singleTimer("rank-single", true);
+#if HAVE_OPENMP
+    #pragma omp parallel for schedule(static) reduction(+:checksum)
+#endif
+    for(int64_t i = 0; i < (int64_t)numQueries; ++i)
+    {
+        AlphaCount64 occ = pBWT->getFullOcc(positions[i]);
+        checksum += occ.get('A') + occ.get('T');
+    }
+    double singleSecs = singleTimer.getElapsedWallTime();
+
+    // The second position is up to 63 symbols past the first, as for a short interval
+    Timer pairTimer("rank-pair", true);
+#if HAVE_OPENMP
+    #pragma omp parallel for schedule(static) reduction(+:checksum)
+#endif
+    for(int64_t i = 0; i < (int64_t)numQueries; ++i)
+    {
+        AlphaCount64 occ0;
+        AlphaCount64 occ1;
+        size_t end = std::min(positions[i] + (i & 63), bwLen - 1);
+        pBWT->getFullOccPair(positions[i], end, occ0, occ1);
+        checksum += occ1.get('C') - occ0.get('G');
+    }
+    double pairSecs = pairTimer.getElapsedWallTime();
+
+    double ns = 1000000000.0 / numQueries;
+    printf("[%s] rank benchmark with %d threads over %zu random positions (checksum %zu)\n", PROGRAM_IDENT, opt::numThreads, numQueries, checksum);
+    printf("[%s] getFullOcc: %.2lfs (%.1lf ns per query) getFullOccPair: %.2lfs (%.1lf ns per query)\n", 
+           PROGRAM_IDENT, singleSecs, singleSecs * ns, pairSecs, pairSecs * ns);
+}
+
+// The workloads of the BitVector benchmark
+enum BitVectorWorkload
+{
+    BVW_CAS,            // set single bits with updateCAS
+    BVW_TEST_AND_SET,   // set single bits with testAndSet
+    BVW_RANGE_CAS,      // claim ranges one bit at a time with updateCAS
+    BVW_RANGE_CLAIM     // claim ranges with claimRange
+};
+
+// Run numOps operations of the workload split over the threads and return the
+// number of bits the threads changed from false to true. Every 1024th single-bit
+// update clears its bit again so the threads keep competing for the bits.
+// The ranges are 1-200 bits long, like the intervals claimed by fm-merge and cluster.
+static size_t runBitVectorWorkload(BitVector* pBitVector, size_t numBits, BitVectorWorkload workload, size_t numOps)
+{
+    size_t won = 0;
+#if HAVE_OPENMP
+    #pragma omp parallel reduction(+:won)
+#endif
+    {
+#if HAVE_OPENMP
+        int threadIdx = omp_get_thread_num();
+        int numThreads = omp_get_num_threads();
+#else
+        int threadIdx = 0;
+        int numThreads = 1;
+#endif
+        unsigned int seed = threadIdx * 7919 + 1;
+        size_t threadOps = numOps / numThreads;
+        for(size_t k = 0; k < threadOps; ++k)
+        {
+            if(workload == BVW_CAS || workload == BVW_TEST_AND_SET)
+            {
+                size_t i = rand_r(&seed) % numBits;
+                if(workload == BVW_CAS)
+                    won += pBitVector->updateCAS(i, false, true);
+                else
+                    won += pBitVector->testAndSet(i);
+
+                if((k & 1023) == 0)
+                    pBitVector->updateCAS(i, true, false);
+            }
+            else
+            {
+                size_t begin = rand_r(&seed) % (numBits - 256);
+                size_t end = begin + 1 + rand_r(&seed) % 200;
+                if(workload == BVW_RANGE_CLAIM)
+                {
+                    won += pBitVector->claimRange(begin, end);
+                }
+                else
+                {
+                    for(size_t i = begin; i < end; ++i)
+                    {
+                        if(!pBitVector->test(i))
+                            won += pBitVector->updateCAS(i, false, true);
+                    }
+                }
+            }
+        }
+    }
+    return won;
+}
+
+// Time the atomic BitVector operations under contention. The single bits
+// are drawn from a small vector so the threads collide on the same words.
+void runBitVectorBenchmark(size_t numUpdates)
+{
+    const size_t SINGLE_BITS = 1 << 16;
+    const size_t RANGE_BITS = 1 << 20;
+    size_t numRanges = std::max(numUpdates / 64, (size_t)1);
+
+#if HAVE_OPENMP
+    omp_set_num_threads(opt::numThreads);
+#endif
+
+    const char* names[] = { "updateCAS", "testAndSet", "range updateCAS", "claimRange" };
+    printf("[%s] BitVector benchmark with %d threads, %zu single-bit updates over %zu bits, %zu range claims over %zu bits\n", 
+           PROGRAM_IDENT, opt::numThreads, numUpdates, SINGLE_BITS, numRanges, RANGE_BITS);
+    for(int w = BVW_CAS; w <= BVW_RANGE_CLAIM; ++w)
+    {
+        bool bRange = w == BVW_RANGE_CAS || w == BVW_RANGE_CLAIM;
+        size_t numBits = bRange ? RANGE_BITS : SINGLE_BITS;
+        BitVector bitVector(numBits);
+
+        Timer timer(names[w], true);
+        size_t won = runBitVectorWorkload(&bitVector, numBits, (BitVectorWorkload)w, bRange ? numRanges : numUpdates);
+        double secs = timer.getElapsedWallTime();
+        printf("[%s] %s: %.3lfs, %zu bits won\n", PROGRAM_IDENT, names[w], secs, won);
+    }
+}
+
 // 
 // Handle command line arguments
 //
@@ -184,6 +368,16 @@ void parseStatsOptions(int argc, char** argv)
             case OPT_KMERDIST: opt::bPrintKmerDist = true; break;
             case OPT_RUNLENGTHS: opt::bPrintRunLengths = true; break;
             case OPT_NOOVERLAP: opt::bNoOverlap = true; break;
+            case OPT_RANKBENCHMARK: arg >> opt::numBenchmarkQueries; break;
+            case OPT_BITVECTORBENCHMARK: arg >> opt::numBitVectorUpdates; break;
+            case OPT_NUMAINTERLEAVE: opt::bNumaInterleave = true; break;
+            case OPT_HUGEPAGES:
+                if(!IndexMemory::parseHugePageMode(arg.str(), opt::hugePageMode))
+                {
+                    std::cerr << SUBPROGRAM ": invalid parameter to --huge-pages: " << arg.str() << ", must be none, thp, 2m or 1g\n";
+                    die = true;
+                }
+                break;
             case OPT_HELP:
                 std::cout << STATS_USAGE_MESSAGE;
                 exit(EXIT_SUCCESS);
@@ -193,7 +387,7 @@ void parseStatsOptions(int argc, char** argv)
         }
     }
 
-    if (argc - optind < 1) 
+    if (argc - optind < 1 && opt::numBitVectorUpdates == 0) 
     {
         std::cerr << SUBPROGRAM ": missing arguments\n";
         die = true;
@@ -223,7 +417,8 @@ void parseStatsOptions(int argc, char** argv)
     }
 
     // Parse the input filenames
-    opt::readsFile = argv[optind++];
+    if(optind < argc)
+        opt::readsFile = argv[optind++];
 
     if(opt::prefix.empty())
     {
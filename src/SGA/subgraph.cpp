@@ -8,15 +8,20 @@
 //
 #include <iostream>
 #include <fstream>
+#include <queue>
 #include "subgraph.h"
 #include "Util.h"
 #include "SGUtil.h"
 #include "SGAlgorithms.h"
 #include "SGVisitors.h"
 #include "Timer.h"
+#include "ASQGIndex.h"
+#include "HashMap.h"
 
 // functions
-void addNeighborsToSubgraph(Vertex* pCurrVertex, StringGraph* pSubgraph, int span);
+void subgraphFromGraph();
+void subgraphFromIndex();
+void addNeighborsToSubgraph(Vertex* pRootVertex, StringGraph* pSubgraph, int span);
 void copyVertexToSubgraph(StringGraph* pSubgraph, const Vertex* pVertex);
 
 
@@ -33,12 +38,16 @@ SUBPROGRAM " Version " PACKAGE_VERSION "\n"
 static const char *SUBGRAPH_USAGE_MESSAGE =
 "Usage: " PACKAGE_NAME " " SUBPROGRAM " [OPTION] ... ID ASQGFILE\n"
 "Extract the subgraph around the sequence with ID from an asqg file.\n"
+"If ASQGFILE is uncompressed and has an index (ASQGFILE.aqi, written by sga overlap/assemble\n"
+"or with --build-index) only the records in the subgraph are read from the file.\n"
 "\n"
 "  -v, --verbose                        display verbose output\n"
 "      --help                           display this help and exit\n"
 "      -o, --out=FILE                   write the subgraph to FILE (default: subgraph.asqg.gz)\n"
 "      -s, --size=N                     the size of the subgraph to extract, all vertices that are at most N hops\n"
 "                                       away from the root will be included (default: 5)\n"
+"      --build-index                    write the index for ASQGFILE before extracting the subgraph\n"
+"      --no-index                       do not use the index of ASQGFILE even if it exists\n"
 "\nReport bugs to " PACKAGE_BUGREPORT "\n\n";
 
 namespace opt
@@ -48,16 +57,20 @@ namespace opt
     static std::string outFile;
     static std::string rootID;
     static unsigned int span = 5;
+    static bool buildIndex = false;
+    static bool useIndex = true;
 }
 
 static const char* shortopts = "o:s:";
 
-enum { OPT_HELP = 1, OPT_VERSION };
+enum { OPT_HELP = 1, OPT_VERSION, OPT_BUILD_INDEX, OPT_NO_INDEX };
 
 static const struct option longopts[] = {
     { "verbose",        no_argument,       NULL, 'v' },
     { "out",            required_argument, NULL, 'o' },
     { "size",           required_argument, NULL, 's' },
+    { "build-index",    no_argument,       NULL, OPT_BUILD_INDEX },
+    { "no-index",       no_argument,       NULL, OPT_NO_INDEX },
     { "help",           no_argument,       NULL, OPT_HELP },
     { "version",        no_argument,       NULL, OPT_VERSION },
     { NULL, 0, NULL, 0 }
@@ -77,6 +90,25 @@ int subgraphMain(int argc, char** argv)
 }
 
 void subgraph()
+{
+    if(opt::buildIndex)
+    {
+        if(!ASQGIndex::isIndexable(opt::asqgFile))
+        {
+            std::cerr << SUBPROGRAM ": compressed graphs cannot be indexed\n";
+            exit(EXIT_FAILURE);
+        }
+        ASQGIndex::build(opt::asqgFile);
+    }
+
+    if(opt::useIndex && ASQGIndex::hasIndex(opt::asqgFile))
+        subgraphFromIndex();
+    else
+        subgraphFromGraph();
+}
+
+// Load the entire graph into memory and extract the subgraph from it
+void subgraphFromGraph()
 {
     StringGraph* pGraph = SGUtil::loadASQG(opt::asqgFile, 0, true);
     pGraph->printMemSize();
@@ -106,10 +138,7 @@ void subgraph()
     }
     else
     {
-        copyVertexToSubgraph(pSubgraph, pRootVertex);
-        pRootVertex->setColor(GC_BLACK);
-
-        // Recursively add neighbors
+        // Add the neighbors of the root
         addNeighborsToSubgraph(pRootVertex, pSubgraph, opt::span);
 
         // Write the subgraph
@@ -120,27 +149,107 @@ void subgraph()
     delete pGraph;
 }
 
-//
-void addNeighborsToSubgraph(Vertex* pCurrVertex, StringGraph* pSubgraph, int span)
+// Extract the subgraph by reading only the records of the vertices
+// in the subgraph, using the index of the graph file
+void subgraphFromIndex()
 {
-    if(span <= 0)
+    ASQGIndex index(opt::asqgFile);
+
+    StringGraph* pSubgraph = new StringGraph;
+
+    // Set the graph parameters to match the main graph
+    SGUtil::setGraphParameters(pSubgraph, index.readHeader());
+
+    ASQG::VertexRecord vertexRecord;
+    if(!index.readVertex(opt::rootID, vertexRecord, NULL))
+    {
+        std::cout << "Vertex " << opt::rootID << " not found in the graph.\n";
+        delete pSubgraph;
         return;
+    }
+
+    Vertex* pRootVertex = new(pSubgraph->getVertexAllocator()) Vertex(vertexRecord.getID(), vertexRecord.getSeq());
+    pSubgraph->addVertex(pRootVertex);
+
+    // Breadth-first search from the root. The edges of a vertex are added to the 
+    // subgraph when it is expanded, unless the other endpoint has already been expanded 
+    // as the edge was added then.
+    HashSet<std::string> expanded;
+    std::queue<std::pair<std::string, int> > queue;
+    queue.push(std::make_pair(opt::rootID, 0));
 
-    // These are the edges in the main graph
-    EdgePtrVec edges = pCurrVertex->getEdges();
-    for(size_t i = 0; i < edges.size(); ++i)
+    std::vector<ASQG::EdgeRecord> edgeRecords;
+    while(!queue.empty())
     {
-        if(edges[i]->getColor() != GC_BLACK)
+        std::string currID = queue.front().first;
+        int depth = queue.front().second;
+        queue.pop();
+
+        if(depth >= (int)opt::span)
+            continue;
+
+        index.readVertex(currID, vertexRecord, &edgeRecords);
+        for(size_t i = 0; i < edgeRecords.size(); ++i)
         {
-            Vertex* pY = edges[i]->getEnd();
-            copyVertexToSubgraph(pSubgraph, pY);
-            Overlap ovr = edges[i]->getOverlap();
+            const Overlap& ovr = edgeRecords[i].getOverlap();
+            const std::string& otherID = ovr.id[0] == currID ? ovr.id[1] : ovr.id[0];
+            if(expanded.find(otherID) != expanded.end())
+                continue;
+
+            if(pSubgraph->getVertex(otherID) == NULL)
+            {
+                ASQG::VertexRecord otherRecord;
+                index.readVertex(otherID, otherRecord, NULL);
+                Vertex* pOther = new(pSubgraph->getVertexAllocator()) Vertex(otherRecord.getID(), otherRecord.getSeq());
+                pSubgraph->addVertex(pOther);
+                queue.push(std::make_pair(otherID, depth + 1));
+            }
             SGAlgorithms::createEdgesFromOverlap(pSubgraph, ovr, true);
-            edges[i]->setColor(GC_BLACK);
-            edges[i]->getTwin()->setColor(GC_BLACK);
+        }
+        expanded.insert(currID);
+    }
+
+    // Write the subgraph
+    pSubgraph->writeASQG(opt::outFile);
+    delete pSubgraph;
+}
+
+// Add all the vertices that are at most span edges away from the root
+// vertex to the subgraph, along with the edges that were followed to reach them
+void addNeighborsToSubgraph(Vertex* pRootVertex, StringGraph* pSubgraph, int span)
+{
+    copyVertexToSubgraph(pSubgraph, pRootVertex);
+
+    // Breadth-first search from the root so that every vertex within the
+    // span is reached by its shortest path
+    std::queue<std::pair<Vertex*, int> > queue;
+    queue.push(std::make_pair(pRootVertex, 0));
+    while(!queue.empty())
+    {
+        Vertex* pCurrVertex = queue.front().first;
+        int depth = queue.front().second;
+        queue.pop();
+
+        if(depth >= span)
+            continue;
+
+        // These are the edges in the main graph
+        EdgePtrVec edges = pCurrVertex->getEdges();
+        for(size_t i = 0; i < edges.size(); ++i)
+        {
+            if(edges[i]->getColor() != GC_BLACK)
+            {
+                Vertex* pY = edges[i]->getEnd();
+                bool isNewVertex = pSubgraph->getVertex(pY->getID()) == NULL;
+                copyVertexToSubgraph(pSubgraph, pY);
+                Overlap ovr = edges[i]->getOverlap();
+                SGAlgorithms::createEdgesFromOverlap(pSubgraph, ovr, true);
+                edges[i]->setColor(GC_BLACK);
+                edges[i]->getTwin()->setColor(GC_BLACK);
 
-            // Recurse
-            addNeighborsToSubgraph(pY, pSubgraph, span - 1);
+                if(isNewVertex)
+                    queue.push(std::make_pair(pY, depth + 1));
+            }
         }
     }
 }
@@ -175,6 +284,8 @@ void parseSubgraphOptions(int argc, char** argv)
             case 's': arg >> opt::span; break;
             case '?': die = true; break;
             case 'v': opt::verbose++; break;
+            case OPT_BUILD_INDEX: opt::buildIndex = true; break;
+            case OPT_NO_INDEX: opt::useIndex = false; break;
             case OPT_HELP:
                 std::cout << SUBGRAPH_USAGE_MESSAGE;
                 exit(EXIT_SUCCESS);
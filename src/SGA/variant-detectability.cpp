@@ -18,6 +18,16 @@
 #include "BWTIndexSet.h"
 #include "Timer.h"
 
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
+
+// The number of reference positions processed by a thread per unit of work
+#define DETECTABILITY_CHUNK_SIZE 100000
+
+// Marks a reference position that was not tested in a chunk
+#define DETECTABILITY_NOT_TESTED 0xFF
+
 // Structs
 struct KmerCounts
 {
@@ -25,8 +35,24 @@ struct KmerCounts
     size_t zero;
 };
 
+// The results of testing every mutation in a chunk of a reference sequence
+struct DetectabilityChunk
+{
+    size_t ref_idx;
+    size_t start;
+    size_t end;
+
+    // The number of detectable alternative bases at each position of [start, end),
+    // or DETECTABILITY_NOT_TESTED
+    std::vector<uint8_t> num_detectable;
+    size_t tested;
+    size_t detected;
+};
+
 // Local functions
-void computeDetectableAll(StringVector& ref_sequences, const BWTIndexSet& ref_index);
+void computeDetectableAll(const StringVector& ref_names, const StringVector& ref_sequences, const BWTIndexSet& ref_index);
+void computeDetectableChunk(const std::string& sequence, const BWT* pBWT, DetectabilityChunk& chunk);
+void writeDetectableBedGraph(std::ostream& out, const std::string& ref_name, const DetectabilityChunk& chunk);
 void computeDetectableSampling(StringVector& ref_sequences, const BWTIndexSet& ref_index);
 KmerCounts computeChangeCounts(const BWTIndexSet& ref_index, std::string& sequence, size_t base_idx, char new_base);
 
@@ -49,6 +75,11 @@ static const char *VARIANT_DETECTABILITY_USAGE_MESSAGE =
 "      --help                           display this help and exit\n"
 "  -k, --kmer=K                         set the k-mer length\n"
 "  -n, --num-samples=N                  perform the calculation by randomly sampling N mutations\n"
+"  -a, --all                            test every mutation of the reference instead of sampling.\n"
+"                                       The number of detectable mutations at each position is\n"
+"                                       written in bedGraph format to FILE.detectability.bedGraph\n"
+"  -o, --outfile=FILE                   write the bedGraph for --all to FILE\n"
+"  -t, --threads=NUM                    use NUM threads for --all (default: 1)\n"
 "\nReport bugs to " PACKAGE_BUGREPORT "\n\n";
 
 namespace opt
@@ -57,15 +88,21 @@ namespace opt
     static std::string referenceFile;
     static size_t kmer = 31;
     static size_t num_samples = 10000;
+    static bool testAll = false;
+    static std::string outFile;
+    static int numThreads = 1;
 }
 
-static const char* shortopts = "k:n:v";
+static const char* shortopts = "k:n:o:t:av";
 
 enum { OPT_HELP = 1, OPT_VERSION, OPT_NO_REVERSE };
 
 static const struct option longopts[] = {
     { "kmer",        required_argument, NULL, 'k' },
     { "num-samples", required_argument, NULL, 'n' },
+    { "all",         no_argument,       NULL, 'a' },
+    { "outfile",     required_argument, NULL, 'o' },
+    { "threads",     required_argument, NULL, 't' },
     { "verbose",     no_argument,       NULL, 'v' },
     { "help",        no_argument,       NULL, OPT_HELP },
     { "version",     no_argument,       NULL, OPT_VERSION },
@@ -86,46 +123,242 @@ int variantDetectabilityMain(int argc, char** argv)
     ReadTable ref_table(opt::referenceFile);
         
     // Convert to string vector
+    StringVector ref_names;
     StringVector ref_sequences;
     for(size_t i = 0; i < ref_table.getCount(); ++i) {
+        ref_names.push_back(ref_table.getRead(i).id);
         ref_sequences.push_back(ref_table.getRead(i).seq.toString());   
     }
-    computeDetectableSampling(ref_sequences, ref_index);
+
+    if(opt::testAll)
+        computeDetectableAll(ref_names, ref_sequences, ref_index);
+    else
+        computeDetectableSampling(ref_sequences, ref_index);
 
     delete ref_index.pBWT;
     delete ref_index.pCache;
     return 0;
 }
 
-//
-void computeDetectableAll(StringVector& ref_sequences, const BWTIndexSet& ref_index)
+// Test every mutation of the reference. The reference is split into chunks
+// that are processed in parallel and the results are written in order.
+void computeDetectableAll(const StringVector& ref_names, const StringVector& ref_sequences, const BWTIndexSet& ref_index)
 {
+    Timer t("sga variant-detectability");
+
+#if HAVE_OPENMP
+    omp_set_num_threads(opt::numThreads);
+#endif
+
+    // Make the list of chunks to process
+    std::vector<DetectabilityChunk> chunks;
+    for(size_t ri = 0; ri < ref_sequences.size(); ++ri) {
+        size_t l = ref_sequences[ri].length();
+        for(size_t start = 0; start < l; start += DETECTABILITY_CHUNK_SIZE) {
+            DetectabilityChunk chunk;
+            chunk.ref_idx = ri;
+            chunk.start = start;
+            chunk.end = std::min(start + DETECTABILITY_CHUNK_SIZE, l);
+            chunk.tested = 0;
+            chunk.detected = 0;
+            chunks.push_back(chunk);
+        }
+    }
+
+    std::ostream* pWriter = createWriter(opt::outFile);
     size_t total_tested = 0;
     size_t total_detected = 0;
 
-    for(size_t ri = 0; ri < ref_sequences.size(); ++ri) {
-        std::string& sequence = ref_sequences[ri];
-        size_t l = sequence.length();
-        for(size_t i = 0; i < l; ++i) {
-
-            char b = sequence[i];
-            for(size_t j = 0; j < 4; ++j) {
-                char m = "ACGT"[j];
-                if(b == m)
-                    continue;
-                KmerCounts counts = computeChangeCounts(ref_index, sequence, i, m);
-                total_tested += 1;
-                total_detected += (counts.zero > 0) ? 1 : 0;
-            }
+    // Process a batch of chunks in parallel then write them out, to bound
+    // the amount of memory used for the per-position results
+    int64_t batch_size = 4 * opt::numThreads;
+    for(int64_t batch_start = 0; batch_start < (int64_t)chunks.size(); batch_start += batch_size) {
+        int64_t batch_end = std::min(batch_start + batch_size, (int64_t)chunks.size());
+
+#if HAVE_OPENMP
+        #pragma omp parallel for schedule(dynamic)
+#endif
+        for(int64_t ci = batch_start; ci < batch_end; ++ci) {
+            DetectabilityChunk& chunk = chunks[ci];
+            computeDetectableChunk(ref_sequences[chunk.ref_idx], ref_index.pBWT, chunk);
+        }
+
+        for(int64_t ci = batch_start; ci < batch_end; ++ci) {
+            DetectabilityChunk& chunk = chunks[ci];
+            writeDetectableBedGraph(*pWriter, ref_names[chunk.ref_idx], chunk);
+            total_tested += chunk.tested;
+            total_detected += chunk.detected;
+
+            // Release the per-position results
+            std::vector<uint8_t>().swap(chunk.num_detectable);
         }
 
-        if(total_tested % 1000 == 0)
+        if(opt::verbose > 0)
             printf("Tested %zu\n", total_tested);
     }
+    delete pWriter;
+
     printf("Tested: %zu\n", total_tested);
     printf("Detectable: %zu\n", total_detected);
 }
 
+// Returns true if b is one of the four DNA bases
+static inline bool isACGT(char b)
+{
+    return b == 'A' || b == 'C' || b == 'G' || b == 'T';
+}
+
+// Extend interval to the left by b. Strings containing a base that
+// is not in the index do not occur in it.
+static inline void extendDetectInterval(BWTInterval& interval, char b, const BWT* pBWT)
+{
+    if(!interval.isValid())
+        return;
+
+    if(isACGT(b)) {
+        BWTAlgorithms::updateInterval(interval, b, pBWT);
+    } else {
+        interval.lower = 1;
+        interval.upper = 0;
+    }
+}
+
+// Test all mutations in [chunk.start, chunk.end) of sequence.
+// A mutation is detectable if one of the k-mers covering it does not occur
+// in the index on either strand. Rather than searching each mutated k-mer
+// from scratch, the intervals of the unmutated parts of the k-mers are
+// shared between the k overlapping k-mers and the three alternative bases,
+// and updated incrementally as we move along the reference. For the
+// forward strand these are the parts to the right of the mutated base, so
+// the chunk is scanned right-to-left. For the reverse strand they are the
+// parts to the left and the chunk is scanned left-to-right. The k-mers
+// that are absent are recorded in a bitmask over the k-mer start positions.
+void computeDetectableChunk(const std::string& sequence, const BWT* pBWT, DetectabilityChunk& chunk)
+{
+    size_t k = opt::kmer;
+    size_t l = sequence.length();
+    size_t n = chunk.end - chunk.start;
+    chunk.num_detectable.assign(n, DETECTABILITY_NOT_TESTED);
+    chunk.tested = 0;
+    chunk.detected = 0;
+
+    if(l < k)
+        return;
+
+    BWTInterval full_interval(0, pBWT->getBWLen() - 1);
+    BWTInterval empty_interval(1, 0);
+
+    // The absent k-mers of each mutation, indexed by 4 * position + base rank.
+    // Bit d is set if the k-mer starting d bases before the position is absent.
+    std::vector<uint64_t> fwd_absent(4 * n, 0);
+    std::vector<uint64_t> rc_absent(4 * n, 0);
+
+    // The intervals of the reference substrings adjacent to the current position,
+    // indexed by the end (forward) or start (reverse) coordinate of the k-mer modulo k
+    std::vector<BWTInterval> intervals(k, empty_interval);
+
+    // Forward strand. At position i, intervals[e % k] holds the interval
+    // of sequence[i+1, e] for each k-mer ending at e.
+    size_t last = std::min(chunk.end + k - 1, l);
+    for(size_t i = last; i-- > chunk.start; ) {
+        if(i + 1 < l) {
+            for(size_t s = 0; s < k; ++s)
+                extendDetectInterval(intervals[s], sequence[i + 1], pBWT);
+        }
+        intervals[i % k] = full_interval;
+
+        if(i >= chunk.end || !isACGT(sequence[i]))
+            continue;
+
+        size_t first_ki = (i + 1) > k ? i + 1 - k : 0;
+        size_t last_ki = std::min(i, l - k);
+        for(size_t j = 0; j < 4; ++j) {
+            char m = "ACGT"[j];
+            if(m == sequence[i])
+                continue;
+
+            uint64_t mask = 0;
+            for(size_t ki = first_ki; ki <= last_ki; ++ki) {
+                BWTInterval interval = intervals[(ki + k - 1) % k];
+                extendDetectInterval(interval, m, pBWT);
+                for(size_t p = i; p > ki && interval.isValid(); --p)
+                    extendDetectInterval(interval, sequence[p - 1], pBWT);
+                if(!interval.isValid())
+                    mask |= (uint64_t)1 << (i - ki);
+            }
+            fwd_absent[4 * (i - chunk.start) + j] = mask;
+        }
+    }
+
+    // Reverse strand. At position i, intervals[s % k] holds the interval
+    // of the reverse complement of sequence[s, i-1] for each k-mer starting at s.
+    std::fill(intervals.begin(), intervals.end(), empty_interval);
+    size_t first = chunk.start + 1 > k ? chunk.start + 1 - k : 0;
+    for(size_t i = first; i < chunk.end; ++i) {
+        if(i > 0) {
+            for(size_t s = 0; s < k; ++s)
+                extendDetectInterval(intervals[s], complement(sequence[i - 1]), pBWT);
+        }
+        intervals[i % k] = full_interval;
+
+        if(i < chunk.start || !isACGT(sequence[i]))
+            continue;
+
+        size_t first_ki = (i + 1) > k ? i + 1 - k : 0;
+        size_t last_ki = std::min(i, l - k);
+        for(size_t j = 0; j < 4; ++j) {
+            char m = "ACGT"[j];
+            if(m == sequence[i])
+                continue;
+
+            uint64_t mask = 0;
+            for(size_t ki = first_ki; ki <= last_ki; ++ki) {
+                BWTInterval interval = intervals[ki % k];
+                extendDetectInterval(interval, complement(m), pBWT);
+                for(size_t p = i + 1; p < ki + k && interval.isValid(); ++p)
+                    extendDetectInterval(interval, complement(sequence[p]), pBWT);
+                if(!interval.isValid())
+                    mask |= (uint64_t)1 << (i - ki);
+            }
+            rc_absent[4 * (i - chunk.start) + j] = mask;
+        }
+    }
+
+    // A mutation is detectable if some k-mer is absent on both strands
+    for(size_t i = chunk.start; i < chunk.end; ++i) {
+        if(!isACGT(sequence[i]))
+            continue;
+
+        uint8_t num_detectable = 0;
+        for(size_t j = 0; j < 4; ++j) {
+            size_t idx = 4 * (i - chunk.start) + j;
+            if((fwd_absent[idx] & rc_absent[idx]) != 0)
+                num_detectable += 1;
+        }
+        chunk.num_detectable[i - chunk.start] = num_detectable;
+        chunk.tested += 3;
+        chunk.detected += num_detectable;
+    }
+}
+
+// Write the results for a chunk as bedGraph records, merging
+// runs of positions with the same number of detectable mutations
+void writeDetectableBedGraph(std::ostream& out, const std::string& ref_name, const DetectabilityChunk& chunk)
+{
+    size_t n = chunk.num_detectable.size();
+    size_t run_start = 0;
+    while(run_start < n) {
+        uint8_t value = chunk.num_detectable[run_start];
+        size_t run_end = run_start + 1;
+        while(run_end < n && chunk.num_detectable[run_end] == value)
+            ++run_end;
+
+        if(value != DETECTABILITY_NOT_TESTED)
+            out << ref_name << "\t" << chunk.start + run_start << "\t" << chunk.start + run_end << "\t" << (int)value << "\n";
+        run_start = run_end;
+    }
+}
+
 void computeDetectableSampling(StringVector& ref_sequences, const BWTIndexSet& ref_index)
 {
     size_t total_tested = 0;
@@ -210,6 +443,9 @@ void parseVarDetectOptions(int argc, char** argv)
             case '?': die = true; break;
             case 'k': arg >> opt::kmer; break;
             case 'n': arg >> opt::num_samples; break;
+            case 'a': opt::testAll = true; break;
+            case 'o': arg >> opt::outFile; break;
+            case 't': arg >> opt::numThreads; break;
             case 'v': opt::verbose++; break;
             case OPT_HELP:
                 std::cout << VARIANT_DETECTABILITY_USAGE_MESSAGE;
@@ -231,6 +467,18 @@ void parseVarDetectOptions(int argc, char** argv)
         die = true;
     }
 
+    if(opt::numThreads <= 0)
+    {
+        std::cerr << SUBPROGRAM ": invalid number of threads: " << opt::numThreads << "\n";
+        die = true;
+    }
+
+    if(opt::testAll && (opt::kmer == 0 || opt::kmer > 64))
+    {
+        std::cerr << SUBPROGRAM ": the k-mer length must be between 1 and 64 when using --all\n";
+        die = true;
+    }
+
     if(die) 
     {
         std::cerr << "Try `" << SUBPROGRAM << " --help' for more information.\n";
@@ -239,4 +487,7 @@ void parseVarDetectOptions(int argc, char** argv)
 
     // Parse the input filenames
     opt::referenceFile = argv[optind++];
+
+    if(opt::outFile.empty())
+        opt::outFile = stripFilename(opt::referenceFile) + ".detectability.bedGraph";
 }
@@ -0,0 +1,353 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// ASQGIndex - A sidecar index over an uncompressed
+// ASQG file for random access to vertex neighbourhoods
+//
+#include <algorithm>
+#include <sys/stat.h>
+#include "ASQGIndex.h"
+#include "Util.h"
+
+static const uint64_t ASQG_INDEX_MAGIC_NUMBER = 0x41515149ULL;
+#define AQI_READ(x) m_indexReader.read(reinterpret_cast<char*>(&(x)), sizeof((x)));
+#define AQI_WRITE(x) pWriter->write(reinterpret_cast<const char*>(&(x)), sizeof((x)));
+
+// Size of the chunks used to read names and records from disk
+static const size_t AQI_READ_CHUNK = 256;
+
+namespace
+{
+
+// The byte offset of a vertex record, keyed by the vertex ID
+struct IndexVertex
+{
+    std::string id;
+    uint64_t recordOffset;
+    bool operator<(const IndexVertex& other) const { return id < other.id; }
+};
+
+// An edge record offset, keyed by the position of one of its
+// endpoints in the sorted vertex table
+struct IndexEdge
+{
+    uint64_t vertexIdx;
+    uint64_t recordOffset;
+    bool operator<(const IndexEdge& other) const
+    {
+        if(vertexIdx != other.vertexIdx)
+            return vertexIdx < other.vertexIdx;
+        return recordOffset < other.recordOffset;
+    }
+};
+
+// Return the position of id in the sorted vertex table
+uint64_t lookupVertexIdx(const std::vector<IndexVertex>& vertices, const std::string& id)
+{
+    IndexVertex key;
+    key.id = id;
+    std::vector<IndexVertex>::const_iterator iter = std::lower_bound(vertices.begin(), vertices.end(), key);
+    if(iter == vertices.end() || iter->id != id)
+    {
+        std::cerr << "Error: edge record references vertex " << id << " that is not in the graph\n";
+        exit(EXIT_FAILURE);
+    }
+    return iter - vertices.begin();
+}
+
+}
+
+//
+ASQGIndex::ASQGIndex(const std::string& asqgFilename)
+{
+    m_graphReader.open(asqgFilename.c_str(), std::ios::in | std::ios::binary);
+    assertFileOpen(m_graphReader, asqgFilename);
+
+    std::string indexFilename = getIndexFilename(asqgFilename);
+    m_indexReader.open(indexFilename.c_str(), std::ios::in | std::ios::binary);
+    assertFileOpen(m_indexReader, indexFilename);
+
+    uint64_t magic = 0;
+    AQI_READ(magic)
+    if(magic != ASQG_INDEX_MAGIC_NUMBER)
+    {
+        std::cerr << "Error: " << indexFilename << " is not a valid ASQG index\n";
+        exit(EXIT_FAILURE);
+    }
+
+    AQI_READ(m_numVertices)
+    AQI_READ(m_numEdgeOffsets)
+    AQI_READ(m_firstVertexOffset)
+
+    m_vertexTableStart = m_indexReader.tellg();
+    m_edgeTableStart = m_vertexTableStart + (m_numVertices + 1) * sizeof(VertexEntry);
+    m_nameTableStart = m_edgeTableStart + m_numEdgeOffsets * sizeof(uint64_t);
+}
+
+//
+ASQGIndex::~ASQGIndex()
+{
+    m_graphReader.close();
+    m_indexReader.close();
+}
+
+//
+ASQG::HeaderRecord ASQGIndex::readHeader()
+{
+    // The header is the first record of the file
+    if(m_firstVertexOffset == 0)
+        return ASQG::HeaderRecord();
+    return ASQG::HeaderRecord(readRecordLine(0));
+}
+
+//
+bool ASQGIndex::readVertex(const std::string& id,
+                           ASQG::VertexRecord& vertexRecord,
+                           std::vector<ASQG::EdgeRecord>* pEdgeRecords)
+{
+    VertexEntry entry;
+    VertexEntry next;
+    if(!findVertex(id, entry, next))
+        return false;
+
+    vertexRecord.parse(readRecordLine(entry.recordOffset));
+
+    if(pEdgeRecords != NULL)
+    {
+        pEdgeRecords->clear();
+        uint64_t numEdges = next.firstEdge - entry.firstEdge;
+        std::vector<uint64_t> edgeOffsets(numEdges);
+        if(numEdges > 0)
+        {
+            m_indexReader.clear();
+            m_indexReader.seekg(m_edgeTableStart + entry.firstEdge * sizeof(uint64_t));
+            m_indexReader.read(reinterpret_cast<char*>(&edgeOffsets[0]), numEdges * sizeof(uint64_t));
+        }
+
+        for(size_t i = 0; i < edgeOffsets.size(); ++i)
+            pEdgeRecords->push_back(ASQG::EdgeRecord(readRecordLine(edgeOffsets[i])));
+    }
+    return true;
+}
+
+// Binary search the on-disk vertex table for id
+bool ASQGIndex::findVertex(const std::string& id, VertexEntry& entry, VertexEntry& next)
+{
+    uint64_t lo = 0;
+    uint64_t hi = m_numVertices;
+    while(lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        VertexEntry midEntry = readVertexEntry(mid);
+        int cmp = readName(midEntry.nameOffset).compare(id);
+        if(cmp == 0)
+        {
+            entry = midEntry;
+            next = readVertexEntry(mid + 1);
+            return true;
+        }
+        else if(cmp < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+//
+ASQGIndex::VertexEntry ASQGIndex::readVertexEntry(uint64_t idx)
+{
+    assert(idx <= m_numVertices);
+    VertexEntry entry;
+    m_indexReader.clear();
+    m_indexReader.seekg(m_vertexTableStart + idx * sizeof(VertexEntry));
+    AQI_READ(entry)
+    return entry;
+}
+
+// Read a '\0' terminated string from the name table
+std::string ASQGIndex::readName(uint64_t nameOffset)
+{
+    m_indexReader.clear();
+    m_indexReader.seekg(m_nameTableStart + nameOffset);
+
+    std::string name;
+    char buffer[AQI_READ_CHUNK];
+    while(m_indexReader.read(buffer, AQI_READ_CHUNK) || m_indexReader.gcount() > 0)
+    {
+        size_t n = m_indexReader.gcount();
+        char* pEnd = std::find(buffer, buffer + n, '\0');
+        name.append(buffer, pEnd);
+        if(pEnd != buffer + n)
+            break;
+    }
+    m_indexReader.clear();
+    return name;
+}
+
+// Read a single line of the graph starting at offset
+std::string ASQGIndex::readRecordLine(uint64_t offset)
+{
+    m_graphReader.clear();
+    m_graphReader.seekg(offset);
+
+    std::string line;
+    if(!getline(m_graphReader, line))
+    {
+        std::cerr << "Error: could not read ASQG record at offset " << offset << ", the index may be out of date\n";
+        exit(EXIT_FAILURE);
+    }
+    return line;
+}
+
+//
+void ASQGIndex::build(const std::string& asqgFilename)
+{
+    assert(isIndexable(asqgFilename));
+
+    std::ifstream reader(asqgFilename.c_str(), std::ios::in | std::ios::binary);
+    assertFileOpen(reader, asqgFilename);
+
+    // First pass over the vertex records to collect the vertex ids and offsets
+    std::vector<IndexVertex> vertices;
+    uint64_t firstVertexOffset = 0;
+    bool foundVertex = false;
+
+    uint64_t offset = 0;
+    std::string recordLine;
+    while(getline(reader, recordLine))
+    {
+        uint64_t recordOffset = offset;
+        offset += recordLine.size() + 1;
+        if(recordLine.empty())
+            continue;
+
+        ASQG::RecordType rt = ASQG::getRecordType(recordLine);
+        if(rt == ASQG::RT_HEADER)
+            continue;
+        else if(rt == ASQG::RT_EDGE)
+            break;
+
+        if(!foundVertex)
+        {
+            firstVertexOffset = recordOffset;
+            foundVertex = true;
+        }
+
+        // The id is the second tab-delimited field of the record
+        size_t start = recordLine.find('\t') + 1;
+        size_t end = recordLine.find('\t', start);
+        IndexVertex iv;
+        iv.id = recordLine.substr(start, end - start);
+        iv.recordOffset = recordOffset;
+        vertices.push_back(iv);
+    }
+
+    std::sort(vertices.begin(), vertices.end());
+
+    // Second pass over the edge records. Each edge record is indexed under both of its endpoints
+    reader.clear();
+    reader.seekg(0);
+    offset = 0;
+
+    std::vector<IndexEdge> edges;
+    while(getline(reader, recordLine))
+    {
+        uint64_t recordOffset = offset;
+        offset += recordLine.size() + 1;
+        if(recordLine.empty() || ASQG::getRecordType(recordLine) != ASQG::RT_EDGE)
+            continue;
+
+        // The overlap field starts with the space-delimited ids of the two vertices
+        size_t start1 = recordLine.find('\t') + 1;
+        size_t end1 = recordLine.find(' ', start1);
+        size_t start2 = end1 + 1;
+        size_t end2 = recordLine.find(' ', start2);
+        if(end1 == std::string::npos || end2 == std::string::npos)
+        {
+            std::cerr << "Error: Edge record is incomplete.\n";
+            std::cerr << "Record: " << recordLine << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        IndexEdge ie;
+        ie.recordOffset = recordOffset;
+        ie.vertexIdx = lookupVertexIdx(vertices, recordLine.substr(start1, end1 - start1));
+        edges.push_back(ie);
+
+        // Self-overlaps are only indexed once
+        uint64_t otherIdx = lookupVertexIdx(vertices, recordLine.substr(start2, end2 - start2));
+        if(otherIdx != ie.vertexIdx)
+        {
+            ie.vertexIdx = otherIdx;
+            edges.push_back(ie);
+        }
+    }
+    reader.close();
+
+    std::sort(edges.begin(), edges.end());
+
+    // Write the index
+    std::string indexFilename = getIndexFilename(asqgFilename);
+    std::ostream* pWriter = createWriter(indexFilename, std::ios::out | std::ios::binary);
+
+    uint64_t numVertices = vertices.size();
+    uint64_t numEdgeOffsets = edges.size();
+    AQI_WRITE(ASQG_INDEX_MAGIC_NUMBER)
+    AQI_WRITE(numVertices)
+    AQI_WRITE(numEdgeOffsets)
+    AQI_WRITE(firstVertexOffset)
+
+    // Vertex table, followed by a sentinel entry that closes the edge range of the last vertex
+    uint64_t nameOffset = 0;
+    size_t edgeIdx = 0;
+    for(size_t i = 0; i <= vertices.size(); ++i)
+    {
+        while(edgeIdx < edges.size() && edges[edgeIdx].vertexIdx < i)
+            ++edgeIdx;
+
+        VertexEntry entry;
+        entry.nameOffset = nameOffset;
+        entry.recordOffset = i < vertices.size() ? vertices[i].recordOffset : 0;
+        entry.firstEdge = edgeIdx;
+        AQI_WRITE(entry)
+
+        if(i < vertices.size())
+            nameOffset += vertices[i].id.size() + 1;
+    }
+
+    // Edge table
+    for(size_t i = 0; i < edges.size(); ++i)
+        AQI_WRITE(edges[i].recordOffset)
+
+    // Name table
+    for(size_t i = 0; i < vertices.size(); ++i)
+        pWriter->write(vertices[i].id.c_str(), vertices[i].id.size() + 1);
+
+    delete pWriter;
+}
+
+//
+bool ASQGIndex::isIndexable(const std::string& asqgFilename)
+{
+    return !isGzip(asqgFilename);
+}
+
+//
+bool ASQGIndex::hasIndex(const std::string& asqgFilename)
+{
+    if(!isIndexable(asqgFilename))
+        return false;
+
+    struct stat graphStat;
+    struct stat indexStat;
+    if(stat(asqgFilename.c_str(), &graphStat) != 0 || stat(getIndexFilename(asqgFilename).c_str(), &indexStat) != 0)
+        return false;
+    return indexStat.st_mtime >= graphStat.st_mtime;
+}
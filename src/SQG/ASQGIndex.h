@@ -0,0 +1,92 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// ASQGIndex - A sidecar index over an uncompressed
+// ASQG file that maps a vertex ID to the byte offset
+// of its vertex record and the offsets of all the edge
+// records it participates in. This allows the neighbourhood
+// of a vertex to be read by seeking instead of loading
+// the entire graph.
+//
+// The index is stored in binary next to the graph, in FILE.asqg.aqi,
+// with the following layout:
+//   magic number, number of vertices, number of edge offsets,
+//   byte offset of the first vertex record
+//   vertex table sorted by id: (name offset, record offset, first edge)
+//     followed by a sentinel entry
+//   edge record offsets, grouped by vertex
+//   vertex names, each terminated by a '\0'
+//
+#ifndef ASQGINDEX_H
+#define ASQGINDEX_H
+
+#include <fstream>
+#include <stdint.h>
+#include "ASQG.h"
+
+#define ASQG_INDEX_EXT ".aqi"
+
+class ASQGIndex
+{
+    public:
+
+        // Open the graph and its index for reading
+        ASQGIndex(const std::string& asqgFilename);
+        ~ASQGIndex();
+
+        // Returns the header record of the graph
+        ASQG::HeaderRecord readHeader();
+
+        // Read the vertex record for id and all the edge records it is part of.
+        // Returns false if the vertex is not in the graph.
+        bool readVertex(const std::string& id,
+                        ASQG::VertexRecord& vertexRecord,
+                        std::vector<ASQG::EdgeRecord>* pEdgeRecords);
+
+        size_t getNumVertices() const { return m_numVertices; }
+
+        // Build the index for the graph and write it to disk.
+        // Gzipped graphs cannot be seeked into so they are not indexed.
+        static void build(const std::string& asqgFilename);
+
+        // Returns true if the graph can be indexed
+        static bool isIndexable(const std::string& asqgFilename);
+
+        // Returns true if an index exists for the graph that is not older than the graph
+        static bool hasIndex(const std::string& asqgFilename);
+
+        static std::string getIndexFilename(const std::string& asqgFilename) { return asqgFilename + ASQG_INDEX_EXT; }
+
+    private:
+
+        // An entry in the sorted vertex table
+        struct VertexEntry
+        {
+            uint64_t nameOffset;
+            uint64_t recordOffset;
+            uint64_t firstEdge;
+        };
+
+        // Functions
+        VertexEntry readVertexEntry(uint64_t idx);
+        std::string readName(uint64_t nameOffset);
+        std::string readRecordLine(uint64_t offset);
+        bool findVertex(const std::string& id, VertexEntry& entry, VertexEntry& next);
+
+        // Data
+        std::ifstream m_graphReader;
+        std::ifstream m_indexReader;
+
+        uint64_t m_numVertices;
+        uint64_t m_numEdgeOffsets;
+        uint64_t m_firstVertexOffset;
+
+        // Offsets of the sections of the index file
+        uint64_t m_vertexTableStart;
+        uint64_t m_edgeTableStart;
+        uint64_t m_nameTableStart;
+};
+
+#endif
@@ -51,7 +51,7 @@ std::string ScaffoldRecord::generateString(const ResolveParams& params, StringVe
     // Starting from the root, join the sequence(s) of the scaffold
     // together along with the appropriate gaps/overlap
     std::string sequence = params.pSequenceCollection->getSequence(m_rootID);
-    params.pSequenceCollection->setPlaced(m_rootID);
+    markPlaced(params, m_rootID);
     ids.push_back(m_rootID + "+");
  
     if(m_links.empty())
@@ -78,7 +78,7 @@ std::string ScaffoldRecord::generateString(const ResolveParams& params, StringVe
 
         // Mark the current link as placed in the scaffold
         const ScaffoldLink& link = m_links[i];
-        params.pSequenceCollection->setPlaced(link.endpointID);
+        markPlaced(params, link.endpointID);
 
         // Calculate the strand this sequence is on relative to the root
         if(link.getComp() == EC_REVERSE)
@@ -160,6 +160,54 @@ bool ScaffoldRecord::graphResolve(const ResolveParams& params, const std::string
 {
     assert(params.pGraph != NULL);
 
+    GraphResolveResult result;
+    std::string cacheKey;
+    bool cached = false;
+    if(params.pGraphResolveCache != NULL)
+    {
+        // The result of the search only depends on the endpoints, the
+        // orientation of the link and the distance window
+        std::stringstream key_ss;
+        key_ss << startID << "\t" << link.endpointID << "\t" << link.getDir() << link.getComp()
+               << "\t" << link.distance << "\t" << static_cast<int>(params.distanceFactor * link.stdDev);
+        cacheKey = key_ss.str();
+        cached = params.pGraphResolveCache->find(cacheKey, result);
+    }
+
+    if(!cached)
+    {
+        searchGraphWalks(params, startID, link, result);
+        if(params.pGraphResolveCache != NULL)
+            params.pGraphResolveCache->insert(cacheKey, result);
+    }
+
+    // Was an acceptable walk found? 
+    if(result.status == GraphResolveResult::GRR_FOUND)
+    {
+        outExtensionString = result.extensionString;
+        params.pStats->graphWalkFound += 1;
+
+        // Mark all vertices in the walk as visited
+        for(size_t i = 0; i < result.walkIDs.size(); ++i)
+            markPlaced(params, result.walkIDs[i]);
+        return true;
+    }
+    else
+    {
+        if(result.status == GraphResolveResult::GRR_TOO_MANY)
+            params.pStats->graphWalkTooMany += 1;
+        else
+            params.pStats->graphWalkNoPath += 1;
+        assert(outExtensionString.empty());
+        return false;
+    }
+}
+
+// Find the walks through the graph that are consistent with the link and
+// select one according to the resolve mode. This does not modify the graph.
+void ScaffoldRecord::searchGraphWalks(const ResolveParams& params, const std::string& startID,
+                                      const ScaffoldLink& link, GraphResolveResult& result) const
+{
     // Get the vertex to start the search from
     Vertex* pStartVertex = params.pGraph->getVertex(startID);
     Vertex* pEndVertex = params.pGraph->getVertex(link.endpointID);
@@ -169,7 +217,7 @@ bool ScaffoldRecord::graphResolve(const ResolveParams& params, const std::string
     int maxDistance = link.distance + threshold;
     int maxExtensionDistance = maxDistance + pEndVertex->getSeqLen();
     SGWalkVector walks;
-    SGSearch::findWalks(pStartVertex, pEndVertex, link.getDir(), maxExtensionDistance, 10000, true, walks);
+    SGSearch::findWalks(pStartVertex, pEndVertex, link.getDir(), maxExtensionDistance, params.maxSearchNodes, true, walks);
 
     int numWalksValid = 0;
     int numWalksClosest = 0;
@@ -220,6 +268,7 @@ bool ScaffoldRecord::graphResolve(const ResolveParams& params, const std::string
 
     // Choose the best path, if any, depending on the algorithm to use
     bool useWalk = false;
+    result.status = GraphResolveResult::GRR_NO_PATH;
 
     if(numWalksValid > 0)
     {
@@ -229,14 +278,14 @@ bool ScaffoldRecord::graphResolve(const ResolveParams& params, const std::string
             if(!(params.resolveMask & RESOLVE_GRAPH_UNIQUE) || numWalksClosest == 1)
                 useWalk = true;
             else if((params.resolveMask & RESOLVE_GRAPH_UNIQUE) && numWalksClosest > 1)
-                params.pStats->graphWalkTooMany += 1;
+                result.status = GraphResolveResult::GRR_TOO_MANY;
         }
         else
         {
             if(numWalksValid == 1)
                 useWalk = true;
             else if(numWalksValid > 1)
-                params.pStats->graphWalkTooMany += 1;
+                result.status = GraphResolveResult::GRR_TOO_MANY;
         }
     }
 
@@ -244,25 +293,15 @@ bool ScaffoldRecord::graphResolve(const ResolveParams& params, const std::string
     std::cout << "  Num walks: " << walks.size() << " Num valid: " << numWalksValid << " Num closest: " << numWalksClosest << " using: " << useWalk << "\n";
 #endif
 
-    // Was an acceptable walk found? 
     if(useWalk)
     {
         assert(selectedIdx != -1);
-        outExtensionString = walks[selectedIdx].getString(SGWT_EXTENSION);
-        params.pStats->graphWalkFound += 1;
+        result.status = GraphResolveResult::GRR_FOUND;
+        result.extensionString = walks[selectedIdx].getString(SGWT_EXTENSION);
 
-        // Mark all vertices in the walk as visited
         VertexPtrVec vertexPtrVector = walks[selectedIdx].getVertices();
         for(size_t i = 0; i < vertexPtrVector.size(); ++i)
-            params.pSequenceCollection->setPlaced(vertexPtrVector[i]->getID());
-        return true;
-    }
-    else
-    {
-        if(numWalksValid == 0)
-            params.pStats->graphWalkNoPath += 1;
-        assert(outExtensionString.empty());
-        return false;
+            result.walkIDs.push_back(vertexPtrVector[i]->getID());
     }
 }
 
@@ -326,6 +365,15 @@ bool ScaffoldRecord::introduceGap(int minGapLength, const std::string& contigStr
     return true;
 }
 
+//
+void ScaffoldRecord::markPlaced(const ResolveParams& params, const std::string& id) const
+{
+    if(params.pPlacedIDs != NULL)
+        params.pPlacedIDs->push_back(id);
+    else
+        params.pSequenceCollection->setPlaced(id);
+}
+
 //
 void ScaffoldRecord::parse(const std::string& text)
 {
@@ -349,3 +397,31 @@ void ScaffoldRecord::writeScaf(std::ostream* pWriter)
         *pWriter << "\t" << m_links[i];
     *pWriter << "\n";
 }
+
+//
+bool GraphResolveCache::find(const std::string& key, GraphResolveResult& result) const
+{
+    bool found = false;
+#if HAVE_OPENMP
+    #pragma omp critical(graph_resolve_cache)
+#endif
+    {
+        ResultMap::const_iterator iter = m_map.find(key);
+        if(iter != m_map.end())
+        {
+            result = iter->second;
+            m_numHits += 1;
+            found = true;
+        }
+    }
+    return found;
+}
+
+//
+void GraphResolveCache::insert(const std::string& key, const GraphResolveResult& result)
+{
+#if HAVE_OPENMP
+    #pragma omp critical(graph_resolve_cache)
+#endif
+    m_map.insert(std::make_pair(key, result));
+}
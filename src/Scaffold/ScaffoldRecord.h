@@ -14,6 +14,7 @@
 #include "ScaffoldLink.h"
 #include "ScaffoldSequenceCollection.h"
 #include "SGUtil.h"
+#include <map>
 
 // Gap resolution statistics
 struct ResolveStats
@@ -32,8 +33,21 @@ struct ResolveStats
         overlapFailed = 0;
     }
 
-    ~ResolveStats() { print(); }
-    
+    // Add the counts of other to this object
+    void add(const ResolveStats& other)
+    {
+        numGapsResolved += other.numGapsResolved;
+        numGapsAttempted += other.numGapsAttempted;
+        numScaffolds += other.numScaffolds;
+
+        graphWalkFound += other.graphWalkFound;
+        graphWalkTooMany += other.graphWalkTooMany;
+        graphWalkNoPath += other.graphWalkNoPath;
+
+        overlapFound += other.overlapFound;
+        overlapFailed += other.overlapFailed;
+    }
+
     void print() const
     {
         printf("Num scaffolds: %d\n", numScaffolds);
@@ -62,9 +76,52 @@ struct ResolveStats
     int overlapFailed;
 };
 
+// The outcome of resolving a link by walking through the graph
+struct GraphResolveResult
+{
+    enum Status
+    {
+        GRR_FOUND,
+        GRR_TOO_MANY,
+        GRR_NO_PATH
+    };
+
+    Status status;
+
+    // The sequence that extends the start contig to the end of the
+    // link and the vertices on the selected walk. Only set if status is GRR_FOUND
+    std::string extensionString;
+    StringVector walkIDs;
+};
+
+// A cache of graph resolution results keyed by the link that was resolved,
+// so that links that are resolved more than once only search the graph once.
+// The cache can be shared between threads.
+class GraphResolveCache
+{
+    public:
+
+        // Returns true and sets result if the link has been resolved before
+        bool find(const std::string& key, GraphResolveResult& result) const;
+        void insert(const std::string& key, const GraphResolveResult& result);
+
+        size_t getNumHits() const { return m_numHits; }
+
+        GraphResolveCache() : m_numHits(0) {}
+
+    private:
+
+        typedef std::map<std::string, GraphResolveResult> ResultMap;
+        ResultMap m_map;
+        mutable size_t m_numHits;
+};
+
 // Parameter object for the scaffold record generateString function
 struct ResolveParams
 {
+    ResolveParams() : pSequenceCollection(NULL), pGraph(NULL), maxSearchNodes(10000),
+                      pStats(NULL), pPlacedIDs(NULL), pGraphResolveCache(NULL) {}
+
     ScaffoldSequenceCollection* pSequenceCollection;
     StringGraph* pGraph;
 
@@ -74,7 +131,20 @@ struct ResolveParams
     int resolveMask;
     int minGapLength;
     double distanceFactor;
+
+    // The maximum number of nodes the walk search for a single link may expand.
+    // Links whose search exceeds this are not resolved through the graph.
+    size_t maxSearchNodes;
+
     ResolveStats* pStats;
+
+    // If set, the IDs of the sequences placed in the scaffold are appended to
+    // this vector instead of being marked in the sequence collection. This allows
+    // scaffolds to be generated in parallel against a read-only collection.
+    StringVector* pPlacedIDs;
+
+    // Optional cache of graph walk resolutions
+    GraphResolveCache* pGraphResolveCache;
 };
 
 // Flags indicating what level of gap resolution should be performed
@@ -102,6 +172,10 @@ class ScaffoldRecord
         bool overlapResolve(const ResolveParams& params, const std::string& s1, const std::string& s2, 
                             const ScaffoldLink& link, std::string& outString) const;
 
+        // Search the graph for walks that resolve the link from startID
+        void searchGraphWalks(const ResolveParams& params, const std::string& startID,
+                              const ScaffoldLink& link, GraphResolveResult& result) const;
+
         // Resolve a link by introducing a gap
         bool introduceGap(int minGapLength, const std::string& contigString, const ScaffoldLink& link, std::string& outString) const;
 
@@ -109,7 +183,10 @@ class ScaffoldRecord
         void writeScaf(std::ostream* pWriter);
 
     private:
-        
+
+        // Mark the sequence with id as being placed in the scaffold
+        void markPlaced(const ResolveParams& params, const std::string& id) const;
+
         typedef std::vector<ScaffoldLink> LinkVector;
         
         std::string m_rootID;
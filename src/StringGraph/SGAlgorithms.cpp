@@ -65,16 +65,15 @@ Edge* SGAlgorithms::createEdgesFromOverlap(StringGraph* pGraph, const Overlap& o
 
     if(!isContainment)
     {
-        Edge* pEdges[2];
+        EdgeDir dirs[2];
         for(size_t idx = 0; idx < 2; ++idx)
-        {
-            EdgeDir dir = o.match.coord[idx].isLeftExtreme() ? ED_ANTISENSE : ED_SENSE;
-            const SeqCoord& coord = o.match.coord[idx];
-            pEdges[idx] = new(pGraph->getEdgeAllocator()) Edge(pVerts[1 - idx], dir, comp, coord);
-        }
+            dirs[idx] = o.match.coord[idx].isLeftExtreme() ? ED_ANTISENSE : ED_SENSE;
 
-        pEdges[0]->setTwin(pEdges[1]);
-        pEdges[1]->setTwin(pEdges[0]);
+        Edge* pEdges[2];
+        pEdges[0] = Edge::createTwins(pGraph->getEdgeAllocator(),
+                                      pVerts[1], dirs[0], o.match.coord[0],
+                                      pVerts[0], dirs[1], o.match.coord[1], comp);
+        pEdges[1] = pEdges[0]->getTwin();
         
         pGraph->addEdge(pVerts[0], pEdges[0]);
         pGraph->addEdge(pVerts[1], pEdges[1]);
@@ -87,20 +86,17 @@ Edge* SGAlgorithms::createEdgesFromOverlap(StringGraph* pGraph, const Overlap& o
         // add two edges per vertex. Later during the contain removal
         // algorithm this is important to determine transitivity
         Edge* pEdges[4];
-        for(size_t idx = 0; idx < 2; ++idx)
-        {
-            const SeqCoord& coord = o.match.coord[idx];
-            pEdges[idx] = new(pGraph->getEdgeAllocator()) Edge(pVerts[1 - idx], ED_SENSE, comp, coord);
-            pEdges[idx + 2] = new(pGraph->getEdgeAllocator()) Edge(pVerts[1 - idx], ED_ANTISENSE, comp, coord);
-        }
-        
-        // Twin the edges and add them to the graph
-        pEdges[0]->setTwin(pEdges[1]);
-        pEdges[1]->setTwin(pEdges[0]);
-
-        pEdges[2]->setTwin(pEdges[3]);
-        pEdges[3]->setTwin(pEdges[2]);
+        pEdges[0] = Edge::createTwins(pGraph->getEdgeAllocator(),
+                                      pVerts[1], ED_SENSE, o.match.coord[0],
+                                      pVerts[0], ED_SENSE, o.match.coord[1], comp);
+        pEdges[1] = pEdges[0]->getTwin();
+
+        pEdges[2] = Edge::createTwins(pGraph->getEdgeAllocator(),
+                                      pVerts[1], ED_ANTISENSE, o.match.coord[0],
+                                      pVerts[0], ED_ANTISENSE, o.match.coord[1], comp);
+        pEdges[3] = pEdges[2]->getTwin();
     
+        // Add the edges to the graph
         pGraph->addEdge(pVerts[0], pEdges[0]);
         pGraph->addEdge(pVerts[0], pEdges[2]);
 
@@ -11,6 +11,8 @@
 #include "SeqReader.h"
 #include "SGAlgorithms.h"
 #include "SGVisitors.h"
+#include "HashMap.h"
+#include <queue>
 
 StringGraph* SGUtil::loadASQG(const std::string& filename, const unsigned int minOverlap, 
                               bool allowContainments, size_t maxEdges)
@@ -37,33 +39,7 @@ StringGraph* SGUtil::loadASQG(const std::string& filename, const unsigned int mi
                 }
 
                 ASQG::HeaderRecord headerRecord(recordLine);
-                const SQG::IntTag& overlapTag = headerRecord.getOverlapTag();
-                if(overlapTag.isInitialized())
-                    pGraph->setMinOverlap(overlapTag.get());
-                else
-                    pGraph->setMinOverlap(0);
-
-                const SQG::FloatTag& errorRateTag = headerRecord.getErrorRateTag();
-                if(errorRateTag.isInitialized())
-                    pGraph->setErrorRate(errorRateTag.get());
-                
-                const SQG::IntTag& containmentTag = headerRecord.getContainmentTag();
-                if(containmentTag.isInitialized())
-                    pGraph->setContainmentFlag(containmentTag.get());
-                else
-                    pGraph->setContainmentFlag(true); // conservatively assume containments are present
-
-                const SQG::IntTag& transitiveTag = headerRecord.getTransitiveTag();
-                if(!transitiveTag.isInitialized())
-                {
-                    std::cerr << "Warning: ASQG does not have transitive tag\n";
-                    pGraph->setTransitiveFlag(true);
-                }
-                else
-                {
-                    pGraph->setTransitiveFlag(transitiveTag.get());
-                }
-
+                setGraphParameters(pGraph, headerRecord);
                 break;
             }
             case ASQG::RT_VERTEX:
@@ -114,16 +90,7 @@ StringGraph* SGUtil::loadASQG(const std::string& filename, const unsigned int mi
         ++line;
     }
 
-    // Completely delete the edges for all nodes that were marked as super-repetitive in the graph
-    SGSuperRepeatVisitor superRepeatVisitor;
-    pGraph->visit(superRepeatVisitor);
-
-    // Remove any duplicate edges
-    SGDuplicateVisitor dupVisit;
-    pGraph->visit(dupVisit);
-
-    SGGraphStatsVisitor statsVisit;
-    pGraph->visit(statsVisit);
+    finishLoading(pGraph);
     // Remove identical vertices
     // This is much cheaper to do than remove via
     // SGContainRemove as no remodelling needs to occur
@@ -142,6 +109,192 @@ StringGraph* SGUtil::loadASQG(const std::string& filename, const unsigned int mi
     return pGraph;
 }
 
+//
+void SGUtil::finishLoading(StringGraph* pGraph)
+{
+    // Completely delete the edges for all nodes that were marked as super-repetitive in the graph
+    SGSuperRepeatVisitor superRepeatVisitor;
+    pGraph->visit(superRepeatVisitor);
+
+    // Remove any duplicate edges
+    SGDuplicateVisitor dupVisit;
+    pGraph->visit(dupVisit);
+
+    SGGraphStatsVisitor statsVisit;
+    pGraph->visit(statsVisit);
+}
+
+//
+void SGUtil::setGraphParameters(StringGraph* pGraph, const ASQG::HeaderRecord& headerRecord)
+{
+    const SQG::IntTag& overlapTag = headerRecord.getOverlapTag();
+    if(overlapTag.isInitialized())
+        pGraph->setMinOverlap(overlapTag.get());
+    else
+        pGraph->setMinOverlap(0);
+
+    const SQG::FloatTag& errorRateTag = headerRecord.getErrorRateTag();
+    if(errorRateTag.isInitialized())
+        pGraph->setErrorRate(errorRateTag.get());
+
+    const SQG::IntTag& containmentTag = headerRecord.getContainmentTag();
+    if(containmentTag.isInitialized())
+        pGraph->setContainmentFlag(containmentTag.get());
+    else
+        pGraph->setContainmentFlag(true); // conservatively assume containments are present
+
+    const SQG::IntTag& transitiveTag = headerRecord.getTransitiveTag();
+    if(!transitiveTag.isInitialized())
+    {
+        std::cerr << "Warning: ASQG does not have transitive tag\n";
+        pGraph->setTransitiveFlag(true);
+    }
+    else
+    {
+        pGraph->setTransitiveFlag(transitiveTag.get());
+    }
+}
+
+// Find the representative of the set containing idx in the union-find forest
+static size_t findComponent(std::vector<size_t>& parent, size_t idx)
+{
+    while(parent[idx] != idx)
+    {
+        parent[idx] = parent[parent[idx]];
+        idx = parent[idx];
+    }
+    return idx;
+}
+
+//
+StringVector SGUtil::partitionASQG(const std::string& filename, size_t numPartitions, const std::string& outPrefix)
+{
+    typedef HashMap<std::string, size_t, StringHasher> IDIndexMap;
+    IDIndexMap idMap;
+    std::vector<size_t> parent;
+    std::vector<size_t> lengths;
+
+    // Pass 1: find the connected components of the graph using only the vertex IDs
+    std::istream* pReader = createReader(filename);
+    std::string recordLine;
+    while(getline(*pReader, recordLine))
+    {
+        ASQG::RecordType rt = ASQG::getRecordType(recordLine);
+        if(rt == ASQG::RT_VERTEX)
+        {
+            ASQG::VertexRecord vertexRecord(recordLine);
+            size_t idx = parent.size();
+            if(!idMap.insert(std::make_pair(vertexRecord.getID(), idx)).second)
+            {
+                std::cerr << "Error: duplicate vertex " << vertexRecord.getID() << " in " << filename << "\n";
+                exit(EXIT_FAILURE);
+            }
+            parent.push_back(idx);
+            lengths.push_back(vertexRecord.getSeq().length());
+        }
+        else if(rt == ASQG::RT_EDGE)
+        {
+            ASQG::EdgeRecord edgeRecord(recordLine);
+            const Overlap& ovr = edgeRecord.getOverlap();
+            IDIndexMap::const_iterator iter0 = idMap.find(ovr.id[0]);
+            IDIndexMap::const_iterator iter1 = idMap.find(ovr.id[1]);
+            if(iter0 == idMap.end() || iter1 == idMap.end())
+                continue;
+
+            size_t c0 = findComponent(parent, iter0->second);
+            size_t c1 = findComponent(parent, iter1->second);
+            if(c0 != c1)
+                parent[std::max(c0, c1)] = std::min(c0, c1);
+        }
+    }
+    delete pReader;
+
+    // Sum the sequence length of each component
+    std::vector<size_t> componentLengths(parent.size(), 0);
+    std::vector<size_t> componentRoots;
+    for(size_t i = 0; i < parent.size(); ++i)
+    {
+        size_t c = findComponent(parent, i);
+        if(c == i)
+            componentRoots.push_back(i);
+        componentLengths[c] += lengths[i];
+    }
+
+    // Assign the largest remaining component to the smallest partition
+    typedef std::pair<size_t, size_t> LengthIndexPair;
+    std::vector<LengthIndexPair> sortedComponents;
+    for(size_t i = 0; i < componentRoots.size(); ++i)
+        sortedComponents.push_back(std::make_pair(componentLengths[componentRoots[i]], componentRoots[i]));
+    std::sort(sortedComponents.begin(), sortedComponents.end(), std::greater<LengthIndexPair>());
+
+    numPartitions = std::max((size_t)1, std::min(numPartitions, componentRoots.size()));
+    std::priority_queue<LengthIndexPair, std::vector<LengthIndexPair>, std::greater<LengthIndexPair> > partitionQueue;
+    for(size_t i = 0; i < numPartitions; ++i)
+        partitionQueue.push(std::make_pair(0, i));
+
+    std::vector<size_t> componentPartition(parent.size(), 0);
+    std::vector<size_t> partitionLengths(numPartitions, 0);
+    for(size_t i = 0; i < sortedComponents.size(); ++i)
+    {
+        LengthIndexPair smallest = partitionQueue.top();
+        partitionQueue.pop();
+        componentPartition[sortedComponents[i].second] = smallest.second;
+        smallest.first += sortedComponents[i].first;
+        partitionLengths[smallest.second] = smallest.first;
+        partitionQueue.push(smallest);
+    }
+
+    printf("Partitioned %zu vertices in %zu connected components into %zu partitions (largest: %zu bases)\n",
+           parent.size(), componentRoots.size(), numPartitions,
+           *std::max_element(partitionLengths.begin(), partitionLengths.end()));
+
+    // Pass 2: copy each record to the partition of its vertices
+    StringVector partitionFilenames;
+    std::vector<std::ostream*> writers;
+    for(size_t i = 0; i < numPartitions; ++i)
+    {
+        std::stringstream ss;
+        ss << outPrefix << "-" << i << ".asqg" << GZIP_EXT;
+        partitionFilenames.push_back(ss.str());
+        writers.push_back(createWriter(ss.str()));
+    }
+
+    pReader = createReader(filename);
+    while(getline(*pReader, recordLine))
+    {
+        ASQG::RecordType rt = ASQG::getRecordType(recordLine);
+        if(rt == ASQG::RT_HEADER)
+        {
+            for(size_t i = 0; i < numPartitions; ++i)
+                *writers[i] << recordLine << "\n";
+            continue;
+        }
+
+        std::string id;
+        if(rt == ASQG::RT_VERTEX)
+        {
+            ASQG::VertexRecord vertexRecord(recordLine);
+            id = vertexRecord.getID();
+        }
+        else
+        {
+            ASQG::EdgeRecord edgeRecord(recordLine);
+            id = edgeRecord.getOverlap().id[0];
+        }
+
+        IDIndexMap::const_iterator iter = idMap.find(id);
+        if(iter == idMap.end())
+            continue;
+        size_t partition = componentPartition[findComponent(parent, iter->second)];
+        *writers[partition] << recordLine << "\n";
+    }
+    delete pReader;
+
+    for(size_t i = 0; i < numPartitions; ++i)
+        delete writers[i];
+    return partitionFilenames;
+}
+
 // Load a graph (with no edges) from a fasta file
 StringGraph* SGUtil::loadFASTA(const std::string& filename)
 {
@@ -23,6 +23,21 @@ namespace SGUtil
 // Vertices that are substrings of other vertices (SS flag = 1) are never kept
 StringGraph* loadASQG(const std::string& filename, const unsigned int minOverlap, bool allowContainments = false, size_t maxEdges = -1);
 
+// Remove the edges of super-repetitive vertices and duplicate edges
+// once all the edges have been added to a graph
+void finishLoading(StringGraph* pGraph);
+
+// Set the graph parameters (minimum overlap, error rate, containment and transitive flags)
+// from the header record of an ASQG file
+void setGraphParameters(StringGraph* pGraph, const ASQG::HeaderRecord& headerRecord);
+
+// Split the graph in the ASQG file into at most numPartitions ASQG files without
+// loading it into memory. Each connected component of the graph is written to a
+// single partition, so no edges cross between partitions. The components are assigned
+// to partitions so that the total length of the vertex sequences is balanced.
+// Returns the names of the files, which are outPrefix-N.asqg.gz
+StringVector partitionASQG(const std::string& filename, size_t numPartitions, const std::string& outPrefix);
+
 // Load a string graph from a fasta file.
 // Returns a graph where each sequence in the fasta is a vertex but there are no edges in the graph.
 StringGraph* loadFASTA(const std::string& filename);
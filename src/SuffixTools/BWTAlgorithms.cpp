@@ -6,7 +6,9 @@
 //
 // bwt_algorithms.cpp - Algorithms for aligning to a bwt structure
 //
+#include <algorithm>
 #include "BWTAlgorithms.h"
+#include "ShardedBWT.h"
 
 // Find the interval in pBWT corresponding to w
 // If w does not exist in the BWT, the interval 
@@ -64,6 +66,8 @@ BWTInterval BWTAlgorithms::findIntervalWithCache(const BWT* pBWT, const BWTInter
 // Delegate the findInterval call based on what indices are loaded
 BWTInterval BWTAlgorithms::findInterval(const BWTIndexSet& indices, const std::string& w)
 {
+    // An interval is only defined with respect to a single index
+    assert(indices.pShards == NULL);
     if(indices.pCache != NULL)
         return findIntervalWithCache(indices.pBWT, indices.pCache, w);
     else
@@ -156,6 +160,9 @@ size_t BWTAlgorithms::countSequenceOccurrencesWithCache(const std::string& w, co
 //
 size_t BWTAlgorithms::countSequenceOccurrences(const std::string& w, const BWTIndexSet& indices)
 {
+    if(indices.pShards != NULL)
+        return indices.pShards->countSequenceOccurrences(w);
+
     assert(indices.pBWT != NULL);
     if(indices.pCache != NULL)
         return countSequenceOccurrencesWithCache(w, indices.pBWT, indices.pCache);
@@ -165,6 +172,9 @@ size_t BWTAlgorithms::countSequenceOccurrences(const std::string& w, const BWTIn
 
 size_t BWTAlgorithms::countSequenceOccurrencesSingleStrand(const std::string& w, const BWTIndexSet& indices)
 {
+    if(indices.pShards != NULL)
+        return indices.pShards->countSequenceOccurrencesSingleStrand(w);
+
     assert(indices.pBWT != NULL);
     assert(indices.pCache != NULL);
 
@@ -400,6 +410,49 @@ std::string BWTAlgorithms::sampleRandomSubstring(const BWT* pBWT, size_t len)
     return "";
 }
 
+// Return a random index in [0, n) using the rand_r state in pSeed.
+// Two draws are combined as RAND_MAX may be less than the number of strings.
+// Values from the incomplete block at the top of the combined range are
+// redrawn so that the result is not biased towards small indices.
+size_t BWTAlgorithms::randomIndex(size_t n, unsigned int* pSeed)
+{
+    assert(n > 0);
+    const uint64_t draw_range = (uint64_t)RAND_MAX + 1;
+    const uint64_t range = draw_range * draw_range;
+    const uint64_t limit = range - range % n;
+    uint64_t r;
+    do
+    {
+        // The draws are sequenced so the result does not depend on the compiler
+        uint64_t high = rand_r(pSeed);
+        uint64_t low = rand_r(pSeed);
+        r = high * draw_range + low;
+    } while(r >= limit);
+    return r % n;
+}
+
+// Return a random string from the BWT using the random state in pSeed
+std::string BWTAlgorithms::sampleRandomString(const BWT* pBWT, unsigned int* pSeed)
+{
+    size_t n = pBWT->getNumStrings();
+    size_t idx = randomIndex(n, pSeed);
+    return extractString(pBWT, idx);
+}
+
+// Return a random substring from the BWT using the random state in pSeed
+std::string BWTAlgorithms::sampleRandomSubstring(const BWT* pBWT, size_t len, unsigned int* pSeed)
+{
+    size_t tries = 1000;
+    while(tries-- > 0)
+    {
+        size_t n = pBWT->getBWLen();
+        size_t idx = randomIndex(n, pSeed);
+        std::string s = extractString(pBWT, idx, len);
+        if(s.size() == len)
+            return s;
+    }
+    return "";
+}
 
 // Return the string from the BWT at idx
 std::string BWTAlgorithms::extractString(const BWT* pBWT, size_t idx)
@@ -410,20 +463,67 @@ std::string BWTAlgorithms::extractString(const BWT* pBWT, size_t idx)
     // symbols for the reads. Search backwards from one of them
     // until the '$' is found gives a full string.
     std::string out;
-    BWTInterval interval(idx, idx);
     while(1)
     {
-        assert(interval.isValid());
-        char b = pBWT->getChar(interval.lower);
+        char b;
+        idx = pBWT->getLF(idx, b);
         if(b == '$')
             break;
         else
             out.push_back(b);
-        updateInterval(interval, b, pBWT);
     } 
     return reverse(out);
 }
 
+// Extract the complete strings for the terminal symbols [first, last)
+void BWTAlgorithms::extractStrings(const BWT* pBWT, size_t first, size_t last, std::vector<std::string>& out)
+{
+    assert(first <= last && last <= pBWT->getNumStrings());
+    out.resize(last - first);
+
+    // The strings are walked in lock-step in blocks. The marker lookups
+    // of the next position of each string are prefetched while the other
+    // strings of the block are processed, which hides most of the latency
+    // of the random accesses into the index.
+    size_t positions[EXTRACT_STRINGS_BLOCK_SIZE];
+    size_t active[EXTRACT_STRINGS_BLOCK_SIZE];
+    for(size_t block_start = first; block_start < last; block_start += EXTRACT_STRINGS_BLOCK_SIZE)
+    {
+        size_t block_end = std::min(block_start + EXTRACT_STRINGS_BLOCK_SIZE, last);
+        size_t num_active = block_end - block_start;
+        for(size_t i = 0; i < num_active; ++i)
+        {
+            positions[i] = block_start + i;
+            active[i] = i;
+            out[block_start - first + i].clear();
+        }
+
+        while(num_active > 0)
+        {
+            size_t i = 0;
+            while(i < num_active)
+            {
+                size_t j = active[i];
+                char b;
+                positions[j] = pBWT->getLF(positions[j], b);
+                std::string& str = out[block_start - first + j];
+                if(b == '$')
+                {
+                    // This string is complete, remove it from the active list
+                    std::reverse(str.begin(), str.end());
+                    active[i] = active[--num_active];
+                }
+                else
+                {
+                    str.push_back(b);
+                    pBWT->prefetchMarkers(positions[j]);
+                    ++i;
+                }
+            }
+        }
+    }
+}
+
 // Extract the substring from start, start+length of the sequence starting at position idx
 std::string BWTAlgorithms::extractSubstring(const BWT* pBWT, uint64_t idx, size_t start, size_t length)
 {
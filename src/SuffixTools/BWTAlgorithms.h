@@ -20,6 +20,9 @@
 #define LEFT_INT_IDX 0
 #define RIGHT_INT_IDX 1
 
+// The number of strings that are walked together by extractStrings
+#define EXTRACT_STRINGS_BLOCK_SIZE 32
+
 // structures
 
 // A (partial) prefix of a string contained in the BWT
@@ -89,11 +92,28 @@ inline void updateBothR(BWTIntervalPair& pair, char b, const BWT* pRevBWT,
 inline void updateBothR(BWTIntervalPair& pair, char b, const BWT* pRevBWT)
 {
     // Update the left index using the difference between the AlphaCounts in the reverse table
-    AlphaCount64 l = pRevBWT->getFullOcc(pair.interval[1].lower - 1);
-    AlphaCount64 u = pRevBWT->getFullOcc(pair.interval[1].upper);
+    AlphaCount64 l;
+    AlphaCount64 u;
+    pRevBWT->getFullOccPair(pair.interval[1].lower - 1, pair.interval[1].upper, l, u);
     updateBothR(pair, b, pRevBWT, l, u);
 }
 
+//
+// Calculate the interval pairs for the right extensions of pair to each
+// of the four DNA bases, in ALPHABET order, with a single rank query.
+//
+inline void updateBothRAllBases(const BWTIntervalPair& pair, const BWT* pRevBWT, BWTIntervalPair* pOut)
+{
+    AlphaCount64 l;
+    AlphaCount64 u;
+    pRevBWT->getFullOccPair(pair.interval[1].lower - 1, pair.interval[1].upper, l, u);
+    for(int i = 0; i < DNA_ALPHABET::size; ++i)
+    {
+        pOut[i] = pair;
+        updateBothR(pOut[i], DNA_ALPHABET::getBase(i), pRevBWT, l, u);
+    }
+}
+
 // Update the interval pair for the left extension to symbol b.
 // In this version the AlphaCounts for the upper and lower intervals
 // have been calculated.
@@ -117,11 +137,28 @@ inline void updateBothL(BWTIntervalPair& pair, char b, const BWT* pBWT,
 inline void updateBothL(BWTIntervalPair& pair, char b, const BWT* pBWT)
 {
     // Update the left index using the difference between the AlphaCounts in the reverse table
-    AlphaCount64 l = pBWT->getFullOcc(pair.interval[0].lower - 1);
-    AlphaCount64 u = pBWT->getFullOcc(pair.interval[0].upper);
+    AlphaCount64 l;
+    AlphaCount64 u;
+    pBWT->getFullOccPair(pair.interval[0].lower - 1, pair.interval[0].upper, l, u);
     updateBothL(pair, b, pBWT, l, u);
 }
 
+//
+// Calculate the interval pairs for the left extensions of pair to each
+// of the four DNA bases, in ALPHABET order, with a single rank query.
+//
+inline void updateBothLAllBases(const BWTIntervalPair& pair, const BWT* pBWT, BWTIntervalPair* pOut)
+{
+    AlphaCount64 l;
+    AlphaCount64 u;
+    pBWT->getFullOccPair(pair.interval[0].lower - 1, pair.interval[0].upper, l, u);
+    for(int i = 0; i < DNA_ALPHABET::size; ++i)
+    {
+        pOut[i] = pair;
+        updateBothL(pOut[i], DNA_ALPHABET::getBase(i), pBWT, l, u);
+    }
+}
+
 
 // Initialize the interval of index idx to be the range containining all the b suffixes
 inline void initInterval(BWTInterval& interval, char b, const BWT* pB)
@@ -171,6 +208,10 @@ AlphaCount64 calculateDeBruijnExtensionsSingleIndex(const std::string str,
 // Extract the complete string starting at idx in the BWT
 std::string extractString(const BWT* pBWT, size_t idx);
 
+// Extract the complete strings for the terminal symbols [first, last) in the BWT.
+// out[i] is set to the string with index first + i.
+void extractStrings(const BWT* pBWT, size_t first, size_t last, std::vector<std::string>& out);
+
 // Extract the next len bases of the string starting at idx
 std::string extractString(const BWT* pBWT, size_t idx, size_t len);
 
@@ -192,6 +233,15 @@ std::string sampleRandomString(const BWT* pBWT);
 // Returns a randomly chosen substring from the BWT 
 std::string sampleRandomSubstring(const BWT* pBWT, size_t len);
 
+// As above but the random numbers are drawn with rand_r from the state in pSeed,
+// so that concurrent callers with their own states get reproducible samples
+std::string sampleRandomString(const BWT* pBWT, unsigned int* pSeed);
+std::string sampleRandomSubstring(const BWT* pBWT, size_t len, unsigned int* pSeed);
+
+// Returns a uniformly distributed index in [0, n) drawn with rand_r from the state in pSeed.
+// n may be larger than RAND_MAX.
+size_t randomIndex(size_t n, unsigned int* pSeed);
+
 };
 
 #endif
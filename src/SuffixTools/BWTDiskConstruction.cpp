@@ -45,16 +45,46 @@ typedef std::vector<MergeItem> MergeVector;
 int64_t merge(SeqReader* pReader, 
               const MergeItem& item1, const MergeItem& item2, 
               const std::string& bwt_outname, const std::string& sai_outname,
-              bool doReverse, int numThreads, int storageLevel);
+              bool doReverse, int numThreads, int storageLevel, size_t gapRangeSize);
 
 // Initial BWT construction algorithms
 MergeVector computeInitialSAIS(const BWTDiskParameters& parameters); 
 MergeVector computeInitialBCR(const BWTDiskParameters& parameters); 
 
-//
-void writeMergedIndex(const BWT* pBWTInternal, const MergeItem& externalItem, 
-                      const MergeItem& internalItem, const std::string& bwt_outname,
-                      const std::string& sai_outname, const GapArray* pGapArray);
+// Write the merged BWT and SAI of an external and internal index. The
+// output is written in the order of the ranks of the internal BWT, one
+// range of ranks at a time, so the gap array only needs to be held
+// for the range being written.
+class MergedIndexWriter
+{
+    public:
+        MergedIndexWriter(const BWT* pBWTInternal, const MergeItem& externalItem, 
+                          const MergeItem& internalItem, const std::string& bwt_outname,
+                          const std::string& sai_outname);
+        ~MergedIndexWriter();
+
+        // Write the symbols for ranks [rangeStart, rangeStart + pGapArray->size())
+        // of the internal BWT. The ranges must be written in order.
+        void writeRange(size_t rangeStart, const GapArray* pGapArray);
+
+        // Check that the entire index was written and finalize the output
+        void finalize();
+
+    private:
+        const BWT* m_pBWTInternal;
+        IBWTWriter* m_pBWTWriter;
+        IBWTReader* m_pBWTExtReader;
+        SAWriter m_saiWriter;
+        SAReader m_saiExtReader;
+        SAReader m_saiIntReader;
+
+        size_t m_diskStrings;
+        size_t m_totalStrings;
+        size_t m_totalSymbols;
+        size_t m_nextRank;
+        size_t m_numBWTWrote;
+        size_t m_numSAIWrote;
+};
 
 void writeRemovalIndex(const BWT* pBWTInternal, const std::string& sai_inname,
                        const std::string& bwt_outname, const std::string& sai_outname, 
@@ -65,6 +95,11 @@ void computeGapArray(SeqReader* pReader, size_t n, const BWT* pBWT, bool doRever
                      int numThreads, GapArray* pGapArray, bool removeMode,
                      size_t& num_strings_read, size_t& num_symbols_read);
 
+template<class PostProcess>
+size_t computeRanks(SeqReader* pReader, size_t n, const BWT* pBWT, bool doReverse, 
+                    int numThreads, GapArray* pSharedGapArray, bool removeMode,
+                    PostProcess* pPostProcessor);
+
 //
 std::string makeTempName(const std::string& prefix, int id, const std::string& extension);
 std::string makeFilename(const std::string& prefix, const std::string& extension);
@@ -106,7 +141,8 @@ void buildBWTDisk(const BWTDiskParameters& parameters)
                 // Perform the actual merge
                 int64_t curr_idx = merge(pReader, item1, item2, 
                                          bwt_merged_name, sai_merged_name, 
-                                         parameters.bBuildReverse, parameters.numThreads, parameters.storageLevel);
+                                         parameters.bBuildReverse, parameters.numThreads, 
+                                         parameters.storageLevel, parameters.gapRangeSize);
 
                 // pReader now points to the end of item1's block of 
                 // reads. Skip item2's reads
@@ -279,7 +315,8 @@ MergeVector computeInitialBCR(const BWTDiskParameters& parameters)
 // Merge the indices for the two independent sets of reads in readsFile1 and readsFile2
 void mergeIndependentIndices(const std::string& readsFile1, const std::string& readsFile2, 
                              const std::string& outPrefix, const std::string& bwt_extension, 
-                             const std::string& sai_extension, bool doReverse, int numThreads, int storageLevel)
+                             const std::string& sai_extension, bool doReverse, int numThreads, 
+                             int storageLevel, size_t gapRangeSize)
 {
     MergeItem item1;
     std::string prefix1 = stripGzippedExtension(readsFile1);
@@ -305,7 +342,7 @@ void mergeIndependentIndices(const std::string& readsFile1, const std::string& r
     std::string sai_merged_name = makeFilename(outPrefix, sai_extension);
 
     // Perform the actual merge
-    merge(pReader, item1, item2, bwt_merged_name, sai_merged_name, doReverse, numThreads, storageLevel);
+    merge(pReader, item1, item2, bwt_merged_name, sai_merged_name, doReverse, numThreads, storageLevel, gapRangeSize);
     delete pReader;
 }
 
@@ -392,16 +429,31 @@ void computeGapArray(SeqReader* pReader, size_t n, const BWT* pBWT, bool doRever
     // and returns a vector of ranks. The postprocessor takes in the vector
     // and updates the gap array
     RankPostProcess postProcessor(pGapArray);
+    size_t numProcessed = computeRanks(pReader, n, pBWT, doReverse, numThreads, pGapArray, removeMode, &postProcessor);
+
+    num_strings_read = postProcessor.getNumStringsProcessed();
+    num_symbols_read = postProcessor.getNumSymbolsProcessed();
+    assert(n == (size_t)-1 || (numProcessed == n));
+    (void)numProcessed;
+}
+
+// Compute the rank of every suffix of the first n items in pReader
+// and pass them to pPostProcessor. Returns the number of items processed.
+template<class PostProcess>
+size_t computeRanks(SeqReader* pReader, size_t n, const BWT* pBWT, bool doReverse, 
+                    int numThreads, GapArray* pSharedGapArray, bool removeMode,
+                    PostProcess* pPostProcessor)
+{
     size_t numProcessed = 0;
     if(numThreads <= 1)
     {
-        RankProcess processor(pBWT, pGapArray, doReverse, removeMode);
+        RankProcess processor(pBWT, pSharedGapArray, doReverse, removeMode);
 
         numProcessed = 
            SequenceProcessFramework::processSequencesSerial<SequenceWorkItem,
                                                             RankResult, 
                                                             RankProcess, 
-                                                            RankPostProcess>(*pReader, &processor, &postProcessor, n);
+                                                            PostProcess>(*pReader, &processor, pPostProcessor, n);
     }
     else
     {
@@ -409,7 +461,7 @@ void computeGapArray(SeqReader* pReader, size_t n, const BWT* pBWT, bool doRever
         RankProcessVector rankProcVec;
         for(int i = 0; i < numThreads; ++i)
         {
-            RankProcess* pProcess = new RankProcess(pBWT, pGapArray, doReverse, removeMode);
+            RankProcess* pProcess = new RankProcess(pBWT, pSharedGapArray, doReverse, removeMode);
             rankProcVec.push_back(pProcess);
         }
     
@@ -417,23 +469,23 @@ void computeGapArray(SeqReader* pReader, size_t n, const BWT* pBWT, bool doRever
            SequenceProcessFramework::processSequencesParallel<SequenceWorkItem,
                                                               RankResult, 
                                                               RankProcess, 
-                                                              RankPostProcess>(*pReader, rankProcVec, &postProcessor, n);
+                                                              PostProcess>(*pReader, rankProcVec, pPostProcessor, n);
 
         for(int i = 0; i < numThreads; ++i)
             delete rankProcVec[i];
     }
-
-    num_strings_read = postProcessor.getNumStringsProcessed();
-    num_symbols_read = postProcessor.getNumSymbolsProcessed();
-    assert(n == (size_t)-1 || (numProcessed == n));
+    return numProcessed;
 }
 
 // Merge a pair of BWTs using disk storage
 // Precondition: pReader is positioned at the start of the read block for item1
+// If gapRangeSize is zero, the gap array for the entire internal BWT is held in memory.
+// Otherwise the ranks of item1's reads are written to disk, split into ranges of 
+// gapRangeSize ranks, and the gap array is built and written one range at a time.
 int64_t merge(SeqReader* pReader,
               const MergeItem& item1, const MergeItem& item2,
               const std::string& bwt_outname, const std::string& sai_outname,
-              bool doReverse, int numThreads, int storageLevel)
+              bool doReverse, int numThreads, int storageLevel, size_t gapRangeSize)
 {
     std::cout << "Merge1: " << item1 << "\n";
     std::cout << "Merge2: " << item2 << "\n";
@@ -448,13 +500,42 @@ int64_t merge(SeqReader* pReader,
     // Calculate the rank of every read from item1.start_index to item1.end_index
     // and increment the gap counts
     int64_t curr_idx = item1.start_index;
-    
-    // Compute the gap/rank array
-    GapArray* pGapArray = createGapArray(storageLevel);
     size_t num_strings_read = 0;
     size_t num_symbols_read = 0;
-    computeGapArray(pReader, n, pBWTInternal, doReverse, numThreads, pGapArray, 
-                    false, num_strings_read, num_symbols_read);
+    MergedIndexWriter writer(pBWTInternal, item1, item2, bwt_outname, sai_outname);
+
+    if(gapRangeSize == 0)
+    {
+        // Compute the gap/rank array
+        GapArray* pGapArray = createGapArray(storageLevel);
+        computeGapArray(pReader, n, pBWTInternal, doReverse, numThreads, pGapArray, 
+                        false, num_strings_read, num_symbols_read);
+
+        // Write the merged BWT/SAI to disk
+        writer.writeRange(0, pGapArray);
+        delete pGapArray;
+    }
+    else
+    {
+        size_t num_ranks = pBWTInternal->getBWLen() + 1;
+        RankSpillPostProcess spiller(bwt_outname, num_ranks, gapRangeSize);
+        computeRanks(pReader, n, pBWTInternal, doReverse, numThreads, NULL, false, &spiller);
+        spiller.close();
+        num_strings_read = spiller.getNumStringsProcessed();
+        num_symbols_read = spiller.getNumSymbolsProcessed();
+
+        for(size_t r = 0; r < spiller.getNumRanges(); ++r)
+        {
+            size_t range_start = r * gapRangeSize;
+            GapArray* pGapArray = createGapArray(storageLevel);
+            pGapArray->resize(std::min(gapRangeSize, num_ranks - range_start));
+            loadRankRange(spiller.getRangeFilename(r), pGapArray);
+            unlink(spiller.getRangeFilename(r).c_str());
+
+            writer.writeRange(range_start, pGapArray);
+            delete pGapArray;
+        }
+    }
 
     assert(n == (size_t)-1 || (num_strings_read == n));
 
@@ -462,112 +543,124 @@ int64_t merge(SeqReader* pReader,
     curr_idx += num_strings_read;
     assert(item1.end_index == -1 || (curr_idx == item1.end_index + 1 && curr_idx == item2.start_index));
 
-    // Write the merged BWT/SAI to disk
-    writeMergedIndex(pBWTInternal, item1, item2, bwt_outname, sai_outname, pGapArray);
-
+    writer.finalize();
     delete pBWTInternal;
-    delete pGapArray;
     return curr_idx;
 }
 
-// Merge the internal and external BWTs and the SAIs
-void writeMergedIndex(const BWT* pBWTInternal, const MergeItem& externalItem, 
-                      const MergeItem& internalItem, const std::string& bwt_outname,
-                      const std::string& sai_outname, const GapArray* pGapArray)
+//
+MergedIndexWriter::MergedIndexWriter(const BWT* pBWTInternal, const MergeItem& externalItem, 
+                                     const MergeItem& internalItem, const std::string& bwt_outname,
+                                     const std::string& sai_outname) : m_pBWTInternal(pBWTInternal),
+                                                                       m_saiWriter(sai_outname),
+                                                                       m_saiExtReader(externalItem.sai_filename),
+                                                                       m_saiIntReader(internalItem.sai_filename),
+                                                                       m_nextRank(0),
+                                                                       m_numBWTWrote(0),
+                                                                       m_numSAIWrote(0)
 {
-    IBWTWriter* pBWTWriter = BWTWriter::createWriter(bwt_outname);
-    IBWTReader* pBWTExtReader = BWTReader::createReader(externalItem.bwt_filename);
-    
-    SAWriter saiWriter(sai_outname);
-    SAReader saiExtReader(externalItem.sai_filename);
-    SAReader saiIntReader(internalItem.sai_filename);
+    m_pBWTWriter = BWTWriter::createWriter(bwt_outname);
+    m_pBWTExtReader = BWTReader::createReader(externalItem.bwt_filename);
 
     // Calculate and write header values
-    size_t disk_strings;
     size_t disk_symbols;
     BWFlag flag;
-    pBWTExtReader->readHeader(disk_strings, disk_symbols, flag);
+    m_pBWTExtReader->readHeader(m_diskStrings, disk_symbols, flag);
 
-    size_t total_strings = disk_strings + pBWTInternal->getNumStrings();
-    size_t total_symbols = disk_symbols + pBWTInternal->getBWLen();
-    pBWTWriter->writeHeader(total_strings, total_symbols, BWF_NOFMI);
+    m_totalStrings = m_diskStrings + pBWTInternal->getNumStrings();
+    m_totalSymbols = disk_symbols + pBWTInternal->getBWLen();
+    m_pBWTWriter->writeHeader(m_totalStrings, m_totalSymbols, BWF_NOFMI);
     
     // Discard the first header each sai
     size_t discard1, discard2;
-    saiExtReader.readHeader(discard1, discard2);
-    saiIntReader.readHeader(discard1, discard2);
+    m_saiExtReader.readHeader(discard1, discard2);
+    m_saiIntReader.readHeader(discard1, discard2);
 
     // Write the header of the SAI which is just the number of strings and elements in the SAI
-    saiWriter.writeHeader(total_strings, total_strings);
+    m_saiWriter.writeHeader(m_totalStrings, m_totalStrings);
+}
 
-    // Calculate and write the actual string
-    // The semantics of the gap array are that we need to write gap_array[i]
-    // symbols to the stream before writing bwtInternal[i]
-    // Each time a '$' symbol is read, it signals the end of some read. We
-    // output one element of the sai from corresponding internal or external
-    // sai file.
-    size_t num_bwt_wrote = 0;
-    size_t num_sai_wrote = 0;
-    for(size_t i = 0; i < pGapArray->size(); ++i)
+//
+MergedIndexWriter::~MergedIndexWriter()
+{
+    delete m_pBWTExtReader;
+    delete m_pBWTWriter;
+}
+
+// Calculate and write the actual string
+// The semantics of the gap array are that we need to write gap_array[i]
+// symbols to the stream before writing bwtInternal[i]
+// Each time a '$' symbol is read, it signals the end of some read. We
+// output one element of the sai from corresponding internal or external
+// sai file.
+void MergedIndexWriter::writeRange(size_t rangeStart, const GapArray* pGapArray)
+{
+    assert(rangeStart == m_nextRank);
+    for(size_t k = 0; k < pGapArray->size(); ++k)
     {
-        size_t v = pGapArray->get(i);
+        size_t i = rangeStart + k;
+        size_t v = pGapArray->get(k);
         for(size_t j = 0; j < v; ++j)
         {
-            char b = pBWTExtReader->readBWChar();
+            char b = m_pBWTExtReader->readBWChar();
             assert(b != '\n');
-            pBWTWriter->writeBWChar(b);
-            ++num_bwt_wrote;
+            m_pBWTWriter->writeBWChar(b);
+            ++m_numBWTWrote;
             
             if(b == '$')
             {
                 // The external indices only need to be copied
-                SAElem e = saiExtReader.readElem(); 
-                saiWriter.writeElem(e);
-                ++num_sai_wrote;
+                SAElem e = m_saiExtReader.readElem(); 
+                m_saiWriter.writeElem(e);
+                ++m_numSAIWrote;
             }
         }
         
         // If this is the last entry in the gap array, do not output a symbol from
         // the internal BWT
-        if(i != pBWTInternal->getBWLen())
+        if(i != m_pBWTInternal->getBWLen())
         {
-            char b = pBWTInternal->getChar(i);
-            pBWTWriter->writeBWChar(b);
-            ++num_bwt_wrote;
+            char b = m_pBWTInternal->getChar(i);
+            m_pBWTWriter->writeBWChar(b);
+            ++m_numBWTWrote;
 
             if(b == '$')
             {
                 // The internal indices need to be offset
                 // by the number of strings in the external collection
-                SAElem e = saiIntReader.readElem(); 
+                SAElem e = m_saiIntReader.readElem(); 
 
                 uint64_t id = e.getID();
-                id += disk_strings;
+                id += m_diskStrings;
                 e.setID(id);
                 
-                saiWriter.writeElem(e);
-                ++num_sai_wrote;
+                m_saiWriter.writeElem(e);
+                ++m_numSAIWrote;
             }
         }
     }
-    if(num_bwt_wrote != total_symbols)
+    m_nextRank += pGapArray->size();
+}
+
+//
+void MergedIndexWriter::finalize()
+{
+    assert(m_nextRank == m_pBWTInternal->getBWLen() + 1);
+    if(m_numBWTWrote != m_totalSymbols)
     {
-        printf("Error expected to write %zu symbols, actually wrote %zu\n", total_symbols, num_bwt_wrote);
-        assert(num_bwt_wrote == total_symbols);
+        printf("Error expected to write %zu symbols, actually wrote %zu\n", m_totalSymbols, m_numBWTWrote);
+        assert(m_numBWTWrote == m_totalSymbols);
     }
         
-    assert(num_sai_wrote == total_strings);
+    assert(m_numSAIWrote == m_totalStrings);
     
     // Ensure we read the entire bw string from disk
-    char last = pBWTExtReader->readBWChar();
+    char last = m_pBWTExtReader->readBWChar();
     assert(last == '\n');
     (void)last;
 
     // Finalize the BWT disk file
-    pBWTWriter->finalize();
-
-    delete pBWTExtReader;
-    delete pBWTWriter;
+    m_pBWTWriter->finalize();
 }
 
 // Write a new BWT and SAI that skips the elements marked
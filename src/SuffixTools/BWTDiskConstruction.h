@@ -27,6 +27,7 @@ struct BWTDiskParameters
     size_t numReadsPerBatch;
     int numThreads;
     int storageLevel;
+    size_t gapRangeSize; // if non-zero, merge using gap arrays of at most this many ranks
     bool bBuildReverse;
     bool bUseBCR;
 };
@@ -36,9 +37,12 @@ struct BWTDiskParameters
 void buildBWTDisk(const BWTDiskParameters& parameters);
 
 // Merge the indices for the readsFile1 and readsFile2
+// If gapRangeSize is non-zero, the ranks of readsFile1 in the index of readsFile2 are
+// spilled to temporary files and the gap array is built gapRangeSize ranks at a time
 void mergeIndependentIndices(const std::string& readsFile1, const std::string& readsFile2, 
                              const std::string& outPrefix, const std::string& bwt_extension, 
-                             const std::string& sai_extension, bool doReverse, int numThreads, int storageLevel);
+                             const std::string& sai_extension, bool doReverse, int numThreads, 
+                             int storageLevel, size_t gapRangeSize);
 
 // Compute new indices from allReadsFile without the reads in readsToRemove
 void removeReadsFromIndices(const std::string& allReadsFile, const std::string& readsToRemove,
@@ -17,14 +17,19 @@
 #include "PopulationIndex.h"
 #include "QualityTable.h"
 
+class ShardedBWT;
+
 // A collection of indices. For some algorithms
 // all indices are not necessary so some of these
 // can be NULL. The algorithms will check as preconditions
 // which indices they need.
+// If pShards is set, the count functions in BWTAlgorithms
+// that take a BWTIndexSet sum their results over the shards
+// instead of using pBWT.
 struct BWTIndexSet
 {
     // Constructor
-    BWTIndexSet() : pBWT(NULL), pRBWT(NULL), pCache(NULL), pSSA(NULL), pPopIdx(NULL), pQualityTable(NULL), pReadTable(NULL) {}
+    BWTIndexSet() : pBWT(NULL), pRBWT(NULL), pCache(NULL), pSSA(NULL), pPopIdx(NULL), pQualityTable(NULL), pReadTable(NULL), pShards(NULL) {}
 
     // Data
     const BWT* pBWT;
@@ -34,6 +39,7 @@ struct BWTIndexSet
     const PopulationIndex* pPopIdx;
     const QualityTable* pQualityTable;
     const ReadTable* pReadTable;
+    const ShardedBWT* pShards;
 };
 
 #endif
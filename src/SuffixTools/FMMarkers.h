@@ -10,6 +10,9 @@
 #ifndef FMMARKERS_H
 #define FMMARKERS_H
 
+#include <vector>
+#include "IndexMemory.h"
+
 // LargeMarker - To allow random access to the 
 // BWT symbols and implement the occurrence array
 // we keep a vector of symbol counts every D1 symbols.
@@ -59,7 +62,7 @@ struct LargeMarker
     // a valid index if there is a marker after the last symbol in the BWT
     size_t unitIndex;
 };
-typedef std::vector<LargeMarker> LargeMarkerVector;
+typedef std::vector<LargeMarker, IndexAllocator<LargeMarker> > LargeMarkerVector;
 
 // SmallMarker - Small markers contain the counts
 // within an individual block of the BWT. In other words
@@ -91,6 +94,6 @@ struct SmallMarker
     // The number of RL units in this block
     uint16_t unitCount;
 };
-typedef std::vector<SmallMarker> SmallMarkerVector;
+typedef std::vector<SmallMarker, IndexAllocator<SmallMarker> > SmallMarkerVector;
 
 #endif
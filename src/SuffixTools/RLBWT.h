@@ -62,6 +62,50 @@ class RLBWT
             return unit.getChar();
         }
 
+        // Return the LF-mapping of idx, PC(b) + Occ(b, idx - 1) where b = bwt[idx],
+        // and set b. This is equivalent to a getChar/getOcc pair but it
+        // finds the symbol and its rank in a single pass over the runs.
+        inline size_t getLF(size_t idx, char& b) const
+        {
+            const LargeMarker& upper = getUpperMarker(idx);
+            size_t current_position = upper.getActualPosition();
+            assert(current_position >= idx);
+
+            AlphaCount64 running_count = upper.counts;
+            size_t symbol_index = upper.unitIndex;
+
+            // Search backwards (towards 0) until the run containing idx is found,
+            // removing the symbols of each run passed from the count
+            while(current_position > idx)
+            {
+                assert(symbol_index != 0);
+                symbol_index -= 1;
+                const RLUnit& unit = m_rlString[symbol_index];
+                size_t run_len = unit.getCount();
+                running_count.subtract(unit.getChar(), run_len);
+                current_position -= run_len;
+            }
+
+            // running_count now holds the counts of bwt[0, current_position)
+            // and idx is in the run starting at current_position
+            b = m_rlString[symbol_index].getChar();
+            return m_predCount.get(b) + running_count.get(b) + (idx - current_position);
+        }
+
+        // Hint to the processor that the markers used to look up idx
+        // will be needed soon
+        inline void prefetchMarkers(size_t idx) const
+        {
+#ifdef __GNUC__
+            size_t target_small_idx = (idx >> m_smallShiftValue) + 1;
+            size_t target_large_idx = (target_small_idx << m_smallShiftValue) >> m_largeShiftValue;
+            __builtin_prefetch(&m_smallMarkers[target_small_idx]);
+            __builtin_prefetch(&m_largeMarkers[target_large_idx]);
+#else
+            (void)idx;
+#endif
+        }
+
         // Get the index of the marker nearest to position in the bwt
         inline size_t getNearestMarkerIdx(size_t position, size_t sampleRate, size_t shiftValue) const
         {
@@ -229,10 +273,72 @@ class RLBWT
             }
         }
 
+        // Set occ0 and occ1 to getFullOcc(idx0) and getFullOcc(idx1), as used
+        // to extend the interval [idx0 + 1, idx1]. When the two positions are
+        // close, which is the case for nearly every interval after a few
+        // extension steps, both counts are found with one marker lookup and
+        // one forward scan of the runs instead of two independent lookups.
+        inline void getFullOccPair(size_t idx0, size_t idx1, AlphaCount64& occ0, AlphaCount64& occ1) const
+        {
+            // The counts in the marker are not inclusive
+            ++idx0;
+            ++idx1;
+            if(idx1 < idx0 || idx1 - idx0 > m_smallSampleRate)
+            {
+                occ0 = getFullOcc(idx0 - 1);
+                occ1 = getFullOcc(idx1 - 1);
+                return;
+            }
+
+            const LargeMarker& marker = getNearestMarker(idx0);
+            size_t current_position = marker.getActualPosition();
+            AlphaCount64 running_count = marker.counts;
+            size_t symbol_index = marker.unitIndex;
+
+            // If the marker is past idx0, step back over whole runs
+            while(current_position > idx0)
+            {
+                --symbol_index;
+                const RLUnit& unit = m_rlString[symbol_index];
+                running_count.subtract(unit.getChar(), unit.getCount());
+                current_position -= unit.getCount();
+            }
+
+            accumulateRunsForwards(running_count, symbol_index, current_position, idx0);
+            occ0 = running_count;
+            if(current_position < idx0)
+                occ0.add(m_rlString[symbol_index].getChar(), idx0 - current_position);
+
+            accumulateRunsForwards(running_count, symbol_index, current_position, idx1);
+            occ1 = running_count;
+            if(current_position < idx1)
+                occ1.add(m_rlString[symbol_index].getChar(), idx1 - current_position);
+        }
+
+        // Add the counts of the whole runs from currentPosition towards targetPosition,
+        // stopping at the run containing targetPosition
+        inline void accumulateRunsForwards(AlphaCount64& running_count, size_t& currentUnitIndex,
+                                           size_t& currentPosition, const size_t targetPosition) const
+        {
+            while(currentPosition < targetPosition)
+            {
+                const RLUnit& unit = m_rlString[currentUnitIndex];
+                size_t run_len = unit.getCount();
+                if(currentPosition + run_len > targetPosition)
+                    break;
+                running_count.add(unit.getChar(), run_len);
+                currentPosition += run_len;
+                ++currentUnitIndex;
+            }
+        }
+
         // Return the number of times each symbol in the alphabet appears ins bwt[idx0, idx1]
-        inline AlphaCount64 getOccDiff(size_t idx0, size_t idx1) const 
-        { 
-            return getFullOcc(idx1) - getFullOcc(idx0); 
+        inline AlphaCount64 getOccDiff(size_t idx0, size_t idx1) const
+        {
+            AlphaCount64 occ0;
+            AlphaCount64 occ1;
+            getFullOccPair(idx0, idx1, occ0, occ1);
+            return occ1 - occ0;
         }
 
         inline size_t getNumStrings() const { return m_numStrings; } 
@@ -7,6 +7,7 @@
 // RankProcess - Compute a vector of BWT ranks for
 // SequenceWorkItems
 //
+#include <limits>
 #include "RankProcess.h"
 
 //
@@ -30,7 +31,8 @@ RankProcess::~RankProcess()
 }
 
 // Calculate the ranks of the given sequence.
-// We attempt to update the count of the rank in the gap array 
+// If there is no shared gap array, the ranks are passed to the
+// post-processor. Otherwise we attempt to update the count of the rank in the gap array 
 // using an atomic compare and swap. The update will fail if the
 // small-storage maximum count is exceeded. In this case
 // we push the value to the overflow array for a serial
@@ -57,9 +59,7 @@ RankResult RankProcess::process(const SequenceWorkItem& workItem)
         rank = parseRankFromID(workItem.read.id);
     }
 
-    out.numRanksProcessed += 1;
-    if(!m_pSharedGapArray->attemptBaseIncrement(rank))
-        out.overflowVec.push_back(rank);
+    addRank(rank, out);
 
     // Compute the starting rank for the last symbol of w
     char c = w.get(i);
@@ -73,9 +73,7 @@ RankResult RankProcess::process(const SequenceWorkItem& workItem)
     else
         rank = m_pBWT->getPC(c) + m_pBWT->getOcc(c, rank - 1);
     
-    out.numRanksProcessed += 1;
-    if(!m_pSharedGapArray->attemptBaseIncrement(rank))
-        out.overflowVec.push_back(rank);
+    addRank(rank, out);
     --i;
 
     // Iteratively compute the remaining ranks
@@ -84,14 +82,20 @@ RankResult RankProcess::process(const SequenceWorkItem& workItem)
         char c = w.get(i);
         rank = m_pBWT->getPC(c) + m_pBWT->getOcc(c, rank - 1);
         //std::cout << "c: " << c << " rank: " << rank << "\n";
-        out.numRanksProcessed += 1;
-        if(!m_pSharedGapArray->attemptBaseIncrement(rank))
-            out.overflowVec.push_back(rank);
+        addRank(rank, out);
         --i;
     }
     return out;
 }
 
+//
+void RankProcess::addRank(int64_t rank, RankResult& out)
+{
+    out.numRanksProcessed += 1;
+    if(m_pSharedGapArray == NULL || !m_pSharedGapArray->attemptBaseIncrement(rank))
+        out.overflowVec.push_back(rank);
+}
+
 // Parse the rank of a read from its ID. This must be set by the process
 // which discards the read.
 int64_t RankProcess::parseRankFromID(const std::string& id)
@@ -136,3 +140,120 @@ void RankPostProcess::process(const SequenceWorkItem& /*item*/, const RankResult
         m_pGapArray->incrementOverflowSerial(*iter);
     num_serial_updates += result.overflowVec.size();
 }
+
+//
+//
+//
+RankSpillPostProcess::RankSpillPostProcess(const std::string& prefix, 
+                                           size_t numRanks, 
+                                           size_t rankRangeSize) : m_rangeSize(rankRangeSize), 
+                                                                   num_strings(0), 
+                                                                   num_symbols(0)
+{
+    assert(m_rangeSize > 0 && m_rangeSize <= std::numeric_limits<uint32_t>::max());
+    size_t numRanges = (numRanks + m_rangeSize - 1) / m_rangeSize;
+    if(numRanges > RANK_SPILL_MAX_RANGES)
+    {
+        std::cerr << "Error: a gap range of " << m_rangeSize << " splits the " << numRanks << " ranks of the index into " 
+                  << numRanges << " ranges, at most " << RANK_SPILL_MAX_RANGES << " are allowed. Use a larger gap range.\n";
+        exit(EXIT_FAILURE);
+    }
+
+    m_filenames.resize(numRanges);
+    m_files.resize(numRanges);
+    m_buffers.resize(numRanges);
+    for(size_t r = 0; r < numRanges; ++r)
+    {
+        std::stringstream ss;
+        ss << prefix << ".ranks-" << r;
+        m_filenames[r] = ss.str();
+        m_files[r] = fopen(m_filenames[r].c_str(), "wb");
+        if(m_files[r] == NULL)
+        {
+            std::cerr << "Error: could not open " << m_filenames[r] << " for writing\n";
+            exit(EXIT_FAILURE);
+        }
+        m_buffers[r].reserve(RANK_SPILL_BUFFER_SIZE);
+    }
+}
+
+//
+RankSpillPostProcess::~RankSpillPostProcess()
+{
+    close();
+}
+
+//
+void RankSpillPostProcess::process(const SequenceWorkItem& /*item*/, const RankResult& result)
+{
+    ++num_strings;
+    num_symbols += result.numRanksProcessed;
+
+    for(RankVector::const_iterator iter = result.overflowVec.begin(); iter != result.overflowVec.end(); ++iter)
+    {
+        size_t r = *iter / m_rangeSize;
+        assert(r < m_buffers.size());
+        m_buffers[r].push_back(*iter - r * m_rangeSize);
+        if(m_buffers[r].size() == RANK_SPILL_BUFFER_SIZE)
+            flushRange(r);
+    }
+}
+
+//
+void RankSpillPostProcess::flushRange(size_t r)
+{
+    RangeBuffer& buffer = m_buffers[r];
+    if(!buffer.empty() && fwrite(&buffer[0], sizeof(uint32_t), buffer.size(), m_files[r]) != buffer.size())
+    {
+        std::cerr << "Error: could not write to " << m_filenames[r] << "\n";
+        exit(EXIT_FAILURE);
+    }
+    buffer.clear();
+}
+
+//
+void RankSpillPostProcess::close()
+{
+    for(size_t r = 0; r < m_files.size(); ++r)
+    {
+        if(m_files[r] == NULL)
+            continue;
+        flushRange(r);
+        if(fclose(m_files[r]) != 0)
+        {
+            std::cerr << "Error: could not write to " << m_filenames[r] << "\n";
+            exit(EXIT_FAILURE);
+        }
+        m_files[r] = NULL;
+        RangeBuffer().swap(m_buffers[r]);
+    }
+}
+
+//
+void loadRankRange(const std::string& filename, GapArray* pGapArray)
+{
+    FILE* pFile = fopen(filename.c_str(), "rb");
+    if(pFile == NULL)
+    {
+        std::cerr << "Error: could not open " << filename << " for reading\n";
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<uint32_t> buffer(RANK_SPILL_BUFFER_SIZE);
+    size_t n;
+    while((n = fread(&buffer[0], sizeof(uint32_t), buffer.size(), pFile)) > 0)
+    {
+        for(size_t i = 0; i < n; ++i)
+        {
+            if(!pGapArray->attemptBaseIncrement(buffer[i]))
+                pGapArray->incrementOverflowSerial(buffer[i]);
+        }
+    }
+
+    if(ferror(pFile))
+    {
+        std::cerr << "Error: could not read " << filename << "\n";
+        exit(EXIT_FAILURE);
+    }
+    fclose(pFile);
+}
@@ -14,12 +14,21 @@
 #include "BWT.h"
 #include "SequenceWorkItem.h"
 #include "GapArray.h"
+#include <stdio.h>
+
+// The number of ranks buffered for each range before they are written
+#define RANK_SPILL_BUFFER_SIZE 16384
+
+// The maximum number of range files open at once
+#define RANK_SPILL_MAX_RANGES 512
 
 typedef std::vector<int64_t> RankVector;
 struct RankResult
 {
     RankResult() : numRanksProcessed(0) {}
 
+    // The ranks that could not be added to the shared gap array. If
+    // there is no shared gap array, this holds every rank of the sequence.
     RankVector overflowVec;
     size_t numRanksProcessed;
 };
@@ -28,6 +37,8 @@ struct RankResult
 class RankProcess
 {
     public:
+        // pSharedGapArray may be NULL, in which case the ranks are
+        // returned to the post-processor
         RankProcess(const BWT* pBWT, GapArray* pSharedGapArray, bool doReverse, bool removeMode);
         ~RankProcess();
 
@@ -36,6 +47,7 @@ class RankProcess
     private:
 
         int64_t parseRankFromID(const std::string& id);
+        void addRank(int64_t rank, RankResult& out);
 
         const BWT* m_pBWT;
         GapArray* m_pSharedGapArray;
@@ -62,4 +74,40 @@ class RankPostProcess
         size_t num_serial_updates;
 };
 
+// Write the ranks to one file per range of rankRangeSize ranks of the
+// internal BWT, so the gap array can be built one range at a time
+// in bounded memory. The ranks are stored as 32-bit offsets into their range.
+class RankSpillPostProcess
+{
+    public:
+        RankSpillPostProcess(const std::string& prefix, size_t numRanks, size_t rankRangeSize);
+        ~RankSpillPostProcess();
+
+        void process(const SequenceWorkItem& item, const RankResult& result);
+
+        // Flush and close the range files. This must be called before they are read
+        void close();
+
+        size_t getNumRanges() const { return m_files.size(); }
+        size_t getRangeSize() const { return m_rangeSize; }
+        const std::string& getRangeFilename(size_t r) const { return m_filenames[r]; }
+        size_t getNumStringsProcessed() const { return num_strings; }
+        size_t getNumSymbolsProcessed() const { return num_symbols; }
+
+    private:
+        typedef std::vector<uint32_t> RangeBuffer;
+        void flushRange(size_t r);
+
+        size_t m_rangeSize;
+        std::vector<std::string> m_filenames;
+        std::vector<FILE*> m_files;
+        std::vector<RangeBuffer> m_buffers;
+        size_t num_strings;
+        size_t num_symbols;
+};
+
+// Add the ranks in the range file filename to pGapArray. The gap array
+// holds the counts of the ranks of one range.
+void loadRankRange(const std::string& filename, GapArray* pGapArray);
+
 #endif
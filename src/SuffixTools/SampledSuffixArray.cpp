@@ -175,8 +175,8 @@ void SampledSuffixArray::buildLexicoIndex(const BWT* pBWT, int num_threads)
         size_t idx = read_idx;
         while(1)
         {
-            char b = pBWT->getChar(idx);
-            idx = pBWT->getPC(b) + pBWT->getOcc(b, idx - 1);
+            char b;
+            idx = pBWT->getLF(idx, b);
             if(b == '$')
             {
                 // There is a one-to-one mapping between read_index and the element
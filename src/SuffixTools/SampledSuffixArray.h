@@ -15,6 +15,7 @@
 #include "SuffixArray.h"
 #include "BWT.h"
 #include "ReadInfoTable.h"
+#include "IndexMemory.h"
 
 typedef uint32_t SSA_INT_TYPE;
 
@@ -68,7 +69,7 @@ class SampledSuffixArray
 
         static const int DEFAULT_SA_SAMPLE_RATE = 64;
         int m_sampleRate;
-        SAElemVector m_saSamples;
+        std::vector<SAElem, IndexAllocator<SAElem> > m_saSamples;
 };
 
 #endif
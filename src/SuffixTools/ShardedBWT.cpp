@@ -0,0 +1,156 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// ShardedBWT - A set of independent FM-indices that
+// together index one collection of reads
+//
+#include "ShardedBWT.h"
+#include "BWTAlgorithms.h"
+#include "Util.h"
+
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
+
+//
+ShardedBWT::ShardedBWT(const std::vector<std::string>& filenames, int sampleRate, size_t cacheLength)
+{
+    assert(!filenames.empty());
+    for(size_t i = 0; i < filenames.size(); ++i)
+    {
+        BWT* pBWT = new BWT(filenames[i], sampleRate);
+        m_shards.push_back(pBWT);
+        m_caches.push_back(new BWTIntervalCache(cacheLength, pBWT));
+    }
+}
+
+//
+ShardedBWT::~ShardedBWT()
+{
+    for(size_t i = 0; i < m_shards.size(); ++i)
+    {
+        delete m_caches[i];
+        delete m_shards[i];
+    }
+}
+
+//
+std::vector<std::string> ShardedBWT::parseList(const std::string& str)
+{
+    std::vector<std::string> names;
+    StringVector fields = split(str, ',');
+    for(size_t i = 0; i < fields.size(); ++i)
+    {
+        if(!fields[i].empty())
+            names.push_back(fields[i]);
+    }
+    return names;
+}
+
+//
+size_t ShardedBWT::getNumStrings() const
+{
+    size_t n = 0;
+    for(size_t i = 0; i < m_shards.size(); ++i)
+        n += m_shards[i]->getNumStrings();
+    return n;
+}
+
+//
+size_t ShardedBWT::getBWLen() const
+{
+    size_t n = 0;
+    for(size_t i = 0; i < m_shards.size(); ++i)
+        n += m_shards[i]->getBWLen();
+    return n;
+}
+
+//
+void ShardedBWT::findIntervals(const std::string& w, std::vector<BWTInterval>& out) const
+{
+    out.resize(m_shards.size());
+    for(size_t i = 0; i < m_shards.size(); ++i)
+        out[i] = BWTAlgorithms::findIntervalWithCache(m_shards[i], m_caches[i], w);
+}
+
+//
+size_t ShardedBWT::countSequenceOccurrences(const std::string& w) const
+{
+    size_t count = 0;
+    for(size_t i = 0; i < m_shards.size(); ++i)
+        count += BWTAlgorithms::countSequenceOccurrencesWithCache(w, m_shards[i], m_caches[i]);
+    return count;
+}
+
+//
+size_t ShardedBWT::countSequenceOccurrencesSingleStrand(const std::string& w) const
+{
+    size_t count = 0;
+    for(size_t i = 0; i < m_shards.size(); ++i)
+    {
+        BWTInterval interval = BWTAlgorithms::findIntervalWithCache(m_shards[i], m_caches[i], w);
+        if(interval.isValid())
+            count += interval.size();
+    }
+    return count;
+}
+
+//
+AlphaCount64 ShardedBWT::getExtCount(const std::string& w) const
+{
+    AlphaCount64 ext_counts;
+    for(size_t i = 0; i < m_shards.size(); ++i)
+    {
+        BWTInterval interval = BWTAlgorithms::findIntervalWithCache(m_shards[i], m_caches[i], w);
+        if(interval.isValid())
+            ext_counts += BWTAlgorithms::getExtCount(interval, m_shards[i]);
+    }
+    return ext_counts;
+}
+
+// Each task counts one chunk of the words against one shard, so
+// large batches use all the threads even when there are fewer shards than threads.
+// The tasks only share the read-only input. The per-shard counts are summed
+// at the end.
+void ShardedBWT::countSequenceOccurrences(const std::vector<std::string>& words, 
+                                          std::vector<size_t>& counts, 
+                                          int numThreads) const
+{
+#if !HAVE_OPENMP
+    (void)numThreads;
+#endif
+    static const size_t CHUNK_SIZE = 1024;
+    size_t numShards = m_shards.size();
+    size_t numChunks = (words.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<std::vector<size_t> > shardCounts(numShards, std::vector<size_t>(words.size()));
+
+#if HAVE_OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+#endif
+    for(int t = 0; t < (int)(numShards * numChunks); ++t)
+    {
+        size_t i = t / numChunks;
+        size_t start = (t % numChunks) * CHUNK_SIZE;
+        size_t end = std::min(start + CHUNK_SIZE, words.size());
+        std::vector<size_t>& out = shardCounts[i];
+        for(size_t j = start; j < end; ++j)
+            out[j] = BWTAlgorithms::countSequenceOccurrencesWithCache(words[j], m_shards[i], m_caches[i]);
+    }
+
+    counts.assign(words.size(), 0);
+    for(size_t i = 0; i < numShards; ++i)
+    {
+        for(size_t j = 0; j < words.size(); ++j)
+            counts[j] += shardCounts[i][j];
+    }
+}
+
+//
+void ShardedBWT::printInfo() const
+{
+    printf("ShardedBWT: %zu shards, %zu strings, %zu symbols\n", m_shards.size(), getNumStrings(), getBWLen());
+    for(size_t i = 0; i < m_shards.size(); ++i)
+        m_shards[i]->printInfo();
+}
@@ -0,0 +1,81 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// ShardedBWT - A set of independent FM-indices that
+// together index one collection of reads. Count queries
+// are answered by summing over the shards, so the
+// per-file indices do not need to be merged first.
+//
+// A single query searches the shards one after another so it costs about
+// as much as one query per shard. Programs that query per read, like
+// sga correct, already keep every thread busy with their own reads, so
+// only the batch count fans out over the threads.
+//
+// Only sga correct -a kmer takes sharded indices. filter needs the
+// identity of each read, which a shard does not know, so it is not
+// supported. preqc, kmer-count and haplotype-filter read the suffix array or
+// walk intervals within one index, and have been left for later.
+//
+#ifndef SHARDED_BWT_H
+#define SHARDED_BWT_H
+
+#include "BWT.h"
+#include "BWTInterval.h"
+#include "BWTIntervalCache.h"
+
+class ShardedBWT
+{
+    public:
+
+        // Load the BWT in each file and build an interval cache of cacheLength for it
+        ShardedBWT(const std::vector<std::string>& filenames, int sampleRate, size_t cacheLength);
+        ~ShardedBWT();
+
+        // Split a comma-separated list of names, dropping empty entries
+        static std::vector<std::string> parseList(const std::string& str);
+
+        //
+        size_t getNumShards() const { return m_shards.size(); }
+        const BWT* getBWT(size_t shardIdx) const { return m_shards[shardIdx]; }
+        const BWTIntervalCache* getCache(size_t shardIdx) const { return m_caches[shardIdx]; }
+
+        // Totals over all the shards
+        size_t getNumStrings() const;
+        size_t getBWLen() const;
+
+        // Set out to the interval of w in each shard. The intervals
+        // are only meaningful with respect to their own shard.
+        void findIntervals(const std::string& w, std::vector<BWTInterval>& out) const;
+
+        // Count the occurrences of w in the collection, including its reverse complement
+        size_t countSequenceOccurrences(const std::string& w) const;
+
+        // Count the occurrences of w, not including the reverse complement
+        size_t countSequenceOccurrencesSingleStrand(const std::string& w) const;
+
+        // Return the number of times each symbol precedes w in the collection
+        AlphaCount64 getExtCount(const std::string& w) const;
+
+        // Count the occurrences (including the reverse complement) of every string in words.
+        // The words are split into chunks and the (shard, chunk) pairs are
+        // counted in parallel using up to numThreads threads.
+        void countSequenceOccurrences(const std::vector<std::string>& words, 
+                                      std::vector<size_t>& counts, 
+                                      int numThreads) const;
+
+        //
+        void printInfo() const;
+
+    private:
+        
+        // Not allowed
+        ShardedBWT(const ShardedBWT&);
+        ShardedBWT& operator=(const ShardedBWT&);
+
+        std::vector<BWT*> m_shards;
+        std::vector<BWTIntervalCache*> m_caches;
+};
+
+#endif
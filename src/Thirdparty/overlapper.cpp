@@ -32,6 +32,13 @@
 #include <limits>
 #include <stdio.h>
 #include <inttypes.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // 
 OverlapperParams default_params = { 2, -6, -3, -2, ALT_OVERLAP };
@@ -246,82 +253,276 @@ void SequenceOverlap::printAlignment(const std::string& s1, const std::string& s
 }
 
 typedef std::vector<int> DPCells;
-typedef std::vector<DPCells> DPMatrix;
 
-//
-SequenceOverlap Overlapper::computeOverlap(const std::string& s1, const std::string& s2, const OverlapperParams params)
+// Returns the index into a cell vector for for the ith column and jth row
+// of a dynamic programming matrix. The band_origin gives the row in first
+// column of the matrix that the bands start at. This is used to calculate
+// the starting band row for each column.
+inline int _getBandedCellIndex(int i, int j, int band_width, int band_origin_row)
 {
-    // Exit with invalid intervals if either string is zero length
-    SequenceOverlap output;
-    if(s1.empty() || s2.empty()) {
-        std::cerr << "Overlapper::computeOverlap error: empty input sequence\n";
-        exit(EXIT_FAILURE);
+    int band_start = band_origin_row + i;
+    int band_row_index = j - band_start;
+    return (band_row_index >= 0 && band_row_index < band_width) ? i * band_width + band_row_index : -1;
+}
+
+// Returns the score for (i,j) in the 
+inline int _getBandedCellScore(const DPCells& cells, int i, int j, int band_width, int band_origin_row, int invalid_score)
+{
+    int band_start = band_origin_row + i;
+    int band_row_index = j - band_start;
+    return (band_row_index >= 0 && band_row_index < band_width) ? cells[i * band_width + band_row_index] : invalid_score;
+}
+
+// computeOverlap works in two passes. The first pass only calculates scores,
+// keeping a single column of the matrix, to find the cell in the last row or
+// last column the best overlap ends at. When the scores fit in 16 bits this
+// pass is vectorized with the striped layout of Farrar (2007). The score of the
+// end cell bounds the number of gaps in any path reaching it with that score,
+// so the second pass refills the matrix only over the band of diagonals around
+// the end cell and the traceback runs on the band. Every cell on the best path
+// gets its exact score in the band and a cell outside of it is read as invalid,
+// which can only lose the tie-breaking below, so the alignment is the same as a
+// traceback over the full matrix.
+
+// Tracks the highest scoring cell of the last row and of the last column
+struct OverlapEndTracker
+{
+    OverlapEndTracker() : max_row_value(std::numeric_limits<int>::min()),
+                          max_column_value(std::numeric_limits<int>::min()),
+                          max_row_index(0),
+                          max_column_index(0) {}
+
+    // The cells must be added in order of increasing index,
+    // the first cell with the highest score is kept
+    void addRowCell(size_t i, int v)
+    {
+        if(v > max_row_value) {
+            max_row_value = v;
+            max_row_index = i;
+        }
     }
 
-    // Initialize the scoring matrix
+    void addColumnCell(size_t j, int v)
+    {
+        if(v > max_column_value) {
+            max_column_value = v;
+            max_column_index = j;
+        }
+    }
+
+    int max_row_value;
+    int max_column_value;
+    size_t max_row_index;
+    size_t max_column_index;
+};
+
+// Calculate the scores of the last row and last column of the overlap matrix
+static void _scoreOverlapScalar(const std::string& s1, const std::string& s2, 
+                                const OverlapperParams& params, OverlapEndTracker& tracker)
+{
     size_t num_columns = s1.size() + 1;
     size_t num_rows = s2.size() + 1;
+    DPCells prev_column(num_rows, 0);
+    DPCells curr_column(num_rows, 0);
 
-    DPMatrix score_matrix;
-    score_matrix.resize(num_columns);
-    for(size_t i = 0; i < score_matrix.size(); ++i)
-        score_matrix[i].resize(num_rows);
-
-    // Calculate scores
+    const char* pS2 = s2.data();
+    const int match_score = params.match_score;
+    const int mismatch_penalty = params.mismatch_penalty;
+    const int gap_penalty = params.gap_penalty;
     for(size_t i = 1; i < num_columns; ++i) {
+        char b = s1[i - 1];
+        const int* pPrev = &prev_column[0];
+        int* pCurr = &curr_column[0];
+        int up = pCurr[0];
         for(size_t j = 1; j < num_rows; ++j) {
-            // Calculate the score for entry (i,j)
-            int idx_1 = i - 1;
-            int idx_2 = j - 1;
-            int diagonal = score_matrix[i-1][j-1] + (s1[idx_1] == s2[idx_2] ? params.match_score : params.mismatch_penalty);
-            int up = score_matrix[i][j-1] + params.gap_penalty;
-            int left = score_matrix[i-1][j] + params.gap_penalty;
-
-            score_matrix[i][j] = max3(diagonal, up, left);
+            int diagonal = pPrev[j-1] + (b == pS2[j - 1] ? match_score : mismatch_penalty);
+            int left = pPrev[j] + gap_penalty;
+            up = max3(diagonal, up + gap_penalty, left);
+            pCurr[j] = up;
         }
+        tracker.addRowCell(i, up);
+        prev_column.swap(curr_column);
     }
- 
-    // The location of the highest scoring match in the
-    // last row or last column is the maximum scoring overlap
-    // for the pair of strings. We start the backtracking from
-    // that cell
-    int max_row_value = std::numeric_limits<int>::min();
-    int max_column_value = std::numeric_limits<int>::min();
-    size_t max_row_index = 0;
-    size_t max_column_index = 0;
 
-    // Check every column of the last row
-    // The first column is skipped to avoid empty alignments
-    for(size_t i = 1; i < num_columns; ++i) {
-        int v = score_matrix[i][num_rows - 1];
-        if(score_matrix[i][num_rows - 1] > max_row_value) {
-            max_row_value = v;
-            max_row_index = i;
+    for(size_t j = 1; j < num_rows; ++j)
+        tracker.addColumnCell(j, prev_column[j]);
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+#define HAVE_STRIPED_OVERLAP 1
+
+#if defined(__AVX2__)
+typedef __m256i StripedScores;
+#define STRIPED_LANES 16
+
+static inline StripedScores _stripedSet(int16_t v) { return _mm256_set1_epi16(v); }
+static inline StripedScores _stripedAdds(StripedScores a, StripedScores b) { return _mm256_adds_epi16(a, b); }
+static inline StripedScores _stripedMax(StripedScores a, StripedScores b) { return _mm256_max_epi16(a, b); }
+static inline bool _stripedAnyGreater(StripedScores a, StripedScores b) { return _mm256_movemask_epi8(_mm256_cmpgt_epi16(a, b)) != 0; }
+
+// Move every score up one lane, the first lane is set to v
+static inline StripedScores _stripedShift(StripedScores a, int16_t v)
+{
+    __m256i low = _mm256_permute2x128_si256(a, a, 0x08);
+    return _mm256_insert_epi16(_mm256_alignr_epi8(a, low, 14), v, 0);
+}
+#else
+typedef __m128i StripedScores;
+#define STRIPED_LANES 8
+
+static inline StripedScores _stripedSet(int16_t v) { return _mm_set1_epi16(v); }
+static inline StripedScores _stripedAdds(StripedScores a, StripedScores b) { return _mm_adds_epi16(a, b); }
+static inline StripedScores _stripedMax(StripedScores a, StripedScores b) { return _mm_max_epi16(a, b); }
+static inline bool _stripedAnyGreater(StripedScores a, StripedScores b) { return _mm_movemask_epi8(_mm_cmpgt_epi16(a, b)) != 0; }
+
+// Move every score up one lane, the first lane is set to v
+static inline StripedScores _stripedShift(StripedScores a, int16_t v)
+{
+    return _mm_insert_epi16(_mm_slli_si128(a, 2), v, 0);
+}
+#endif
+
+// Calculate the scores of the last row and last column of the overlap matrix
+// with 16 bit saturating arithmetic. Row j - 1 of s2 is held by lane (j - 1) / seg_len
+// of vector (j - 1) % seg_len. Returns false, without scoring, if a cell of the matrix
+// could fall outside of the 16 bit range.
+static bool _scoreOverlapStriped(const std::string& s1, const std::string& s2, 
+                                 const OverlapperParams& params, OverlapEndTracker& tracker)
+{
+    const size_t n = s1.size();
+    const size_t m = s2.size();
+    const size_t seg_len = (m + STRIPED_LANES - 1) / STRIPED_LANES;
+
+    // Every cell is bounded by the score of its diagonal path to the first row or column,
+    // as the gap penalty is not positive. The padding rows past the end of s2 are included.
+    const int match_score = params.match_score;
+    const int mismatch_penalty = params.mismatch_penalty;
+    const int gap_penalty = params.gap_penalty;
+    long diagonal_length = std::min(n, seg_len * STRIPED_LANES);
+    long max_step = std::max(std::max(match_score, mismatch_penalty), 0);
+    long min_step = std::min(std::min(match_score, mismatch_penalty), 0);
+    if(gap_penalty > 0 || gap_penalty < -32767 ||
+       max_step * (diagonal_length + 1) > 32767 || min_step * (diagonal_length + 1) < -32767)
+        return false;
+
+    // Assign a query profile to each distinct base of s1
+    int profile_index[256];
+    std::fill(profile_index, profile_index + 256, -1);
+    int num_profiles = 0;
+    for(size_t i = 0; i < n; ++i) {
+        unsigned char b = s1[i];
+        if(profile_index[b] == -1)
+            profile_index[b] = num_profiles++;
+    }
+
+    // The profiles and two columns of scores share a single block of memory
+    // which is aligned for the vector loads
+    const size_t column_size = seg_len * STRIPED_LANES;
+    std::vector<int16_t> memory((num_profiles + 2) * column_size + STRIPED_LANES, 0);
+    uintptr_t aligned_address = reinterpret_cast<uintptr_t>(&memory[0]);
+    aligned_address = (aligned_address + sizeof(StripedScores) - 1) & ~(uintptr_t)(sizeof(StripedScores) - 1);
+    int16_t* pProfiles = reinterpret_cast<int16_t*>(aligned_address);
+    int16_t* pLoad = pProfiles + num_profiles * column_size;
+    int16_t* pStore = pLoad + column_size;
+
+    for(int c = 0; c < 256; ++c) {
+        if(profile_index[c] == -1)
+            continue;
+        int16_t* pProfile = pProfiles + profile_index[c] * column_size;
+        for(size_t t = 0; t < seg_len; ++t) {
+            for(size_t k = 0; k < STRIPED_LANES; ++k) {
+                size_t r = k * seg_len + t;
+                bool is_match = r < m && (unsigned char)s2[r] == c;
+                pProfile[t * STRIPED_LANES + k] = is_match ? match_score : mismatch_penalty;
+            }
         }
     }
 
-    // Check every row of the last column
-    for(size_t j = 1; j < num_rows; ++j) {
-        int v = score_matrix[num_columns - 1][j];
-        if(v > max_column_value) {
-            max_column_value = v;
-            max_column_index = j;
+    const int16_t min_score = std::numeric_limits<int16_t>::min();
+    const StripedScores v_gap = _stripedSet(gap_penalty);
+    const StripedScores v_min = _stripedSet(min_score);
+    const size_t last_row_index = ((m - 1) % seg_len) * STRIPED_LANES + (m - 1) / seg_len;
+
+    for(size_t i = 1; i <= n; ++i) {
+        const StripedScores* pProfile = reinterpret_cast<const StripedScores*>(pProfiles + profile_index[(unsigned char)s1[i - 1]] * column_size);
+        const StripedScores* pPrev = reinterpret_cast<const StripedScores*>(pLoad);
+        StripedScores* pCurr = reinterpret_cast<StripedScores*>(pStore);
+
+        // The first row of the matrix is zero, which gives the up score
+        // of row 1 and the diagonal score of row 1
+        StripedScores v_up = _stripedShift(v_min, gap_penalty);
+        StripedScores v_score = _stripedShift(pPrev[seg_len - 1], 0);
+        for(size_t t = 0; t < seg_len; ++t) {
+            v_score = _stripedAdds(v_score, pProfile[t]);
+            v_score = _stripedMax(v_score, _stripedAdds(pPrev[t], v_gap));
+            v_score = _stripedMax(v_score, v_up);
+            pCurr[t] = v_score;
+            v_up = _stripedAdds(v_score, v_gap);
+            v_score = pPrev[t];
+        }
+
+        // Carry the up scores across the lanes until they no longer improve a cell
+        v_up = _stripedShift(v_up, min_score);
+        size_t t = 0;
+        while(_stripedAnyGreater(v_up, pCurr[t])) {
+            pCurr[t] = _stripedMax(pCurr[t], v_up);
+            v_up = _stripedAdds(v_up, v_gap);
+            if(++t == seg_len) {
+                t = 0;
+                v_up = _stripedShift(v_up, min_score);
+            }
         }
+
+        std::swap(pLoad, pStore);
+        tracker.addRowCell(i, pLoad[last_row_index]);
     }
 
+    for(size_t r = 0; r < m; ++r)
+        tracker.addColumnCell(r + 1, pLoad[(r % seg_len) * STRIPED_LANES + r / seg_len]);
+    return true;
+}
+
+#endif
+
+//
+SequenceOverlap Overlapper::computeOverlap(const std::string& s1, const std::string& s2, const OverlapperParams params)
+{
+    // Exit with invalid intervals if either string is zero length
+    SequenceOverlap output;
+    if(s1.empty() || s2.empty()) {
+        std::cerr << "Overlapper::computeOverlap error: empty input sequence\n";
+        exit(EXIT_FAILURE);
+    }
+
+    size_t num_columns = s1.size() + 1;
+    size_t num_rows = s2.size() + 1;
+
+    // The location of the highest scoring match in the
+    // last row or last column is the maximum scoring overlap
+    // for the pair of strings. We start the backtracking from
+    // that cell. The first column is skipped to avoid empty alignments
+    OverlapEndTracker tracker;
+#ifdef HAVE_STRIPED_OVERLAP
+    if(!_scoreOverlapStriped(s1, s2, params, tracker))
+        _scoreOverlapScalar(s1, s2, params, tracker);
+#else
+    _scoreOverlapScalar(s1, s2, params, tracker);
+#endif
+
     // Compute the location at which to start the backtrack
     size_t i;
     size_t j;
 
-    if(max_column_value > max_row_value) {
+    if(tracker.max_column_value > tracker.max_row_value) {
         i = num_columns - 1;
-        j = max_column_index;
-        output.score = max_column_value;
+        j = tracker.max_column_index;
+        output.score = tracker.max_column_value;
     }
     else {
-        i = max_row_index;
+        i = tracker.max_row_index;
         j = num_rows - 1;
-        output.score = max_row_value;
+        output.score = tracker.max_row_value;
     }
 
     // Set the alignment endpoints to be the index of the last aligned base
@@ -333,34 +534,69 @@ SequenceOverlap Overlapper::computeOverlap(const std::string& s1, const std::str
     printf("Endpoints selected: (%d %d) with score %d\n", output.match[0].end, output.match[1].end, output.score);
 #endif
 
+    // A path to (i,j) takes at most min(i,j) diagonal steps so the score bounds its number
+    // of gaps, and each gap moves the path one diagonal away from the diagonal of the end cell.
+    // The band covers the diagonals d = j - i in [band_low, band_high] for columns 0..i
+    // and rows 0..j.
+    const int end_column = i;
+    const int end_row = j;
+    const int end_diagonal = end_row - end_column;
+    int band_low = -end_column;
+    int band_high = end_row;
+    if(params.gap_penalty < 0) {
+        long max_step = std::max(std::max(params.match_score, params.mismatch_penalty), 0);
+        long max_gaps = (max_step * std::min(end_column, end_row) - output.score) / -params.gap_penalty;
+        max_gaps = std::max(max_gaps, 0L);
+        band_low = std::max((long)band_low, end_diagonal - max_gaps);
+        band_high = std::min((long)band_high, end_diagonal + max_gaps);
+    }
+    const int band_width = band_high - band_low + 1;
+    const int INVALID_SCORE = std::numeric_limits<int>::min() / 2;
+    DPCells cells((end_column + 1) * band_width, INVALID_SCORE);
+
+    for(int ci = 0; ci <= end_column; ++ci) {
+        int first_row = std::max(0, band_low + ci);
+        int last_row = std::min(end_row, band_high + ci);
+        int idx = _getBandedCellIndex(ci, first_row, band_width, band_low);
+        for(int cj = first_row; cj <= last_row; ++cj, ++idx) {
+            if(ci == 0 || cj == 0) {
+                cells[idx] = 0;
+                continue;
+            }
+            int d = cj - ci;
+            int diagonal = cells[idx - band_width] + (s1[ci - 1] == s2[cj - 1] ? params.match_score : params.mismatch_penalty);
+            int left = d < band_high ? cells[idx - band_width + 1] + params.gap_penalty : INVALID_SCORE;
+            int up = d > band_low ? cells[idx - 1] + params.gap_penalty : INVALID_SCORE;
+            cells[idx] = max3(diagonal, up, left);
+        }
+    }
+
     output.edit_distance = 0;
     output.total_columns = 0;
 
     std::string cigar;
     while(i > 0 && j > 0) {
         // Compute the possible previous locations of the path
-        int idx_1 = i - 1;
-        int idx_2 = j - 1;
-
-        bool is_match = s1[idx_1] == s2[idx_2];
-        int diagonal = score_matrix[i - 1][j - 1] + (is_match ? params.match_score : params.mismatch_penalty);
-        int up = score_matrix[i][j-1] + params.gap_penalty;
-        int left = score_matrix[i-1][j] + params.gap_penalty;
+        bool is_match = s1[i - 1] == s2[j - 1];
+        int score = _getBandedCellScore(cells, i, j, band_width, band_low, INVALID_SCORE);
+        int diagonal = _getBandedCellScore(cells, i - 1, j - 1, band_width, band_low, INVALID_SCORE) + (is_match ? params.match_score : params.mismatch_penalty);
+        int up = _getBandedCellScore(cells, i, j - 1, band_width, band_low, INVALID_SCORE) + params.gap_penalty;
+        int left = _getBandedCellScore(cells, i - 1, j, band_width, band_low, INVALID_SCORE) + params.gap_penalty;
 
         // If there are multiple possible paths to this cell
         // we break ties in order of insertion,deletion,match
         // this helps left-justify matches for homopolymer runs
         // of unequal lengths
-        if(score_matrix[i][j] == up) {
+        if(score == up) {
             cigar.push_back('I');
             j -= 1;
             output.edit_distance += 1;
-        } else if(score_matrix[i][j] == left) {
+        } else if(score == left) {
             cigar.push_back('D');
             i -= 1;
             output.edit_distance += 1;
         } else {
-            assert(score_matrix[i][j] == diagonal);
+            assert(score == diagonal);
             if(!is_match)
                 output.edit_distance += 1;
             cigar.push_back('M');
@@ -383,23 +619,111 @@ SequenceOverlap Overlapper::computeOverlap(const std::string& s1, const std::str
     return output;
 }
 
-// Returns the index into a cell vector for for the ith column and jth row
-// of a dynamic programming matrix. The band_origin gives the row in first
-// column of the matrix that the bands start at. This is used to calculate
-// the starting band row for each column.
-inline int _getBandedCellIndex(int i, int j, int band_width, int band_origin_row)
+// An alignment of the first length bases of one sequence with distance edits has
+// at most length + distance columns. It can only reach min_overlap columns with at
+// least min_identity of them matching if these hold.
+static inline bool _canPassOverlapThresholds(int distance, int length, int min_overlap, double min_identity)
 {
-    int band_start = band_origin_row + i;
-    int band_row_index = j - band_start;
-    return (band_row_index >= 0 && band_row_index < band_width) ? i * band_width + band_row_index : -1;
+    const double EPSILON = 1e-9;
+    return distance * min_identity <= (1.0 - min_identity) * length + EPSILON &&
+           length >= min_identity * min_overlap - EPSILON;
 }
 
-// Returns the score for (i,j) in the 
-inline int _getBandedCellScore(const DPCells& cells, int i, int j, int band_width, int band_origin_row, int invalid_score)
+// Calculate the edit distance of each prefix of pattern to the best matching
+// substring of text with the bit-parallel algorithm of Myers (1999), in the
+// multi-word form of Hyyro (2003). Returns true if the whole pattern ending at some
+// position of text, or some prefix of the pattern ending at the end of text, can
+// pass the thresholds.
+static bool _hasPassingPrefixAlignment(const std::string& pattern, const std::string& text, 
+                                       int min_overlap, double min_identity)
 {
-    int band_start = band_origin_row + i;
-    int band_row_index = j - band_start;
-    return (band_row_index >= 0 && band_row_index < band_width) ? cells[i * band_width + band_row_index] : invalid_score;
+    const size_t m = pattern.size();
+    const size_t num_blocks = (m + 63) / 64;
+    const uint64_t last_bit = (uint64_t)1 << ((m - 1) % 64);
+
+    // The positions in the pattern of each base of text
+    int mask_index[256];
+    std::fill(mask_index, mask_index + 256, -1);
+    int num_masks = 0;
+    for(size_t i = 0; i < text.size(); ++i) {
+        unsigned char b = text[i];
+        if(mask_index[b] == -1)
+            mask_index[b] = num_masks++;
+    }
+
+    // The last mask is for the bases that are not in text
+    std::vector<uint64_t> masks((num_masks + 1) * num_blocks, 0);
+    for(size_t r = 0; r < m; ++r) {
+        int idx = mask_index[(unsigned char)pattern[r]];
+        idx = idx == -1 ? num_masks : idx;
+        masks[idx * num_blocks + r / 64] |= (uint64_t)1 << (r % 64);
+    }
+
+    // The largest distance of the whole pattern that can pass
+    int max_distance = -1;
+    while(max_distance < (int)m && _canPassOverlapThresholds(max_distance + 1, m, min_overlap, min_identity))
+        max_distance += 1;
+
+    // The vertical differences between adjacent rows of the current column
+    std::vector<uint64_t> differences(2 * num_blocks, 0);
+    uint64_t* pPositive = &differences[0];
+    uint64_t* pNegative = &differences[num_blocks];
+    std::fill(pPositive, pPositive + num_blocks, ~(uint64_t)0);
+
+    // The distance of the whole pattern ending at the current position
+    int distance = m;
+    for(size_t i = 0; i < text.size(); ++i) {
+        const uint64_t* pMask = &masks[mask_index[(unsigned char)text[i]] * num_blocks];
+
+        // The first row is zero as the match can start anywhere in text
+        uint64_t h_in_positive = 0;
+        uint64_t h_in_negative = 0;
+        uint64_t ph = 0;
+        uint64_t mh = 0;
+        for(size_t b = 0; b < num_blocks; ++b) {
+            uint64_t eq = pMask[b];
+            uint64_t pv = pPositive[b];
+            uint64_t mv = pNegative[b];
+            uint64_t xv = eq | mv;
+            eq |= h_in_negative;
+            uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            ph = mv | ~(xh | pv);
+            mh = pv & xh;
+            uint64_t h_out_positive = ph >> 63;
+            uint64_t h_out_negative = mh >> 63;
+            uint64_t ph_shifted = (ph << 1) | h_in_positive;
+            uint64_t mh_shifted = (mh << 1) | h_in_negative;
+            pPositive[b] = mh_shifted | ~(xv | ph_shifted);
+            pNegative[b] = ph_shifted & xv;
+            h_in_positive = h_out_positive;
+            h_in_negative = h_out_negative;
+        }
+
+        distance += ((ph & last_bit) != 0) - ((mh & last_bit) != 0);
+        if(distance <= max_distance)
+            return true;
+    }
+
+    // Check every prefix of the pattern against the end of text
+    distance = 0;
+    for(size_t r = 0; r < m; ++r) {
+        distance += (int)((pPositive[r / 64] >> (r % 64)) & 1) - (int)((pNegative[r / 64] >> (r % 64)) & 1);
+        if(_canPassOverlapThresholds(distance, r + 1, min_overlap, min_identity))
+            return true;
+    }
+    return false;
+}
+
+//
+bool Overlapper::isOverlapPossible(const std::string& s1, const std::string& s2, int min_overlap, double min_identity)
+{
+    if(s1.empty() || s2.empty())
+        return true;
+
+    // An overlap starts at the first base of s2, which is covered by
+    // aligning s2 to s1, or at the first base of s1
+    return _hasPassingPrefixAlignment(s2, s1, min_overlap, min_identity) ||
+           _hasPassingPrefixAlignment(s1, s2, min_overlap, min_identity);
 }
 
 SequenceOverlap Overlapper::extendMatch(const std::string& s1, const std::string& s2, 
@@ -634,7 +958,7 @@ static const uint8_t FROM_LEFT = 1;
 static const uint8_t FROM_UP = 2;
 static const uint8_t FROM_INVALID = 3;
 
-// The score for this cell coming from a match, deletion and insertion and its direction
+// The scores of a cell ending in a match, deletion and insertion
 struct AffineCell
 {
     AffineCell() : G(0), I(-std::numeric_limits<int>::max()), D(-std::numeric_limits<int>::max()) {}
@@ -643,14 +967,20 @@ struct AffineCell
     int G;
     int I;
     int D;
-    
-    uint8_t Gt;
-    uint8_t It;
-    uint8_t Dt;
 };
-
 typedef std::vector<AffineCell> AffineCells;
-typedef std::vector<AffineCells> AffineMatrix;
+
+// The directions of the G, I and D scores of a cell are
+// packed into a single byte of the traceback matrix
+#define AFFINE_G_SHIFT 0
+#define AFFINE_I_SHIFT 2
+#define AFFINE_D_SHIFT 4
+typedef std::vector<uint8_t> AffineTraceback;
+
+inline uint8_t _getAffineDirection(const AffineTraceback& traceback, size_t idx, int shift)
+{
+    return (traceback[idx] >> shift) & 3;
+}
 
 SequenceOverlap Overlapper::computeAlignmentAffine(const std::string& s1, const std::string& s2, const OverlapperParams params)
 {
@@ -707,97 +1037,110 @@ SequenceOverlap Overlapper::computeAlignmentAffine(const std::string& s1, const
     int gap_open = -params.gap_penalty;
     int gap_ext = -params.gap_ext_penalty;
     
-    AffineMatrix score_matrix;
-    score_matrix.resize(num_columns);
-    
-    for(size_t i = 0; i < score_matrix.size(); ++i)
-        score_matrix[i].resize(num_rows);
-    
+    // Only two columns of scores are kept. The directions of each cell
+    // are stored column-major in the traceback matrix
+    AffineCells prev_column(num_rows);
+    AffineCells curr_column(num_rows);
+    AffineTraceback traceback(num_columns * num_rows, 0);
+
     // Initialze first row and column
     // Penalties in first row iff gap_s1_start==false
-    int c = (gap_s1_start == false ? 1 : 0);
-    for(size_t i = 1; i < num_columns; ++i) {
-        int v = -(gap_open + i * gap_ext) * c;
-        score_matrix[i][0].D = v;
-        score_matrix[i][0].Dt = (i == 1? FROM_DIAG : FROM_LEFT);
-        score_matrix[i][0].G = v;
-        score_matrix[i][0].Gt = FROM_LEFT;
-    }
+    int c1 = (gap_s1_start == false ? 1 : 0);
 
     // Penalties in first column iff gap_s2_start==false
-    c = (gap_s2_start == false ? 1 : 0);
+    int c = (gap_s2_start == false ? 1 : 0);
     for(size_t j = 1; j < num_rows; ++j) {
         int v = -(gap_open + j * gap_ext) * c;
-        score_matrix[0][j].I = v;
-        score_matrix[0][j].It = (j == 1? FROM_DIAG : FROM_UP);
-        score_matrix[0][j].G = v;
-        score_matrix[0][j].Gt = FROM_UP;
+        prev_column[j].I = v;
+        prev_column[j].G = v;
+        uint8_t It = (j == 1? FROM_DIAG : FROM_UP);
+        traceback[j] = (FROM_UP << AFFINE_G_SHIFT) | (It << AFFINE_I_SHIFT);
     }
 
     // Calculate scores
     for(size_t i = 1; i < num_columns; ++i) {
+        size_t column_offset = i * num_rows;
+
+        // First row of the column
+        int v = -(gap_open + i * gap_ext) * c1;
+        curr_column[0].D = v;
+        curr_column[0].G = v;
+        curr_column[0].I = -std::numeric_limits<int>::max();
+        uint8_t first_Dt = (i == 1? FROM_DIAG : FROM_LEFT);
+        traceback[column_offset] = (FROM_LEFT << AFFINE_G_SHIFT) | (first_Dt << AFFINE_D_SHIFT);
+
+        // In the last column, insertion costs are controlled by gap_s2_end
+        int ins_open = (i < num_columns - 1 or not gap_s2_end? gap_open : 0);
+        int ins_ext = (i < num_columns - 1 or not gap_s2_end? gap_ext : 0);
+        char b = s1[i - 1];
+
+        // Raw pointers are used in the inner loop as the writes to the
+        // traceback could otherwise alias the vectors' storage
+        const AffineCell* pPrev = &prev_column[0];
+        AffineCell* pCurr = &curr_column[0];
+        uint8_t* pTraceback = &traceback[column_offset];
+
         for(size_t j = 1; j < num_rows; ++j) {
             
             // Calculate the score for entry (i,j)
-            int idx_1 = i - 1;
-            int idx_2 = j - 1;
-            int diagonal = score_matrix[i-1][j-1].G + (s1[idx_1] == s2[idx_2] ? params.match_score : params.mismatch_penalty);
+            int diagonal = pPrev[j-1].G + (b == s2[j - 1] ? params.match_score : params.mismatch_penalty);
             
-            AffineCell& curr = score_matrix[i][j];
-            AffineCell& up = score_matrix[i][j-1];
-            AffineCell& left = score_matrix[i-1][j];
+            AffineCell& curr = pCurr[j];
+            const AffineCell& up = pCurr[j-1];
+            const AffineCell& left = pPrev[j];
             
             // When computing the score starting from the left/right cells, we have to determine
             // whether to extend an existing gap or start a new one.
-            // In the last column, insertion costs are controlled by gap_s2_end
-            int ins_open = (i < num_columns - 1 or not gap_s2_end? gap_open : 0);
-            int ins_ext = (i < num_columns - 1 or not gap_s2_end? gap_ext : 0);
-            
             // In the last row, deletion costs are controlled by gap_s1_end
             int del_open = (j < num_rows - 1 or not gap_s1_end? gap_open : 0);
             int del_ext = (j < num_rows - 1 or not gap_s1_end? gap_ext : 0);
             
+            uint8_t It;
+            uint8_t Dt;
+            uint8_t Gt;
             if(up.I > up.G - ins_open) {
                 curr.I = up.I - ins_ext;
-                curr.It = FROM_UP;
+                It = FROM_UP;
             } else {
                 curr.I = up.G - (ins_open + ins_ext);
-                curr.It = FROM_DIAG;
+                It = FROM_DIAG;
             }
             if(left.D > left.G - del_open) {
                 curr.D = left.D - del_ext;
-                curr.Dt = FROM_LEFT;
+                Dt = FROM_LEFT;
             } else {
                 curr.D = left.G - (del_open + del_ext);
-                curr.Dt = FROM_DIAG;
+                Dt = FROM_DIAG;
             }
             
             curr.G = max3(curr.D, curr.I, diagonal);
             if(curr.G == curr.I)
-                curr.Gt = FROM_UP;
+                Gt = FROM_UP;
             else if(curr.G == curr.D)
-                curr.Gt = FROM_LEFT;
+                Gt = FROM_LEFT;
             else
-                curr.Gt = FROM_DIAG;
+                Gt = FROM_DIAG;
+            pTraceback[j] = (Gt << AFFINE_G_SHIFT) | (It << AFFINE_I_SHIFT) | (Dt << AFFINE_D_SHIFT);
         }
+        prev_column.swap(curr_column);
     }
     
     // With the new scores, the max score is always in the bottom right cell
     size_t i = num_columns - 1;
     size_t j = num_rows - 1;
     
-    output.score = score_matrix[i][j].G;
-    uint8_t direction = score_matrix[i][j].Gt;
+    output.score = prev_column[j].G;
+    uint8_t direction = _getAffineDirection(traceback, i * num_rows + j, AFFINE_G_SHIFT);
     
     // However, the alignment might contain free end gaps which we now remove
     if (gap_s2_end)
     {
         while (j >= 1 and direction == FROM_UP)
         {
-            direction = score_matrix[i][j].It;
+            direction = _getAffineDirection(traceback, i * num_rows + j, AFFINE_I_SHIFT);
             --j;
             if (direction == FROM_DIAG)
-                direction = score_matrix[i][j].Gt;
+                direction = _getAffineDirection(traceback, i * num_rows + j, AFFINE_G_SHIFT);
         }
     }
 
@@ -805,10 +1148,10 @@ SequenceOverlap Overlapper::computeAlignmentAffine(const std::string& s1, const
     {
         while (i >= 1 and direction == FROM_LEFT)
         {
-            direction = score_matrix[i][j].Dt;
+            direction = _getAffineDirection(traceback, i * num_rows + j, AFFINE_D_SHIFT);
             --i;
             if (direction == FROM_DIAG)
-                direction = score_matrix[i][j].Gt;
+                direction = _getAffineDirection(traceback, i * num_rows + j, AFFINE_G_SHIFT);
         }
     }
 
@@ -835,21 +1178,21 @@ SequenceOverlap Overlapper::computeAlignmentAffine(const std::string& s1, const
         {
             cigar.push_back('I');
             ++output.edit_distance;
-            direction = score_matrix[i][j].It;
+            direction = _getAffineDirection(traceback, i * num_rows + j, AFFINE_I_SHIFT);
             --j;
 
             if (direction == FROM_DIAG)
-                direction = score_matrix[i][j].Gt;
+                direction = _getAffineDirection(traceback, i * num_rows + j, AFFINE_G_SHIFT);
         }
         else if (direction == FROM_LEFT)
         {
             cigar.push_back('D');
             ++output.edit_distance;
-            direction = score_matrix[i][j].Dt;
+            direction = _getAffineDirection(traceback, i * num_rows + j, AFFINE_D_SHIFT);
             --i;
          
             if (direction == FROM_DIAG)
-                direction = score_matrix[i][j].Gt;
+                direction = _getAffineDirection(traceback, i * num_rows + j, AFFINE_G_SHIFT);
         }
         else
         {
@@ -870,7 +1213,7 @@ SequenceOverlap Overlapper::computeAlignmentAffine(const std::string& s1, const
             }
             --i;
             --j;
-            direction = score_matrix[i][j].Gt;
+            direction = _getAffineDirection(traceback, i * num_rows + j, AFFINE_G_SHIFT);
         }
         ++output.total_columns;
     }
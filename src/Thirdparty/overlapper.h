@@ -167,9 +167,16 @@ namespace Overlapper
 {
 
 // Compute the highest-scoring overlap between s1 and s2.
-// This is a naive O(M*N) algorithm with a linear gap penalty.
+// This is an O(M*N) algorithm with a linear gap penalty. The scores are calculated
+// with SIMD instructions when available and the traceback is banded.
 SequenceOverlap computeOverlap(const std::string& s1, const std::string& s2, const OverlapperParams params = default_params);
 
+// Returns false if s1 and s2 cannot have an overlap, of the kind computed by computeOverlap,
+// that is at least min_overlap columns long with at least min_identity (a fraction) of the
+// columns matching. This is a fast bit-parallel filter to run before computeOverlap, 
+// a true result does not mean that such an overlap exists.
+bool isOverlapPossible(const std::string& s1, const std::string& s2, int min_overlap, double min_identity);
+
 // Extend a match between s1 and s2 into a full overlap using banded dynamic programming.
 // start_1/start_2 give the starting positions of the current partial alignment. These coordinates
 // are used to estimate where the overlap begins. The estimated alignment is refined by calculating
@@ -0,0 +1,84 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// AllocationCounter - Count the calls to the global operator new.
+//
+#include <stdlib.h>
+#include <new>
+#include "AllocationCounter.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+static size_t s_numAllocations = 0;
+
+// Count the allocation and get the memory from malloc,
+// following the rules for a replacement operator new
+static void* countedAllocate(size_t bytes)
+{
+    __sync_fetch_and_add(&s_numAllocations, 1);
+    if(bytes == 0)
+        bytes = 1;
+
+    while(1)
+    {
+        void* ptr = malloc(bytes);
+        if(ptr != NULL)
+            return ptr;
+
+        std::new_handler handler = std::set_new_handler(0);
+        std::set_new_handler(handler);
+        if(handler == NULL)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* operator new(size_t bytes) throw(std::bad_alloc)
+{
+    return countedAllocate(bytes);
+}
+
+void* operator new[](size_t bytes) throw(std::bad_alloc)
+{
+    return countedAllocate(bytes);
+}
+
+void operator delete(void* ptr) throw()
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) throw()
+{
+    free(ptr);
+}
+
+//
+bool AllocationCounter::isEnabled()
+{
+    return true;
+}
+
+//
+size_t AllocationCounter::getCount()
+{
+    return __sync_fetch_and_add(&s_numAllocations, 0);
+}
+
+#else
+
+//
+bool AllocationCounter::isEnabled()
+{
+    return false;
+}
+
+//
+size_t AllocationCounter::getCount()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,34 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// AllocationCounter - Count the calls to the global operator new.
+//
+// When sga is configured with --enable-allocation-count, COUNT_ALLOCATIONS
+// is defined and the global operator new and delete are replaced by
+// versions that count the allocations made by all threads. sga overlap
+// then reports the number of allocations per read, which is used to check
+// changes to the memory use of the overlap search. Otherwise the
+// operators are left alone and the count is not available.
+//
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <stddef.h>
+#include "config.h"
+
+//#define COUNT_ALLOCATIONS 1
+
+namespace AllocationCounter
+{
+
+// Returns true if the allocations are being counted
+bool isEnabled();
+
+// Returns the number of calls to operator new since the program started
+size_t getCount();
+
+};
+
+#endif
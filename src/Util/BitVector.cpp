@@ -9,6 +9,8 @@
 #include "BitVector.h"
 #include <assert.h>
 #include <cstdlib>
+#include <algorithm>
+#include <iostream>
 
 //
 BitVector::BitVector()
@@ -47,8 +49,8 @@ BitVector::~BitVector()
 //
 void BitVector::resize(size_t n)
 {
-    size_t num_bytes = (n % 8 == 0) ? n / 8 : (n / 8) + 1;
-    m_data.resize(num_bytes);
+    size_t num_words = (n + 63) / 64;
+    m_data.resize(num_words);
 }
 
 //
@@ -66,27 +68,87 @@ void BitVector::unlock()
 //
 bool BitVector::updateCAS(size_t i, bool oldValue, bool newValue)
 {
-    size_t byte = i / 8;
-    assert(byte < m_data.size());
-    size_t offset = i - byte * 8;
-    return m_data[byte].updateCAS(offset, oldValue, newValue);
-}
+    assert(oldValue != newValue);
+    if(newValue)
+    {
+        assert(!oldValue);
+        return testAndSet(i);
+    }
 
+    size_t word = i >> 6;
+    assert(word < m_data.size());
+    uint64_t mask = (uint64_t)1 << (i & 63);
+    uint64_t previous = __sync_fetch_and_and(&m_data[word], ~mask);
+    return previous & mask;
+}
 
-// Set bit at position i to value v
-void BitVector::set(size_t i, bool v)
+//
+bool BitVector::testAndSet(size_t i)
 {
-    size_t byte = i / 8;
-    assert(byte < m_data.size());
-    size_t offset = i - byte * 8;
-    m_data[byte].set(offset, v);
+    size_t word = i >> 6;
+    assert(word < m_data.size());
+    uint64_t mask = (uint64_t)1 << (i & 63);
+
+    // Most calls find the bit already set, avoid the atomic operation in this case
+    const volatile uint64_t* pWord = &m_data[word];
+    if(*pWord & mask)
+        return false;
+
+    uint64_t previous = __sync_fetch_and_or(&m_data[word], mask);
+    return !(previous & mask);
 }
 
-// Test bit i
-bool BitVector::test(size_t i) const
+//
+size_t BitVector::claimRange(size_t begin, size_t end, std::vector<size_t>* pClaimed)
 {
-    size_t byte = i / 8;
-    size_t offset = i - byte * 8;
-    return m_data[byte].test(offset);
+    assert(begin <= end);
+    assert(end <= capacity());
+
+    size_t num_claimed = 0;
+    size_t i = begin;
+    while(i < end)
+    {
+        // Build the mask of the bits of [i, end) in this word
+        size_t word = i >> 6;
+        size_t first_bit = i & 63;
+        size_t last_bit = std::min((size_t)64, first_bit + (end - i));
+        uint64_t mask = ~(uint64_t)0 << first_bit;
+        if(last_bit < 64)
+            mask &= ((uint64_t)1 << last_bit) - 1;
+
+        // Skip the atomic operation if all the bits are already set.
+        // This avoids taking the cache line exclusively when another thread has claimed the range.
+        const volatile uint64_t* pWord = &m_data[word];
+        uint64_t won = 0;
+        if((*pWord & mask) != mask)
+        {
+            uint64_t previous = __sync_fetch_and_or(&m_data[word], mask);
+            won = mask & ~previous;
+        }
+
+        num_claimed += __builtin_popcountll(won);
+        if(pClaimed != NULL)
+        {
+            while(won != 0)
+            {
+                pClaimed->push_back((word << 6) + __builtin_ctzll(won));
+                won &= won - 1;
+            }
+        }
+        i = (word + 1) << 6;
+    }
+    return num_claimed;
 }
 
+// Set bit at position i to value v
+// This is not atomic, the lock must be held if other threads may update the vector
+void BitVector::set(size_t i, bool v)
+{
+    size_t word = i >> 6;
+    assert(word < m_data.size());
+    uint64_t mask = (uint64_t)1 << (i & 63);
+    if(v)
+        m_data[word] |= mask;
+    else
+        m_data[word] &= ~mask;
+}
@@ -7,10 +7,17 @@
 // BitVector - Vector of bits. The structure
 // can be locked by a mutex to guarentee atomic access.
 //
+// The bits are stored in 64-bit words. The atomic
+// operations (updateCAS, testAndSet, claimRange) use
+// a single fetch-and-or/fetch-and-and on the word holding
+// the bit so they never have to retry when another thread
+// changes a neighbouring bit.
+//
 #ifndef BITVECTOR_H
 #define BITVECTOR_H
 
-#include "BitChar.h"
+#include <pthread.h>
+#include <stdint.h>
 #include <vector>
 
 class BitVector
@@ -28,21 +35,36 @@ class BitVector
         void lock();
         void unlock();
 
-        // Update the bit at position i from oldValue to newValue using a
-        // compare and swap operation. Returns true if the update is successful.
+        // Update the bit at position i from oldValue to newValue using an
+        // atomic operation. Returns true if the update is successful.
         bool updateCAS(size_t i, bool oldValue, bool newValue);
 
+        // Atomically set bit i. Returns true if this call changed the
+        // bit from false to true, false if it was already set.
+        bool testAndSet(size_t i);
+
+        // Atomically set the bits in [begin, end) using one operation per word.
+        // Returns the number of bits that were changed from false to true by this call.
+        // If pClaimed is not NULL the positions of these bits are appended to it.
+        size_t claimRange(size_t begin, size_t end, std::vector<size_t>* pClaimed = NULL);
+
         void resize(size_t n);
         void set(size_t i, bool v);
-        bool test(size_t i) const;
 
-        size_t capacity() const { return m_data.size() * 8; }
+        //
+        inline bool test(size_t i) const
+        {
+            const volatile uint64_t* pWord = &m_data[i >> 6];
+            return (*pWord >> (i & 63)) & 1;
+        }
+
+        size_t capacity() const { return m_data.size() * 64; }
 
     private:
 
         void initializeMutex();
 
-        std::vector<BitChar> m_data;
+        std::vector<uint64_t> m_data;
         pthread_mutex_t m_mutex;
 };
 
@@ -43,7 +43,7 @@ void BloomFilter::add(const void* key, int num_bytes)
         MurmurHash3_x64_128(key, num_bytes, m_hashes[i], &h);
         size_t idx = h[0] % m_width;
 
-        bool was_set = m_bitvector.updateCAS(idx, false, true);
+        bool was_set = m_bitvector.testAndSet(idx);
 #if TRACK_OCCUPANCY
         // This call uses an atomic update and returns true if the
         // bit was sucessfully set
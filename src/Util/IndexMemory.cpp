@@ -0,0 +1,316 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// IndexMemory - Allocation of the large, read-only arrays
+// of the FM-index and sampled suffix array.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include "IndexMemory.h"
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+// The mempolicy mode of mbind that spreads pages round-robin over the nodes
+#define INDEX_MPOL_INTERLEAVE 3
+
+// The largest number of NUMA nodes handled
+#define INDEX_MAX_NODES 1024
+
+// Arrays smaller than this are allocated with operator new whatever the policy
+static const size_t MAPPED_THRESHOLD = 2 * 1024 * 1024;
+
+// Each allocation is preceded by a header recording how to free it.
+// The header size keeps the data aligned to a cache line.
+static const size_t HEADER_SIZE = 64;
+
+enum AllocationKind
+{
+    AK_HEAP,
+    AK_MAPPED
+};
+
+struct AllocationHeader
+{
+    size_t mappedBytes;
+    AllocationKind kind;
+};
+
+// The policy
+static IndexMemory::HugePageMode s_mode = IndexMemory::HPM_NONE;
+static bool s_interleave = false;
+
+// Bytes mapped for each kind of page. Indices can be loaded by several
+// threads at once so these are updated atomically.
+static size_t s_hugetlbBytes = 0;
+static size_t s_transparentBytes = 0;
+static size_t s_regularBytes = 0;
+static size_t s_interleavedBytes = 0;
+static int s_warnedFallback = 0;
+
+// Parse a list like 0-3,8,10-11 as used in /sys/devices/system/node
+static std::vector<int> parseList(const std::string& str)
+{
+    std::vector<int> out;
+    std::stringstream ss(str);
+    std::string range;
+    while(getline(ss, range, ','))
+    {
+        int first, last;
+        char dash;
+        std::stringstream rs(range);
+        if(!(rs >> first))
+            continue;
+        if(rs >> dash >> last)
+        {
+            for(int i = first; i <= last; ++i)
+                out.push_back(i);
+        }
+        else
+        {
+            out.push_back(first);
+        }
+    }
+    return out;
+}
+
+// Read the first line of a sysfs file, returning the empty string if it cannot be read
+static std::string readSysFile(const std::string& filename)
+{
+    std::ifstream reader(filename.c_str());
+    std::string line;
+    if(reader)
+        getline(reader, line);
+    return line;
+}
+
+// Return the ids of the NUMA nodes that are online
+static const std::vector<int>& getNodes()
+{
+    static std::vector<int> nodes;
+    static bool loaded = false;
+    if(!loaded)
+    {
+        nodes = parseList(readSysFile("/sys/devices/system/node/online"));
+        if(nodes.empty())
+            nodes.push_back(0);
+        loaded = true;
+    }
+    return nodes;
+}
+
+// Spread the pages of the mapping over all the nodes
+static bool interleave(void* ptr, size_t bytes)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    const std::vector<int>& nodes = getNodes();
+    if(nodes.size() < 2)
+        return false;
+
+    const size_t bitsPerWord = sizeof(unsigned long) * 8;
+    unsigned long mask[INDEX_MAX_NODES / (sizeof(unsigned long) * 8)] = { 0 };
+    for(size_t i = 0; i < nodes.size(); ++i)
+    {
+        if(nodes[i] < INDEX_MAX_NODES)
+            mask[nodes[i] / bitsPerWord] |= 1UL << (nodes[i] % bitsPerWord);
+    }
+    return syscall(SYS_mbind, ptr, bytes, INDEX_MPOL_INTERLEAVE, mask, INDEX_MAX_NODES + 1, 0) == 0;
+#else
+    (void)ptr;
+    (void)bytes;
+    return false;
+#endif
+}
+
+// Map an anonymous region of at least bytes bytes following the policy.
+// The length of the mapping is returned in mappedBytes.
+static void* mapRegion(size_t bytes, size_t& mappedBytes)
+{
+    void* ptr = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+    if(s_mode == IndexMemory::HPM_2M || s_mode == IndexMemory::HPM_1G)
+    {
+        int pageShift = s_mode == IndexMemory::HPM_2M ? 21 : 30;
+        size_t pageSize = (size_t)1 << pageShift;
+        mappedBytes = (bytes + pageSize - 1) & ~(pageSize - 1);
+        ptr = mmap(NULL, mappedBytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (pageShift << MAP_HUGE_SHIFT), -1, 0);
+
+        if(ptr != MAP_FAILED)
+            __sync_fetch_and_add(&s_hugetlbBytes, mappedBytes);
+        else if(__sync_bool_compare_and_swap(&s_warnedFallback, 0, 1))
+            std::cerr << "Warning: could not allocate " << mappedBytes / (1024 * 1024) << "MB of "
+                      << (pageSize >> 20) << "MB pages for the index, using transparent huge pages instead\n";
+    }
+#endif
+
+    if(ptr == MAP_FAILED)
+    {
+        mappedBytes = bytes;
+        ptr = mmap(NULL, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(ptr == MAP_FAILED)
+        {
+            std::cerr << "Error: could not map " << mappedBytes << " bytes for the index\n";
+            exit(EXIT_FAILURE);
+        }
+
+        bool bTransparent = false;
+#if defined(MADV_HUGEPAGE)
+        if(s_mode != IndexMemory::HPM_NONE)
+            bTransparent = madvise(ptr, mappedBytes, MADV_HUGEPAGE) == 0;
+#endif
+        if(bTransparent)
+            __sync_fetch_and_add(&s_transparentBytes, mappedBytes);
+        else
+            __sync_fetch_and_add(&s_regularBytes, mappedBytes);
+    }
+
+    // The policy must be set before the pages are first touched
+    if(s_interleave && interleave(ptr, mappedBytes))
+        __sync_fetch_and_add(&s_interleavedBytes, mappedBytes);
+    return ptr;
+}
+
+//
+bool IndexMemory::parseHugePageMode(const std::string& str, HugePageMode& mode)
+{
+    if(str == "none")
+        mode = HPM_NONE;
+    else if(str == "thp")
+        mode = HPM_TRANSPARENT;
+    else if(str == "2m" || str == "2M")
+        mode = HPM_2M;
+    else if(str == "1g" || str == "1G")
+        mode = HPM_1G;
+    else
+        return false;
+    return true;
+}
+
+//
+void IndexMemory::setHugePageMode(HugePageMode mode)
+{
+    s_mode = mode;
+}
+
+//
+void IndexMemory::setInterleave(bool interleave)
+{
+    s_interleave = interleave;
+
+    // Look up the nodes now, before any worker thread needs them
+    getNodes();
+}
+
+//
+void* IndexMemory::allocate(size_t bytes)
+{
+    size_t total = bytes + HEADER_SIZE;
+    AllocationHeader header;
+    char* pBase;
+    if((s_mode == HPM_NONE && !s_interleave) || total < MAPPED_THRESHOLD)
+    {
+        pBase = static_cast<char*>(::operator new(total));
+        header.kind = AK_HEAP;
+        header.mappedBytes = 0;
+    }
+    else
+    {
+        pBase = static_cast<char*>(mapRegion(total, header.mappedBytes));
+        header.kind = AK_MAPPED;
+    }
+    *reinterpret_cast<AllocationHeader*>(pBase) = header;
+    return pBase + HEADER_SIZE;
+}
+
+//
+void IndexMemory::deallocate(void* ptr)
+{
+    if(ptr == NULL)
+        return;
+
+    char* pBase = static_cast<char*>(ptr) - HEADER_SIZE;
+    const AllocationHeader& header = *reinterpret_cast<AllocationHeader*>(pBase);
+    if(header.kind == AK_HEAP)
+        ::operator delete(pBase);
+    else
+        munmap(pBase, header.mappedBytes);
+}
+
+//
+void IndexMemory::pinThread(size_t threadIdx)
+{
+#if defined(__linux__) && defined(CPU_SET)
+    if(!s_interleave)
+        return;
+
+    const std::vector<int>& nodes = getNodes();
+    if(nodes.size() < 2)
+        return;
+
+    std::stringstream ss;
+    ss << "/sys/devices/system/node/node" << nodes[threadIdx % nodes.size()] << "/cpulist";
+    std::vector<int> cpus = parseList(readSysFile(ss.str()));
+    if(cpus.empty())
+        return;
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for(size_t i = 0; i < cpus.size(); ++i)
+        CPU_SET(cpus[i], &cpuSet);
+    if(sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0)
+        std::cerr << "Warning: could not pin thread " << threadIdx << " to NUMA node " << nodes[threadIdx % nodes.size()] << "\n";
+#else
+    (void)threadIdx;
+#endif
+}
+
+//
+size_t IndexMemory::getNumNodes()
+{
+    return getNodes().size();
+}
+
+//
+void IndexMemory::printInfo()
+{
+    if(s_mode == HPM_NONE && !s_interleave)
+        return;
+
+    double mb = (double)(1024 * 1024);
+    printf("Index Memory -- Huge pages: %.1lf MB Transparent huge pages requested: %.1lf MB Regular pages: %.1lf MB\n",
+           s_hugetlbBytes / mb, s_transparentBytes / mb, s_regularBytes / mb);
+
+    // Report how much of the process the kernel has actually backed with transparent huge pages
+    if(s_transparentBytes > 0)
+    {
+        std::ifstream reader("/proc/self/smaps_rollup");
+        std::string line;
+        while(getline(reader, line))
+        {
+            if(line.compare(0, 14, "AnonHugePages:") == 0)
+            {
+                size_t start = line.find_first_not_of(' ', 14);
+                printf("Transparent huge pages in use by the process: %s\n", line.substr(start).c_str());
+            }
+        }
+    }
+
+    if(s_interleave)
+        printf("Interleaved over %zu NUMA nodes: %.1lf MB\n", getNumNodes(), s_interleavedBytes / mb);
+}
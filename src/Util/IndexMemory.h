@@ -0,0 +1,112 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// IndexMemory - Allocation of the large, read-only arrays
+// of the FM-index and sampled suffix array.
+//
+// The rank queries jump around arrays that are far larger than
+// what the TLB covers with 4KB pages. Arrays allocated through
+// IndexAllocator can be backed by 2MB or 1GB pages, or by transparent
+// huge pages requested with madvise. On NUMA machines their pages
+// can be interleaved over all nodes so the worker threads do not
+// all read from the node of the thread that loaded the index, and the
+// worker threads of SequenceProcessFramework can be pinned to the nodes
+// in turn. The policy is set once, before the indices are loaded.
+// By default the arrays are allocated with operator new.
+//
+#ifndef INDEXMEMORY_H
+#define INDEXMEMORY_H
+
+#include <stddef.h>
+#include <limits>
+#include <new>
+#include <string>
+
+namespace IndexMemory
+{
+
+enum HugePageMode
+{
+    HPM_NONE, // regular pages
+    HPM_TRANSPARENT, // ask for transparent huge pages with madvise
+    HPM_2M, // 2MB pages from the hugetlb pool, falling back to HPM_TRANSPARENT
+    HPM_1G // 1GB pages from the hugetlb pool, falling back to HPM_TRANSPARENT
+};
+
+// Parse a mode named none, thp, 2m or 1g. Returns false if str is not one of these
+bool parseHugePageMode(const std::string& str, HugePageMode& mode);
+
+// Set the allocation policy. This must be called before any index is loaded
+void setHugePageMode(HugePageMode mode);
+void setInterleave(bool interleave);
+
+// Allocate and free memory for the index arrays
+void* allocate(size_t bytes);
+void deallocate(void* ptr);
+
+// If interleaving is on, bind the calling thread to the CPUs
+// of NUMA node (threadIdx % number of nodes). Otherwise this does nothing.
+void pinThread(size_t threadIdx);
+
+// Return the number of NUMA nodes that are online
+size_t getNumNodes();
+
+// Print how the index arrays were allocated, if the policy is not the default
+void printInfo();
+
+};
+
+// STL allocator placing the elements in memory from IndexMemory::allocate
+template<class T>
+class IndexAllocator
+{
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        template<class U>
+        struct rebind
+        {
+            typedef IndexAllocator<U> other;
+        };
+
+        IndexAllocator() {}
+        IndexAllocator(const IndexAllocator&) {}
+        template<class U> IndexAllocator(const IndexAllocator<U>&) {}
+
+        pointer address(reference x) const { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+
+        pointer allocate(size_type n, const void* /*hint*/ = 0)
+        {
+            if(n > max_size())
+                throw std::bad_alloc();
+            return static_cast<pointer>(IndexMemory::allocate(n * sizeof(T)));
+        }
+
+        void deallocate(pointer p, size_type /*n*/)
+        {
+            IndexMemory::deallocate(p);
+        }
+
+        size_type max_size() const { return std::numeric_limits<size_type>::max() / sizeof(T); }
+
+        void construct(pointer p, const T& val) { new(static_cast<void*>(p)) T(val); }
+        void destroy(pointer p) { p->~T(); }
+};
+
+// All IndexAllocators share the same memory so they are interchangeable
+template<class T, class U>
+inline bool operator==(const IndexAllocator<T>&, const IndexAllocator<U>&) { return true; }
+
+template<class T, class U>
+inline bool operator!=(const IndexAllocator<T>&, const IndexAllocator<U>&) { return false; }
+
+#endif
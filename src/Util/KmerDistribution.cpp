@@ -13,14 +13,40 @@
 #include <iostream>
 #include <limits>
 
-KmerDistribution::KmerDistribution()
+KmerDistribution::KmerDistribution() : m_total(0)
 {
 
 }
 
 void KmerDistribution::add(int kcount)
 {
-    m_data[kcount]++;
+    if(kcount >= 0 && kcount < KMER_DISTRIBUTION_DENSE_SIZE)
+    {
+        if(m_dense.empty())
+            m_dense.resize(KMER_DISTRIBUTION_DENSE_SIZE, 0);
+        m_dense[kcount]++;
+    }
+    else
+    {
+        m_overflow[kcount]++;
+    }
+    m_total++;
+}
+
+void KmerDistribution::merge(const KmerDistribution& other)
+{
+    if(!other.m_dense.empty())
+    {
+        if(m_dense.empty())
+            m_dense.resize(KMER_DISTRIBUTION_DENSE_SIZE, 0);
+        for(size_t i = 0; i < m_dense.size(); ++i)
+            m_dense[i] += other.m_dense[i];
+    }
+
+    std::map<int, size_t>::const_iterator iter = other.m_overflow.begin();
+    for(; iter != other.m_overflow.end(); ++iter)
+        m_overflow[iter->first] += iter->second;
+    m_total += other.m_total;
 }
 
 double KmerDistribution::getCumulativeProportionLEQ(int n) const
@@ -163,33 +189,28 @@ int KmerDistribution::findErrorBoundaryByRatio(double ratio) const
 std::vector<int> KmerDistribution::toCountVector(int max) const
 {
     std::vector<int> out;
-    if(m_data.empty())
+    if(m_total == 0)
         return out;
 
     int min = 0;
 
     for(int i = min; i <= max; ++i)
-    {
-        std::map<int,int>::const_iterator iter = m_data.find(i);
-        int v = (iter != m_data.end()) ? iter->second : 0;
-        out.push_back(v);
-    }
+        out.push_back(getNumberWithCount(i));
     return out;
 }
 
 size_t KmerDistribution::getTotalKmers() const
 {
-    size_t sum = 0;
-    std::map<int,int>::const_iterator iter = m_data.begin();
-    for(; iter != m_data.end(); ++iter)
-        sum += iter->second;
-    return sum;
+    return m_total;
 }
 
 size_t KmerDistribution::getNumberWithCount(size_t c) const
 {
-    std::map<int,int>::const_iterator iter = m_data.find(c);
-    if(iter != m_data.end())
+    if(c < KMER_DISTRIBUTION_DENSE_SIZE)
+        return m_dense.empty() ? 0 : m_dense[c];
+
+    std::map<int, size_t>::const_iterator iter = m_overflow.find((int)c);
+    if(iter != m_overflow.end())
         return iter->second;
     else
         return 0;
@@ -206,15 +227,31 @@ void KmerDistribution::print(FILE* fp, int max) const
     fprintf(fp, "Kmer coverage histogram\n");
     fprintf(fp, "cov\tcount\n");
 
-    int maxCount = 0;
-    std::map<int,int>::const_iterator iter = m_data.begin();
-    for(; iter != m_data.end(); ++iter)
+    // Negative counts are only in the overflow map and
+    // are printed first to keep the output in order of count
+    size_t maxCount = 0;
+    std::map<int, size_t>::const_iterator iter = m_overflow.begin();
+    for(; iter != m_overflow.end() && iter->first < 0; ++iter)
+        fprintf(fp, "%d\t%zu\n", iter->first, iter->second);
+
+    for(size_t i = 0; i < m_dense.size(); ++i)
+    {
+        if(m_dense[i] == 0)
+            continue;
+
+        if((int)i <= max)
+            fprintf(fp, "%zu\t%zu\n", i, m_dense[i]);
+        else
+            maxCount += m_dense[i];
+    }
+
+    for(; iter != m_overflow.end(); ++iter)
     {
         if(iter->first <= max)
-            fprintf(fp, "%d\t%d\n", iter->first, iter->second);
+            fprintf(fp, "%d\t%zu\n", iter->first, iter->second);
         else
             maxCount += iter->second;
     }
-    fprintf(fp, ">%d\t%d\n", max, maxCount);
+    fprintf(fp, ">%d\t%zu\n", max, maxCount);
 
 }
@@ -6,6 +6,11 @@
 //
 // KmerDistribution - Histogram of kmer frequencies
 //
+// The number of kmers seen with each count below KMER_DISTRIBUTION_DENSE_SIZE
+// is stored in an array so add() is a single increment. Larger counts are
+// rare and are kept in a map. Distributions are cheap to create and can be
+// merged, so threads can fill their own distribution and combine them at the end.
+//
 #ifndef KMERDISTRIBUTION_H
 #define KMERDISTRIBUTION_H
 
@@ -14,6 +19,8 @@
 #include <cstddef>
 #include <stdio.h>
 
+#define KMER_DISTRIBUTION_DENSE_SIZE 1024
+
 class KmerDistribution
 {
     public:
@@ -44,13 +51,24 @@ class KmerDistribution
         //
         int findFirstLocalMinimum() const;
         void add(int count);
+
+        // Add the counts of other to this distribution
+        void merge(const KmerDistribution& other);
         void print(int max) const; 
         void print(FILE* file, int max) const; 
 
     private:
 
-        // int -> int map of the number of times a kmer with multiplicty N has been seen
-        std::map<int,int> m_data;
+        // The number of times a kmer with multiplicity N has been seen, for N
+        // less than KMER_DISTRIBUTION_DENSE_SIZE. The array is allocated on the
+        // first add so that empty distributions are cheap.
+        std::vector<size_t> m_dense;
+
+        // The number of times a kmer with multiplicity N has been seen, for all other N
+        std::map<int, size_t> m_overflow;
+
+        // The number of kmers added
+        size_t m_total;
 };
 
 #endif
@@ -8,22 +8,77 @@
 //
 #include <iostream>
 #include <algorithm>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "QualityTable.h"
 #include "QualityCodec.h"
 #include "SeqReader.h"
 
+static const uint64_t QUALITY_TABLE_MAGIC_NUMBER = 0x51535432ULL; // "QST2"
+
+// The header of the table file. It is followed by dataSize bytes of
+// compressed blocks, padding to a multiple of 8 bytes and then
+// numBlocks + 1 block offsets.
+struct QSTHeader
+{
+    uint64_t magic;
+    uint64_t numReads;
+    uint64_t numBlocks;
+    uint64_t dataSize;
+};
+
+// Each compressed block is preceded by its uncompressed size
+typedef uint32_t BlockSizeType;
+
+// Append v to out using a variable number of bytes, 7 bits per byte
+static inline void writeVarint(std::string& out, size_t v)
+{
+    while(v >= 0x80)
+    {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+// Return the position of the block offsets in a file with dataSize bytes of blocks
+static inline size_t getOffsetsPosition(size_t dataSize)
+{
+    return sizeof(QSTHeader) + ((dataSize + 7) & ~(size_t)7);
+}
+
+// Read a variable-length integer starting at p and advance p past it
+static inline size_t readVarint(const char*& p)
+{
+    size_t v = 0;
+    int shift = 0;
+    uint8_t byte;
+    do
+    {
+        byte = static_cast<uint8_t>(*p++);
+        v |= static_cast<size_t>(byte & 0x7F) << shift;
+        shift += 7;
+    } while(byte & 0x80);
+    return v;
+}
+
 // Read the sequences from a file
-QualityTable::QualityTable() : m_bytes_used(0)
+QualityTable::QualityTable() : m_count(0), m_pBlockData(NULL), m_pBlockOffsets(NULL), m_numBlocks(0),
+                               m_pMapped(NULL), m_mappedSize(0)
 {
     int missing_phred = 20;
     m_missingQualityChar = Quality::phred2char(missing_phred);
+    updateViews();
 }
 
- 
+
 QualityTable::~QualityTable()
 {
-    for(size_t i = 0; i < m_table.size(); ++i)
-        delete m_table[i].encoded_data;
+    unmapFile();
 }
 
 //
@@ -35,34 +90,134 @@ void QualityTable::loadQualities(const std::string& filename)
         addQualityString(sr.qual);
 }
 
+//
+void QualityTable::loadQualities(const std::string& filename, const std::string& indexPrefix, size_t num_expected)
+{
+    if(!mapFile(filename, indexPrefix + QUALITY_TABLE_EXT, num_expected))
+        loadQualities(filename);
+}
+
 //
 void QualityTable::addQualityString(const std::string& qual)
 {
-    size_t num_bytes_required = m_codec.getRequiredUnits(qual.size());
-    QualityString incoming;
-    incoming.encoded_data = new QualityStorageUnit[num_bytes_required];
-    incoming.num_encoded_symbols = qual.size();
-    for(size_t i = 0; i < qual.size(); ++i)
-        m_codec.store(incoming.encoded_data, i, qual[i]);
-    m_table.push_back(incoming);
+    assert(m_pMapped == NULL);
+    m_pendingQuals.push_back(qual);
+    ++m_count;
 
-    //std::cout << "Stored:  " << qual << "\n";
-    //std::cout << "Decoded: " << getQualityString(m_table.size() - 1, qual.size()) << "\n";
-    m_bytes_used += (sizeof(incoming) + num_bytes_required);
+    if(m_pendingQuals.size() == QUALITY_BLOCK_SIZE)
+        flushBlock();
+}
+
+// Compress the quality strings of a block and append the block to out.
+// The block is stored as the lengths of the quality strings followed by the binned
+// quality values, one byte each. The bytes are left unpacked as zlib compresses them
+// better than two bins per byte.
+static void appendBlock(const std::vector<std::string>& quals, const QualityCodec<4>& codec, std::string& out)
+{
+    std::string raw;
+    for(size_t i = 0; i < quals.size(); ++i)
+        writeVarint(raw, quals[i].size());
+
+    for(size_t i = 0; i < quals.size(); ++i)
+    {
+        const std::string& qual = quals[i];
+        for(size_t j = 0; j < qual.size(); ++j)
+            raw.push_back(static_cast<char>(codec.encode(qual[j])));
+    }
+
+    uLongf compressedSize = compressBound(raw.size());
+    std::vector<Bytef> compressed(compressedSize);
+    if(compress2(&compressed[0], &compressedSize, reinterpret_cast<const Bytef*>(raw.data()), raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        std::cerr << "Error: could not compress quality values\n";
+        exit(EXIT_FAILURE);
+    }
+
+    BlockSizeType rawSize = raw.size();
+    out.append(reinterpret_cast<const char*>(&rawSize), sizeof(rawSize));
+    out.append(reinterpret_cast<const char*>(&compressed[0]), compressedSize);
+}
+
+//
+void QualityTable::flushBlock()
+{
+    if(m_pendingQuals.empty())
+        return;
+
+    if(m_blockOffsets.empty())
+        m_blockOffsets.push_back(0);
+
+    appendBlock(m_pendingQuals, m_codec, m_blockData);
+    m_blockOffsets.push_back(m_blockData.size());
+
+    m_pendingQuals.clear();
+    updateViews();
+}
+
+//
+void QualityTable::updateViews()
+{
+    if(m_pMapped != NULL)
+        return;
+
+    m_pBlockData = m_blockData.data();
+    m_pBlockOffsets = m_blockOffsets.empty() ? NULL : &m_blockOffsets[0];
+    m_numBlocks = m_blockOffsets.empty() ? 0 : m_blockOffsets.size() - 1;
 }
 
 //
 std::string QualityTable::getQualityString(size_t idx, size_t n) const
 {
     // If there is no quality string for this index, return default qualities
-    if(idx >= m_table.size())
+    if(idx >= m_count)
         return std::string(n, m_missingQualityChar);
 
-    QualityString encoded = m_table[idx];
     std::string out;
-    out.reserve(encoded.num_encoded_symbols);
-    for(size_t i = 0; i < encoded.num_encoded_symbols; ++i)
-        out.push_back(m_codec.get(encoded.encoded_data, i));
+    size_t blockIdx = idx / QUALITY_BLOCK_SIZE;
+    if(blockIdx >= m_numBlocks)
+    {
+        // The string is in the partial block that has not been compressed
+        const std::string& qual = m_pendingQuals[idx % QUALITY_BLOCK_SIZE];
+        out.reserve(qual.size());
+        for(size_t i = 0; i < qual.size(); ++i)
+            out.push_back(m_codec.decode(m_codec.encode(qual[i])));
+        assert(out.length() == n);
+        return out;
+    }
+
+    // Decompress the block
+    const char* pBlock = m_pBlockData + m_pBlockOffsets[blockIdx];
+    BlockSizeType rawSize;
+    memcpy(&rawSize, pBlock, sizeof(rawSize));
+    uLongf decompressedSize = rawSize;
+    std::vector<char> raw(rawSize);
+    uLong compressedSize = m_pBlockOffsets[blockIdx + 1] - m_pBlockOffsets[blockIdx] - sizeof(rawSize);
+    if(uncompress(reinterpret_cast<Bytef*>(&raw[0]), &decompressedSize,
+                  reinterpret_cast<const Bytef*>(pBlock + sizeof(rawSize)), compressedSize) != Z_OK ||
+       decompressedSize != rawSize)
+    {
+        std::cerr << "Error: could not decompress quality values\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Find the position of the string in the block
+    const char* p = &raw[0];
+    size_t offset = 0;
+    size_t length = 0;
+    size_t numInBlock = std::min((size_t)QUALITY_BLOCK_SIZE, m_count - blockIdx * QUALITY_BLOCK_SIZE);
+    for(size_t i = 0; i < numInBlock; ++i)
+    {
+        size_t l = readVarint(p);
+        if(i < idx % QUALITY_BLOCK_SIZE)
+            offset += l;
+        else if(i == idx % QUALITY_BLOCK_SIZE)
+            length = l;
+    }
+
+    const char* pSymbols = p + offset;
+    out.reserve(length);
+    for(size_t i = 0; i < length; ++i)
+        out.push_back(m_codec.decode(static_cast<uint8_t>(pSymbols[i])));
     assert(out.length() == n);
     return out;
 }
@@ -70,12 +225,194 @@ std::string QualityTable::getQualityString(size_t idx, size_t n) const
 //
 size_t QualityTable::getCount() const
 {
-    return m_table.size();
+    return m_count;
+}
+
+//
+void QualityTable::clear()
+{
+    unmapFile();
+    m_count = 0;
+    m_blockData.clear();
+    m_blockOffsets.clear();
+    m_pendingQuals.clear();
+    updateViews();
+}
+
+// Map the table in filename. Returns false if the file is missing, older
+// than the reads or holds a different number of reads than the index
+bool QualityTable::mapFile(const std::string& readsFilename, const std::string& filename, size_t num_expected)
+{
+    struct stat readsStat;
+    struct stat tableStat;
+    if(stat(filename.c_str(), &tableStat) != 0)
+        return false;
+
+    if(stat(readsFilename.c_str(), &readsStat) == 0 && tableStat.st_mtime < readsStat.st_mtime)
+    {
+        std::cerr << "Warning: " << filename << " is older than " << readsFilename << ", ignoring it\n";
+        return false;
+    }
+
+    if((size_t)tableStat.st_size < sizeof(QSTHeader))
+        return false;
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    void* pMapped = mmap(NULL, tableStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(pMapped == MAP_FAILED)
+        return false;
+
+    const char* pData = static_cast<const char*>(pMapped);
+    QSTHeader header;
+    memcpy(&header, pData, sizeof(header));
+
+    size_t numOffsets = header.numBlocks > 0 ? header.numBlocks + 1 : 0;
+    size_t offsetsPosition = getOffsetsPosition(header.dataSize);
+    size_t expectedSize = offsetsPosition + numOffsets * sizeof(uint64_t);
+    bool valid = header.magic == QUALITY_TABLE_MAGIC_NUMBER && expectedSize == (size_t)tableStat.st_size;
+    if(valid && num_expected > 0 && header.numReads != num_expected)
+    {
+        std::cerr << "Warning: " << filename << " has " << header.numReads << " reads but the index has " << num_expected << ", ignoring it\n";
+        valid = false;
+    }
+
+    if(!valid)
+    {
+        munmap(pMapped, tableStat.st_size);
+        return false;
+    }
+
+    clear();
+    m_pMapped = pMapped;
+    m_mappedSize = tableStat.st_size;
+    m_count = header.numReads;
+    m_numBlocks = header.numBlocks;
+    m_pBlockOffsets = reinterpret_cast<const uint64_t*>(pData + offsetsPosition);
+    m_pBlockData = pData + sizeof(header);
+    return true;
+}
+
+//
+void QualityTable::unmapFile()
+{
+    if(m_pMapped != NULL)
+    {
+        munmap(m_pMapped, m_mappedSize);
+        m_pMapped = NULL;
+        m_mappedSize = 0;
+    }
 }
 
 //
 void QualityTable::printSize() const
 {
-    printf("QualityTable: %.2lfGB\n", (double)m_bytes_used / (1000 * 1000 * 1000));
+    size_t bytes_used = m_mappedSize > 0 ? m_mappedSize : m_blockData.size() + m_blockOffsets.size() * sizeof(uint64_t);
+    printf("QualityTable: %.2lfGB\n", (double)bytes_used / (1000 * 1000 * 1000));
 }
 
+//
+QualityTableWriter::QualityTableWriter(const std::string& filename) : m_filename(filename),
+                                                                      m_offsetsFilename(filename + ".offsets.tmp"),
+                                                                      m_isOpen(true),
+                                                                      m_count(0),
+                                                                      m_numBlocks(0),
+                                                                      m_dataSize(0)
+{
+    m_writer.open(m_filename.c_str(), std::ios::out | std::ios::binary);
+    m_offsetsWriter.open(m_offsetsFilename.c_str(), std::ios::out | std::ios::binary);
+    if(!m_writer || !m_offsetsWriter)
+    {
+        std::cerr << "Error: could not open " << m_filename << " for writing\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Leave room for the header, which is written when the table is closed
+    QSTHeader header;
+    memset(&header, 0, sizeof(header));
+    m_writer.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+//
+QualityTableWriter::~QualityTableWriter()
+{
+    close();
+}
+
+//
+void QualityTableWriter::addQualityString(const std::string& qual)
+{
+    assert(m_isOpen);
+    m_pendingQuals.push_back(qual);
+    ++m_count;
+
+    if(m_pendingQuals.size() == QUALITY_BLOCK_SIZE)
+        flushBlock();
+}
+
+//
+void QualityTableWriter::flushBlock()
+{
+    if(m_pendingQuals.empty())
+        return;
+
+    if(m_numBlocks == 0)
+    {
+        uint64_t first = 0;
+        m_offsetsWriter.write(reinterpret_cast<const char*>(&first), sizeof(first));
+    }
+
+    std::string block;
+    appendBlock(m_pendingQuals, m_codec, block);
+    m_writer.write(block.data(), block.size());
+    m_dataSize += block.size();
+    m_numBlocks += 1;
+    m_offsetsWriter.write(reinterpret_cast<const char*>(&m_dataSize), sizeof(m_dataSize));
+    m_pendingQuals.clear();
+}
+
+//
+void QualityTableWriter::close()
+{
+    if(!m_isOpen)
+        return;
+    m_isOpen = false;
+
+    flushBlock();
+    m_offsetsWriter.close();
+
+    // Pad the blocks so the offsets are aligned
+    size_t offsetsPosition = getOffsetsPosition(m_dataSize);
+    size_t padding = offsetsPosition - sizeof(QSTHeader) - m_dataSize;
+    const char zeros[8] = { 0 };
+    m_writer.write(zeros, padding);
+
+    // Copy the offsets to the end of the table
+    std::ifstream offsetsReader(m_offsetsFilename.c_str(), std::ios::in | std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    while(offsetsReader)
+    {
+        offsetsReader.read(&buffer[0], buffer.size());
+        m_writer.write(&buffer[0], offsetsReader.gcount());
+    }
+    offsetsReader.close();
+    unlink(m_offsetsFilename.c_str());
+
+    QSTHeader header;
+    header.magic = QUALITY_TABLE_MAGIC_NUMBER;
+    header.numReads = m_count;
+    header.numBlocks = m_numBlocks;
+    header.dataSize = m_dataSize;
+    m_writer.seekp(0);
+    m_writer.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_writer.close();
+
+    if(m_writer.fail())
+    {
+        std::cerr << "Error: could not write " << m_filename << "\n";
+        exit(EXIT_FAILURE);
+    }
+}
@@ -6,20 +6,25 @@
 //
 // QualityTable - A 0-indexed table of quality scores
 //
+// The quality scores are binned by QualityCodec and the reads are
+// grouped into blocks of QUALITY_BLOCK_SIZE. Each block holds the lengths
+// of its reads followed by one bin per quality value, and is compressed with zlib.
+// An offset table gives random access to the blocks, so a lookup only
+// decompresses the block of the requested read.
+//
+// sga index --qualities writes the table to PREFIX.qst with a QualityTableWriter,
+// which can be memory-mapped instead of parsing the FASTQ file.
+//
 #ifndef QUALITYTABLE_H
 #define QUALITYTABLE_H
 #include "Util.h"
 #include "SeqReader.h"
 #include "QualityCodec.h"
 #include <map>
+#include <fstream>
 
-struct QualityString
-{
-    uint8_t num_encoded_symbols;
-    QualityStorageUnit* encoded_data;
-};
-
-typedef std::vector<QualityString> QualityStringVector;
+#define QUALITY_TABLE_EXT ".qst"
+#define QUALITY_BLOCK_SIZE 64
 
 class QualityTable
 {
@@ -29,8 +34,15 @@ class QualityTable
         QualityTable();
         ~QualityTable();
 
-        //
+        // Parse the quality strings of the reads in filename
         void loadQualities(const std::string& filename);
+
+        // Load the qualities for the reads in filename, which were indexed with indexPrefix.
+        // If indexPrefix.qst exists, is not older than the reads and holds num_expected
+        // reads it is memory-mapped, otherwise the reads are parsed. A num_expected of 0
+        // skips the check of the read count.
+        void loadQualities(const std::string& filename, const std::string& indexPrefix, size_t num_expected);
+
         void addQualityString(const std::string& qual);
         std::string getQualityString(size_t idx, size_t n) const;
         size_t getCount() const;
@@ -40,10 +52,78 @@ class QualityTable
         void printSize() const;
 
     private:
+
+        // Not allowed
+        QualityTable(const QualityTable&);
+        QualityTable& operator=(const QualityTable&);
+
+        bool mapFile(const std::string& readsFilename, const std::string& filename, size_t num_expected);
+        void unmapFile();
+
+        // Compress the pending quality strings into a new block
+        void flushBlock();
+
+        // Point the block views at the in-memory data
+        void updateViews();
+
         QualityCodec<4> m_codec;
-        QualityStringVector m_table;
-        size_t m_bytes_used;
         char m_missingQualityChar;
+
+        // The number of quality strings in the table
+        size_t m_count;
+
+        // In-memory storage, used when the table is not mapped from disk.
+        // The strings of a partial block are kept uncompressed.
+        std::string m_blockData;
+        std::vector<uint64_t> m_blockOffsets;
+        std::vector<std::string> m_pendingQuals;
+
+        // Views of the blocks, either into the storage above or the mapped file.
+        // Block i is stored in [m_pBlockOffsets[i], m_pBlockOffsets[i + 1]) of m_pBlockData.
+        const char* m_pBlockData;
+        const uint64_t* m_pBlockOffsets;
+        size_t m_numBlocks;
+
+        // The mapped file, if any
+        void* m_pMapped;
+        size_t m_mappedSize;
+};
+
+// Write a table file one block at a time, so the qualities of
+// a large read set do not need to be held in memory. Each block is
+// written as soon as it is full. The block offsets are streamed to a
+// temporary file and appended to the table when it is closed.
+class QualityTableWriter
+{
+    public:
+        QualityTableWriter(const std::string& filename);
+        ~QualityTableWriter();
+
+        void addQualityString(const std::string& qual);
+
+        // Write the last block and the offsets and complete the header.
+        // This is called by the destructor if it has not been called already.
+        void close();
+
+    private:
+
+        // Not allowed
+        QualityTableWriter(const QualityTableWriter&);
+        QualityTableWriter& operator=(const QualityTableWriter&);
+
+        void flushBlock();
+
+        std::string m_filename;
+        std::string m_offsetsFilename;
+        std::ofstream m_writer;
+        std::ofstream m_offsetsWriter;
+        bool m_isOpen;
+
+        QualityCodec<4> m_codec;
+        std::vector<std::string> m_pendingQuals;
+        size_t m_count;
+        size_t m_numBlocks;
+        uint64_t m_dataSize;
 };
 
 #endif
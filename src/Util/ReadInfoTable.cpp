@@ -10,23 +10,115 @@
 //
 #include <iostream>
 #include <algorithm>
+#include <limits>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ReadInfoTable.h"
 #include "SeqReader.h"
 
+static const uint64_t RIT_MAGIC_NUMBER = 0x52495431ULL; // "RIT1"
+
+// The header of the table file. It is followed by the length blocks, the packed length
+// words, the name block offsets and the name pool. Every section but the last
+// is a multiple of 8 bytes so the mapped sections stay aligned.
+struct RITHeader
+{
+    uint64_t magic;
+    uint64_t numReads;
+    uint64_t hasNames;
+    uint64_t numLengthBlocks;
+    uint64_t numLengthWords;
+    uint64_t numNameBlocks;
+    uint64_t namePoolSize;
+};
+
+// Append v to out using a variable number of bytes, 7 bits per byte
+static inline void writeVarint(std::string& out, size_t v)
+{
+    while(v >= 0x80)
+    {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+// Read a variable-length integer starting at p and advance p past it
+static inline size_t readVarint(const char*& p)
+{
+    size_t v = 0;
+    int shift = 0;
+    uint8_t byte;
+    do
+    {
+        byte = static_cast<uint8_t>(*p++);
+        v |= static_cast<size_t>(byte & 0x7F) << shift;
+        shift += 7;
+    } while(byte & 0x80);
+    return v;
+}
+
+//
+ReadInfoTable::ReadInfoTable()
+{
+    init(RIO_NONE);
+}
+
 // Read the sequences from a file
-ReadInfoTable::ReadInfoTable(std::string filename, 
-                             size_t num_expected, 
-                             ReadInfoOption option) : m_numericIDs(false)
+ReadInfoTable::ReadInfoTable(std::string filename,
+                             size_t num_expected,
+                             ReadInfoOption option)
+{
+    init(option);
+    loadReads(filename, num_expected);
+}
+
+// Map the table written by the indexer, falling back to the reads
+ReadInfoTable::ReadInfoTable(std::string filename,
+                             std::string indexPrefix,
+                             size_t num_expected,
+                             ReadInfoOption option)
+{
+    init(option);
+    if(!mapFile(filename, indexPrefix + RIT_EXT, num_expected))
+        loadReads(filename, num_expected);
+}
+
+//
+ReadInfoTable::~ReadInfoTable()
+{
+    unmapFile();
+}
+
+//
+void ReadInfoTable::init(ReadInfoOption option)
 {
     // Do not store actual ids, use a numeric id equal to the table index
-    if(option == RIO_NUMERICID)
-        m_numericIDs = true;
+    m_numericIDs = option == RIO_NUMERICID;
+    m_hasNames = !m_numericIDs;
+    m_count = 0;
+    m_finalized = false;
+    m_pLengthBlocks = NULL;
+    m_pLengthWords = NULL;
+    m_pNameBlockOffsets = NULL;
+    m_pNamePool = NULL;
+    m_numNameBlocks = 0;
+    m_namePoolSize = 0;
+    m_pMapped = NULL;
+    m_mappedSize = 0;
+}
 
+//
+void ReadInfoTable::loadReads(const std::string& filename, size_t num_expected)
+{
     if(num_expected > 0)
     {
-        m_lengths.reserve(num_expected);
-        if(!m_numericIDs)
-            m_ids.reserve(num_expected);
+        m_lengthBlocks.reserve(num_expected / RIT_LENGTH_BLOCK_SIZE + 1);
+        if(m_hasNames)
+            m_nameBlockOffsets.reserve(num_expected / RIT_NAME_BLOCK_SIZE + 1);
     }
 
     SeqReader reader(filename);
@@ -34,26 +126,224 @@ ReadInfoTable::ReadInfoTable(std::string filename,
 
     // Load the lengths and ids
     while(reader.get(sr))
+        addRead(sr.id, sr.seq.length());
+    finalize();
+}
+
+// Map the table in filename. Returns false if the file is missing, older than
+// the reads or does not match what the caller needs
+bool ReadInfoTable::mapFile(const std::string& readsFilename, const std::string& filename, size_t num_expected)
+{
+    struct stat readsStat;
+    struct stat tableStat;
+    if(stat(filename.c_str(), &tableStat) != 0)
+        return false;
+
+    if(stat(readsFilename.c_str(), &readsStat) == 0 && tableStat.st_mtime < readsStat.st_mtime)
+    {
+        std::cerr << "Warning: " << filename << " is older than " << readsFilename << ", ignoring it\n";
+        return false;
+    }
+
+    if((size_t)tableStat.st_size < sizeof(RITHeader))
+        return false;
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    void* pMapped = mmap(NULL, tableStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(pMapped == MAP_FAILED)
+        return false;
+
+    const char* pData = static_cast<const char*>(pMapped);
+    RITHeader header;
+    memcpy(&header, pData, sizeof(header));
+
+    size_t expectedSize = sizeof(header) +
+                          header.numLengthBlocks * sizeof(LengthBlock) +
+                          header.numLengthWords * sizeof(uint64_t) +
+                          header.numNameBlocks * sizeof(uint64_t) +
+                          header.namePoolSize;
+
+    bool valid = header.magic == RIT_MAGIC_NUMBER && expectedSize == (size_t)tableStat.st_size;
+    if(valid && num_expected > 0 && header.numReads != num_expected)
+    {
+        std::cerr << "Warning: " << filename << " has " << header.numReads << " reads but the index has " << num_expected << ", ignoring it\n";
+        valid = false;
+    }
+
+    // The names are required unless numeric ids are used
+    if(!valid || (!header.hasNames && !m_numericIDs))
+    {
+        munmap(pMapped, tableStat.st_size);
+        return false;
+    }
+
+    m_pMapped = pMapped;
+    m_mappedSize = tableStat.st_size;
+    m_count = header.numReads;
+    m_hasNames = header.hasNames;
+    m_finalized = true;
+
+    pData += sizeof(header);
+    m_pLengthBlocks = reinterpret_cast<const LengthBlock*>(pData);
+    pData += header.numLengthBlocks * sizeof(LengthBlock);
+    m_pLengthWords = reinterpret_cast<const uint64_t*>(pData);
+    pData += header.numLengthWords * sizeof(uint64_t);
+    m_pNameBlockOffsets = reinterpret_cast<const uint64_t*>(pData);
+    pData += header.numNameBlocks * sizeof(uint64_t);
+    m_pNamePool = pData;
+    m_numNameBlocks = header.numNameBlocks;
+    m_namePoolSize = header.namePoolSize;
+    return true;
+}
+
+//
+void ReadInfoTable::unmapFile()
+{
+    if(m_pMapped != NULL)
+    {
+        munmap(m_pMapped, m_mappedSize);
+        m_pMapped = NULL;
+        m_mappedSize = 0;
+    }
+}
+
+//
+void ReadInfoTable::addRead(const std::string& id, size_t length)
+{
+    assert(!m_finalized);
+    assert(length <= std::numeric_limits<uint32_t>::max());
+
+    m_pendingLengths.push_back(length);
+    if(m_pendingLengths.size() == RIT_LENGTH_BLOCK_SIZE)
+        flushLengths();
+
+    if(m_hasNames)
     {
-        m_lengths.push_back(sr.seq.length());
-        if(!m_numericIDs)
+        if(m_count % RIT_NAME_BLOCK_SIZE == 0)
         {
-            m_ids.push_back(sr.id);
+            // Start a new block with the full name
+            m_nameBlockOffsets.push_back(m_namePool.size());
+            writeVarint(m_namePool, id.size());
+            m_namePool.append(id);
+        }
+        else
+        {
+            size_t prefixLength = 0;
+            size_t maxPrefix = std::min(id.size(), m_prevName.size());
+            while(prefixLength < maxPrefix && id[prefixLength] == m_prevName[prefixLength])
+                ++prefixLength;
+
+            writeVarint(m_namePool, prefixLength);
+            writeVarint(m_namePool, id.size() - prefixLength);
+            m_namePool.append(id, prefixLength, std::string::npos);
         }
+        m_prevName = id;
     }
+    ++m_count;
 }
 
-// 
-ReadInfoTable::~ReadInfoTable()
+//
+void ReadInfoTable::flushLengths()
 {
+    if(m_pendingLengths.empty())
+        return;
+
+    uint32_t minLength = *std::min_element(m_pendingLengths.begin(), m_pendingLengths.end());
+    uint32_t maxLength = *std::max_element(m_pendingLengths.begin(), m_pendingLengths.end());
 
+    LengthBlock block;
+    block.base = minLength;
+    block.bits = 0;
+    while(block.bits < 32 && ((uint64_t)1 << block.bits) <= (uint64_t)(maxLength - minLength))
+        ++block.bits;
+    block.wordOffset = m_lengthWords.size();
+
+    size_t numBits = block.bits * m_pendingLengths.size();
+    m_lengthWords.resize(m_lengthWords.size() + (numBits + 63) / 64, 0);
+    for(size_t i = 0; i < m_pendingLengths.size() && block.bits > 0; ++i)
+    {
+        uint64_t v = m_pendingLengths[i] - minLength;
+        size_t bitPos = i * block.bits;
+        size_t wordIdx = block.wordOffset + bitPos / 64;
+        size_t shift = bitPos % 64;
+        m_lengthWords[wordIdx] |= v << shift;
+        if(shift + block.bits > 64)
+            m_lengthWords[wordIdx + 1] |= v >> (64 - shift);
+    }
+
+    m_lengthBlocks.push_back(block);
+    m_pendingLengths.clear();
+}
+
+//
+void ReadInfoTable::finalize()
+{
+    if(m_finalized)
+        return;
+
+    flushLengths();
+    m_pLengthBlocks = m_lengthBlocks.empty() ? NULL : &m_lengthBlocks[0];
+    m_pLengthWords = m_lengthWords.empty() ? NULL : &m_lengthWords[0];
+    m_pNameBlockOffsets = m_nameBlockOffsets.empty() ? NULL : &m_nameBlockOffsets[0];
+    m_pNamePool = m_namePool.data();
+    m_numNameBlocks = m_nameBlockOffsets.size();
+    m_namePoolSize = m_namePool.size();
+    m_prevName.clear();
+    m_finalized = true;
+}
+
+//
+void ReadInfoTable::write(const std::string& filename)
+{
+    finalize();
+
+    RITHeader header;
+    header.magic = RIT_MAGIC_NUMBER;
+    header.numReads = m_count;
+    header.hasNames = m_hasNames;
+    header.numLengthBlocks = (m_count + RIT_LENGTH_BLOCK_SIZE - 1) / RIT_LENGTH_BLOCK_SIZE;
+    header.numLengthWords = 0;
+    header.numNameBlocks = m_hasNames ? m_numNameBlocks : 0;
+    header.namePoolSize = m_hasNames ? m_namePoolSize : 0;
+
+    // The words of the last block end the length data
+    if(header.numLengthBlocks > 0)
+    {
+        const LengthBlock& last = m_pLengthBlocks[header.numLengthBlocks - 1];
+        size_t lastCount = m_count - (header.numLengthBlocks - 1) * RIT_LENGTH_BLOCK_SIZE;
+        header.numLengthWords = last.wordOffset + (last.bits * lastCount + 63) / 64;
+    }
+
+    std::ostream* pWriter = createWriter(filename, std::ios::out | std::ios::binary);
+    pWriter->write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pWriter->write(reinterpret_cast<const char*>(m_pLengthBlocks), header.numLengthBlocks * sizeof(LengthBlock));
+    pWriter->write(reinterpret_cast<const char*>(m_pLengthWords), header.numLengthWords * sizeof(uint64_t));
+    pWriter->write(reinterpret_cast<const char*>(m_pNameBlockOffsets), header.numNameBlocks * sizeof(uint64_t));
+    pWriter->write(m_pNamePool, header.namePoolSize);
+    delete pWriter;
 }
 
 //
 size_t ReadInfoTable::getReadLength(size_t idx) const
 {
-    assert(idx < m_lengths.size());
-    return m_lengths[idx];
+    assert(m_finalized);
+    assert(idx < m_count);
+
+    const LengthBlock& block = m_pLengthBlocks[idx / RIT_LENGTH_BLOCK_SIZE];
+    if(block.bits == 0)
+        return block.base;
+
+    size_t bitPos = (idx % RIT_LENGTH_BLOCK_SIZE) * block.bits;
+    const uint64_t* pWord = m_pLengthWords + block.wordOffset + bitPos / 64;
+    size_t shift = bitPos % 64;
+    uint64_t v = pWord[0] >> shift;
+    if(shift + block.bits > 64)
+        v |= pWord[1] << (64 - shift);
+    return block.base + (v & (((uint64_t)1 << block.bits) - 1));
 }
 
 //
@@ -61,8 +351,24 @@ std::string ReadInfoTable::getReadID(size_t idx) const
 {
     if(!m_numericIDs)
     {
-        assert(idx < m_ids.size());
-        return m_ids[idx];
+        assert(m_finalized && m_hasNames);
+        assert(idx < m_count);
+
+        // Decode the names of the block up to idx
+        const char* p = m_pNamePool + m_pNameBlockOffsets[idx / RIT_NAME_BLOCK_SIZE];
+        size_t length = readVarint(p);
+        std::string name(p, length);
+        p += length;
+
+        for(size_t i = 0; i < idx % RIT_NAME_BLOCK_SIZE; ++i)
+        {
+            size_t prefixLength = readVarint(p);
+            size_t suffixLength = readVarint(p);
+            name.resize(prefixLength);
+            name.append(p, suffixLength);
+            p += suffixLength;
+        }
+        return name;
     }
     else
     {
@@ -83,22 +389,26 @@ const ReadInfo ReadInfoTable::getReadInfo(size_t idx) const
 //
 size_t ReadInfoTable::getCount() const
 {
-    return m_lengths.size();
+    return m_count;
 }
 
-// 
+//
 size_t ReadInfoTable::countSumLengths() const
 {
     size_t sum = 0;
-    for(size_t i = 0; i < m_lengths.size(); ++i)
-        sum += m_lengths[i];
+    for(size_t i = 0; i < m_count; ++i)
+        sum += getReadLength(i);
     return sum;
 }
 
 //
 void ReadInfoTable::clear()
 {
-    m_lengths.clear();
-    m_ids.clear();
+    unmapFile();
+    m_lengthBlocks.clear();
+    m_lengthWords.clear();
+    m_pendingLengths.clear();
+    m_nameBlockOffsets.clear();
+    m_namePool.clear();
+    init(m_numericIDs ? RIO_NUMERICID : RIO_NONE);
 }
-
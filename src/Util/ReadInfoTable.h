@@ -7,12 +7,26 @@
 // ReadInfoTable - A 0-indexed table of ID, length pairs
 // Used to convert suffix array hits to overlaps
 //
+// The table is stored compactly. The lengths are split into
+// blocks of RIT_LENGTH_BLOCK_SIZE reads, and each length is
+// bit-packed as its difference from the smallest length in its block.
+// The IDs are front-coded in blocks of RIT_NAME_BLOCK_SIZE reads: the first
+// ID of a block is stored in full, and each later ID is stored as the length
+// of the prefix it shares with the previous ID followed by the rest of the ID.
+//
+// sga index writes the table to PREFIX.rit. If that file is present and
+// up to date, it is memory-mapped instead of parsing the reads file.
+//
 #ifndef READINFOTABLE_H
 #define READINFOTABLE_H
 #include "Util.h"
 #include "SeqReader.h"
 #include <map>
 
+#define RIT_EXT ".rit"
+#define RIT_LENGTH_BLOCK_SIZE 64
+#define RIT_NAME_BLOCK_SIZE 16
+
 enum ReadInfoOption
 {
     RIO_NONE,
@@ -33,13 +47,25 @@ class ReadInfoTable
 {
     public:
         //
-        ReadInfoTable() {}
+        ReadInfoTable();
 
         // Load the table using the read in filename
         // If num_expected > 0, reserve room in the table for num_expected reads
         ReadInfoTable(std::string filename, size_t num_expected = 0, ReadInfoOption options = RIO_NONE);
+
+        // Load the table for the reads in filename, which were indexed with indexPrefix.
+        // If indexPrefix.rit exists, is not older than the reads and holds num_expected
+        // reads (if num_expected > 0) it is memory-mapped, otherwise the reads are parsed.
+        ReadInfoTable(std::string filename, std::string indexPrefix, size_t num_expected = 0, ReadInfoOption options = RIO_NONE);
         ~ReadInfoTable();
 
+        // Add a read to the end of the table. This can only be used
+        // on tables constructed with the default constructor.
+        void addRead(const std::string& id, size_t length);
+
+        // Write the table to filename, in the format that can be mapped
+        void write(const std::string& filename);
+
         //
         const ReadInfo getReadInfo(size_t idx) const;
         std::string getReadID(size_t idx) const;
@@ -50,10 +76,56 @@ class ReadInfoTable
 
     private:
 
-        std::vector<int> m_lengths;
-        std::vector<std::string> m_ids;
+        // The lengths of a block of reads are stored as base + packed[i]
+        // where each value of packed uses bits bits
+        struct LengthBlock
+        {
+            uint32_t base;
+            uint32_t bits;
+            uint64_t wordOffset;
+        };
+
+        // Not allowed
+        ReadInfoTable(const ReadInfoTable&);
+        ReadInfoTable& operator=(const ReadInfoTable&);
 
+        //
+        void init(ReadInfoOption option);
+        void loadReads(const std::string& filename, size_t num_expected);
+        bool mapFile(const std::string& readsFilename, const std::string& filename, size_t num_expected);
+        void unmapFile();
+
+        // Pack the pending lengths into a new block
+        void flushLengths();
+
+        // Pack any partial block and point the table at the in-memory data
+        void finalize();
+
+        // Number of reads in the table
+        size_t m_count;
         bool m_numericIDs;
+        bool m_hasNames;
+        bool m_finalized;
+
+        // In-memory storage, used when the table is not mapped from disk
+        std::vector<LengthBlock> m_lengthBlocks;
+        std::vector<uint64_t> m_lengthWords;
+        std::vector<uint32_t> m_pendingLengths;
+        std::vector<uint64_t> m_nameBlockOffsets;
+        std::string m_namePool;
+        std::string m_prevName;
+
+        // Views of the table, either into the vectors above or the mapped file
+        const LengthBlock* m_pLengthBlocks;
+        const uint64_t* m_pLengthWords;
+        const uint64_t* m_pNameBlockOffsets;
+        const char* m_pNamePool;
+        size_t m_numNameBlocks;
+        size_t m_namePoolSize;
+
+        // The mapped file, if any
+        void* m_pMapped;
+        size_t m_mappedSize;
 };
 
 #endif
@@ -0,0 +1,134 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// ScratchMemory - Per-thread free lists for the small,
+// short-lived objects of the overlap search.
+//
+#include <stdlib.h>
+#include <pthread.h>
+#include <iostream>
+#include "ScratchMemory.h"
+
+// The size classes are the powers of two from 16 bytes to SCRATCH_MAX_POOLED_BYTES
+static const size_t MIN_CLASS_BYTES = 16;
+static const size_t NUM_CLASSES = 8;
+
+// The most blocks a thread keeps on the free list of one size class
+static const size_t MAX_FREE_PER_CLASS = 1024;
+
+struct FreeBlock
+{
+    FreeBlock* pNext;
+};
+
+struct ThreadFreeLists
+{
+    FreeBlock* pHead[NUM_CLASSES];
+    size_t numFree[NUM_CLASSES];
+};
+
+static pthread_key_t s_key;
+static pthread_once_t s_keyOnce = PTHREAD_ONCE_INIT;
+
+// Release the blocks cached by a thread when it exits
+static void destroyFreeLists(void* ptr)
+{
+    ThreadFreeLists* pLists = static_cast<ThreadFreeLists*>(ptr);
+    for(size_t c = 0; c < NUM_CLASSES; ++c)
+    {
+        FreeBlock* pBlock = pLists->pHead[c];
+        while(pBlock != NULL)
+        {
+            FreeBlock* pNext = pBlock->pNext;
+            ::operator delete(pBlock);
+            pBlock = pNext;
+        }
+    }
+    delete pLists;
+}
+
+static void createKey()
+{
+    int ret = pthread_key_create(&s_key, destroyFreeLists);
+    if(ret != 0)
+    {
+        std::cerr << "Thread key creation failed with error " << ret << ", aborting" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Return the free lists of the calling thread, creating them on first use
+static ThreadFreeLists* getFreeLists()
+{
+    pthread_once(&s_keyOnce, createKey);
+    ThreadFreeLists* pLists = static_cast<ThreadFreeLists*>(pthread_getspecific(s_key));
+    if(pLists == NULL)
+    {
+        pLists = new ThreadFreeLists;
+        for(size_t c = 0; c < NUM_CLASSES; ++c)
+        {
+            pLists->pHead[c] = NULL;
+            pLists->numFree[c] = 0;
+        }
+        pthread_setspecific(s_key, pLists);
+    }
+    return pLists;
+}
+
+// Return the size class for a request of bytes bytes
+static inline size_t getClass(size_t bytes)
+{
+    size_t c = 0;
+    size_t classBytes = MIN_CLASS_BYTES;
+    while(classBytes < bytes)
+    {
+        classBytes <<= 1;
+        ++c;
+    }
+    return c;
+}
+
+//
+void* ScratchMemory::allocate(size_t bytes)
+{
+    if(bytes > SCRATCH_MAX_POOLED_BYTES)
+        return ::operator new(bytes);
+
+    size_t c = getClass(bytes);
+    ThreadFreeLists* pLists = getFreeLists();
+    FreeBlock* pBlock = pLists->pHead[c];
+    if(pBlock == NULL)
+        return ::operator new(MIN_CLASS_BYTES << c);
+
+    pLists->pHead[c] = pBlock->pNext;
+    pLists->numFree[c] -= 1;
+    return pBlock;
+}
+
+//
+void ScratchMemory::deallocate(void* ptr, size_t bytes)
+{
+    if(ptr == NULL)
+        return;
+
+    if(bytes > SCRATCH_MAX_POOLED_BYTES)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    size_t c = getClass(bytes);
+    ThreadFreeLists* pLists = getFreeLists();
+    if(pLists->numFree[c] >= MAX_FREE_PER_CLASS)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    FreeBlock* pBlock = static_cast<FreeBlock*>(ptr);
+    pBlock->pNext = pLists->pHead[c];
+    pLists->pHead[c] = pBlock;
+    pLists->numFree[c] += 1;
+}
@@ -0,0 +1,90 @@
+//-----------------------------------------------
+// Copyright 2026 The SGA contributors
+// Released under the GPL
+//-----------------------------------------------
+//
+// ScratchMemory - Per-thread free lists for the small,
+// short-lived objects of the overlap search.
+//
+// Each thread keeps a free list for each size class of up to
+// SCRATCH_MAX_POOLED_BYTES. Freed blocks go onto the free list of the
+// thread that frees them and are handed out again to that thread, so once
+// a worker has searched a few reads its list nodes and history vectors
+// are recycled instead of coming from the global heap. The lists are
+// capped so a thread that only frees, like one writing out the results of
+// other threads, does not hold on to an unbounded amount of memory.
+// The blocks cached by a thread are released when it exits.
+//
+#ifndef SCRATCHMEMORY_H
+#define SCRATCHMEMORY_H
+
+#include <stddef.h>
+#include <limits>
+#include <new>
+
+// Larger requests go straight to operator new
+#define SCRATCH_MAX_POOLED_BYTES 2048
+
+namespace ScratchMemory
+{
+
+// Allocate a block of at least bytes bytes for the calling thread
+void* allocate(size_t bytes);
+
+// Free a block returned by allocate. bytes must be the size it was allocated with.
+void deallocate(void* ptr, size_t bytes);
+
+};
+
+// STL allocator drawing from the free lists of the calling thread
+template<class T>
+class ScratchAllocator
+{
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        template<class U>
+        struct rebind
+        {
+            typedef ScratchAllocator<U> other;
+        };
+
+        ScratchAllocator() {}
+        ScratchAllocator(const ScratchAllocator&) {}
+        template<class U> ScratchAllocator(const ScratchAllocator<U>&) {}
+
+        pointer address(reference x) const { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+
+        pointer allocate(size_type n, const void* /*hint*/ = 0)
+        {
+            if(n > max_size())
+                throw std::bad_alloc();
+            return static_cast<pointer>(ScratchMemory::allocate(n * sizeof(T)));
+        }
+
+        void deallocate(pointer p, size_type n)
+        {
+            ScratchMemory::deallocate(p, n * sizeof(T));
+        }
+
+        size_type max_size() const { return std::numeric_limits<size_type>::max() / sizeof(T); }
+
+        void construct(pointer p, const T& val) { new(static_cast<void*>(p)) T(val); }
+        void destroy(pointer p) { p->~T(); }
+};
+
+// A block can be freed by any thread so all ScratchAllocators are interchangeable
+template<class T, class U>
+inline bool operator==(const ScratchAllocator<T>&, const ScratchAllocator<U>&) { return true; }
+
+template<class T, class U>
+inline bool operator!=(const ScratchAllocator<T>&, const ScratchAllocator<U>&) { return false; }
+
+#endif
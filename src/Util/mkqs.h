@@ -12,6 +12,10 @@
 // Example code was downloaded from http://www.cs.princeton.edu/~rs/strings/demo.c
 // Modified by JTS to take in a comparator and use a generic type
 //
+// parallel_mkqs first buckets the strings by a short prefix using
+// a parallel counting pass and an in-place permutation, then sorts the
+// buckets with work-stealing threads (see MkqsThread.h).
+//
 
 #ifndef MKQS_H
 #define MKQS_H
@@ -20,7 +24,11 @@
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
-#include <queue>
+#include <stdint.h>
+#include <pthread.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
 #include "MkqsThread.h"
 
 #define mkqs_swap(a, b) { T tmp = x[a]; x[a] = x[b]; x[b] = tmp; }
@@ -86,9 +94,11 @@ inline void inssort(T* a, int n, int d, const PrimarySorter& primarySorter, cons
     }
 }
 
-// 
+
+// Sort a[0, n) starting at depth. The pivots are chosen with rand_r(pSeed)
+// so concurrent sorts do not contend on the lock inside rand().
 template<typename T, typename PrimarySorter, typename FinalSorter>
-void mkqs2(T* a, int n, int depth, const PrimarySorter& primarySorter, const FinalSorter& finalSorter)
+void mkqs2(T* a, int n, int depth, const PrimarySorter& primarySorter, const FinalSorter& finalSorter, unsigned int* pSeed)
 {   
     int r, partval;
     T *pa, *pb, *pc, *pd, *pm, *pn, t;
@@ -102,7 +112,7 @@ void mkqs2(T* a, int n, int depth, const PrimarySorter& primarySorter, const Fin
     pm = a + (n/2);
     pn = a + (n-1);
 
-    int mid_idx = rand() % n;
+    int mid_idx = rand_r(pSeed) % n;
 
     pm = &a[mid_idx];
     mkqs_swap2(a, pm);
@@ -130,140 +140,302 @@ void mkqs2(T* a, int n, int depth, const PrimarySorter& primarySorter, const Fin
     r = std::min(pa-a, pb-pa);    vecswap2(a,  pb-r, r);
     r = std::min(pd-pc, pn-pd-1); vecswap2(pb, pn-r, r);
     if ((r = pb-pa) > 1)
-        mkqs2(a, r, depth, primarySorter, finalSorter);
+        mkqs2(a, r, depth, primarySorter, finalSorter, pSeed);
     if (ptr2char(a + r) != 0)
-        mkqs2(a + r, pa-a + pn-pd-1, depth+1, primarySorter, finalSorter);
+        mkqs2(a + r, pa-a + pn-pd-1, depth+1, primarySorter, finalSorter, pSeed);
     else
     {
         int n2 = pa - a + pn - pd - 1;
         std::sort(a + r, a + r + n2, finalSorter);
     }
     if ((r = pd-pc) > 1)
-        mkqs2(a + n-r, r, depth, primarySorter, finalSorter);
+        mkqs2(a + n-r, r, depth, primarySorter, finalSorter, pSeed);
 }
 
-// Parallel multikey quicksort. It performs mkqs but will
-// subdivide the array to sort into sub jobs which can be sorted using threads.
+// 
 template<typename T, typename PrimarySorter, typename FinalSorter>
-void parallel_mkqs(T* pData, int n, int numThreads, const PrimarySorter& primarySorter, const FinalSorter& finalSorter)
+void mkqs2(T* a, int n, int depth, const PrimarySorter& primarySorter, const FinalSorter& finalSorter)
 {
-    typedef MkqsJob<T> Job;
-    typedef std::queue<Job> JobQueue;
-    Job initialJob(pData, n, 0);
-    JobQueue queue;
-    queue.push(initialJob);
-    
-    // Create the mutex that guards the queue
-    pthread_mutex_t queue_mutex;
-    int ret = pthread_mutex_init(&queue_mutex, NULL);
-    if(ret != 0)
+    unsigned int seed = rand();
+    mkqs2(a, n, depth, primarySorter, finalSorter, &seed);
+}
+
+// Arrays smaller than this are sorted serially by parallel_mkqs
+#define MKQS_PARALLEL_MIN_SIZE 65536
+
+// parallel_mkqs splits the work into roughly this many jobs per thread
+// before it switches to the serial sort
+#define MKQS_JOBS_PER_THREAD 64
+#define MKQS_MIN_JOB_SIZE 1024
+
+// The radix front-end of parallel_mkqs buckets the strings by their first
+// few characters. The number of characters is chosen so that there are at
+// most MKQS_RADIX_MAX_BUCKETS buckets, keeping the per-thread counts in cache.
+#define MKQS_RADIX_MAX_DEPTH 6
+#define MKQS_RADIX_MAX_BUCKETS 4096
+
+// A slice of the array processed by one thread of the radix front-end.
+// The first pass records which symbols occur in the first MKQS_RADIX_MAX_DEPTH
+// positions of the strings, the second pass calculates the bucket of each
+// string and counts the size of each bucket.
+template<typename T, typename PrimarySorter>
+struct MkqsRadixSlice
+{
+    T* pData;
+    int begin;
+    int end;
+    const PrimarySorter* pPrimary;
+
+    // First pass
+    bool symbolSeen[256];
+
+    // Second pass
+    const int* pSymbolCode;
+    int numSymbols;
+    int radixDepth;
+    uint16_t* pKeys;
+    std::vector<int> counts;
+};
+
+//
+template<typename T, typename PrimarySorter>
+void* mkqs_radix_alphabet_thread(void* obj)
+{
+    MkqsRadixSlice<T, PrimarySorter>* pSlice = reinterpret_cast<MkqsRadixSlice<T, PrimarySorter>*>(obj);
+    const PrimarySorter& primarySorter = *pSlice->pPrimary;
+    memset(pSlice->symbolSeen, 0, sizeof(pSlice->symbolSeen));
+    for(int i = pSlice->begin; i < pSlice->end; ++i)
     {
-        std::cerr << "Mutex initialization failed with error " << ret << ", aborting" << std::endl;
-        exit(EXIT_FAILURE);
+        for(int d = 0; d < MKQS_RADIX_MAX_DEPTH; ++d)
+        {
+            char c = elem2char(pSlice->pData[i], d);
+            pSlice->symbolSeen[(unsigned char)c] = true;
+            if(c == 0)
+                break;
+        }
     }
+    return NULL;
+}
 
-    // Calculate the threshold size for performing serial continuation of the sort. Once the chunks 
-    // are below this size, it is better to not subdivide the problem into smaller chunks
-    // to avoid the overhead of locking, adding to the queue, etc. 
-    int threshold_size = n / numThreads;
-
-    // Create the semaphore used to signal that data is ready to be processed
-    // Initial value is 1 as there is one item on the queue to start
-    sem_t queue_sem;
-    ret = sem_init( &queue_sem, PTHREAD_PROCESS_PRIVATE, 1 );
-    if(ret != 0)
+//
+template<typename T, typename PrimarySorter>
+void* mkqs_radix_count_thread(void* obj)
+{
+    MkqsRadixSlice<T, PrimarySorter>* pSlice = reinterpret_cast<MkqsRadixSlice<T, PrimarySorter>*>(obj);
+    const PrimarySorter& primarySorter = *pSlice->pPrimary;
+    for(int i = pSlice->begin; i < pSlice->end; ++i)
     {
-        std::cerr << "Semaphore initialization failed with error " << ret << "\n";
-        std::cerr << "You are probably running on OSX which does not provide unnamed semaphores\n";
-        exit(EXIT_FAILURE);
+        // The positions after the end of the string are given code 0,
+        // all the strings of a bucket end at the same position
+        int key = 0;
+        bool ended = false;
+        for(int d = 0; d < pSlice->radixDepth; ++d)
+        {
+            int code = 0;
+            if(!ended)
+            {
+                char c = elem2char(pSlice->pData[i], d);
+                code = pSlice->pSymbolCode[(unsigned char)c];
+                ended = c == 0;
+            }
+            key = key * pSlice->numSymbols + code;
+        }
+        pSlice->pKeys[i] = key;
+        pSlice->counts[key] += 1;
     }
+    return NULL;
+}
 
-    // Create the semaphore indicating a thread is finished working.
-    // This semaphore is incremented by the threads in their run loop
-    // before waiting for queue items. If the thread takes an item,
-    // this semaphore is decremented. The main thread checks
-    // this semaphore after confirming the queue is empty. If this 
-    // semaphore value equals the total number of threads, 
-    // no more work can remain the the threads are cleaned up
-    sem_t done_sem;
-    ret = sem_init( &done_sem, PTHREAD_PROCESS_PRIVATE, 0 );
-    if(ret != 0)
+// Run fn on each slice in its own thread
+template<typename T, typename PrimarySorter>
+void mkqs_run_radix_threads(std::vector<MkqsRadixSlice<T, PrimarySorter> >& slices, void* (*fn)(void*))
+{
+    std::vector<pthread_t> threads(slices.size());
+    for(size_t i = 0; i < slices.size(); ++i)
     {
-        std::cerr << "Semaphore initialization failed with error " << ret << "\n";
-        std::cerr << "You are probably running on OSX which does not provide unnamed semaphores\n";
-        exit(EXIT_FAILURE);
+        int ret = pthread_create(&threads[i], 0, fn, &slices[i]);
+        if(ret != 0)
+        {
+            std::cerr << "Thread creation failed with error " << ret << ", aborting" << std::endl;
+            exit(EXIT_FAILURE);
+        }
     }
 
-    // Create and start the threads
-    MkqsThread<T, PrimarySorter, FinalSorter>* threads[numThreads];
+    for(size_t i = 0; i < slices.size(); ++i)
+    {
+        int ret = pthread_join(threads[i], NULL);
+        if(ret != 0)
+        {
+            std::cerr << "Thread join failed with error " << ret << ", aborting" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Partition pData[0, n) into buckets by the first few characters of each string
+// using numThreads threads. A sort job is added to outJobs for each bucket that
+// needs further sorting, starting at the first character that is not yet sorted.
+template<typename T, typename PrimarySorter>
+void mkqs_radix_partition(T* pData, int n, int numThreads, const PrimarySorter& primarySorter, std::vector<MkqsJob<T> >& outJobs)
+{
+    typedef MkqsRadixSlice<T, PrimarySorter> Slice;
+    std::vector<Slice> slices(numThreads);
     for(int i = 0; i < numThreads; ++i)
     {
-        threads[i] = new MkqsThread<T, PrimarySorter, FinalSorter>(i, &queue, &queue_mutex, &queue_sem, &done_sem, threshold_size, &primarySorter, &finalSorter);   
-        threads[i]->start();
+        slices[i].pData = pData;
+        slices[i].begin = (int64_t)n * i / numThreads;
+        slices[i].end = (int64_t)n * (i + 1) / numThreads;
+        slices[i].pPrimary = &primarySorter;
     }
 
-    // Check for the end condition
-    bool done = false;
-    while(!done)
+    // Find the alphabet and give each symbol a code in the order used by the sort
+    mkqs_run_radix_threads(slices, &mkqs_radix_alphabet_thread<T, PrimarySorter>);
+
+    int symbolCode[256];
+    int numSymbols = 0;
+    for(int c = -128; c < 128; ++c)
     {
-        sleep(1);
+        bool seen = false;
+        for(int i = 0; i < numThreads; ++i)
+            seen = seen || slices[i].symbolSeen[(unsigned char)c];
+        symbolCode[(unsigned char)c] = seen ? numSymbols++ : 0;
+    }
 
-        // Check if the queue is empty
-        // If it is and all threads are finished working (all have posted to
-        // the done semaphore), then the threads can be cleaned up.
-        pthread_mutex_lock(&queue_mutex);
-        if(queue.empty())
-        {
-            int semval;
-            sem_getvalue(&done_sem, &semval);
-            if(semval == numThreads)
-                done = true;
-        }
-        pthread_mutex_unlock(&queue_mutex);
+    // Use as many characters as fit in the bucket limit
+    int radixDepth = 1;
+    int numBuckets = numSymbols;
+    while(radixDepth < MKQS_RADIX_MAX_DEPTH && numBuckets * numSymbols <= MKQS_RADIX_MAX_BUCKETS)
+    {
+        radixDepth += 1;
+        numBuckets *= numSymbols;
     }
 
-    // Signal all the threads to stop, then post to the semaphore they are waiting on
-    // All threads will pick up the stop request after the posts and call pthread exit
+    // Calculate the bucket of each string
+    std::vector<uint16_t> keys(n);
     for(int i = 0; i < numThreads; ++i)
     {
-        threads[i]->stop();
+        slices[i].pSymbolCode = symbolCode;
+        slices[i].numSymbols = numSymbols;
+        slices[i].radixDepth = radixDepth;
+        slices[i].pKeys = &keys[0];
+        slices[i].counts.resize(numBuckets, 0);
     }
+    mkqs_run_radix_threads(slices, &mkqs_radix_count_thread<T, PrimarySorter>);
 
-    for(int i = 0; i < numThreads; ++i)
+    std::vector<int> bucketStart(numBuckets + 1, 0);
+    for(int b = 0; b < numBuckets; ++b)
+    {
+        int count = 0;
+        for(int i = 0; i < numThreads; ++i)
+            count += slices[i].counts[b];
+        bucketStart[b + 1] = bucketStart[b] + count;
+    }
+
+    // Move the strings into their buckets in place by following the
+    // cycles of the permutation, each string is moved at most once
+    std::vector<int> next(bucketStart.begin(), bucketStart.end() - 1);
+    for(int b = 0; b < numBuckets; ++b)
     {
-        sem_post(&queue_sem);
+        while(next[b] < bucketStart[b + 1])
+        {
+            int i = next[b];
+            int key = keys[i];
+            while(key != b)
+            {
+                int j = next[key]++;
+                std::swap(pData[i], pData[j]);
+                std::swap(keys[i], keys[j]);
+                key = keys[i];
+            }
+            next[b] += 1;
+        }
     }
 
-    // Join and destroy the threads
+    // Create the jobs. The strings of a bucket that ends before radixDepth
+    // are equal up to the end of the string, sorting them from the position
+    // of the end leaves only the final sort to be done.
+    bool endSeen = false;
     for(int i = 0; i < numThreads; ++i)
+        endSeen = endSeen || slices[i].symbolSeen[0];
+
+    for(int b = 0; b < numBuckets; ++b)
     {
-        threads[i]->join();
-        delete threads[i];
+        int size = bucketStart[b + 1] - bucketStart[b];
+        if(size < 2)
+            continue;
+
+        int depth = radixDepth;
+        if(endSeen)
+        {
+            // Find the first character of the key that is the end of the string
+            int divisor = numBuckets;
+            for(int d = 0; d < radixDepth; ++d)
+            {
+                divisor /= numSymbols;
+                if((b / divisor) % numSymbols == symbolCode[0])
+                {
+                    depth = d;
+                    break;
+                }
+            }
+        }
+        outJobs.push_back(MkqsJob<T>(pData + bucketStart[b], size, depth));
     }
+}
 
-    // Destroy the semaphore
-    sem_destroy(&queue_sem);
-    sem_destroy(&done_sem);
+// Parallel multikey quicksort. The array is first split into buckets by the
+// first few characters of each string, then the buckets are sorted by mkqs
+// using threads that each keep a deque of sort jobs and steal jobs from the
+// other threads when their own deque is empty.
+template<typename T, typename PrimarySorter, typename FinalSorter>
+void parallel_mkqs(T* pData, int n, int numThreads, const PrimarySorter& primarySorter, const FinalSorter& finalSorter)
+{
+    typedef MkqsThread<T, PrimarySorter, FinalSorter> Thread;
 
-    // Destroy the queue mutex
-    ret = pthread_mutex_destroy(&queue_mutex);
-    if(ret != 0)
+    if(numThreads <= 1 || n < MKQS_PARALLEL_MIN_SIZE)
     {
-        std::cerr << "Mutex destruction failed with error " << ret << ", aborting" << std::endl;
-        exit(EXIT_FAILURE);
+        mkqs2(pData, n, 0, primarySorter, finalSorter);
+        return;
+    }
+
+    std::vector<MkqsJob<T> > initialJobs;
+    mkqs_radix_partition(pData, n, numThreads, primarySorter, initialJobs);
+
+    // Calculate the threshold size for performing serial continuation of the sort. Once the chunks 
+    // are below this size, it is better to not subdivide the problem into smaller chunks
+    // to avoid the overhead of locking and adding to the deques. The jobs are kept
+    // small enough that a thread that finishes early can steal work.
+    int threshold_size = std::max(MKQS_MIN_JOB_SIZE, n / (numThreads * MKQS_JOBS_PER_THREAD));
+    MkqsSharedState<T> state(numThreads, threshold_size);
+
+    // Create the threads and deal the buckets out to them
+    std::vector<Thread*> threads(numThreads);
+    for(int i = 0; i < numThreads; ++i)
+        threads[i] = new Thread(i, &state, &primarySorter, &finalSorter);
+
+    for(size_t i = 0; i < initialJobs.size(); ++i)
+        threads[i % numThreads]->addJob(initialJobs[i]);
+
+    // The threads exit once all jobs are finished
+    for(int i = 0; i < numThreads; ++i)
+        threads[i]->start();
+
+    for(int i = 0; i < numThreads; ++i)
+    {
+        threads[i]->join();
+        delete threads[i];
     }
 }
 
 //
 // Perform a partial sort of the data using the mkqs algorithm
-// Iterative sort jobs are created and added to pQueue which is
-// protected by pQueueMutex. After addition, pQueueSem is updated.
+// The jobs for the partitions that still need sorting are added
+// to the deque of the thread pSink.
 //
-template<typename T, class PrimarySorter, class FinalSorter>
+template<typename T, class JobSink, class PrimarySorter, class FinalSorter>
 void parallel_mkqs_process(MkqsJob<T>& job, 
-                           std::queue<MkqsJob<T> >* pQueue, 
-                           pthread_mutex_t* pQueueMutex, 
-                           sem_t* pQueueSem,
+                           JobSink* pSink,
+                           unsigned int* pSeed,
                            const PrimarySorter& primarySorter, 
                            const FinalSorter& finalSorter)
 {
@@ -283,7 +455,7 @@ void parallel_mkqs_process(MkqsJob<T>& job,
     pm = a + (n/2);
     pn = a + (n-1);
 
-    int mid_idx = rand() % n;
+    int mid_idx = rand_r(pSeed) % n;
 
     pm = &a[mid_idx];
     mkqs_swap2(a, pm);
@@ -311,22 +483,18 @@ void parallel_mkqs_process(MkqsJob<T>& job,
     r = std::min(pa-a, pb-pa);    vecswap2(a,  pb-r, r);
     r = std::min(pd-pc, pn-pd-1); vecswap2(pb, pn-r, r);
 
-    // Lock the queue and push new items if necessary
-    // If new items are added to the queue, the semaphore is posted to
-    pthread_mutex_lock(pQueueMutex);
-
+    // Push the new jobs. The middle partition is pushed last so
+    // this thread continues with it while the others can be stolen.
     if ((r = pb-pa) > 1)
-    {
-        MkqsJob<T> job(a, r, depth);
-        pQueue->push(job);
-        sem_post(pQueueSem);
-    }
-    
+        pSink->addJob(MkqsJob<T>(a, r, depth));
+
+    int r2 = pd-pc;
+    if (r2 > 1)
+        pSink->addJob(MkqsJob<T>(a + n-r2, r2, depth));
+
     if (ptr2char(a + r) != 0)
     {
-        MkqsJob<T> job(a + r, pa-a + pn-pd-1, depth + 1);
-        pQueue->push(job);
-        sem_post(pQueueSem);
+        pSink->addJob(MkqsJob<T>(a + r, pa-a + pn-pd-1, depth + 1));
     }
     else
     {
@@ -334,16 +502,5 @@ void parallel_mkqs_process(MkqsJob<T>& job,
         int n2 = pa - a + pn - pd - 1;
         std::sort(a + r, a + r + n2, finalSorter);
     }
-
-    if ((r = pd-pc) > 1)
-    {
-        MkqsJob<T> job(a + n-r, r, depth);
-        pQueue->push(job);
-        sem_post(pQueueSem);
-    }
-
-    // Unlock the mutex
-    pthread_mutex_unlock(pQueueMutex);
 }
 #endif
-